@@ -4,17 +4,21 @@
 #include "onyx/serialization/color.hpp"
 #include "tkit/reflection/driz/simulation/settings.hpp"
 #include "tkit/reflection/driz/simulation/kernel.hpp"
+#include "tkit/reflection/driz/simulation/scene.hpp"
 #include "tkit/serialization/yaml/container.hpp"
 #include "tkit/serialization/yaml/tensor.hpp"
 #include "tkit/serialization/yaml/driz/simulation/settings.hpp"
+#include "tkit/serialization/yaml/driz/simulation/material.hpp"
+#include "tkit/serialization/yaml/driz/simulation/flow.hpp"
+#include "tkit/serialization/yaml/driz/simulation/scene.hpp"
 
 #include <argparse/argparse.hpp>
 
 namespace Driz
 {
-static std::string cliName(const char *p_Name)
+static std::string cliName(const char *p_Name, const char *p_Prefix = "--")
 {
-    std::string result{"--"};
+    std::string result{p_Prefix};
     for (const char *c = p_Name; *c != '\0'; ++c)
     {
         if (std::isupper(*c) && c != p_Name && !std::isupper(c[-1]))
@@ -26,6 +30,52 @@ static std::string cliName(const char *p_Name)
     return result;
 }
 
+template <typename T>
+static void addCommandLineFields(argparse::ArgumentParser &p_Parser, const char *p_Prefix, const char *p_TypeName)
+{
+    TKit::Reflect<T>::ForEachCommandLineMemberField([&p_Parser, p_Prefix, p_TypeName](const auto &p_Field) {
+        using Type = TKIT_REFLECT_FIELD_TYPE(p_Field);
+
+        argparse::Argument &arg = p_Parser.add_argument(cliName(p_Field.Name, p_Prefix));
+        if constexpr (std::is_same_v<Type, f32>)
+            arg.scan<'f', f32>();
+        else if constexpr (std::is_same_v<Type, u32>)
+            arg.scan<'u', u32>();
+
+        if constexpr (std::is_enum_v<Type>)
+            arg.help(TKit::Format("'{}' enum field of type '{}'. You may specify it with a string.", p_TypeName,
+                                  p_Field.TypeString));
+        else
+            arg.help(TKit::Format("'{}' field of type '{}'.", p_TypeName, p_Field.TypeString));
+    });
+}
+
+template <typename T>
+static bool setCommandLineFields(const argparse::ArgumentParser &p_Parser, const char *p_Prefix, T &p_Instance)
+{
+    bool any = false;
+    TKit::Reflect<T>::ForEachCommandLineMemberField([&p_Parser, &p_Instance, &any, p_Prefix](const auto &p_Field) {
+        using Type = TKIT_REFLECT_FIELD_TYPE(p_Field);
+        if constexpr (std::is_enum_v<Type>)
+        {
+            if (const auto value = p_Parser.present(cliName(p_Field.Name, p_Prefix)))
+            {
+                p_Field.Set(p_Instance, TKit::Reflect<Type>::FromString(*value));
+                any = true;
+            }
+        }
+        else
+        {
+            if (const auto value = p_Parser.present<Type>(cliName(p_Field.Name, p_Prefix)))
+            {
+                p_Field.Set(p_Instance, *value);
+                any = true;
+            }
+        }
+    });
+    return any;
+}
+
 ParseResult ParseArgs(int argc, char **argv)
 {
     argparse::ArgumentParser parser{"drizzle", DRIZ_VERSION, argparse::default_arguments::all};
@@ -42,42 +92,182 @@ ParseResult ParseArgs(int argc, char **argv)
         "A path pointing to a .yaml file with the simulation state. The file must be compliant with the program's "
         "structure to work. Trying to load a 2D state in a 3D simulation and vice versa will result in an error.");
     parser.add_argument("--no-intro").flag().help("Skip the intro layer and start the simulation directly.");
+    parser.add_argument("--huge-pages")
+        .flag()
+        .help("Back large scratch buffers and per particle arrays with huge pages where the platform supports it. "
+              "This may speed up very large simulations.");
+    parser.add_argument("--autotune")
+        .flag()
+        .help("Pick the fastest worker partition count for the current machine and particle count by running short "
+              "trial steps. Decisions are cached per machine, so the trials only run once per configuration.");
+    parser.add_argument("--autotune-threshold")
+        .scan<'f', f32>()
+        .default_value(0.25f)
+        .help("The relative particle count change that triggers a new autotune, as a fraction.");
+    parser.add_argument("--telemetry")
+        .help("A path where per step timings and throughput will be exported when the simulation ends. The format is "
+              "chosen from the extension, which can be either .csv or .json.");
+    parser.add_argument("--publish").help(
+        "A POSIX shared memory name, such as '/drizzle', where the positions, velocities and densities of every step "
+        "will be published for other processes to read. The solver never waits on readers.");
+    parser.add_argument("--publish-slots")
+        .scan<'u', u32>()
+        .default_value(4u)
+        .help("The amount of steps the shared memory ring holds at once. More slots give slow readers more time to "
+              "copy a step before it is overwritten.");
     parser.add_argument("-s", "--seconds", "--run-time")
         .scan<'f', f32>()
         .help("The amount of time the simulation will run for in seconds. If not "
               "specified, the simulation will run indefinitely.");
 
+    parser.add_argument("--headless")
+        .flag()
+        .help("Run the simulation without a window or a GPU for a fixed amount of steps. Frames may still be written "
+              "to disk with a software renderer by specifying '--frames'. A dimension must be specified.");
+    parser.add_argument("--steps")
+        .scan<'u', u32>()
+        .default_value(600u)
+        .help("The amount of steps a headless simulation will run for.");
+    parser.add_argument("--timestep")
+        .scan<'f', f32>()
+        .default_value(1.f / 60.f)
+        .help("The fixed timestep of a headless simulation, in seconds.");
+    parser.add_argument("--frames").help(
+        "A directory where a headless simulation will write its frames, named after their index. Frames are only "
+        "written when this is specified.");
+    parser.add_argument("--frame-every")
+        .scan<'u', u32>()
+        .default_value(1u)
+        .help("Write a headless frame every this many steps.");
+    parser.add_argument("--frame-format")
+        .default_value(std::string{"png"})
+        .choices("png", "ppm")
+        .help("The image format of headless frames. PNG files are uncompressed, and PPM files are raw RGB dumps.");
+    parser.add_argument("--frame-width").scan<'u', u32>().default_value(1280u).help("The width of headless frames.");
+    parser.add_argument("--frame-height").scan<'u', u32>().default_value(720u).help("The height of headless frames.");
+    parser.add_argument("--ranks")
+        .scan<'u', u32>()
+        .help("Split a headless simulation along the x axis across this many processes on the same host. Each one "
+              "steps its own slab of the box and exchanges boundary particles with its neighbors over local sockets. "
+              "Frames cannot be written in this mode.");
+    parser.add_argument("--rebalance-every")
+        .scan<'u', u32>()
+        .default_value(20u)
+        .help("Move the slab boundaries of a distributed run every this many steps, so that every process takes about "
+              "as long to step. Zero disables rebalancing.");
+    parser.add_argument("--sweep")
+        .nargs(argparse::nargs_pattern::at_least_one)
+        .help("Run a headless ensemble over every combination of the given 'Field=value,value,...' sweeps, where "
+              "fields are simulation settings available from the command line. Instances run concurrently, one per "
+              "thread, and their throughput and final kinetic energy and density error are gathered in one table.");
+    parser.add_argument("--sweep-results")
+        .help("A path where the ensemble results table will be written. The format is chosen from the extension, "
+              "which can be either .csv or .json. The table is printed if not specified.");
+    parser.add_argument("--sweep-workers")
+        .scan<'u', u32>()
+        .default_value(0u)
+        .help("The amount of ensemble instances running at once. Defaults to the maximum thread count.");
+    parser.add_argument("--ipc-dir").help(
+        "The directory where the processes of a distributed run place their sockets. A temporary directory is used "
+        "if not specified.");
+
+    parser.add_argument("--serve").help(
+        "Run as a long lived simulation service listening on a Unix domain socket at the given path, instead of "
+        "running a single simulation. Clients submit jobs, follow their progress and stream their frames through "
+        "plain text commands. Every other option is ignored.");
+
     auto &group = parser.add_mutually_exclusive_group();
     group.add_argument("--2-dim").flag().help("Run the simulation in 2D mode.");
     group.add_argument("--3-dim").flag().help("Run the simulation in 3D mode.");
 
-    TKit::Reflect<SimulationSettings>::ForEachCommandLineMemberField([&parser](const auto &p_Field) {
-        using Type = TKIT_REFLECT_FIELD_TYPE(p_Field);
+    parser.add_argument("--scene").help(
+        "A path pointing to a .yaml file with scene generation settings. When a scene is requested (either with this "
+        "file or with any of the '--scene-*' fields), the starting state is generated from it instead of loaded. "
+        "Large scenes are generated in parallel and start almost immediately.");
 
-        argparse::Argument &arg = parser.add_argument(cliName(p_Field.Name));
-        if constexpr (std::is_same_v<Type, f32>)
-            arg.scan<'f', f32>();
-        else if constexpr (std::is_same_v<Type, u32>)
-            arg.scan<'u', u32>();
-
-        if constexpr (std::is_enum_v<Type>)
-            arg.help(TKit::Format("'SimulationSettings' enum field of type '{}'. You may specify it with a string.",
-                                  p_Field.TypeString));
-        else
-            arg.help(TKit::Format("'SimulationSettings' field of type '{}'.", p_Field.TypeString));
-    });
+    addCommandLineFields<SimulationSettings>(parser, "--", "SimulationSettings");
+    addCommandLineFields<SceneSettings>(parser, "--scene-", "SceneSettings");
 
     parser.parse_args(argc, argv);
     ParseResult result{};
 
     SimulationSettings settings{};
     result.Intro = !parser.get<bool>("--no-intro");
+    result.HugePages = parser.get<bool>("--huge-pages");
+    result.Autotune = parser.get<bool>("--autotune");
+    result.AutotuneThreshold = parser.get<f32>("--autotune-threshold");
+    if (const auto path = parser.present("--serve"))
+    {
+        ServiceSpecs specs{};
+        specs.SocketPath = *path;
+        result.Service = specs;
+        result.Intro = false;
+        return result;
+    }
     const bool noDim = !parser.get<bool>("--2-dim") && !parser.get<bool>("--3-dim");
     if (!result.Intro && noDim)
     {
         std::cerr << "A dimension must be specified when skipping the intro layer.\n";
         std::exit(EXIT_FAILURE);
     }
+    if (parser.get<bool>("--headless"))
+    {
+        if (noDim)
+        {
+            std::cerr << "A dimension must be specified when running headless.\n";
+            std::exit(EXIT_FAILURE);
+        }
+        HeadlessSpecs specs{};
+        specs.Steps = parser.get<u32>("--steps");
+        specs.Timestep = parser.get<f32>("--timestep");
+        if (const auto path = parser.present("--frames"))
+            specs.FramesPath = *path;
+        specs.FrameEvery = parser.get<u32>("--frame-every");
+        specs.Format = parser.get<std::string>("--frame-format") == "ppm" ? ImageFormat::PPM : ImageFormat::PNG;
+        specs.Raster.Width = parser.get<u32>("--frame-width");
+        specs.Raster.Height = parser.get<u32>("--frame-height");
+        result.Headless = specs;
+        result.Intro = false;
+    }
+    if (const auto sweeps = parser.present<std::vector<std::string>>("--sweep"))
+    {
+        if (!result.Headless || !result.Headless->FramesPath.empty() || parser.present("--ranks"))
+        {
+            std::cerr << "Ensembles must be headless, and cannot write frames or be distributed.\n";
+            std::exit(EXIT_FAILURE);
+        }
+        EnsembleSpecs specs{};
+        for (const std::string &sweep : *sweeps)
+        {
+            SweepAxis axis{};
+            if (!ParseSweepAxis(sweep, axis))
+                std::exit(EXIT_FAILURE);
+            specs.Axes.Append(axis);
+        }
+        if (const auto path = parser.present("--sweep-results"))
+            specs.ResultsPath = *path;
+        specs.Workers = parser.get<u32>("--sweep-workers");
+        result.Ensemble = specs;
+    }
+    if (const auto ranks = parser.present<u32>("--ranks"))
+    {
+        if (!result.Headless || !result.Headless->FramesPath.empty())
+        {
+            std::cerr << "Distributed runs must be headless, and cannot write frames.\n";
+            std::exit(EXIT_FAILURE);
+        }
+        if (*ranks == 0)
+        {
+            std::cerr << "At least one rank is needed.\n";
+            std::exit(EXIT_FAILURE);
+        }
+        DistributedSpecs specs{};
+        specs.Ranks = *ranks;
+        specs.RebalanceEvery = parser.get<u32>("--rebalance-every");
+        if (const auto path = parser.present("--ipc-dir"))
+            specs.Directory = *path;
+        result.Distributed = specs;
+    }
 
     const bool is2D = parser.get<bool>("--2-dim") || !parser.get<bool>("--3-dim");
     result.Dim = is2D ? D2 : D3;
@@ -98,6 +288,12 @@ ParseResult ParseArgs(int argc, char **argv)
         result.State3.emplace();
     }
 
+    if (const auto path = parser.present("--telemetry"))
+        result.TelemetryPath = *path;
+    if (const auto name = parser.present("--publish"))
+        result.PublishName = name->starts_with('/') ? *name : "/" + *name;
+    result.PublishSlots = parser.get<u32>("--publish-slots");
+
     if (const auto runTime = parser.present<f32>("--run-time"))
     {
         result.RunTime = *runTime;
@@ -106,19 +302,19 @@ ParseResult ParseArgs(int argc, char **argv)
     else
         result.HasRunTime = false;
 
-    TKit::Reflect<SimulationSettings>::ForEachCommandLineMemberField([&parser, &settings](const auto &p_Field) {
-        using Type = TKIT_REFLECT_FIELD_TYPE(p_Field);
-        if constexpr (std::is_enum_v<Type>)
-        {
-            if (const auto value = parser.present(cliName(p_Field.Name)))
-                p_Field.Set(settings, TKit::Reflect<Type>::FromString(*value));
-        }
-        else
-        {
-            if (const auto value = parser.present<Type>(cliName(p_Field.Name)))
-                p_Field.Set(settings, *value);
-        }
-    });
+    setCommandLineFields(parser, "--", settings);
+    settings.Partitions = Math::Clamp(settings.Partitions, 1u, static_cast<u32>(DRIZ_MAX_THREADS));
+
+    SceneSettings scene{};
+    bool hasScene = false;
+    if (const auto path = parser.present("--scene"))
+    {
+        scene = TKit::Yaml::Deserialize<SceneSettings>(*path);
+        hasScene = true;
+    }
+    hasScene |= setCommandLineFields(parser, "--scene-", scene);
+    if (hasScene)
+        result.Scene = scene;
 
     result.Settings = settings;
     return result;
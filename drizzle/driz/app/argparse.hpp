@@ -1,6 +1,11 @@
 #pragma once
 
 #include "driz/simulation/settings.hpp"
+#include "driz/simulation/scene.hpp"
+#include "driz/headless/batch.hpp"
+#include "driz/headless/ensemble.hpp"
+#include "driz/distributed/domain.hpp"
+#include "driz/service/service.hpp"
 #include <optional>
 
 namespace Driz
@@ -10,11 +15,22 @@ struct ParseResult
     SimulationSettings Settings;
     std::optional<SimulationState<D2>> State2;
     std::optional<SimulationState<D3>> State3;
+    std::optional<SceneSettings> Scene;
+    std::optional<HeadlessSpecs> Headless;
+    std::optional<DistributedSpecs> Distributed;
+    std::optional<EnsembleSpecs> Ensemble;
+    std::optional<ServiceSpecs> Service;
+    fs::path TelemetryPath;
+    std::string PublishName;
+    u32 PublishSlots;
+    f32 AutotuneThreshold;
 
     Dimension Dim;
     f32 RunTime;
     bool Intro;
     bool HasRunTime;
+    bool HugePages;
+    bool Autotune;
 };
 
 ParseResult ParseArgs(int argc, char **argv);
@@ -1,6 +1,7 @@
 #include "driz/app/intro_layer.hpp"
 #include "driz/app/sim_layer.hpp"
 #include "driz/app/visualization.hpp"
+#include "driz/simulation/scene.hpp"
 #include "tkit/serialization/yaml/tensor.hpp"
 #include <imgui.h>
 
@@ -202,30 +203,7 @@ void IntroLayer::renderIntroSettings()
 template <Dimension D> void IntroLayer::updateStateAsLattice(SimulationState<D> &p_State, const u32v<D> &p_Dimensions)
 {
     m_NeedsRedraw = true;
-    p_State.Positions.Clear();
-    p_State.Velocities.Clear();
-    const f32 separation = 0.4f * m_Settings.SmoothingRadius;
-    const f32v<D> midPoint = 0.5f * separation * f32v<D>{p_Dimensions - 1u};
-    for (u32 i = 0; i < p_Dimensions[0]; ++i)
-    {
-        const f32 x = static_cast<f32>(i) * separation;
-        for (u32 j = 0; j < p_Dimensions[1]; ++j)
-        {
-            const f32 y = static_cast<f32>(j) * separation;
-            if constexpr (D == D2)
-            {
-                p_State.Positions.Append(f32v2{x, y} - midPoint);
-                p_State.Velocities.Append(f32v2{0.f});
-            }
-            else
-                for (u32 k = 0; k < p_Dimensions[2]; ++k)
-                {
-                    const f32 z = static_cast<f32>(k) * separation;
-                    p_State.Positions.Append(f32v3{x, y, z} - midPoint);
-                    p_State.Velocities.Append(f32v3{0.f});
-                }
-        }
-    }
+    Scene<D>::Lattice(p_State, p_Dimensions, 0.4f * m_Settings.SmoothingRadius, DRIZ_MAX_THREADS);
 }
 
 template <Dimension D> void IntroLayer::renderBoundingBox(SimulationState<D> &p_State)
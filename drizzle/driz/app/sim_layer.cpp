@@ -23,6 +23,15 @@ SimLayer<D>::SimLayer(Onyx::Application *p_Application, const SimulationSettings
     m_Context = m_Window->CreateRenderContext<D>();
 }
 
+template <Dimension D> SimLayer<D>::~SimLayer()
+{
+    m_Pipeline.Stop();
+    if constexpr (D == D3)
+        Visualization<D3>::ReleaseSurface();
+    if (!StepTelemetry::ExportPath.empty())
+        m_Solver.Telemetry.Export(StepTelemetry::ExportPath);
+}
+
 static f32 rayCast(const Onyx::Camera<D3> *p_Camera, const Onyx::RenderContext<D3> *p_Context,
                    const SimulationState<D3> &p_State, const f32 p_Radius)
 {
@@ -54,16 +63,28 @@ static f32 rayCast(const Onyx::Camera<D3> *p_Camera, const Onyx::RenderContext<D
 template <Dimension D> void SimLayer<D>::OnUpdate()
 {
     TKIT_PROFILE_NSCOPE("SimLayer::Onupdate");
+    // From here on and until the next step is kicked off, the solver is idle and may be used as usual
+    if (m_Pipeline.IsRunning())
+        m_Pipeline.Wait();
+    m_Publisher.Publish(m_Solver);
+
     if (Onyx::Input::IsKeyPressed(m_Window, Onyx::Input::Key::R) && !ImGui::GetIO().WantCaptureKeyboard)
         m_Solver.AddParticle(m_Camera->GetWorldMousePosition(&m_Context->GetCurrentAxes()));
-    if (!m_Pause)
+    if (IAutotuner::Enabled && !m_Pause && !m_Autotuner.IsTuning() &&
+        m_Autotuner.NeedsTuning(m_Solver.GetParticleCount()))
+        m_Autotuner.BeginTune(m_Solver);
+    // A single candidate is tried every frame, so that the window stays responsive. The simulation waits for the
+    // sweep to end, and the solver is idle in between trials
+    const bool tuning = m_Autotuner.Advance(m_Solver, m_Timestep);
+
+    const bool pipelined = m_Pipeline.IsRunning() && !m_Pause && !tuning;
+    if (!pipelined && !m_Pause && !tuning)
         step(m_DummyStep);
 
     Visualization<D>::AdjustRenderContext(m_Context);
     if (!ImGui::GetIO().WantCaptureKeyboard)
         m_Camera->ControlMovementWithUserInput(0.75f * m_Application->GetDeltaTime());
-    m_Solver.DrawParticles(m_Context);
-    m_Solver.DrawBoundingBox(m_Context);
+    m_View = Visualization<D>::GetViewVolume(m_Camera, m_Context);
 
     if constexpr (D == D2)
         if (Onyx::Input::IsMouseButtonPressed(m_Window, Onyx::Input::Mouse::ButtonLeft) &&
@@ -71,17 +92,97 @@ template <Dimension D> void SimLayer<D>::OnUpdate()
             Visualization<D2>::DrawMouseInfluence(m_Camera, m_Context, 2.f * m_Solver.Settings.MouseRadius,
                                                   Onyx::Color::ORANGE);
 
+    if (pipelined)
+        drawPipelined();
+    else
+    {
+        m_Kicked = false;
+        if (m_Solver.Settings.DrawSurface)
+            drawSurface(m_Solver.Settings, m_Solver.Data.State.Positions);
+        else
+            m_Solver.DrawParticles(m_Context, &m_View);
+        m_Solver.DrawBoundingBox(m_Context);
+        for (const Emitter<D> &emitter : m_Solver.Emitters)
+            Visualization<D>::DrawBoundingBox(m_Context, emitter.Min, emitter.Max, Onyx::Color::GREEN);
+        drawObstacles();
+        renderSettings();
+    }
+
+    if (m_BackToMenu)
+    {
+        m_Pipeline.Stop();
+        if constexpr (D == D3)
+            Visualization<D3>::ReleaseSurface();
+        m_Window->DestroyCamera(m_Camera);
+        m_Window->DestroyRenderContext(m_Context);
+        m_Application->SetUserLayer<IntroLayer>(m_Application, m_Solver.Settings, m_Solver.GetState());
+    }
+}
+
+// The snapshot and the culling indices both describe the state the last step left behind, and are taken before the
+// next one starts. Everything touching the solver must be done before the kick
+template <Dimension D> void SimLayer<D>::drawPipelined()
+{
+    if (!m_Kicked)
+        m_Pipeline.Publish();
+    const RenderSnapshot<D> &snapshot = m_Pipeline.AcquireSnapshot();
+    ParticleCulling culling = m_Solver.GetCulling(&m_View);
+    if (culling.NeighborCounts)
+        culling.NeighborCounts = snapshot.NeighborCounts.GetData();
+
+    for (const Emitter<D> &emitter : m_Solver.Emitters)
+        Visualization<D>::DrawBoundingBox(m_Context, emitter.Min, emitter.Max, Onyx::Color::GREEN);
+    drawObstacles();
+    const StepInput<D> input = getStepInput();
+    const SimulationSettings settings = m_Solver.Settings;
+    renderSettings();
+
+    // The pipeline may have just been turned off, in which case the solver is still idle and can be drawn directly
+    m_Kicked = m_Pipeline.IsRunning() && !m_BackToMenu;
+    if (!m_Kicked)
+    {
+        m_Solver.DrawParticles(m_Context, &m_View);
+        m_Solver.DrawBoundingBox(m_Context);
+        return;
+    }
+    m_Pipeline.Kick(input);
+
+    if (settings.DrawSurface)
+        drawSurface(settings, snapshot.State.Positions);
+    else if constexpr (D == D2)
+        Visualization<D2>::DrawParticles(m_Context, settings, snapshot.State, &culling);
+    else
+        Visualization<D3>::DrawParticles(m_Context, settings, snapshot.State, snapshot.UnderMouseInfluence.GetData(),
+                                         Onyx::Color::GREEN, Onyx::Color::ORANGE, &culling);
+    Visualization<D>::DrawBoundingBox(m_Context, snapshot.State.Min, snapshot.State.Max,
+                                      Onyx::Color::FromHexadecimal("A6B1E1"));
+}
+
+template <Dimension D>
+void SimLayer<D>::drawSurface(const SimulationSettings &p_Settings, const SimArray<f32v<D>> &p_Positions)
+{
+    m_Surface.Update(p_Settings, p_Positions);
+    if constexpr (D == D2)
+        Visualization<D2>::DrawSurface(m_Context, m_Surface, p_Settings.Gradient[0], 0.5f * p_Settings.ParticleRadius);
+    else
+        Visualization<D3>::DrawSurface(m_Context, m_Surface, p_Settings.Gradient[0]);
+}
+
+template <Dimension D> void SimLayer<D>::renderSettings()
+{
     if (ImGui::Begin("Simulation settings"))
     {
-        ExportWidget("Export simulation state", Core::GetStatePath<D>(), m_Solver.Data.State);
-        ImportWidget("Import simulation state", Core::GetStatePath<D>(), m_Solver.Data.State);
+        ExportWidgetWith("Export simulation state", Core::GetStatePath<D>(), [this] { return m_Solver.GetState(); });
+        SimulationState<D> state{};
+        if (ImportWidget("Import simulation state", Core::GetStatePath<D>(), state))
+            m_Solver.SetState(state);
 
         if (ImGui::Button("Back to menu"))
-        {
-            m_Window->DestroyCamera(m_Camera);
-            m_Window->DestroyRenderContext(m_Context);
-            m_Application->SetUserLayer<IntroLayer>(m_Application, m_Solver.Settings, m_Solver.Data.State);
-        }
+            m_BackToMenu = true;
+        renderFlowSettings();
+        renderObstacleSettings();
+        renderMaterialSettings();
+        renderAutotuneSettings();
         Visualization<D>::RenderSettings(m_Solver.Settings);
     }
     ImGui::End();
@@ -123,17 +224,24 @@ template <Dimension D> void SimLayer<D>::OnEvent(const Onyx::Event &p_Event)
 
 template <Dimension D> void SimLayer<D>::step(const bool p_Dummy)
 {
-    m_Solver.BeginStep(m_Timestep);
-    m_Solver.UpdateLookup();
-    m_Solver.ComputeDensitiesAndDistances(m_Timestep);
-    m_Solver.AddPressureAndViscosity();
+    StepInput<D> input = getStepInput();
+    input.Dummy = p_Dummy;
+    m_Solver.Step(input);
+    m_Publisher.Publish(m_Solver);
+}
+
+template <Dimension D> StepInput<D> SimLayer<D>::getStepInput()
+{
+    StepInput<D> input{};
+    input.DeltaTime = m_Timestep;
+    input.Dummy = m_DummyStep;
     if constexpr (D == D2)
     {
         if (Onyx::Input::IsMouseButtonPressed(m_Window, Onyx::Input::Mouse::ButtonLeft) &&
             !ImGui::GetIO().WantCaptureMouse)
         {
-            const f32v2 mpos = m_Camera->GetWorldMousePosition(&m_Context->GetCurrentAxes());
-            m_Solver.AddMouseForce(mpos);
+            input.MousePosition = m_Camera->GetWorldMousePosition(&m_Context->GetCurrentAxes());
+            input.Mouse = MouseAction::Push;
         }
     }
     else
@@ -141,23 +249,15 @@ template <Dimension D> void SimLayer<D>::step(const bool p_Dummy)
         const f32v3 origin = m_Camera->GetWorldMousePosition(&m_Context->GetCurrentAxes(), 0.f);
         const f32v3 direction = m_Camera->GetMouseRayCastDirection();
         if (Onyx::Input::IsMouseButtonPressed(m_Window, Onyx::Input::Mouse::ButtonLeft))
-            m_Solver.AddMouseForce(origin + s_RayDistance * direction);
+            input.Mouse = MouseAction::Push;
         else
         {
             s_RayDistance = rayCast(m_Camera, m_Context, m_Solver.Data.State, m_Solver.Settings.ParticleRadius);
-            const f32v3 pos = origin + s_RayDistance * direction;
-            for (u32 i = 0; i < m_Solver.Data.State.Positions.GetSize(); ++i)
-            {
-                const f32 distance2 = Math::DistanceSquared(m_Solver.Data.State.Positions[i], pos);
-                if (distance2 < m_Solver.Settings.MouseRadius * m_Solver.Settings.MouseRadius)
-                    m_Solver.Data.UnderMouseInfluence[i] = 2;
-            }
+            input.Mouse = MouseAction::Highlight;
         }
+        input.MousePosition = origin + s_RayDistance * direction;
     }
-
-    if (!p_Dummy)
-        m_Solver.ApplyComputedForces(m_Timestep);
-    m_Solver.EndStep();
+    return input;
 }
 
 template <Dimension D> void SimLayer<D>::renderVisualizationSettings()
@@ -167,11 +267,68 @@ template <Dimension D> void SimLayer<D>::renderVisualizationSettings()
     DisplayFrameTime(m_Application->GetDeltaTime(), Flag_DisplayHelp);
     ImGui::Spacing();
 
+    if (ImGui::TreeNode("Step telemetry"))
+    {
+        TelemetryWidget(m_Solver.Telemetry);
+        ImGui::TreePop();
+    }
+
+    bool pipelined = m_Pipeline.IsRunning();
+    if (ImGui::Checkbox("Overlap simulation and rendering", &pipelined))
+    {
+        if (pipelined)
+            m_Pipeline.Start();
+        else
+            m_Pipeline.Stop();
+    }
+    HelpMarkerSameLine("The next step is computed on a separate worker team while the previous one is drawn, so "
+                       "that a frame takes about as long as the slowest of the two instead of both combined. What is "
+                       "drawn lags one step behind the simulation.");
+
+    ImGui::Checkbox("Cull outside of view", &m_Solver.Settings.CullOutsideView);
+    HelpMarkerSameLine("Grid cells out of the camera's sight are rejected as a whole before their particles are "
+                       "touched, so that a small region of a huge simulation is drawn in constant time. It only "
+                       "applies to the grid lookup.");
+
     if constexpr (D == D3)
+    {
         ResolutionEditor("Shape resolution", Core::Resolution, Flag_DisplayHelp);
+        ImGui::Checkbox("Cull interior particles", &m_Solver.Settings.CullInterior);
+        HelpMarkerSameLine("Particles buried inside the fluid can never be seen. They are recognized by their "
+                           "neighbor count from the density pass, and are not drawn. Particles under the mouse are "
+                           "always drawn.");
+        if (m_Solver.Settings.CullInterior)
+        {
+            ImGui::SliderFloat("Interior neighbor ratio", &m_Solver.Settings.InteriorNeighborRatio, 0.5f, 1.5f);
+            HelpMarkerSameLine("Particles with at least this fraction of the mean neighbor count are considered to "
+                               "be interior ones. Lower values cull more aggressively, and may leave holes in the "
+                               "surface.");
+        }
+        ImGui::DragFloat("LOD distance", &m_Solver.Settings.LodDistance, 0.5f, 0.f, FLT_MAX);
+        HelpMarkerSameLine("Particles further away from the camera than this distance are drawn at the lowest shape "
+                           "resolution. Set it to 0 to disable level of detail.");
+    }
+
+    ImGui::Checkbox("Draw surface", &m_Solver.Settings.DrawSurface);
+    HelpMarkerSameLine("The fluid is drawn as the isosurface of its density field instead of as individual particles. "
+                       "The field is sampled on voxel blocks around occupied lookup cells, and only the blocks whose "
+                       "particles moved are rebuilt every frame.");
+    if (m_Solver.Settings.DrawSurface)
+    {
+        i32 subdivisions = static_cast<i32>(m_Solver.Settings.SurfaceSubdivisions);
+        if (ImGui::SliderInt("Surface subdivisions", &subdivisions, 1, 8))
+            m_Solver.Settings.SurfaceSubdivisions = static_cast<u32>(subdivisions);
+        ImGui::SliderFloat("Surface iso level", &m_Solver.Settings.SurfaceIsoLevel, 0.05f, 2.f);
+        HelpMarkerSameLine("Voxels per lookup cell and axis, and the fraction of the target density the surface "
+                           "sits at. Lower iso levels give a puffier surface.");
+
+        const SurfaceStatistics &stats = m_Surface.Statistics;
+        ImGui::Text("Blocks: %u (%u rebuilt)", stats.Blocks, stats.RebuiltBlocks);
+        ImGui::Text("%s: %u (%.3f ms)", D == D2 ? "Segments" : "Triangles", stats.Primitives, stats.ExtractTime);
+    }
 
     const u32 pcount = m_Solver.GetParticleCount();
-    ImGui::Text("Particles: %u", pcount);
+    ImGui::Text("Particles: %u (%u drawn)", pcount, Visualization<D>::GetParticleRenderer().GetDrawnCount());
 
     static bool syncTimestep = false;
     ImGui::Checkbox("Sync timestep", &syncTimestep);
@@ -205,16 +362,19 @@ template <Dimension D> void SimLayer<D>::renderVisualizationSettings()
         "well as if there are clashes between them.");
 
     if (drawGrid)
+        m_Solver.Lookup.DrawCells(m_Context, m_Solver.Settings.CullOutsideView ? &m_View : nullptr);
+
+    if (ImGui::TreeNode("Lookup statistics"))
     {
-        m_Solver.UpdateLookup();
-        const u32 cellClashes = m_Solver.Lookup.DrawCells(m_Context);
-        ImGui::Text("Cell clashes: %u", cellClashes);
+        ImGui::Checkbox("Collect lookup statistics", &m_Solver.Lookup.CollectStatistics);
         HelpMarkerSameLine(
-            "The grid spatial lookup optimization divides the simulation space into cells, which are "
-            "used to quickly find neighboring particles. To efficiently access and relate particles "
-            "with their corresponding cells, the latter are hashed to the number of particles. Because of this, cell "
-            "hashes can clash, which will render the grid lookup slightly less efficient. This metric displays the "
-            "number of clashes found.");
+            "The grid spatial lookup optimization divides the simulation space into cells, which are used to quickly "
+            "find neighboring particles. Cells are hashed to the number of particles, so their hashes can clash, "
+            "which renders the lookup slightly less efficient. Cell occupancy, clashes and neighbor counts cost an "
+            "extra pass over the grid when it is built, and pair counts and per partition work cost a few counters "
+            "in the pair traversal.");
+        LookupStatisticsWidget(m_Solver.Lookup.Statistics);
+        ImGui::TreePop();
     }
 
     ImGui::Checkbox("Pause simulation", &m_Pause);
@@ -242,6 +402,205 @@ template <Dimension D> void SimLayer<D>::renderVisualizationSettings()
     }
 }
 
+template <Dimension D> void SimLayer<D>::renderAutotuneSettings()
+{
+    if (!ImGui::TreeNode("Autotune"))
+        return;
+
+    ImGui::Checkbox("Enabled", &IAutotuner::Enabled);
+    HelpMarkerSameLine("When enabled, a few trial steps are run for every candidate configuration when the scene "
+                       "starts and whenever the particle count changes beyond the retune threshold. The fastest "
+                       "configuration is applied and cached per machine, so later runs can skip the trials.");
+
+    f32 threshold = 100.f * IAutotuner::RetuneThreshold;
+    if (ImGui::SliderFloat("Retune threshold", &threshold, 5.f, 200.f, "%.0f%%"))
+        IAutotuner::RetuneThreshold = 0.01f * threshold;
+
+    if (!m_Autotuner.IsTuning() && ImGui::Button("Tune now"))
+        m_Autotuner.BeginTune(m_Solver, false);
+
+    const TuneDecision *decision = m_Autotuner.GetDecision();
+    if (m_Autotuner.IsTuning())
+        ImGui::Text("Trying %u candidates for %u particles...", decision->Candidates, decision->Particles);
+    else if (decision)
+    {
+        ImGui::Text("Partitions: %u", decision->Configuration.Partitions);
+        ImGui::Text("Lookup: %s", GetLookupModeName(decision->Configuration.Lookup));
+        if (decision->Configuration.Lookup == LookupMode::Grid)
+        {
+            ImGui::Text("Cell ratio: %u", decision->Configuration.CellRatio);
+            ImGui::Text("Pair schedule: %s", GetPairScheduleName(decision->Configuration.Schedule));
+        }
+        ImGui::Text("Trial step: %.3f ms", decision->StepTime);
+        if (decision->FromCache)
+            ImGui::Text("Taken from the cache for %u particles", decision->Particles);
+        else
+            ImGui::Text("Fastest of %u candidates for %u particles", decision->Candidates, decision->Particles);
+    }
+    else
+        ImGui::TextDisabled("No decision yet");
+
+    ImGui::TreePop();
+}
+
+template <Dimension D> void SimLayer<D>::renderFlowSettings()
+{
+    if (!ImGui::TreeNode("Emitters and sinks"))
+        return;
+
+    const f32v<D> &mn = m_Solver.Data.State.Min;
+    const f32v<D> &mx = m_Solver.Data.State.Max;
+    const f32v<D> size = mx - mn;
+
+    if (ImGui::Button("Add emitter"))
+    {
+        Emitter<D> emitter{};
+        emitter.Min = mn + 0.05f * size;
+        emitter.Min[1] = mx[1] - 0.2f * size[1];
+        emitter.Max = emitter.Min + 0.1f * size;
+        emitter.Seed = m_Solver.Emitters.GetSize();
+        m_Solver.Emitters.Append(emitter);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Add sink"))
+    {
+        Sink<D> sink{};
+        sink.Point = mx - 0.05f * size;
+        sink.Normal[0] = 1.f;
+        m_Solver.Sinks.Append(sink);
+    }
+    HelpMarkerSameLine("Emitters spawn particles inside a box at a fixed rate, and sinks remove every particle that "
+                       "crosses their plane in the direction of the normal. Both act in batches between steps.");
+
+    for (u32 i = 0; i < m_Solver.Emitters.GetSize(); ++i)
+    {
+        Emitter<D> &emitter = m_Solver.Emitters[i];
+        ImGui::PushID(static_cast<i32>(i));
+        ImGui::Text("Emitter %u", i);
+        ImGui::DragFloat("Rate", &emitter.Rate, 1.f, 0.f, FLT_MAX);
+        ImGui::DragScalarN("Min", ImGuiDataType_Float, Math::AsPointer(emitter.Min), D, 0.05f);
+        ImGui::DragScalarN("Max", ImGuiDataType_Float, Math::AsPointer(emitter.Max), D, 0.05f);
+        ImGui::DragScalarN("Velocity", ImGuiDataType_Float, Math::AsPointer(emitter.Velocity), D, 0.05f);
+        const u32 first = 0;
+        const u32 last = Math::Min(static_cast<u32>(m_Solver.Materials.GetSize()), MaterialTable::MaxMaterials - 1);
+        ImGui::SliderScalar("Material", ImGuiDataType_U32, &emitter.Material, &first, &last);
+        ImGui::PopID();
+    }
+    for (u32 i = 0; i < m_Solver.Sinks.GetSize(); ++i)
+    {
+        Sink<D> &sink = m_Solver.Sinks[i];
+        ImGui::PushID(static_cast<i32>(m_Solver.Emitters.GetSize() + i));
+        ImGui::Text("Sink %u", i);
+        ImGui::DragScalarN("Point", ImGuiDataType_Float, Math::AsPointer(sink.Point), D, 0.05f);
+        ImGui::DragScalarN("Normal", ImGuiDataType_Float, Math::AsPointer(sink.Normal), D, 0.01f);
+        ImGui::PopID();
+    }
+
+    if (ImGui::Button("Clear emitters"))
+        m_Solver.Emitters.Clear();
+    ImGui::SameLine();
+    if (ImGui::Button("Clear sinks"))
+        m_Solver.Sinks.Clear();
+
+    ImGui::TreePop();
+}
+
+// Obstacles are only outlined by their bounds, which is enough to place them
+template <Dimension D> void SimLayer<D>::drawObstacles()
+{
+    const ObstacleSet<D> &obstacles = m_Solver.Obstacles;
+    for (const Obstacle<D> &obstacle : obstacles.Obstacles)
+    {
+        f32v<D> mn;
+        f32v<D> mx;
+        obstacles.ComputeBounds(obstacle, mn, mx);
+        Visualization<D>::DrawBoundingBox(m_Context, mn, mx, Onyx::Color::RED);
+    }
+}
+
+template <Dimension D> void SimLayer<D>::renderObstacleSettings()
+{
+    if (!ImGui::TreeNode("Obstacles"))
+        return;
+
+    const f32v<D> center = 0.5f * (m_Solver.Data.State.Min + m_Solver.Data.State.Max);
+    const f32v<D> size = m_Solver.Data.State.Max - m_Solver.Data.State.Min;
+    const auto add = [this, &center, &size](const ObstacleShape p_Shape) {
+        Obstacle<D> obstacle{};
+        obstacle.Shape = p_Shape;
+        obstacle.Center = center;
+        obstacle.HalfExtents = 0.1f * size;
+        obstacle.HalfExtents[1] = 0.02f * size[1];
+        obstacle.Radius = 0.05f * size[0];
+        m_Solver.Obstacles.Obstacles.Append(obstacle);
+    };
+    if (ImGui::Button("Add box"))
+        add(ObstacleShape::Box);
+    ImGui::SameLine();
+    if (ImGui::Button("Add sphere"))
+        add(ObstacleShape::Sphere);
+    ImGui::SameLine();
+    if (ImGui::Button("Add capsule"))
+        add(ObstacleShape::Capsule);
+    HelpMarkerSameLine("Obstacles are rigid shapes described by their signed distance. They may move and spin around "
+                       "the z axis, dragging the particles they touch along. Collisions only test the obstacles "
+                       "overlapping a particle's grid cell, so many of them can be added at a low cost.");
+
+    for (u32 i = 0; i < m_Solver.Obstacles.Obstacles.GetSize(); ++i)
+    {
+        Obstacle<D> &obstacle = m_Solver.Obstacles.Obstacles[i];
+        ImGui::PushID(static_cast<i32>(i));
+        ImGui::Text("Obstacle %u", i);
+        ImGui::DragScalarN("Center", ImGuiDataType_Float, Math::AsPointer(obstacle.Center), D, 0.05f);
+        if (obstacle.Shape == ObstacleShape::Box || obstacle.Shape == ObstacleShape::Capsule)
+            ImGui::DragScalarN("Half extents", ImGuiDataType_Float, Math::AsPointer(obstacle.HalfExtents), D, 0.05f);
+        if (obstacle.Shape == ObstacleShape::Sphere || obstacle.Shape == ObstacleShape::Capsule)
+            ImGui::DragFloat("Radius", &obstacle.Radius, 0.05f, 0.f, FLT_MAX);
+        ImGui::DragFloat("Rotation", &obstacle.Rotation, 0.01f);
+        ImGui::DragScalarN("Velocity", ImGuiDataType_Float, Math::AsPointer(obstacle.Velocity), D, 0.05f);
+        ImGui::DragFloat("Angular velocity", &obstacle.AngularVelocity, 0.01f);
+        ImGui::PopID();
+    }
+
+    if (ImGui::Button("Clear obstacles"))
+        m_Solver.Obstacles.Obstacles.Clear();
+
+    ImGui::TreePop();
+}
+
+template <Dimension D> void SimLayer<D>::renderMaterialSettings()
+{
+    if (!ImGui::TreeNode("Materials"))
+        return;
+
+    SimArray<Material> &materials = m_Solver.Materials;
+    if (materials.GetSize() + 1 < MaterialTable::MaxMaterials && ImGui::Button("Add material"))
+        materials.Append(Material::FromSettings(m_Solver.Settings));
+    HelpMarkerSameLine("Material 0 is the fluid described by the simulation settings below. Further materials start as "
+                       "a copy of it, and particles are given a material by the emitters that spawn them. Mixed pairs "
+                       "use the mean viscosity of both materials, and the elasticity of the weaker one.");
+
+    for (u32 i = 0; i < materials.GetSize(); ++i)
+    {
+        Material &material = materials[i];
+        ImGui::PushID(static_cast<i32>(i));
+        ImGui::Text("Material %u", i + 1);
+        ImGui::DragFloat("Mass", &material.Mass, 0.02f, 0.01f, FLT_MAX);
+        ImGui::DragFloat("Target density", &material.TargetDensity, 0.02f, 0.f, FLT_MAX);
+        ImGui::DragFloat("Pressure stiffness", &material.PressureStiffness, 0.2f, 0.f, FLT_MAX);
+        ImGui::DragFloat("Near pressure stiffness", &material.NearPressureStiffness, 0.2f, 0.f, FLT_MAX);
+        ImGui::DragFloat("Linear viscosity", &material.ViscLinearTerm, 0.002f, 0.f, FLT_MAX);
+        ImGui::DragFloat("Quadratic viscosity", &material.ViscQuadraticTerm, 0.002f, 0.f, FLT_MAX);
+        ImGui::DragFloat("Elastic strength", &material.ElasticityStrength, 0.02f, 0.f, FLT_MAX);
+        ImGui::DragFloat("Plastic alpha", &material.PlasticAlpha, 0.002f, 0.f, FLT_MAX);
+        ImGui::DragFloat("Plastic yield", &material.PlasticYield, 0.002f, 0.f, FLT_MAX);
+        ImGui::DragFloat("Plastic max step", &material.PlasticMaxStep, 0.002f, 0.f, FLT_MAX);
+        ImGui::PopID();
+    }
+
+    ImGui::TreePop();
+}
+
 template class SimLayer<D2>;
 template class SimLayer<D3>;
 
@@ -1,6 +1,9 @@
 #pragma once
 
 #include "driz/simulation/solver.hpp"
+#include "driz/simulation/autotune.hpp"
+#include "driz/simulation/pipeline.hpp"
+#include "driz/simulation/publisher.hpp"
 #include "onyx/app/user_layer.hpp"
 #include "onyx/app/app.hpp"
 #include "onyx/rendering/render_context.hpp"
@@ -11,23 +14,41 @@ template <Dimension D> class SimLayer final : public Onyx::UserLayer
 {
   public:
     SimLayer(Onyx::Application *p_Application, const SimulationSettings &p_Settings, const SimulationState<D> &p_State);
+    ~SimLayer();
 
   private:
     void OnUpdate() override;
     void OnEvent(const Onyx::Event &p_Event) override;
 
     void step(bool p_Dummy = false);
+    void drawPipelined();
+    void drawSurface(const SimulationSettings &p_Settings, const SimArray<f32v<D>> &p_Positions);
+    void drawObstacles();
+    StepInput<D> getStepInput();
+
+    void renderSettings();
     void renderVisualizationSettings();
+    void renderFlowSettings();
+    void renderObstacleSettings();
+    void renderMaterialSettings();
+    void renderAutotuneSettings();
 
     Onyx::Application *m_Application;
     Onyx::Window *m_Window;
 
     Solver<D> m_Solver;
+    SimulationPipeline<D> m_Pipeline{m_Solver};
+    Autotuner<D> m_Autotuner;
+    StatePublisher m_Publisher;
+    SurfaceExtractor<D> m_Surface;
     Onyx::RenderContext<D> *m_Context;
     Onyx::Camera<D> *m_Camera;
+    ViewVolume<D> m_View{};
 
     f32 m_Timestep = 1.f / 60.f;
     bool m_DummyStep = false;
     bool m_Pause = false;
+    bool m_Kicked = false;
+    bool m_BackToMenu = false;
 };
 } // namespace Driz
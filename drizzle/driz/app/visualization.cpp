@@ -1,5 +1,9 @@
 #include "driz/app/visualization.hpp"
+#include "driz/simulation/lookup.hpp"
+#include "onyx/object/mesh.hpp"
+#include "onyx/core/core.hpp"
 #include "tkit/profiling/macros.hpp"
+#include <cfloat>
 
 namespace Driz
 {
@@ -16,37 +20,101 @@ template <Dimension D> void IVisualization<D>::AdjustRenderContext(Onyx::RenderC
     }
 }
 
+void SpeedColorTable::Build(const SimulationSettings &p_Settings)
+{
+    const Onyx::Gradient gradient{p_Settings.Gradient};
+    for (u32 i = 0; i < Size; ++i)
+        m_Colors[i] = gradient.Evaluate(Math::SquareRoot(static_cast<f32>(i) / (Size - 1)));
+    m_Scale = 1.f / (p_Settings.FastSpeed * p_Settings.FastSpeed);
+}
+
 template <Dimension D>
-void IVisualization<D>::DrawParticles(Onyx::RenderContext<D> *p_Context, const SimulationSettings &p_Settings,
-                                      const SimulationState<D> &p_State)
+void ParticleRenderer<D>::Draw(Onyx::RenderContext<D> *p_Context, const SimulationSettings &p_Settings,
+                               const SimulationState<D> &p_State, const u8 *p_Outlines,
+                               const Onyx::Color *p_OutlineColors, const ParticleCulling *p_Culling)
 {
+    TKIT_PROFILE_NSCOPE("Driz::ParticleRenderer::Draw");
+    m_Colors.Build(p_Settings);
+
+    const bool indexed = p_Culling && p_Culling->Indices;
+    const u32 candidates = indexed ? p_Culling->IndexCount : p_State.Positions.GetSize();
+    const bool cull = D == D3 && p_Culling && p_Culling->NeighborCounts;
+    const f32 lod = p_Culling ? p_Culling->LodDistance : 0.f;
+
+    TKit::Array<u32, DRIZ_MAX_THREADS> drawn{};
     p_Context->ShareCurrentState();
-    Core::ForEach(0, p_State.Positions.GetSize(), p_Settings.Partitions,
-                  [&, p_Context](const u32 p_Start, const u32 p_End) {
-                      TKIT_PROFILE_NSCOPE("Driz::IVisualization::DrawParticles");
-                      const f32 psize = 2.f * p_Settings.ParticleRadius;
-
-                      const Onyx::Gradient gradient{p_Settings.Gradient};
-                      for (u32 i = p_Start; i < p_End; ++i)
-                      {
-                          const f32v<D> &pos = p_State.Positions[i];
-                          const f32v<D> &vel = p_State.Velocities[i];
-
-                          const f32 speed = Math::Min(p_Settings.FastSpeed, Math::Norm(vel));
-                          const Onyx::Color color = gradient.Evaluate(speed / p_Settings.FastSpeed);
-
-                          p_Context->Push();
-                          p_Context->Fill(color);
-
-                          p_Context->Translate(pos);
-                          if constexpr (D == D2)
-                              p_Context->Circle(psize);
-                          else
-                              p_Context->Sphere(psize, Core::Resolution);
-
-                          p_Context->Pop();
-                      }
-                  });
+    Core::ForEachChunk(
+        0, candidates, p_Settings.Partitions,
+        [this, p_Context, &p_Settings, &p_State, &drawn, p_Outlines, p_OutlineColors, p_Culling, indexed, cull,
+         lod](const u32 p_Chunk, const u32 p_Start, const u32 p_End) {
+            TKIT_PROFILE_NSCOPE("Driz::ParticleRenderer::Submit");
+            const f32 diameter = 2.f * p_Settings.ParticleRadius;
+            u32 count = 0;
+            for (u32 k = p_Start; k < p_End; ++k)
+            {
+                const u32 i = indexed ? p_Culling->Indices[k] : k;
+                const u8 outline = p_Outlines ? p_Outlines[i] : 0;
+                if (cull && p_Culling->NeighborCounts[i] >= p_Culling->InteriorNeighbors && outline == 0)
+                    continue;
+                ++count;
+
+                const f32v<D> &position = p_State.Positions[i];
+                p_Context->Push();
+                p_Context->Translate(position);
+                if (outline != 0 && p_OutlineColors)
+                    p_Context->Outline(p_OutlineColors[outline - 1]);
+                p_Context->Fill(m_Colors.Evaluate(Math::NormSquared(p_State.Velocities[i])));
+                if constexpr (D == D2)
+                    p_Context->Circle(diameter);
+                else
+                {
+                    const bool far = lod > 0.f && Math::DistanceSquared(position, p_Culling->Viewer) > lod * lod;
+                    p_Context->Sphere(diameter, far ? Onyx::Resolution::VeryLow : Core::Resolution);
+                }
+                p_Context->Pop();
+            }
+            drawn[p_Chunk] = count;
+        });
+
+    m_Drawn = 0;
+    for (u32 i = 0; i < p_Settings.Partitions; ++i)
+        m_Drawn += drawn[i];
+}
+
+template <Dimension D> u32 ParticleRenderer<D>::GetDrawnCount() const
+{
+    return m_Drawn;
+}
+
+template <Dimension D> ParticleRenderer<D> &IVisualization<D>::GetParticleRenderer()
+{
+    static ParticleRenderer<D> renderer{};
+    return renderer;
+}
+
+template <Dimension D>
+void IVisualization<D>::DrawParticles(Onyx::RenderContext<D> *p_Context, const SimulationSettings &p_Settings,
+                                      const SimulationState<D> &p_State, const ParticleCulling *p_Culling)
+{
+    GetParticleRenderer().Draw(p_Context, p_Settings, p_State, nullptr, nullptr, p_Culling);
+}
+
+template <Dimension D>
+ViewVolume<D> IVisualization<D>::GetViewVolume(const Onyx::Camera<D> *p_Camera,
+                                               const Onyx::RenderContext<D> *p_Context)
+{
+    const TKit::Array<f32v2, 4> screen = {f32v2{-1.f, -1.f}, f32v2{1.f, -1.f}, f32v2{1.f, 1.f}, f32v2{-1.f, 1.f}};
+    const auto *axes = &p_Context->GetCurrentAxes();
+    TKit::Array<f32v<D>, ViewVolume<D>::CornerCount> corners;
+    for (u32 i = 0; i < 4; ++i)
+        if constexpr (D == D2)
+            corners[i] = p_Camera->ScreenToWorld(screen[i], axes);
+        else
+        {
+            corners[i] = p_Camera->ScreenToWorld(f32v3{screen[i][0], screen[i][1], 0.f}, axes);
+            corners[4 + i] = p_Camera->ScreenToWorld(f32v3{screen[i][0], screen[i][1], 1.f}, axes);
+        }
+    return ViewVolume<D>::FromCorners(corners);
 }
 
 template <Dimension D>
@@ -99,46 +167,46 @@ void IVisualization<D>::DrawBoundingBox(Onyx::RenderContext<D> *p_Context, const
 }
 
 template <Dimension D>
-void IVisualization<D>::DrawCell(Onyx::RenderContext<D> *p_Context, const i32v<D> &p_Position, const f32 p_Size,
+void IVisualization<D>::DrawCell(Onyx::RenderContext<D> *p_Context, const f32v<D> &p_Min, const f32v<D> &p_Size,
                                  const Onyx::Color &p_Color, const f32 p_Thickness)
 {
     p_Context->Fill(p_Color);
     if constexpr (D == D2)
     {
-        const i32v2 right = i32v2{p_Size, 0};
-        const i32v2 up = i32v2{0, p_Size};
-        const i32v2 wopa = i32v2{p_Size, p_Size};
+        const f32v2 right = f32v2{p_Size[0], 0.f};
+        const f32v2 up = f32v2{0.f, p_Size[1]};
+        const f32v2 wopa = p_Size;
 
-        p_Context->Line(p_Position, p_Position + right, p_Thickness);
-        p_Context->Line(p_Position, p_Position + up, p_Thickness);
+        p_Context->Line(p_Min, p_Min + right, p_Thickness);
+        p_Context->Line(p_Min, p_Min + up, p_Thickness);
 
-        p_Context->Line(p_Position + right, p_Position + wopa, p_Thickness);
-        p_Context->Line(p_Position + up, p_Position + wopa, p_Thickness);
+        p_Context->Line(p_Min + right, p_Min + wopa, p_Thickness);
+        p_Context->Line(p_Min + up, p_Min + wopa, p_Thickness);
     }
     else
     {
-        const i32v3 right = i32v3{p_Size, 0, 0};
-        const i32v3 up = i32v3{0, p_Size, 0};
-        const i32v3 front = i32v3{0, 0, p_Size};
-        const i32v3 wopa = i32v3{p_Size, p_Size, 0};
+        const f32v3 right = f32v3{p_Size[0], 0.f, 0.f};
+        const f32v3 up = f32v3{0.f, p_Size[1], 0.f};
+        const f32v3 front = f32v3{0.f, 0.f, p_Size[2]};
+        const f32v3 wopa = f32v3{p_Size[0], p_Size[1], 0.f};
 
         const Onyx::LineOptions options{.Thickness = p_Thickness, .Resolution = Core::Resolution};
-        p_Context->Line(p_Position, p_Position + right, options);
-        p_Context->Line(p_Position, p_Position + up, options);
+        p_Context->Line(p_Min, p_Min + right, options);
+        p_Context->Line(p_Min, p_Min + up, options);
 
-        p_Context->Line(p_Position + right, p_Position + wopa, options);
-        p_Context->Line(p_Position + up, p_Position + wopa, options);
+        p_Context->Line(p_Min + right, p_Min + wopa, options);
+        p_Context->Line(p_Min + up, p_Min + wopa, options);
 
-        p_Context->Line(p_Position + front, p_Position + front + right, options);
-        p_Context->Line(p_Position + front, p_Position + front + up, options);
+        p_Context->Line(p_Min + front, p_Min + front + right, options);
+        p_Context->Line(p_Min + front, p_Min + front + up, options);
 
-        p_Context->Line(p_Position + front + right, p_Position + front + wopa, options);
-        p_Context->Line(p_Position + front + up, p_Position + front + wopa, options);
+        p_Context->Line(p_Min + front + right, p_Min + front + wopa, options);
+        p_Context->Line(p_Min + front + up, p_Min + front + wopa, options);
 
-        p_Context->Line(p_Position, p_Position + front, options);
-        p_Context->Line(p_Position + right, p_Position + right + front, options);
-        p_Context->Line(p_Position + up, p_Position + up + front, options);
-        p_Context->Line(p_Position + wopa, p_Position + wopa + front, options);
+        p_Context->Line(p_Min, p_Min + front, options);
+        p_Context->Line(p_Min + right, p_Min + right + front, options);
+        p_Context->Line(p_Min + up, p_Min + up + front, options);
+        p_Context->Line(p_Min + wopa, p_Min + wopa + front, options);
     }
 }
 
@@ -241,19 +309,67 @@ template <Dimension D> void IVisualization<D>::RenderSettings(SimulationSettings
 
     ImGui::Spacing();
 
+    ImGui::Checkbox("Adaptive resolution", &p_Settings.AdaptiveResolution);
+    Onyx::UserLayer::HelpMarkerSameLine(
+        "Calm particles deep inside the fluid merge into heavier ones, and heavy particles near the surface or in "
+        "sheared flow split back. Mass and momentum are conserved, and detail is kept where it is visible.");
+    if (p_Settings.AdaptiveResolution)
+    {
+        const u32 one = 1;
+        const u32 maxInterval = 120;
+        const u32 maxRatio = 64;
+        ImGui::SliderScalar("Adaptation interval", ImGuiDataType_U32, &p_Settings.AdaptiveInterval, &one,
+                            &maxInterval);
+        ImGui::SliderScalar("Max mass ratio", ImGuiDataType_U32, &p_Settings.AdaptiveMaxMassRatio, &one, &maxRatio);
+        ImGui::DragFloat("Split shear", &p_Settings.AdaptiveShear, 0.01f * speed, 0.f, FLT_MAX);
+        Onyx::UserLayer::HelpMarkerSameLine("Particles split when their mean speed relative to their neighbors "
+                                            "exceeds this value, and only merge below half of it.");
+        ImGui::SliderFloat("Surface neighbor ratio", &p_Settings.AdaptiveSurfaceRatio, 0.f, 1.f);
+    }
+
+    ImGui::Spacing();
+
     ImGui::Text("Environment settings");
     ImGui::DragFloat("Gravity", &p_Settings.Gravity, speed);
     ImGui::DragFloat("Encase Friction", &p_Settings.EncaseFriction, speed);
     Onyx::UserLayer::HelpMarkerSameLine("How much are the particles slowed down when they collide with the walls.");
 
+    const char *axes[3] = {"Periodic X", "Periodic Y", "Periodic Z"};
+    for (u32 i = 0; i < D; ++i)
+    {
+        if (i != 0)
+            ImGui::SameLine();
+        ImGui::CheckboxFlags(axes[i], &p_Settings.PeriodicAxes, 1u << i);
+    }
+    Onyx::UserLayer::HelpMarkerSameLine("Particles leaving the box through a periodic axis come back from the opposite "
+                                        "side, and interact with the particles there as if the box was tiled forever.");
+
     ImGui::Spacing();
 
+    ImGui::Combo("Lookup", reinterpret_cast<i32 *>(&p_Settings.Lookup), "Grid\0Brute force\0Tree\0\0");
+    Onyx::UserLayer::HelpMarkerSameLine(
+        "How neighboring particles are found. The grid only tests particles in adjacent cells, while brute force "
+        "tests every pair. Brute force is quadratic and only meant to validate the grid on small scenes. The tree "
+        "adapts its cells to the particles, and shines when a dense pool coexists with spray spread over a huge area.");
+
+    const u32 minRatio = 1;
+    const u32 maxRatio = LookupMethod<D>::MaxCellRatio;
+    ImGui::SliderScalar("Cell ratio", ImGuiDataType_U32, &p_Settings.CellRatio, &minRatio, &maxRatio);
+    Onyx::UserLayer::HelpMarkerSameLine(
+        "How many grid cells fit in a smoothing radius. Finer cells skip more particles that are too far away to "
+        "interact, but every particle visits more cells to find its neighbors.");
+
+    ImGui::Combo("Pair schedule", reinterpret_cast<i32 *>(&p_Settings.Schedule), "Cells\0Particles\0\0");
+    Onyx::UserLayer::HelpMarkerSameLine(
+        "How the grid cells are split among worker tasks when looking for neighbors. Splitting by particles keeps "
+        "every task equally busy when dense regions coexist with sparse ones.");
+
     const u32 mn = 1;
     const u32 mx = DRIZ_MAX_TASKS + 1;
     ImGui::SliderScalar("Worker task count", ImGuiDataType_U32, &p_Settings.Partitions, &mn, &mx);
     Onyx::UserLayer::HelpMarkerSameLine(
         "The number of additional threads that will be used to compute the simulation. Try to match the number of "
-        "threads with the number of cores in your CPU.");
+        "threads with the number of cores in your CPU, or let the autotuner pick it for you.");
 }
 
 void Visualization<D2>::DrawMouseInfluence(const Onyx::Camera<D2> *p_Camera, Onyx::RenderContext<D2> *p_Context,
@@ -267,40 +383,154 @@ void Visualization<D2>::DrawMouseInfluence(const Onyx::Camera<D2> *p_Camera, Ony
     p_Context->Pop();
 }
 
+void Visualization<D2>::DrawSurface(Onyx::RenderContext<D2> *p_Context, const SurfaceExtractor<D2> &p_Surface,
+                                    const Onyx::Color &p_Color, const f32 p_Thickness)
+{
+    const SimArray<f32v2> &vertices = p_Surface.GetVertices();
+    p_Context->Push();
+    p_Context->Fill(p_Color);
+    for (u32 i = 0; i + 1 < vertices.GetSize(); i += 2)
+        p_Context->Line(vertices[i], vertices[i + 1], p_Thickness);
+    p_Context->Pop();
+}
+
+// Meshes replaced by newer geometry may still be read by frames in flight, so they are only destroyed once enough
+// frames went by. Drawing the surface once per frame is what advances the count
+static constexpr u64 s_RetiredMeshFrames = 4;
+
+struct RetiredMesh
+{
+    Onyx::Mesh<D3> Mesh;
+    u64 Frame;
+};
+
+struct SurfaceMesh
+{
+    Onyx::Mesh<D3> Mesh{};
+    u64 Version = 0;
+    u64 Frame = 0;
+    bool Created = false;
+    SimArray<RetiredMesh> Retired;
+};
+static SurfaceMesh s_SurfaceMesh{};
+
+void Visualization<D3>::DrawSurface(Onyx::RenderContext<D3> *p_Context, const SurfaceExtractor<D3> &p_Surface,
+                                    const Onyx::Color &p_Color)
+{
+    SurfaceMesh &surface = s_SurfaceMesh;
+    ++surface.Frame;
+    for (u32 i = 0; i < surface.Retired.GetSize();)
+        if (surface.Retired[i].Frame + s_RetiredMeshFrames <= surface.Frame)
+        {
+            surface.Retired[i].Mesh.Destroy();
+            surface.Retired[i] = surface.Retired[surface.Retired.GetSize() - 1];
+            surface.Retired.Resize(surface.Retired.GetSize() - 1);
+        }
+        else
+            ++i;
+
+    const SimArray<f32v3> &vertices = p_Surface.GetVertices();
+    if (!surface.Created || surface.Version != p_Surface.GetVersion())
+    {
+        if (surface.Created)
+            surface.Retired.Append(RetiredMesh{surface.Mesh, surface.Frame});
+        surface.Created = false;
+        surface.Version = p_Surface.GetVersion();
+        if (vertices.IsEmpty())
+            return;
+
+        const SimArray<f32v3> &normals = p_Surface.GetNormals();
+        Onyx::IndexVertexData<D3> data{};
+        data.Vertices.Resize(vertices.GetSize());
+        data.Indices.Resize(vertices.GetSize());
+        for (u32 i = 0; i < vertices.GetSize(); ++i)
+        {
+            data.Vertices[i] = Onyx::Vertex<D3>{.Position = vertices[i], .Normal = normals[i]};
+            data.Indices[i] = static_cast<Onyx::Index>(i);
+        }
+        surface.Mesh = Onyx::Mesh<D3>::Create(data);
+        surface.Created = true;
+    }
+    if (!surface.Created)
+        return;
+
+    p_Context->Push();
+    p_Context->Fill(p_Color);
+    p_Context->Mesh(surface.Mesh);
+    p_Context->Pop();
+}
+
+void Visualization<D3>::ReleaseSurface()
+{
+    SurfaceMesh &surface = s_SurfaceMesh;
+    if (!surface.Created && surface.Retired.IsEmpty())
+        return;
+    // Only called when the surface goes away for good, so waiting for the frames in flight is fine here
+    Onyx::Core::DeviceWaitIdle();
+    for (RetiredMesh &retired : surface.Retired)
+        retired.Mesh.Destroy();
+    surface.Retired.Clear();
+    if (surface.Created)
+        surface.Mesh.Destroy();
+    surface.Created = false;
+}
+
 void Visualization<D3>::DrawParticles(Onyx::RenderContext<D3> *p_Context, const SimulationSettings &p_Settings,
-                                      const SimulationData<D3> &p_Data, const Onyx::Color &p_OutlineHighlight,
-                                      const Onyx::Color &p_OutlinePressed)
+                                      const SimulationState<D3> &p_State, const u8 *p_MouseInfluence,
+                                      const Onyx::Color &p_OutlineHighlight, const Onyx::Color &p_OutlinePressed,
+                                      const ParticleCulling *p_Culling)
 {
-    p_Context->ShareCurrentState();
-    Core::ForEach(0, p_Data.State.Positions.GetSize(), p_Settings.Partitions,
-                  [&, p_Context](const u32 p_Start, const u32 p_End) {
-                      TKIT_PROFILE_NSCOPE("Driz::Visualization<D3>::DrawParticles");
-                      const f32 psize = 2.f * p_Settings.ParticleRadius;
-
-                      const Onyx::Gradient gradient{p_Settings.Gradient};
-                      for (u32 i = p_Start; i < p_End; ++i)
-                      {
-                          const f32v3 &pos = p_Data.State.Positions[i];
-                          const f32v3 &vel = p_Data.State.Velocities[i];
-
-                          const f32 speed = Math::Min(p_Settings.FastSpeed, Math::Norm(vel));
-                          const Onyx::Color color = gradient.Evaluate(speed / p_Settings.FastSpeed);
-
-                          p_Context->Push();
-                          if (p_Data.UnderMouseInfluence[i] == 1)
-                              p_Context->Outline(p_OutlinePressed);
-                          else if (p_Data.UnderMouseInfluence[i] == 2)
-                              p_Context->Outline(p_OutlineHighlight);
-
-                          p_Context->Fill(color);
-                          p_Context->Translate(pos);
-                          p_Context->Sphere(psize, Core::Resolution);
-
-                          p_Context->Pop();
-                      }
-                  });
+    // Mouse influence is 1 for pressed particles and 2 for highlighted ones
+    const TKit::Array<Onyx::Color, 2> outlines{p_OutlinePressed, p_OutlineHighlight};
+    GetParticleRenderer().Draw(p_Context, p_Settings, p_State, p_MouseInfluence, &outlines[0], p_Culling);
+}
+
+void TelemetryWidget(const StepTelemetry &p_Telemetry, const u32 p_Window)
+{
+    const StepSample average = p_Telemetry.GetAverage(p_Window);
+    ImGui::Text("Step: %.3f ms (%.2f M particle-steps/s)", average.StepTime,
+                1e-6f * average.GetParticleStepsPerSecond());
+    ImGui::Text("Pairs per step: %llu", static_cast<unsigned long long>(average.Pairs));
+    for (u32 i = 0; i < StepPhaseCount; ++i)
+        ImGui::BulletText("%s: %.3f ms", GetPhaseName(static_cast<StepPhase>(i)), average.PhaseTimes[i]);
+    Onyx::UserLayer::HelpMarkerSameLine(
+        "Per phase timings averaged over the last simulation steps. They are always collected, and are exported to "
+        "the file given with '--telemetry' (either .csv or .json) when the simulation ends.");
 }
 
+void LookupStatisticsWidget(const LookupStatistics &p_Statistics)
+{
+    ImGui::Text("Cells: %u (max occupancy %u)", p_Statistics.Cells, p_Statistics.MaxOccupancy);
+    TKit::Array<f32, LookupStatistics::HistogramSize> occupancy;
+    for (u32 i = 0; i < LookupStatistics::HistogramSize; ++i)
+        occupancy[i] = static_cast<f32>(p_Statistics.Occupancy[i]);
+    ImGui::PlotHistogram("Occupancy", &occupancy[0], static_cast<i32>(LookupStatistics::HistogramSize), 0,
+                         nullptr, 0.f, FLT_MAX, ImVec2{0.f, 60.f});
+    Onyx::UserLayer::HelpMarkerSameLine("Number of cells holding 1, 2, 3... particles. The last bar also counts every "
+                                        "fuller cell.");
+
+    ImGui::Text("Neighbors: %u min, %.1f mean, %u max", p_Statistics.MinNeighbors, p_Statistics.MeanNeighbors,
+                p_Statistics.MaxNeighbors);
+    ImGui::Text("Pairs: %llu accepted out of %llu candidates (%.1f%%)",
+                static_cast<unsigned long long>(p_Statistics.AcceptedPairs),
+                static_cast<unsigned long long>(p_Statistics.CandidatePairs), 100.f * p_Statistics.GetPairEfficiency());
+    ImGui::Text("Hash clashes: %u (%llu wasted pairs)", p_Statistics.Clashes,
+                static_cast<unsigned long long>(p_Statistics.ClashPairs));
+    Onyx::UserLayer::HelpMarkerSameLine(
+        "Cells are hashed to the number of particles, so different cells may share the same key. Every pair between "
+        "particles of clashing cells is tested for nothing.");
+
+    ImGui::Text("Work imbalance: %.2f", p_Statistics.GetWorkImbalance());
+    Onyx::UserLayer::HelpMarkerSameLine("Candidate pairs of the busiest partition relative to the average one. A value "
+                                        "of 1 means the work is perfectly balanced.");
+    for (u32 i = 0; i < p_Statistics.Partitions; ++i)
+        ImGui::BulletText("Partition %u: %u cells, %llu candidates", i, p_Statistics.Work[i].Cells,
+                          static_cast<unsigned long long>(p_Statistics.Work[i].Candidates));
+}
+
+template class ParticleRenderer<D2>;
+template class ParticleRenderer<D3>;
+
 template struct IVisualization<D2>;
 template struct IVisualization<D3>;
 
@@ -1,12 +1,17 @@
 #pragma once
 
 #include "driz/core/math.hpp"
+#include "driz/core/view.hpp"
 #include "onyx/rendering/render_context.hpp"
 #include "onyx/serialization/color.hpp"
 #include "onyx/app/user_layer.hpp"
 #include "driz/simulation/settings.hpp"
+#include "driz/simulation/telemetry.hpp"
+#include "driz/simulation/surface.hpp"
 #include "tkit/profiling/timespan.hpp"
 #include "tkit/serialization/yaml/driz/simulation/settings.hpp"
+#include "tkit/serialization/yaml/driz/simulation/material.hpp"
+#include "tkit/serialization/yaml/driz/simulation/flow.hpp"
 #include "tkit/serialization/yaml/driz/simulation/kernel.hpp"
 #include "tkit/serialization/yaml/container.hpp"
 #include <imgui.h>
@@ -14,20 +19,64 @@
 namespace Driz
 {
 struct SimulationSettings;
+
+// Speed to color lookup table. It is indexed by the squared normalized speed, so particles need no square root
+class SpeedColorTable
+{
+  public:
+    static constexpr u32 Size = 1024;
+
+    void Build(const SimulationSettings &p_Settings);
+
+    const Onyx::Color &Evaluate(const f32 p_SpeedSquared) const
+    {
+        const f32 t = Math::Min(p_SpeedSquared * m_Scale, 1.f);
+        return m_Colors[static_cast<u32>(t * (Size - 1))];
+    }
+
+  private:
+    TKit::Array<Onyx::Color, Size> m_Colors;
+    f32 m_Scale = 1.f;
+};
+
+// Particles are drawn in parallel straight from the state arrays, each from a pushed state placed at its absolute
+// position. Onyx has no instanced submission, so every particle still goes through the render context on its own
+template <Dimension D> class ParticleRenderer
+{
+  public:
+    // Outlines hold 0 for no outline, otherwise an index + 1 into the outline colors
+    void Draw(Onyx::RenderContext<D> *p_Context, const SimulationSettings &p_Settings,
+              const SimulationState<D> &p_State, const u8 *p_Outlines = nullptr,
+              const Onyx::Color *p_OutlineColors = nullptr, const ParticleCulling *p_Culling = nullptr);
+
+    // Particles that survived culling in the last draw
+    u32 GetDrawnCount() const;
+
+  private:
+    SpeedColorTable m_Colors;
+    u32 m_Drawn = 0;
+};
+
 template <Dimension D> struct IVisualization
 {
     static void AdjustRenderContext(Onyx::RenderContext<D> *p_Context);
 
     static void DrawParticles(Onyx::RenderContext<D> *p_Context, const SimulationSettings &p_Settings,
-                              const SimulationState<D> &p_State);
+                              const SimulationState<D> &p_State, const ParticleCulling *p_Culling = nullptr);
 
     static void DrawBoundingBox(Onyx::RenderContext<D> *p_Context, const f32v<D> &p_Min, const f32v<D> &p_Max,
                                 const Onyx::Color &p_Color);
 
-    static void DrawCell(Onyx::RenderContext<D> *p_Context, const i32v<D> &p_Position, f32 p_Size,
+    // Cells are given by their lower corner and size in simulation space
+    static void DrawCell(Onyx::RenderContext<D> *p_Context, const f32v<D> &p_Min, const f32v<D> &p_Size,
                          const Onyx::Color &p_Color, f32 p_Thickness = 0.1f);
 
     static void RenderSettings(SimulationSettings &p_Settings);
+
+    static ParticleRenderer<D> &GetParticleRenderer();
+
+    // Corners of the screen are unprojected with the current axes of the context, so the volume is in simulation space
+    static ViewVolume<D> GetViewVolume(const Onyx::Camera<D> *p_Camera, const Onyx::RenderContext<D> *p_Context);
 };
 
 template <Dimension D> struct Visualization;
@@ -36,6 +85,10 @@ template <> struct Visualization<D2> : IVisualization<D2>
 {
     static void DrawMouseInfluence(const Onyx::Camera<D2> *p_Camera, Onyx::RenderContext<D2> *p_Context, f32 p_Size,
                                    const Onyx::Color &p_Color);
+
+    // The contour is drawn as a set of thick segments
+    static void DrawSurface(Onyx::RenderContext<D2> *p_Context, const SurfaceExtractor<D2> &p_Surface,
+                            const Onyx::Color &p_Color, f32 p_Thickness);
 };
 
 template <> struct Visualization<D3> : IVisualization<D3>
@@ -43,11 +96,23 @@ template <> struct Visualization<D3> : IVisualization<D3>
     using IVisualization<D3>::DrawParticles;
 
     static void DrawParticles(Onyx::RenderContext<D3> *p_Context, const SimulationSettings &p_Settings,
-                              const SimulationData<D3> &p_Data, const Onyx::Color &p_OutlineHover,
-                              const Onyx::Color &p_OutlinePressed);
+                              const SimulationState<D3> &p_State, const u8 *p_MouseInfluence,
+                              const Onyx::Color &p_OutlineHover, const Onyx::Color &p_OutlinePressed,
+                              const ParticleCulling *p_Culling = nullptr);
+
+    // The surface is uploaded to a device mesh that is only rebuilt when its geometry changes. Replaced meshes are
+    // destroyed a few frames later instead of stalling the device, and everything must be released before the render
+    // context goes away
+    static void DrawSurface(Onyx::RenderContext<D3> *p_Context, const SurfaceExtractor<D3> &p_Surface,
+                            const Onyx::Color &p_Color);
+    static void ReleaseSurface();
 };
 
-template <typename T> void ExportWidget(const char *p_Name, const fs::path &p_DirPath, const T &p_Instance)
+void TelemetryWidget(const StepTelemetry &p_Telemetry, u32 p_Window = 60);
+void LookupStatisticsWidget(const LookupStatistics &p_Statistics);
+
+// The instance is only fetched once a file name is entered
+template <typename F> void ExportWidgetWith(const char *p_Name, const fs::path &p_DirPath, F &&p_GetInstance)
 {
     static char xport[64] = {0};
     if (ImGui::InputTextWithHint(p_Name, "Filename", xport, 64, ImGuiInputTextFlags_EnterReturnsTrue))
@@ -56,15 +121,22 @@ template <typename T> void ExportWidget(const char *p_Name, const fs::path &p_Di
         if (path.extension().empty())
             path += ".yaml";
 
-        TKit::Yaml::Serialize(path.string(), p_Instance);
+        TKit::Yaml::Serialize(path.string(), p_GetInstance());
         xport[0] = '\0';
     }
     Onyx::UserLayer::HelpMarkerSameLine("The file will be saved as a .yaml file. You do not need to include the "
                                         "extension, nor a complete path. A file name is enough.");
 }
 
-template <typename T> void ImportWidget(const char *p_Name, const fs::path &p_DirPath, T &p_Instance)
+template <typename T> void ExportWidget(const char *p_Name, const fs::path &p_DirPath, const T &p_Instance)
+{
+    ExportWidgetWith(p_Name, p_DirPath, [&p_Instance]() -> const T & { return p_Instance; });
+}
+
+// Returns true if the instance was replaced by an imported one
+template <typename T> bool ImportWidget(const char *p_Name, const fs::path &p_DirPath, T &p_Instance)
 {
+    bool imported = false;
     TKit::StaticArray32<fs::path> paths;
     for (const auto &entry : fs::directory_iterator(p_DirPath))
         paths.Append(entry.path());
@@ -78,13 +150,17 @@ template <typename T> void ImportWidget(const char *p_Name, const fs::path &p_Di
             const bool erase = ImGui::Button("X");
             ImGui::SameLine();
             if (ImGui::MenuItem(filename.c_str()))
+            {
                 p_Instance = TKit::Yaml::Deserialize<T>(path.string());
+                imported = true;
+            }
 
             if (erase)
                 fs::remove(path);
         }
         ImGui::EndMenu();
     }
+    return imported;
 }
 
 } // namespace Driz
@@ -0,0 +1,417 @@
+#include "driz/bench/bench.hpp"
+#include "tkit/profiling/clock.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace Driz
+{
+static constexpr f32 s_Radius = 1.f;
+static constexpr f32 s_DeltaTime = 1.f / 60.f;
+
+using KernelFunction = f32 (*)(f32, f32);
+
+static const char *getKernelName(const KernelType p_Kernel)
+{
+    switch (p_Kernel)
+    {
+    case KernelType::Spiky2:
+        return "Spiky2";
+    case KernelType::Spiky3:
+        return "Spiky3";
+    case KernelType::Spiky5:
+        return "Spiky5";
+    case KernelType::Poly6:
+        return "Poly6";
+    case KernelType::CubicSpline:
+        return "CubicSpline";
+    case KernelType::WendlandC2:
+        return "WendlandC2";
+    case KernelType::WendlandC4:
+        return "WendlandC4";
+    }
+    return "Unknown";
+}
+
+template <Dimension D> static TKit::Array<KernelFunction, 2> getKernelFunctions(const KernelType p_Kernel)
+{
+    switch (p_Kernel)
+    {
+    case KernelType::Spiky2:
+        return {Kernel<D>::Spiky2, Kernel<D>::Spiky2Slope};
+    case KernelType::Spiky3:
+        return {Kernel<D>::Spiky3, Kernel<D>::Spiky3Slope};
+    case KernelType::Spiky5:
+        return {Kernel<D>::Spiky5, Kernel<D>::Spiky5Slope};
+    case KernelType::Poly6:
+        return {Kernel<D>::Poly6, Kernel<D>::Poly6Slope};
+    case KernelType::CubicSpline:
+        return {Kernel<D>::CubicSpline, Kernel<D>::CubicSplineSlope};
+    case KernelType::WendlandC2:
+        return {Kernel<D>::WendlandC2, Kernel<D>::WendlandC2Slope};
+    case KernelType::WendlandC4:
+        return {Kernel<D>::WendlandC4, Kernel<D>::WendlandC4Slope};
+    }
+    return {Kernel<D>::Spiky3, Kernel<D>::Spiky3Slope};
+}
+
+template <typename F> static f32 time(F &&p_Function)
+{
+    TKit::Clock clock{};
+    p_Function();
+    return static_cast<f32>(clock.GetElapsed().AsMilliseconds());
+}
+
+BenchStatistics ComputeStatistics(TKit::DynamicArray<f32> &p_Samples)
+{
+    BenchStatistics stats{};
+    const u32 size = p_Samples.GetSize();
+    if (size == 0)
+        return stats;
+
+    std::sort(p_Samples.begin(), p_Samples.end());
+    stats.Samples = size;
+    stats.Min = p_Samples[0];
+    stats.Max = p_Samples[size - 1];
+    stats.Median = size % 2 == 1 ? p_Samples[size / 2] : 0.5f * (p_Samples[size / 2 - 1] + p_Samples[size / 2]);
+
+    f64 sum = 0.0;
+    for (const f32 sample : p_Samples)
+        sum += sample;
+    const f64 mean = sum / size;
+
+    f64 variance = 0.0;
+    for (const f32 sample : p_Samples)
+        variance += (sample - mean) * (sample - mean);
+
+    stats.Mean = static_cast<f32>(mean);
+    stats.Variance = size > 1 ? static_cast<f32>(variance / (size - 1)) : 0.f;
+    return stats;
+}
+
+template <Dimension D> SimulationState<D> CreateBenchState(const u32 p_Particles, const f32 p_Spacing, const u32 p_Seed)
+{
+    const u32 side = static_cast<u32>(std::ceil(std::pow(static_cast<f64>(p_Particles), 1.0 / D)));
+    const f32 half = 0.5f * p_Spacing * side;
+
+    SimulationState<D> state{};
+    const f32v<D> min{-half};
+    const f32v<D> max{half};
+    Scene<D>::Fill(
+        state, [](const f32v<D> &) { return -1.f; }, min, max, ScenePattern::JitteredLattice, p_Spacing, 0.25f, p_Seed,
+        DRIZ_MAX_THREADS);
+
+    if (state.Positions.GetSize() > p_Particles)
+    {
+        state.Positions.Resize(p_Particles);
+        state.Velocities.Resize(p_Particles);
+    }
+
+    // Leave room for the fluid to spread so that the encasing does not dominate the solver steps
+    state.Min = f32v<D>{-1.5f * half - 2.f * s_Radius};
+    state.Max = f32v<D>{1.5f * half + 2.f * s_Radius};
+    return state;
+}
+
+template <Dimension D>
+SimulationState<D> CreateSparseBenchState(const u32 p_Particles, const f32 p_SprayRatio, const u32 p_Seed)
+{
+    const u32 spray = static_cast<u32>(p_SprayRatio * static_cast<f32>(p_Particles));
+    SimulationState<D> state = CreateBenchState<D>(p_Particles - spray, 0.4f, p_Seed);
+
+    const f32 extent = 200.f * (state.Max[0] - state.Min[0]);
+    for (u32 i = 0; i < spray; ++i)
+    {
+        f32v<D> position;
+        for (u32 j = 0; j < D; ++j)
+            position[j] = extent * (Scene<D>::Random(p_Seed, i, j) - 0.5f);
+        state.Positions.Append(position);
+        state.Velocities.Append(f32v<D>{0.f});
+    }
+    state.Min = f32v<D>{-0.5f * extent - 2.f * s_Radius};
+    state.Max = f32v<D>{0.5f * extent + 2.f * s_Radius};
+    return state;
+}
+
+template <Dimension D> class Benchmarker
+{
+  public:
+    Benchmarker(const BenchSpecs &p_Specs, TKit::DynamicArray<BenchResult> &p_Results)
+        : m_Specs(p_Specs), m_Results(p_Results)
+    {
+    }
+
+    void Run(const u32 p_Particles)
+    {
+        const SimulationState<D> state = CreateBenchState<D>(p_Particles);
+        const u32 size = state.Positions.GetSize();
+
+        benchRadixSort<RadixSort::Base8>("radix_sort/base8", size);
+        benchRadixSort<RadixSort::Base16>("radix_sort/base16", size);
+        benchLookup(state);
+        benchKernels(size);
+        benchSolver(state);
+
+        // Where hashed grids suffer the most, and what the tree lookup is meant for
+        const SimulationState<D> sparse = CreateSparseBenchState<D>(p_Particles);
+        benchLookup(sparse, "sparse/");
+    }
+
+  private:
+    struct alignas(64) PairCounter
+    {
+        u64 Count = 0;
+    };
+
+    bool isEnabled(const std::string &p_Name) const
+    {
+        return m_Specs.Filter.empty() || p_Name.find(m_Specs.Filter) != std::string::npos;
+    }
+
+    template <typename F>
+    void record(const std::string &p_Name, const char *p_Kernel, const char *p_Lookup, const u32 p_Particles,
+                const u32 p_Partitions, F &&p_Function, const u32 p_CellRatio = 1)
+    {
+        BenchResult result{};
+        result.Name = p_Name;
+        result.Kernel = p_Kernel;
+        result.Lookup = p_Lookup;
+        result.Dim = D;
+        result.Particles = p_Particles;
+        result.Partitions = p_Partitions;
+        result.CellRatio = p_CellRatio;
+        result.Statistics = Measure(m_Specs.Repetitions, m_Specs.Warmup, std::forward<F>(p_Function));
+
+        if (m_Specs.Verbose)
+            std::cout << TKit::Format("{}D {:<28} {:<12} N={:<9} P={:<3} K={} median={:.3f} ms var={:.4f}\n",
+                                      static_cast<u32>(D), p_Name, p_Kernel, p_Particles, p_Partitions, p_CellRatio,
+                                      result.Statistics.Median, result.Statistics.Variance);
+        m_Results.Append(result);
+    }
+
+    template <RadixSort Base> void benchRadixSort(const char *p_Name, const u32 p_Particles)
+    {
+        if (!isEnabled(p_Name))
+            return;
+
+        SimArray<IndexPair> source;
+        SimArray<IndexPair> keys;
+        SimArray<IndexPair> scratch;
+        source.Resize(p_Particles);
+        keys.Resize(p_Particles);
+        scratch.Resize(p_Particles);
+        for (u32 i = 0; i < p_Particles; ++i)
+            source[i] = IndexPair{i, (i * 2654435761u) % p_Particles};
+
+        record(p_Name, "-", "Grid", p_Particles, 1, [&] {
+            std::copy(source.begin(), source.end(), keys.begin());
+            return time([&] { RadixSortKeys<Base>(keys.GetData(), scratch.GetData(), p_Particles); });
+        });
+    }
+
+    bool isLookupEnabled(const LookupMode p_Mode, const u32 p_Particles) const
+    {
+        return p_Mode != LookupMode::BruteForce || p_Particles <= m_Specs.MaxBruteForceParticles;
+    }
+
+    // Only the grid cares about the cell ratio, so every other lookup runs once
+    TKit::DynamicArray<u32> getCellRatios(const LookupMode p_Mode) const
+    {
+        TKit::DynamicArray<u32> ratios;
+        if (p_Mode == LookupMode::Grid && !m_Specs.CellRatios.IsEmpty())
+            ratios = m_Specs.CellRatios;
+        else
+            ratios.Append(1);
+        return ratios;
+    }
+
+    void benchLookup(const SimulationState<D> &p_State, const std::string &p_Prefix = "")
+    {
+        const std::string update = p_Prefix + "update_lookup";
+        const std::string traverse = p_Prefix + "for_each_pair";
+        const u32 size = p_State.Positions.GetSize();
+        LookupMethod<D> lookup{};
+        lookup.SetPositions(&p_State.Positions);
+
+        for (const LookupMode mode : m_Specs.Lookups)
+        {
+            if (!isLookupEnabled(mode, size))
+                continue;
+            const char *lname = GetLookupModeName(mode);
+            for (const u32 ratio : getCellRatios(mode))
+                for (const u32 partitions : m_Specs.Partitions)
+                {
+                    lookup.SetCellRatio(ratio);
+                    if (isEnabled(update))
+                        record(
+                            update, "-", lname, size, partitions,
+                            [&] { return time([&] { lookup.Update(mode, s_Radius, partitions); }); }, ratio);
+
+                    if (isEnabled(traverse))
+                    {
+                        lookup.Update(mode, s_Radius, partitions);
+                        TKit::Array<PairCounter, DRIZ_MAX_THREADS> counts{};
+                        record(
+                            traverse, "-", lname, size, partitions,
+                            [&] {
+                                return time([&] {
+                                    lookup.ForEachPair(
+                                        [&counts](const u32, const u32, const f32, const u32 p_ThreadIndex) {
+                                            ++counts[p_ThreadIndex].Count;
+                                        },
+                                        partitions);
+                                });
+                            },
+                            ratio);
+                    }
+                }
+        }
+    }
+
+    void benchKernels(const u32 p_Particles)
+    {
+        SimArray<f32> distances;
+        distances.Resize(p_Particles);
+        for (u32 i = 0; i < p_Particles; ++i)
+            distances[i] = s_Radius * Scene<D>::Random(0, i, 0);
+
+        for (const KernelType kernel : m_Specs.Kernels)
+        {
+            const TKit::Array<KernelFunction, 2> functions = getKernelFunctions<D>(kernel);
+            const char *kname = getKernelName(kernel);
+            for (u32 i = 0; i < 2; ++i)
+            {
+                const std::string name = i == 0 ? "kernel/value" : "kernel/slope";
+                if (!isEnabled(name))
+                    continue;
+
+                // The sum is kept alive so that the kernel calls are not optimized away
+                volatile f32 sink = 0.f;
+                const KernelFunction function = functions[i];
+                record(name, kname, "-", p_Particles, 1, [&] {
+                    return time([&] {
+                        f32 sum = 0.f;
+                        for (const f32 distance : distances)
+                            sum += function(s_Radius, distance);
+                        sink = sum;
+                    });
+                });
+            }
+        }
+    }
+
+    void benchSolver(const SimulationState<D> &p_State)
+    {
+        if (!isEnabled("solver_step"))
+            return;
+
+        const u32 size = p_State.Positions.GetSize();
+        const u32 maxPartitions = *std::max_element(m_Specs.Partitions.begin(), m_Specs.Partitions.end());
+        const KernelType defaultKernel = SimulationSettings{}.KType;
+
+        const auto benchStep = [&](const KernelType p_Kernel, const LookupMode p_Lookup, const u32 p_Partitions,
+                                   const u32 p_CellRatio) {
+            SimulationSettings settings{};
+            settings.SmoothingRadius = s_Radius;
+            settings.KType = p_Kernel;
+            settings.Lookup = p_Lookup;
+            settings.CellRatio = p_CellRatio;
+            settings.Partitions = p_Partitions;
+
+            Solver<D> solver{settings, p_State};
+            record(
+                "solver_step", getKernelName(p_Kernel), GetLookupModeName(p_Lookup), size, p_Partitions,
+                [&] { return time([&] { solver.Step(s_DeltaTime); }); }, p_CellRatio);
+        };
+
+        for (const LookupMode lookup : m_Specs.Lookups)
+            if (isLookupEnabled(lookup, size))
+                for (const u32 ratio : getCellRatios(lookup))
+                    for (const u32 partitions : m_Specs.Partitions)
+                        benchStep(defaultKernel, lookup, partitions, ratio);
+
+        // The kernel sweep is only run at full parallelism and with the grid, it is there to compare kernels, not to
+        // measure scaling
+        for (const KernelType kernel : m_Specs.Kernels)
+            if (kernel != defaultKernel)
+                benchStep(kernel, LookupMode::Grid, maxPartitions, 1);
+    }
+
+    const BenchSpecs &m_Specs;
+    TKit::DynamicArray<BenchResult> &m_Results;
+};
+
+TKit::DynamicArray<BenchResult> RunBenchmarks(const BenchSpecs &p_Specs)
+{
+    TKit::DynamicArray<BenchResult> results;
+    for (const Dimension dim : p_Specs.Dims)
+        for (const u32 particles : p_Specs.ParticleCounts)
+        {
+            if (dim == D2)
+                Benchmarker<D2>{p_Specs, results}.Run(particles);
+            else
+                Benchmarker<D3>{p_Specs, results}.Run(particles);
+        }
+
+    ComputeEfficiencies(results);
+    return results;
+}
+
+void ComputeEfficiencies(TKit::DynamicArray<BenchResult> &p_Results)
+{
+    for (BenchResult &result : p_Results)
+    {
+        result.Efficiency = 1.f;
+        for (const BenchResult &serial : p_Results)
+            if (serial.Partitions == 1 && serial.Name == result.Name && serial.Kernel == result.Kernel &&
+                serial.Lookup == result.Lookup && serial.CellRatio == result.CellRatio && serial.Dim == result.Dim &&
+                serial.Particles == result.Particles)
+            {
+                const f32 parallel = result.Partitions * result.Statistics.Median;
+                result.Efficiency = parallel > 0.f ? serial.Statistics.Median / parallel : 0.f;
+                break;
+            }
+    }
+}
+
+bool WriteCsv(std::ostream &p_Stream, const TKit::DynamicArray<BenchResult> &p_Results)
+{
+    p_Stream << "name,kernel,lookup,cell_ratio,dim,particles,partitions,samples,median_ms,mean_ms,variance_ms2,min_ms,"
+                "max_ms,efficiency\n";
+    for (const BenchResult &result : p_Results)
+    {
+        const BenchStatistics &stats = result.Statistics;
+        p_Stream << result.Name << ',' << result.Kernel << ',' << result.Lookup << ',' << result.CellRatio << ','
+                 << result.Dim << ','
+                 << result.Particles << ',' << result.Partitions << ',' << stats.Samples << ',' << stats.Median << ','
+                 << stats.Mean << ',' << stats.Variance << ',' << stats.Min << ',' << stats.Max << ','
+                 << result.Efficiency << '\n';
+    }
+    return static_cast<bool>(p_Stream);
+}
+
+bool WriteJson(std::ostream &p_Stream, const TKit::DynamicArray<BenchResult> &p_Results)
+{
+    p_Stream << "{\n  \"results\": [";
+    for (u32 i = 0; i < p_Results.GetSize(); ++i)
+    {
+        const BenchResult &result = p_Results[i];
+        const BenchStatistics &stats = result.Statistics;
+        p_Stream << (i == 0 ? "\n    " : ",\n    ") << "{\"name\": \"" << result.Name << "\", \"kernel\": \""
+                 << result.Kernel << "\", \"lookup\": \"" << result.Lookup << "\", \"cell_ratio\": " << result.CellRatio
+                 << ", \"dim\": " << result.Dim
+                 << ", \"particles\": " << result.Particles << ", \"partitions\": " << result.Partitions
+                 << ", \"samples\": " << stats.Samples << ", \"median_ms\": " << stats.Median
+                 << ", \"mean_ms\": " << stats.Mean << ", \"variance_ms2\": " << stats.Variance
+                 << ", \"min_ms\": " << stats.Min << ", \"max_ms\": " << stats.Max
+                 << ", \"efficiency\": " << result.Efficiency << '}';
+    }
+    p_Stream << "\n  ]\n}\n";
+    return static_cast<bool>(p_Stream);
+}
+
+template SimulationState<D2> CreateBenchState<D2>(u32, f32, u32);
+template SimulationState<D3> CreateBenchState<D3>(u32, f32, u32);
+template SimulationState<D2> CreateSparseBenchState<D2>(u32, f32, u32);
+template SimulationState<D3> CreateSparseBenchState<D3>(u32, f32, u32);
+} // namespace Driz
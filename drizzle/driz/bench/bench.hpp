@@ -0,0 +1,76 @@
+#pragma once
+
+#include "driz/simulation/solver.hpp"
+#include "driz/simulation/scene.hpp"
+#include <ostream>
+#include <string>
+
+namespace Driz
+{
+struct BenchStatistics
+{
+    f32 Median = 0.f; // Milliseconds
+    f32 Mean = 0.f;
+    f32 Variance = 0.f;
+    f32 Min = 0.f;
+    f32 Max = 0.f;
+    u32 Samples = 0;
+};
+
+struct BenchResult
+{
+    std::string Name;
+    std::string Kernel;
+    std::string Lookup;
+    u32 Dim;
+    u32 Particles;
+    u32 Partitions;
+    u32 CellRatio = 1; // Only meaningful for the grid lookup
+    BenchStatistics Statistics;
+    f32 Efficiency = 1.f; // Scaling efficiency against the single partition run of the same configuration
+};
+
+struct BenchSpecs
+{
+    TKit::DynamicArray<u32> ParticleCounts;
+    TKit::DynamicArray<u32> Partitions;
+    TKit::DynamicArray<KernelType> Kernels;
+    TKit::DynamicArray<Dimension> Dims;
+    TKit::DynamicArray<LookupMode> Lookups;
+    TKit::DynamicArray<u32> CellRatios; // Grid cells per smoothing radius
+    std::string Filter;
+    // Quadratic lookups are skipped past this particle count, as they would take forever
+    u32 MaxBruteForceParticles = 32768;
+    u32 Repetitions = 10;
+    u32 Warmup = 2;
+    bool Verbose = false;
+};
+
+BenchStatistics ComputeStatistics(TKit::DynamicArray<f32> &p_Samples);
+
+// The callable must run one repetition and return its duration in milliseconds, so that per repetition setup can be
+// left out of the measurement
+template <typename F> BenchStatistics Measure(const u32 p_Repetitions, const u32 p_Warmup, F &&p_Function)
+{
+    for (u32 i = 0; i < p_Warmup; ++i)
+        p_Function();
+
+    TKit::DynamicArray<f32> samples;
+    samples.Reserve(p_Repetitions);
+    for (u32 i = 0; i < p_Repetitions; ++i)
+        samples.Append(p_Function());
+    return ComputeStatistics(samples);
+}
+
+// A jittered lattice with a fixed seed, so that every run benchmarks the exact same particle distribution
+template <Dimension D> SimulationState<D> CreateBenchState(u32 p_Particles, f32 p_Spacing = 0.4f, u32 p_Seed = 7);
+// The same lattice, with a share of the particles taken out as spray scattered over a box hundreds of times wider
+template <Dimension D>
+SimulationState<D> CreateSparseBenchState(u32 p_Particles, f32 p_SprayRatio = 0.1f, u32 p_Seed = 7);
+
+TKit::DynamicArray<BenchResult> RunBenchmarks(const BenchSpecs &p_Specs);
+void ComputeEfficiencies(TKit::DynamicArray<BenchResult> &p_Results);
+
+bool WriteCsv(std::ostream &p_Stream, const TKit::DynamicArray<BenchResult> &p_Results);
+bool WriteJson(std::ostream &p_Stream, const TKit::DynamicArray<BenchResult> &p_Results);
+} // namespace Driz
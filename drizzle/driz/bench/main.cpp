@@ -0,0 +1,238 @@
+#include "driz/bench/bench.hpp"
+#include "driz/bench/regression.hpp"
+#include "driz/bench/validate.hpp"
+#include "tkit/reflection/driz/simulation/kernel.hpp"
+#include "tkit/reflection/driz/simulation/settings.hpp"
+#include <argparse/argparse.hpp>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <optional>
+
+namespace Driz
+{
+static BenchSpecs parseSpecs(int argc, char **argv, std::string &p_Output, std::string &p_Format,
+                             std::optional<RegressionSpecs> &p_Regression,
+                             std::optional<ValidationSpecs> &p_Validation)
+{
+    argparse::ArgumentParser parser{"drizzle-bench", DRIZ_VERSION, argparse::default_arguments::all};
+    parser.add_description("Microbenchmarks for the Drizzle simulation core. Every timed section is repeated after a "
+                           "few warmup runs, and its median, mean and variance are reported together with the "
+                           "scaling efficiency against the single partition run of the same configuration.");
+
+    parser.add_argument("--min-particles").scan<'u', u32>().default_value(1000u).help("Smallest particle count.");
+    parser.add_argument("--max-particles")
+        .scan<'u', u32>()
+        .default_value(4194304u)
+        .help("Largest particle count. Counts grow geometrically from the smallest one.");
+    parser.add_argument("--growth").scan<'u', u32>().default_value(4u).help("Growth factor between particle counts.");
+    parser.add_argument("--partitions")
+        .nargs(argparse::nargs_pattern::at_least_one)
+        .scan<'u', u32>()
+        .help("Partition counts to sweep. Defaults to powers of two up to the maximum thread count.");
+    parser.add_argument("--kernels")
+        .nargs(argparse::nargs_pattern::at_least_one)
+        .help("Kernel types to benchmark. Defaults to all of them.");
+    parser.add_argument("--lookups")
+        .nargs(argparse::nargs_pattern::at_least_one)
+        .help("Lookup modes to benchmark. Defaults to all of them.");
+    parser.add_argument("--cell-ratios")
+        .nargs(argparse::nargs_pattern::at_least_one)
+        .scan<'u', u32>()
+        .help("Grid cells per smoothing radius to sweep with the grid lookup. Defaults to every supported ratio.");
+    parser.add_argument("--max-brute-force")
+        .scan<'u', u32>()
+        .default_value(32768u)
+        .help("Largest particle count the brute force lookup is benchmarked with.");
+    parser.add_argument("--2-dim").flag().help("Only benchmark 2D simulations.");
+    parser.add_argument("--3-dim").flag().help("Only benchmark 3D simulations.");
+    parser.add_argument("-r", "--repetitions")
+        .scan<'u', u32>()
+        .default_value(10u)
+        .help("Measured repetitions per benchmark.");
+    parser.add_argument("-w", "--warmup").scan<'u', u32>().default_value(2u).help("Unmeasured warmup repetitions.");
+    parser.add_argument("-f", "--filter").help("Only run benchmarks whose name contains this string.");
+    parser.add_argument("-o", "--output").help("A path where results will be written. Defaults to stdout.");
+    parser.add_argument("--format")
+        .default_value(std::string{"csv"})
+        .choices("csv", "json")
+        .help("Output format. When an output path is given, its extension takes precedence.");
+    parser.add_argument("-v", "--verbose").flag().help("Print every result as soon as it is measured.");
+
+    parser.add_argument("--regression")
+        .flag()
+        .help("Run the reference scenes instead of the microbenchmarks, and compare their throughput and physical "
+              "invariants against the stored baselines. The exit code is non-zero if any scene regressed.");
+    parser.add_argument("--regression-dir")
+        .default_value((fs::path(DRIZ_ROOT_PATH) / "regression").string())
+        .help("The directory holding the reference scenes.");
+    parser.add_argument("--update-baselines")
+        .flag()
+        .help("Record the measured values of the reference scenes as their new baselines.");
+    parser.add_argument("--update-invariants")
+        .flag()
+        .help("Record only the physical invariants of the reference scenes as their new baselines, leaving the "
+              "machine specific throughput untouched.");
+
+    parser.add_argument("--validate")
+        .flag()
+        .help("Check the grid and tree lookups against the brute force one on a set of adversarial scenes instead of "
+              "running the microbenchmarks. All of them must find the same neighbor pairs and produce the same "
+              "densities and forces. The exit code is non-zero if any scene fails.");
+    parser.add_argument("--tolerance")
+        .scan<'g', f32>()
+        .default_value(1e-4f)
+        .help("Relative tolerance used when validating densities and forces.");
+
+    parser.parse_args(argc, argv);
+
+    BenchSpecs specs{};
+    const u32 minParticles = parser.get<u32>("--min-particles");
+    const u32 maxParticles = parser.get<u32>("--max-particles");
+    const u32 growth = std::max(parser.get<u32>("--growth"), 2u);
+    for (u64 count = minParticles; count <= maxParticles; count *= growth)
+        specs.ParticleCounts.Append(static_cast<u32>(count));
+
+    if (const auto partitions = parser.present<std::vector<u32>>("--partitions"))
+    {
+        for (const u32 p : *partitions)
+            specs.Partitions.Append(std::clamp(p, 1u, static_cast<u32>(DRIZ_MAX_THREADS)));
+    }
+    else
+    {
+        for (u32 p = 1; p < DRIZ_MAX_THREADS; p *= 2)
+            specs.Partitions.Append(p);
+        specs.Partitions.Append(DRIZ_MAX_THREADS);
+    }
+
+    if (const auto kernels = parser.present<std::vector<std::string>>("--kernels"))
+    {
+        for (const std::string &kernel : *kernels)
+            specs.Kernels.Append(TKit::Reflect<KernelType>::FromString(kernel));
+    }
+    else
+        for (u32 i = 0; i <= static_cast<u32>(KernelType::WendlandC4); ++i)
+            specs.Kernels.Append(static_cast<KernelType>(i));
+
+    if (const auto lookups = parser.present<std::vector<std::string>>("--lookups"))
+    {
+        for (const std::string &lookup : *lookups)
+            specs.Lookups.Append(TKit::Reflect<LookupMode>::FromString(lookup));
+    }
+    else
+        for (u32 i = 0; i <= static_cast<u32>(LookupMode::Tree); ++i)
+            specs.Lookups.Append(static_cast<LookupMode>(i));
+    specs.MaxBruteForceParticles = parser.get<u32>("--max-brute-force");
+
+    if (const auto ratios = parser.present<std::vector<u32>>("--cell-ratios"))
+    {
+        for (const u32 ratio : *ratios)
+            specs.CellRatios.Append(std::clamp(ratio, 1u, LookupMethod<D2>::MaxCellRatio));
+    }
+    else
+        for (u32 ratio = 1; ratio <= LookupMethod<D2>::MaxCellRatio; ++ratio)
+            specs.CellRatios.Append(ratio);
+
+    const bool only2 = parser.get<bool>("--2-dim");
+    const bool only3 = parser.get<bool>("--3-dim");
+    if (only2 || !only3)
+        specs.Dims.Append(D2);
+    if (only3 || !only2)
+        specs.Dims.Append(D3);
+
+    specs.Repetitions = parser.get<u32>("--repetitions");
+    specs.Warmup = parser.get<u32>("--warmup");
+    specs.Verbose = parser.get<bool>("--verbose");
+    if (const auto filter = parser.present("--filter"))
+        specs.Filter = *filter;
+
+    const bool updateInvariants = parser.get<bool>("--update-invariants");
+    if (parser.get<bool>("--regression") || parser.get<bool>("--update-baselines") || updateInvariants)
+    {
+        RegressionSpecs regression{};
+        regression.Directory = parser.get<std::string>("--regression-dir");
+        regression.Filter = specs.Filter;
+        regression.UpdateBaselines = parser.get<bool>("--update-baselines") || updateInvariants;
+        regression.InvariantsOnly = updateInvariants;
+        p_Regression = regression;
+    }
+
+    if (parser.get<bool>("--validate"))
+    {
+        ValidationSpecs validation{};
+        validation.Filter = specs.Filter;
+        validation.RelativeTolerance = parser.get<f32>("--tolerance");
+        p_Validation = validation;
+    }
+
+    p_Format = parser.get<std::string>("--format");
+    if (const auto output = parser.present("--output"))
+    {
+        p_Output = *output;
+        const fs::path extension = fs::path{p_Output}.extension();
+        if (extension == ".json")
+            p_Format = "json";
+        else if (extension == ".csv")
+            p_Format = "csv";
+    }
+    return specs;
+}
+} // namespace Driz
+
+int main(int argc, char **argv)
+{
+    TKIT_PROFILE_NOOP();
+    std::string output;
+    std::string format;
+    std::optional<Driz::RegressionSpecs> regression;
+    std::optional<Driz::ValidationSpecs> validation;
+    const Driz::BenchSpecs specs = Driz::parseSpecs(argc, argv, output, format, regression, validation);
+
+    if (validation)
+    {
+        // Ranks are forked before any thread exists, and only the first one goes on to the local scenes
+        Driz::DistributedSpecs distributed{};
+        distributed.Ranks = validation->Ranks;
+        const bool ranked = Driz::IsDistributedValidationEnabled(*validation);
+        const Driz::u32 rank = ranked ? Driz::SpawnRanks(distributed) : 0;
+        if (rank == Driz::Transport::NoRank)
+            return EXIT_FAILURE;
+
+        Driz::Core::Initialize(true);
+        bool passed = !ranked || Driz::RunDistributedValidation(distributed, rank);
+        if (rank == 0)
+            passed = Driz::RunValidation(*validation) && passed;
+        Driz::Core::Terminate();
+        if (rank != 0)
+            return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+        if (ranked)
+            passed = Driz::WaitForRanks(distributed) && passed;
+        return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    Driz::Core::Initialize(true);
+    if (regression)
+    {
+        const bool passed = Driz::RunRegression(*regression);
+        Driz::Core::Terminate();
+        return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    const TKit::DynamicArray<Driz::BenchResult> results = Driz::RunBenchmarks(specs);
+    Driz::Core::Terminate();
+
+    std::ofstream file;
+    if (!output.empty())
+    {
+        file.open(output);
+        if (!file)
+        {
+            std::cerr << "Failed to open '" << output << "' for writing.\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::ostream &stream = output.empty() ? std::cout : file;
+    const bool ok = format == "json" ? Driz::WriteJson(stream, results) : Driz::WriteCsv(stream, results);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
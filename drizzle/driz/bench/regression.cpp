@@ -0,0 +1,174 @@
+#include "driz/bench/regression.hpp"
+#include "driz/bench/bench.hpp"
+#include "onyx/serialization/color.hpp"
+#include "tkit/serialization/yaml/container.hpp"
+#include "tkit/serialization/yaml/tensor.hpp"
+#include "tkit/serialization/yaml/driz/simulation/settings.hpp"
+#include "tkit/serialization/yaml/driz/simulation/material.hpp"
+#include "tkit/serialization/yaml/driz/simulation/flow.hpp"
+#include "tkit/serialization/yaml/driz/simulation/scene.hpp"
+#include "tkit/serialization/yaml/driz/bench/regression.hpp"
+#include "tkit/profiling/clock.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace Driz
+{
+struct RegressionMeasurement
+{
+    f32 ParticleStepsPerSecond;
+    f32 KineticEnergy;
+    f32 DensityError;
+    u32 Particles;
+};
+
+template <Dimension D>
+static RegressionMeasurement runCase(const fs::path &p_Directory, const RegressionCase &p_Case,
+                                     SimulationSettings p_Settings)
+{
+    SimulationState<D> state{};
+    if (fs::exists(p_Directory / "state.yaml"))
+        state = TKit::Yaml::Deserialize<SimulationState<D>>((p_Directory / "state.yaml").string());
+    else
+        Scene<D>::Generate(state, TKit::Yaml::Deserialize<SceneSettings>((p_Directory / "scene.yaml").string()),
+                           DRIZ_MAX_THREADS);
+
+    p_Settings.Partitions = Math::Clamp(p_Case.Partitions, 1u, static_cast<u32>(DRIZ_MAX_THREADS));
+    Solver<D> solver{p_Settings, state};
+
+    const f32v<D> center = 0.5f * (state.Min + state.Max);
+    const auto step = [&](const u32 p_Step) {
+        if (!p_Case.Stir)
+        {
+            solver.Step(p_Case.Timestep);
+            return;
+        }
+        const f32 angle = 2.f * Math::Pi<f32>() * p_Step * p_Case.Timestep / p_Case.StirPeriod;
+        f32v<D> mouse = center;
+        mouse[0] += p_Case.StirOrbit * std::cos(angle);
+        mouse[D - 1] += p_Case.StirOrbit * std::sin(angle);
+        solver.Step(p_Case.Timestep, &mouse);
+    };
+
+    for (u32 i = 0; i < p_Case.Warmup; ++i)
+        step(i);
+
+    TKit::DynamicArray<f32> samples;
+    samples.Reserve(p_Case.Steps);
+    for (u32 i = 0; i < p_Case.Steps; ++i)
+    {
+        TKit::Clock clock{};
+        step(p_Case.Warmup + i);
+        samples.Append(static_cast<f32>(clock.GetElapsed().AsMilliseconds()));
+    }
+
+    // The median step time is far less sensitive to scheduling noise than the total run time
+    const BenchStatistics stats = ComputeStatistics(samples);
+    const u32 particles = solver.GetParticleCount();
+    return RegressionMeasurement{
+        .ParticleStepsPerSecond = stats.Median > 0.f ? 1000.f * particles / stats.Median : 0.f,
+        .KineticEnergy = solver.ComputeKineticEnergy(),
+        .DensityError = solver.ComputeDensityError(),
+        .Particles = particles};
+}
+
+static f32 relativeDifference(const f32 p_Value, const f32 p_Reference)
+{
+    const f32 reference = Math::Absolute(p_Reference);
+    return Math::Absolute(p_Value - p_Reference) / (reference > 1e-6f ? reference : 1e-6f);
+}
+
+static bool compare(const RegressionMeasurement &p_Measurement, const RegressionBaseline &p_Baseline)
+{
+    bool passed = true;
+    const auto report = [&passed](const char *p_Name, const f32 p_Value, const f32 p_Reference, const f32 p_Change,
+                                  const bool p_Failed) {
+        std::cout << TKit::Format("    {:<26} {:>14.4f} (baseline {:>14.4f}, {:+.2f}%){}\n", p_Name, p_Value,
+                                  p_Reference, 100.f * p_Change, p_Failed ? "  REGRESSION" : "");
+        passed &= !p_Failed;
+    };
+
+    if (p_Baseline.ParticleStepsPerSecond > 0.f)
+    {
+        const f32 throughput = p_Measurement.ParticleStepsPerSecond / p_Baseline.ParticleStepsPerSecond - 1.f;
+        report("particle steps per second", p_Measurement.ParticleStepsPerSecond, p_Baseline.ParticleStepsPerSecond,
+               throughput, throughput < -p_Baseline.ThroughputTolerance);
+    }
+    else
+        std::cout << TKit::Format("    {:<26} {:>14.4f} (warning: no throughput baseline on this machine)\n",
+                                  "particle steps per second", p_Measurement.ParticleStepsPerSecond);
+
+    if (p_Baseline.KineticEnergy == 0.f && p_Baseline.DensityError == 0.f)
+    {
+        std::cout << "    warning: no invariants recorded yet, record them with '--update-invariants'\n";
+        return passed;
+    }
+
+    const f32 energy = relativeDifference(p_Measurement.KineticEnergy, p_Baseline.KineticEnergy);
+    report("kinetic energy", p_Measurement.KineticEnergy, p_Baseline.KineticEnergy, energy,
+           energy > p_Baseline.KineticEnergyTolerance);
+
+    const f32 density = relativeDifference(p_Measurement.DensityError, p_Baseline.DensityError);
+    report("mean density error", p_Measurement.DensityError, p_Baseline.DensityError, density,
+           density > p_Baseline.DensityErrorTolerance);
+    return passed;
+}
+
+bool RunRegression(const RegressionSpecs &p_Specs)
+{
+    TKit::DynamicArray<fs::path> directories;
+    for (const auto &entry : fs::directory_iterator(p_Specs.Directory))
+        if (entry.is_directory() && fs::exists(entry.path() / "case.yaml"))
+        {
+            const std::string name = entry.path().filename().string();
+            if (p_Specs.Filter.empty() || name.find(p_Specs.Filter) != std::string::npos)
+                directories.Append(entry.path());
+        }
+    std::sort(directories.begin(), directories.end());
+
+    if (directories.IsEmpty())
+    {
+        std::cerr << "No reference scenes found in '" << p_Specs.Directory.string() << "'.\n";
+        return false;
+    }
+
+    u32 failures = 0;
+    for (const fs::path &directory : directories)
+    {
+        const RegressionCase rcase = TKit::Yaml::Deserialize<RegressionCase>((directory / "case.yaml").string());
+        const SimulationSettings settings =
+            TKit::Yaml::Deserialize<SimulationSettings>((directory / "settings.yaml").string());
+
+        const RegressionMeasurement measurement = rcase.Dim == 3 ? runCase<D3>(directory, rcase, settings)
+                                                                 : runCase<D2>(directory, rcase, settings);
+        std::cout << TKit::Format("{} ({}D, {} particles, {} steps)\n", directory.filename().string(), rcase.Dim,
+                                  measurement.Particles, rcase.Steps);
+
+        const fs::path path = directory / "baseline.yaml";
+        const bool exists = fs::exists(path);
+        RegressionBaseline baseline = exists ? TKit::Yaml::Deserialize<RegressionBaseline>(path.string())
+                                             : RegressionBaseline{};
+        if (p_Specs.UpdateBaselines)
+        {
+            if (!p_Specs.InvariantsOnly)
+                baseline.ParticleStepsPerSecond = measurement.ParticleStepsPerSecond;
+            baseline.KineticEnergy = measurement.KineticEnergy;
+            baseline.DensityError = measurement.DensityError;
+            TKit::Yaml::Serialize(path.string(), baseline);
+            std::cout << "    baseline updated\n";
+        }
+        else if (!exists)
+        {
+            std::cout << "    no baseline, record one with '--update-baselines'\n";
+            ++failures;
+        }
+        else if (!compare(measurement, baseline))
+            ++failures;
+    }
+
+    std::cout << TKit::Format("{} of {} reference scenes passed\n", directories.GetSize() - failures,
+                              directories.GetSize());
+    return failures == 0;
+}
+} // namespace Driz
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "driz/core/core.hpp"
+#include "tkit/reflection/reflect.hpp"
+#include "tkit/serialization/yaml/serialize.hpp"
+#include <string>
+
+namespace Driz
+{
+// A reference scene lives in its own directory, next to a 'settings.yaml' file with its simulation settings and either
+// a 'scene.yaml' file with the settings to generate its state or a 'state.yaml' file with the state itself
+struct RegressionCase
+{
+    TKIT_REFLECT_DECLARE(RegressionCase)
+    TKIT_YAML_SERIALIZE_DECLARE(RegressionCase)
+
+    u32 Dim = 2;
+    u32 Steps = 600;
+    u32 Warmup = 30;
+    // Fixed rather than taken from the host, as the order per-thread arrays are merged in shifts the invariants
+    u32 Partitions = 4;
+    f32 Timestep = 1.f / 60.f;
+
+    // A scripted mouse force that orbits around the center of the bounding box
+    bool Stir = false;
+    f32 StirOrbit = 0.f;
+    f32 StirPeriod = 2.f; // Seconds per revolution
+};
+
+// Throughput is compared one-sided, the invariants in both directions. All tolerances are relative. Throughput is
+// machine specific and may be left unrecorded (zero), in which case it is only reported. Invariants left unrecorded
+// (both zero) only raise a warning, so that a committed baseline can carry its tolerances before its first recording
+struct RegressionBaseline
+{
+    TKIT_REFLECT_DECLARE(RegressionBaseline)
+    TKIT_YAML_SERIALIZE_DECLARE(RegressionBaseline)
+
+    f32 ParticleStepsPerSecond = 0.f;
+    f32 KineticEnergy = 0.f;
+    f32 DensityError = 0.f;
+
+    f32 ThroughputTolerance = 0.1f;
+    f32 KineticEnergyTolerance = 0.05f;
+    f32 DensityErrorTolerance = 0.05f;
+};
+
+struct RegressionSpecs
+{
+    fs::path Directory;
+    std::string Filter;
+    bool UpdateBaselines = false;
+    bool InvariantsOnly = false; // When updating, leave the recorded throughput untouched
+};
+
+// Runs every reference scene headlessly and returns false if any of them regressed or has no baseline to compare
+// against. A missing throughput baseline is only a warning. When updating, the measured values become the new
+// baselines and existing tolerances are kept
+bool RunRegression(const RegressionSpecs &p_Specs);
+} // namespace Driz
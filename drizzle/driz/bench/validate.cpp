@@ -0,0 +1,406 @@
+#include "driz/bench/validate.hpp"
+#include "driz/simulation/solver.hpp"
+#include "driz/simulation/scene.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace Driz
+{
+static constexpr f32 s_Radius = 1.f;
+static constexpr f32 s_Timestep = 1.f / 60.f;
+static constexpr const char *s_DistributedName = "distributed-flows";
+
+template <Dimension D> static f32v<D> randomPosition(const u32 p_Index, const u32 p_Stream, const f32 p_Extent)
+{
+    f32v<D> position{0.f};
+    for (u32 i = 0; i < D; ++i)
+        position[i] = p_Extent * (Scene<D>::Random(13, p_Index, p_Stream * D + i) - 0.5f);
+    return position;
+}
+
+// Roughly four particles per cell, and entirely in positive coordinates so that it does not overlap with the scene
+// that straddles the origin
+template <Dimension D> static void generateUniform(SimArray<f32v<D>> &p_Positions)
+{
+    constexpr u32 count = 4000;
+    const f32 extent = static_cast<f32>(std::pow(count / 4.0, 1.0 / D)) * s_Radius;
+    for (u32 i = 0; i < count; ++i)
+        p_Positions.Append(randomPosition<D>(i, 0, extent) + f32v<D>{0.5f * extent + s_Radius});
+}
+
+template <Dimension D> static void generateCluster(SimArray<f32v<D>> &p_Positions)
+{
+    constexpr u32 count = 600;
+    for (u32 i = 0; i < count; ++i)
+        p_Positions.Append(randomPosition<D>(i, 1, 0.8f * s_Radius) + f32v<D>{0.5f * s_Radius});
+}
+
+// Every other lattice point sits exactly on a cell boundary, and many pairs are exactly one radius apart
+template <Dimension D> static void generateBoundaries(SimArray<f32v<D>> &p_Positions)
+{
+    constexpr u32 side = D == D2 ? 40 : 12;
+    const f32 spacing = 0.5f * s_Radius;
+    const f32 start = -0.5f * side * spacing;
+
+    u32 count = 1;
+    for (u32 i = 0; i < D; ++i)
+        count *= side;
+    for (u32 i = 0; i < count; ++i)
+    {
+        f32v<D> position{0.f};
+        u32 index = i;
+        for (u32 j = 0; j < D; ++j)
+        {
+            position[j] = start + spacing * static_cast<f32>(index % side);
+            index /= side;
+        }
+        p_Positions.Append(position);
+    }
+}
+
+// Pairs of particles scattered over a huge volume. Almost every particle has a cell of its own, so that a large share
+// of the keys clash, and each pair member may land in a different cell than its partner
+template <Dimension D> static void generateClashes(SimArray<f32v<D>> &p_Positions)
+{
+    constexpr u32 count = 3000;
+    for (u32 i = 0; i < count; i += 2)
+    {
+        const f32v<D> center = randomPosition<D>(i, 2, 2000.f * s_Radius);
+        p_Positions.Append(center);
+        p_Positions.Append(center + randomPosition<D>(i, 3, 1.2f * s_Radius));
+    }
+}
+
+// Every other particle is snapped to a quarter of the radius, so that many of them sit exactly on zero or on negative
+// cell boundaries
+template <Dimension D> static void generateStraddling(SimArray<f32v<D>> &p_Positions)
+{
+    constexpr u32 count = 2500;
+    for (u32 i = 0; i < count; ++i)
+    {
+        f32v<D> position = randomPosition<D>(i, 4, 8.f * s_Radius);
+        if (i % 2 == 0)
+            for (u32 j = 0; j < D; ++j)
+                position[j] = 0.25f * s_Radius * std::round(4.f * position[j] / s_Radius);
+        p_Positions.Append(position);
+    }
+}
+
+static constexpr f32 s_SeamExtent = 12.f * s_Radius;
+// Periodic axes this narrow hold 2k cells for a cell ratio of k, so the stencil always wraps around onto itself
+static constexpr f32 s_NarrowExtent = 2.f * s_Radius;
+
+// Half of the particles hug one of the faces of a periodic box, some of them lying exactly on it, so that most pairs
+// are only found across the seam
+template <Dimension D> static void generateSeam(SimArray<f32v<D>> &p_Positions)
+{
+    constexpr u32 count = 2000;
+    for (u32 i = 0; i < count; ++i)
+    {
+        f32v<D> position = randomPosition<D>(i, 5, s_SeamExtent) + f32v<D>{0.5f * s_SeamExtent};
+        if (i % 2 == 1)
+        {
+            const u32 axis = (i / 2) % D;
+            const f32 depth = 0.3f * s_Radius * Scene<D>::Random(13, i, 6);
+            position[axis] = i % 4 == 1 ? depth : s_SeamExtent - depth;
+            if (i % 16 == 1)
+                position[axis] = 0.f;
+        }
+        p_Positions.Append(position);
+    }
+}
+
+// Only the first axis is periodic, and it is narrower than the stencil of every cell ratio
+template <Dimension D> static void generateNarrow(SimArray<f32v<D>> &p_Positions)
+{
+    constexpr u32 count = 800;
+    for (u32 i = 0; i < count; ++i)
+    {
+        f32v<D> position = randomPosition<D>(i, 7, 10.f * s_Radius);
+        position[0] = s_NarrowExtent * Scene<D>::Random(13, i, 8);
+        p_Positions.Append(position);
+    }
+}
+
+template <Dimension D> struct ValidationScene
+{
+    const char *Name;
+    void (*Generate)(SimArray<f32v<D>> &p_Positions);
+    // Periodic axes wrap around between zero and the extent
+    u32 PeriodicAxes = 0;
+    f32 PeriodicExtent = 0.f;
+};
+
+static constexpr u32 s_SceneCount = 7;
+
+template <Dimension D> static TKit::Array<ValidationScene<D>, s_SceneCount> getScenes()
+{
+    return {ValidationScene<D>{"uniform", generateUniform<D>}, ValidationScene<D>{"dense-cluster", generateCluster<D>},
+            ValidationScene<D>{"cell-boundaries", generateBoundaries<D>},
+            ValidationScene<D>{"hash-clashes", generateClashes<D>},
+            ValidationScene<D>{"straddling-origin", generateStraddling<D>},
+            ValidationScene<D>{"periodic-seam", generateSeam<D>, (1u << D) - 1, s_SeamExtent},
+            ValidationScene<D>{"periodic-narrow", generateNarrow<D>, 1u, s_NarrowExtent}};
+}
+
+// Pairs are stored as a single key with the smaller index in the upper half, so that sorting makes them comparable
+template <Dimension D>
+static void collectPairs(LookupMethod<D> &p_Lookup, const u32 p_Partitions, TKit::DynamicArray<u64> &p_Pairs)
+{
+    TKit::Array<TKit::DynamicArray<u64>, DRIZ_MAX_THREADS> pairs{};
+    p_Lookup.ForEachPair(
+        [&pairs](const u32 p_Index1, const u32 p_Index2, const f32, const u32 p_ThreadIndex) {
+            const u64 low = Math::Min(p_Index1, p_Index2);
+            const u64 high = Math::Max(p_Index1, p_Index2);
+            pairs[p_ThreadIndex].Append((low << 32) | high);
+        },
+        p_Partitions);
+
+    p_Pairs.Clear();
+    for (u32 i = 0; i < DRIZ_MAX_THREADS; ++i)
+        for (const u64 pair : pairs[i])
+            p_Pairs.Append(pair);
+    std::sort(p_Pairs.begin(), p_Pairs.end());
+}
+
+struct PairDifference
+{
+    u32 Missing = 0;
+    u32 Extra = 0;
+    u32 Duplicates = 0;
+};
+
+static PairDifference comparePairs(const TKit::DynamicArray<u64> &p_Pairs, const TKit::DynamicArray<u64> &p_Reference)
+{
+    PairDifference difference{};
+    for (u32 i = 1; i < p_Pairs.GetSize(); ++i)
+        difference.Duplicates += p_Pairs[i] == p_Pairs[i - 1];
+    for (u32 i = 1; i < p_Reference.GetSize(); ++i)
+        difference.Duplicates += p_Reference[i] == p_Reference[i - 1];
+
+    u32 i = 0;
+    u32 j = 0;
+    while (i < p_Pairs.GetSize() || j < p_Reference.GetSize())
+    {
+        if (j == p_Reference.GetSize() || (i < p_Pairs.GetSize() && p_Pairs[i] < p_Reference[j]))
+        {
+            ++difference.Extra;
+            ++i;
+        }
+        else if (i == p_Pairs.GetSize() || p_Reference[j] < p_Pairs[i])
+        {
+            ++difference.Missing;
+            ++j;
+        }
+        else
+        {
+            ++i;
+            ++j;
+        }
+    }
+    return difference;
+}
+
+template <typename V>
+static u32 countMismatches(const SimArray<V> &p_Values, const SimArray<V> &p_Reference, const u32 p_Components,
+                           const ValidationSpecs &p_Specs)
+{
+    if (p_Values.GetSize() != p_Reference.GetSize())
+        return static_cast<u32>(Math::Max(p_Values.GetSize(), p_Reference.GetSize()));
+
+    f32 scale = 0.f;
+    for (const V &value : p_Reference)
+        for (u32 i = 0; i < p_Components; ++i)
+            scale = Math::Max(scale, Math::Absolute(value[i]));
+
+    u32 mismatches = 0;
+    for (u32 i = 0; i < p_Values.GetSize(); ++i)
+        for (u32 j = 0; j < p_Components; ++j)
+        {
+            const f32 reference = p_Reference[i][j];
+            const f32 tolerance =
+                p_Specs.RelativeTolerance * Math::Absolute(reference) + p_Specs.AbsoluteTolerance * scale;
+            if (!(Math::Absolute(p_Values[i][j] - reference) <= tolerance))
+            {
+                ++mismatches;
+                break;
+            }
+        }
+    return mismatches;
+}
+
+template <Dimension D>
+static SimulationData<D> stepOnce(const SimulationState<D> &p_State, const LookupMode p_Mode, const u32 p_Partitions,
+                                  const u32 p_PeriodicAxes)
+{
+    SimulationSettings settings{};
+    settings.SmoothingRadius = s_Radius;
+    settings.Partitions = p_Partitions;
+    settings.Lookup = p_Mode;
+    settings.PeriodicAxes = p_PeriodicAxes;
+
+    Solver<D> solver{settings, p_State};
+    solver.Step(s_Timestep);
+    return solver.Data;
+}
+
+// Particles start at rest, in a box two radii wider than their bounds
+template <Dimension D> static void fitBox(SimulationState<D> &p_State)
+{
+    p_State.Min = p_State.Positions[0];
+    p_State.Max = p_State.Positions[0];
+    for (const f32v<D> &position : p_State.Positions)
+    {
+        p_State.Velocities.Append(f32v<D>{0.f});
+        for (u32 i = 0; i < D; ++i)
+        {
+            p_State.Min[i] = Math::Min(p_State.Min[i], position[i]);
+            p_State.Max[i] = Math::Max(p_State.Max[i], position[i]);
+        }
+    }
+    p_State.Min -= f32v<D>{2.f * s_Radius};
+    p_State.Max += f32v<D>{2.f * s_Radius};
+}
+
+template <Dimension D> static bool validateScene(const ValidationScene<D> &p_Scene, const ValidationSpecs &p_Specs)
+{
+    SimulationState<D> state{};
+    p_Scene.Generate(state.Positions);
+    fitBox(state);
+    for (u32 i = 0; i < D; ++i)
+        if (p_Scene.PeriodicAxes & (1u << i))
+        {
+            state.Min[i] = 0.f;
+            state.Max[i] = p_Scene.PeriodicExtent;
+        }
+
+    const u32 maxPartitions = DRIZ_MAX_THREADS;
+    bool passed = true;
+    TKit::DynamicArray<u64> pairs;
+    TKit::DynamicArray<u64> reference;
+    for (const u32 partitions : {1u, maxPartitions})
+    {
+        LookupMethod<D> lookup{};
+        lookup.SetPositions(&state.Positions);
+        lookup.SetPeriodicity(p_Scene.PeriodicAxes, state.Min, state.Max);
+        lookup.UpdateBruteForceLookup(s_Radius);
+        collectPairs(lookup, partitions, reference);
+
+        PairDifference difference{};
+        const auto compare = [&] {
+            collectPairs(lookup, partitions, pairs);
+            const PairDifference current = comparePairs(pairs, reference);
+            difference.Missing += current.Missing;
+            difference.Extra += current.Extra;
+            difference.Duplicates += current.Duplicates;
+        };
+
+        // Finer grids prune their stencils, which is exactly what could drop a legitimate pair
+        for (u32 ratio = 1; ratio <= LookupMethod<D>::MaxCellRatio; ++ratio)
+        {
+            lookup.SetCellRatio(ratio);
+            lookup.UpdateGridLookup(s_Radius, partitions);
+            compare();
+        }
+        lookup.UpdateTreeLookup(s_Radius, partitions);
+        compare();
+
+        const SimulationData<D> bruteForce = stepOnce(state, LookupMode::BruteForce, partitions, p_Scene.PeriodicAxes);
+        u32 densities = 0;
+        u32 accelerations = 0;
+        for (const LookupMode mode : {LookupMode::Grid, LookupMode::Tree})
+        {
+            const SimulationData<D> data = stepOnce(state, mode, partitions, p_Scene.PeriodicAxes);
+            densities += countMismatches(data.Densities, bruteForce.Densities, 2, p_Specs);
+            accelerations += countMismatches(data.Accelerations, bruteForce.Accelerations, D, p_Specs);
+        }
+
+        const bool ok = difference.Missing == 0 && difference.Extra == 0 && difference.Duplicates == 0 &&
+                        densities == 0 && accelerations == 0;
+        std::cout << TKit::Format("{:<18} {}D {:>3} partitions {:>7} particles {:>9} pairs  {}\n", p_Scene.Name,
+                                  static_cast<u32>(D), partitions, state.Positions.GetSize(), reference.GetSize(),
+                                  ok ? "PASS" : "FAIL");
+        if (!ok)
+            std::cout << TKit::Format("    {} missing, {} extra and {} duplicated pairs, {} density and {} "
+                                      "acceleration mismatches\n",
+                                      difference.Missing, difference.Extra, difference.Duplicates, densities,
+                                      accelerations);
+        passed &= ok;
+    }
+    return passed;
+}
+
+template <Dimension D> static void validateScenes(const ValidationSpecs &p_Specs, u32 &p_Runs, u32 &p_Failures)
+{
+    const auto scenes = getScenes<D>();
+    for (u32 i = 0; i < s_SceneCount; ++i)
+    {
+        const std::string name = scenes[i].Name;
+        if (!p_Specs.Filter.empty() && name.find(p_Specs.Filter) == std::string::npos)
+            continue;
+        ++p_Runs;
+        if (!validateScene(scenes[i], p_Specs))
+            ++p_Failures;
+    }
+}
+
+bool RunValidation(const ValidationSpecs &p_Specs)
+{
+    u32 runs = 0;
+    u32 failures = 0;
+    validateScenes<D2>(p_Specs, runs, failures);
+    validateScenes<D3>(p_Specs, runs, failures);
+
+    if (runs == 0)
+    {
+        // The filter may have picked the distributed check alone, which runs on its own
+        if (IsDistributedValidationEnabled(p_Specs))
+            return true;
+        std::cerr << "No validation scene matches the filter '" << p_Specs.Filter << "'.\n";
+        return false;
+    }
+    std::cout << TKit::Format("{} of {} validation scenes passed\n", runs - failures, runs);
+    return failures == 0;
+}
+
+// An emitter on the first slab pushes particles towards a sink on the last one, so that emitted particles have to
+// migrate and sinks remove particles that have halo copies elsewhere. The run fails if the global count drifts
+bool RunDistributedValidation(const DistributedSpecs &p_Specs, const u32 p_Rank)
+{
+    SimulationSettings settings{};
+    settings.SmoothingRadius = s_Radius;
+
+    SimulationState<D2> state{};
+    generateUniform<D2>(state.Positions);
+    fitBox(state);
+
+    const f32 extent = state.Max[0] - state.Min[0];
+    Emitter<D2> emitter{};
+    emitter.Min = state.Min + f32v<D2>{s_Radius};
+    emitter.Max = f32v<D2>{state.Min[0] + 0.1f * extent, state.Max[1] - s_Radius};
+    emitter.Velocity = f32v<D2>{10.f, 0.f};
+    emitter.Rate = 600.f;
+    state.Emitters.Append(emitter);
+
+    Sink<D2> sink{};
+    sink.Point = f32v<D2>{state.Max[0] - 0.2f * extent, 0.f};
+    sink.Normal = f32v<D2>{1.f, 0.f};
+    state.Sinks.Append(sink);
+
+    HeadlessSpecs headless{};
+    headless.Steps = 240;
+    headless.Timestep = s_Timestep;
+    const bool passed = RunDistributed<D2>(headless, p_Specs, p_Rank, settings, state);
+    if (p_Rank == 0)
+        std::cout << TKit::Format("{:<18} 2D {:>3} ranks {:>10} particles  {}\n", s_DistributedName, p_Specs.Ranks,
+                                  state.Positions.GetSize(), passed ? "PASS" : "FAIL");
+    return passed;
+}
+
+bool IsDistributedValidationEnabled(const ValidationSpecs &p_Specs)
+{
+    return p_Specs.Ranks > 1 &&
+           (p_Specs.Filter.empty() || std::string{s_DistributedName}.find(p_Specs.Filter) != std::string::npos);
+}
+} // namespace Driz
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "driz/distributed/domain.hpp"
+#include <string>
+
+namespace Driz
+{
+struct ValidationSpecs
+{
+    std::string Filter;
+    // Densities and accelerations are accumulated in a different order by each lookup, so they may only match up to
+    // rounding. The absolute tolerance is relative to the largest magnitude found in the whole array
+    f32 RelativeTolerance = 1e-4f;
+    f32 AbsoluteTolerance = 1e-5f;
+    // Ranks of the distributed check, which is skipped with a single one or if the filter leaves it out
+    u32 Ranks = 3;
+};
+
+// Runs the grid lookup against the brute force one on a set of adversarial scenes, in 2D and 3D and with one and all
+// partitions. Both must report the exact same neighbor pairs, and a solver step must produce the same densities and
+// accelerations with either of them. Returns false if any scene fails
+bool RunValidation(const ValidationSpecs &p_Specs);
+
+// Runs a scene with an emitter and a sink split across ranks, and checks that the particles held by all ranks add up
+// to the initial ones plus those emitted minus those sunk. Every rank must call it
+bool RunDistributedValidation(const DistributedSpecs &p_Specs, u32 p_Rank);
+bool IsDistributedValidationEnabled(const ValidationSpecs &p_Specs);
+} // namespace Driz
@@ -1,24 +1,26 @@
 #include "driz/core/core.hpp"
 #include "onyx/core/core.hpp"
-#include "tkit/utils/literals.hpp"
 
 #define DRIZ_MAX_WORKERS (ONYX_MAX_THREADS - 1)
 
 namespace Driz
 {
-using namespace TKit::Literals;
-
 static TKit::Storage<TKit::ThreadPool> s_ThreadPool;
-static TKit::ArenaAllocator s_Arena{5_mb};
+static thread_local TKit::ThreadPool *s_ThreadPoolOverride = nullptr;
+static bool s_Headless = false;
+static u32 s_ReservedWorkers = 0;
 
 static fs::path s_SettingsPath = fs::path(DRIZ_ROOT_PATH) / "saves" / "settings";
 static fs::path s_StatePath2 = fs::path(DRIZ_ROOT_PATH) / "saves" / "2D";
 static fs::path s_StatePath3 = fs::path(DRIZ_ROOT_PATH) / "saves" / "3D";
 
-void Core::Initialize()
+void Core::Initialize(const bool p_Headless)
 {
-    s_ThreadPool.Construct(DRIZ_MAX_WORKERS);
-    Onyx::Core::Initialize(Onyx::Specs{.TaskManager = s_ThreadPool.Get()});
+    s_Headless = p_Headless;
+    s_ReservedWorkers = p_Headless ? 0 : DRIZ_MAX_WORKERS / 2;
+    s_ThreadPool.Construct(DRIZ_MAX_WORKERS - s_ReservedWorkers);
+    if (!s_Headless)
+        Onyx::Core::Initialize(Onyx::Specs{.TaskManager = s_ThreadPool.Get()});
 
     fs::create_directories(s_SettingsPath);
     fs::create_directories(s_StatePath2);
@@ -26,28 +28,42 @@ void Core::Initialize()
 }
 void Core::Terminate()
 {
-    Onyx::Core::Terminate();
+    if (!s_Headless)
+        Onyx::Core::Terminate();
     s_ThreadPool.Destruct();
 }
+bool Core::IsHeadless()
+{
+    return s_Headless;
+}
 
-TKit::ArenaAllocator &Core::GetArena()
+ScratchArena &Core::GetThreadArena()
 {
-    return s_Arena;
+    thread_local ScratchArena arena{};
+    return arena;
 }
 TKit::ThreadPool &Core::GetThreadPool()
 {
-    return *s_ThreadPool.Get();
+    return s_ThreadPoolOverride ? *s_ThreadPoolOverride : *s_ThreadPool.Get();
+}
+void Core::SetThreadPool(TKit::ThreadPool *p_Pool)
+{
+    s_ThreadPoolOverride = p_Pool;
+}
+u32 Core::GetThreadCount()
+{
+    const u32 threads = static_cast<u32>(GetThreadPool().GetThreadCount());
+    return threads < DRIZ_MAX_THREADS ? threads : DRIZ_MAX_THREADS;
+}
+u32 Core::GetReservedWorkerCount()
+{
+    return s_ReservedWorkers;
 }
 
 const fs::path &Core::GetSettingsPath()
 {
     return s_SettingsPath;
 }
-u32 Core::GetThreadIndex()
-{
-    thread_local u32 tindex = s_ThreadPool->GetThreadIndex();
-    return tindex;
-}
 
 template <Dimension D> const fs::path &Core::GetStatePath()
 {
@@ -2,7 +2,7 @@
 
 #include "driz/core/alias.hpp"
 #include "driz/core/dimension.hpp"
-#include "tkit/memory/arena_allocator.hpp"
+#include "driz/core/memory.hpp"
 #include "tkit/multiprocessing/thread_pool.hpp"
 #include "tkit/multiprocessing/for_each.hpp"
 #include "onyx/object/primitives.hpp"
@@ -19,15 +19,26 @@ template <typename T> using SimArray = TKit::DynamicArray<T>;
 
 struct Core
 {
-    static void Initialize();
+    // A headless core only spins up the thread pool, and can be used without a window or a GPU. Windowed cores leave
+    // half of the workers out of the default pool, so that the simulation pipeline can run its own team next to the
+    // renderer without oversubscribing the host
+    static void Initialize(bool p_Headless = false);
     static void Terminate();
+    static bool IsHeadless();
 
-    static TKit::ArenaAllocator &GetArena();
+    // Every thread, worker or not, owns its own scratch arena, so parallel passes can allocate without contention
+    static ScratchArena &GetThreadArena();
     static TKit::ThreadPool &GetThreadPool();
+    // Parallel loops issued from the calling thread will run on the given pool instead of the default one, which lets
+    // a thread drive its own worker team. Passing null restores the default pool
+    static void SetThreadPool(TKit::ThreadPool *p_Pool);
+    // Threads the current pool runs parallel loops on, the calling thread included, and never more than the maximum
+    static u32 GetThreadCount();
     static void SetWorkerThreadCount(u32 p_ThreadCount);
+    // Workers left out of the default pool for a team of their own
+    static u32 GetReservedWorkerCount();
 
     static const fs::path &GetSettingsPath();
-    static u32 GetThreadIndex();
 
     template <Dimension D> static const fs::path &GetStatePath();
 
@@ -44,6 +55,20 @@ struct Core
             pool.WaitUntilFinished(tasks[i]);
     }
 
+    // Same as ForEach, but every partition also receives its own index. Chunk boundaries only depend on the range and
+    // the partition count, so two calls with the same arguments always split the work identically
+    template <typename F>
+    static void ForEachChunk(const u32 p_Start, const u32 p_End, const u32 p_Partitions, F &&p_Function)
+    {
+        const u64 size = p_End - p_Start;
+        ForEach(0, p_Partitions, p_Partitions, [&](const u32 p_First, const u32 p_Last) {
+            for (u32 i = p_First; i < p_Last; ++i)
+                p_Function(i, p_Start + static_cast<u32>(size * i / p_Partitions),
+                           p_Start + static_cast<u32>(size * (i + 1) / p_Partitions));
+        });
+    }
+
     static inline Onyx::Resolution Resolution = Onyx::Resolution::VeryLow;
+    static inline bool HugePages = false;
 };
 } // namespace Driz
@@ -7,4 +7,10 @@
 namespace Driz
 {
 namespace Math = Onyx::Math;
+
+inline f32v3 Cross(const f32v3 &p_Left, const f32v3 &p_Right)
+{
+    return f32v3{p_Left[1] * p_Right[2] - p_Left[2] * p_Right[1], p_Left[2] * p_Right[0] - p_Left[0] * p_Right[2],
+                 p_Left[0] * p_Right[1] - p_Left[1] * p_Right[0]};
+}
 } // namespace Driz
@@ -0,0 +1,153 @@
+#include "driz/core/memory.hpp"
+#include "driz/core/core.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+#if defined(__linux__)
+#    include <sys/mman.h>
+#endif
+
+namespace Driz
+{
+static constexpr usize s_PageSize = 4096;
+static constexpr usize s_HugePageSize = 2 * 1024 * 1024;
+
+namespace Memory
+{
+LargeBlock AllocateLarge(const usize p_Size)
+{
+#if defined(__linux__)
+    if (Core::HugePages && p_Size >= s_HugePageSize)
+    {
+        void *ptr = mmap(nullptr, p_Size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr != MAP_FAILED)
+        {
+            madvise(ptr, p_Size, MADV_HUGEPAGE);
+            return LargeBlock{static_cast<std::byte *>(ptr), p_Size, true};
+        }
+    }
+#endif
+    return LargeBlock{static_cast<std::byte *>(::operator new(p_Size, std::align_val_t{s_PageSize})), p_Size, false};
+}
+void DeallocateLarge(const LargeBlock &p_Block)
+{
+    if (!p_Block.Data)
+        return;
+#if defined(__linux__)
+    if (p_Block.Mapped)
+    {
+        munmap(p_Block.Data, p_Block.Size);
+        return;
+    }
+#endif
+    ::operator delete(p_Block.Data, std::align_val_t{s_PageSize});
+}
+
+void AdviseHugePages(void *p_Ptr, const usize p_Size)
+{
+#if defined(__linux__)
+    if (!Core::HugePages || !p_Ptr || p_Size < 2 * s_HugePageSize)
+        return;
+
+    const std::uintptr_t address = reinterpret_cast<std::uintptr_t>(p_Ptr);
+    const std::uintptr_t start = (address + s_HugePageSize - 1) & ~(s_HugePageSize - 1);
+    const std::uintptr_t end = (address + p_Size) & ~(s_HugePageSize - 1);
+    if (end > start)
+        madvise(reinterpret_cast<void *>(start), end - start, MADV_HUGEPAGE);
+#else
+    (void)p_Ptr;
+    (void)p_Size;
+#endif
+}
+} // namespace Memory
+
+ScratchArena::ScratchArena(const usize p_Capacity)
+{
+    m_Block = Memory::AllocateLarge(p_Capacity);
+}
+ScratchArena::~ScratchArena()
+{
+    release();
+}
+
+ScratchArena::ScratchArena(ScratchArena &&p_Other)
+    : m_Block(std::exchange(p_Other.m_Block, Block{})), m_Retired(std::move(p_Other.m_Retired)),
+      m_Offset(p_Other.m_Offset), m_Requested(p_Other.m_Requested), m_HighWaterMark(p_Other.m_HighWaterMark)
+{
+    p_Other.m_Retired.Clear();
+}
+ScratchArena &ScratchArena::operator=(ScratchArena &&p_Other)
+{
+    if (this == &p_Other)
+        return *this;
+    release();
+    m_Block = std::exchange(p_Other.m_Block, Block{});
+    m_Retired = std::move(p_Other.m_Retired);
+    p_Other.m_Retired.Clear();
+    m_Offset = p_Other.m_Offset;
+    m_Requested = p_Other.m_Requested;
+    m_HighWaterMark = p_Other.m_HighWaterMark;
+    return *this;
+}
+
+void *ScratchArena::allocate(const usize p_Size, const usize p_Alignment)
+{
+    m_Requested += p_Size + p_Alignment;
+
+    usize offset = (m_Offset + p_Alignment - 1) & ~(p_Alignment - 1);
+    if (!m_Block.Data || offset + p_Size > m_Block.Size)
+    {
+        if (m_Block.Data)
+            m_Retired.Append(m_Block);
+
+        const usize size = std::max(2 * m_Block.Size, p_Size + p_Alignment);
+        m_Block = Memory::AllocateLarge(size);
+        offset = 0;
+    }
+
+    m_Offset = offset + p_Size;
+    return m_Block.Data + offset;
+}
+
+void ScratchArena::Reset()
+{
+    if (m_Requested > m_HighWaterMark)
+        m_HighWaterMark = m_Requested;
+
+    if (!m_Retired.IsEmpty())
+    {
+        for (const Block &block : m_Retired)
+            Memory::DeallocateLarge(block);
+        m_Retired.Clear();
+
+        if (m_Block.Size < m_HighWaterMark)
+        {
+            Memory::DeallocateLarge(m_Block);
+            m_Block = Memory::AllocateLarge(m_HighWaterMark);
+        }
+    }
+    m_Offset = 0;
+    m_Requested = 0;
+}
+
+void ScratchArena::release()
+{
+    for (const Block &block : m_Retired)
+        Memory::DeallocateLarge(block);
+    m_Retired.Clear();
+    Memory::DeallocateLarge(m_Block);
+    m_Block = Block{};
+}
+
+usize ScratchArena::GetCapacity() const
+{
+    return m_Block.Size;
+}
+usize ScratchArena::GetHighWaterMark() const
+{
+    return m_HighWaterMark;
+}
+
+} // namespace Driz
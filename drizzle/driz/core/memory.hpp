@@ -0,0 +1,68 @@
+#pragma once
+
+#include "driz/core/alias.hpp"
+#include "tkit/container/dynamic_array.hpp"
+#include <cstddef>
+
+namespace Driz
+{
+namespace Memory
+{
+struct LargeBlock
+{
+    std::byte *Data = nullptr;
+    usize Size = 0;
+    bool Mapped = false; // Backed by an anonymous mapping rather than the heap
+};
+
+// Large blocks are page aligned. When huge pages are enabled, blocks bigger than a huge page are backed by them where
+// the platform allows it, which cuts TLB misses on the big per particle arrays. Blocks remember how they were backed,
+// so Core::HugePages may change at any time
+LargeBlock AllocateLarge(usize p_Size);
+void DeallocateLarge(const LargeBlock &p_Block);
+
+// Hint the kernel to back an already allocated region with huge pages. Only the page aligned interior of the region is
+// affected. It is a no-op when huge pages are disabled or unsupported
+void AdviseHugePages(void *p_Ptr, usize p_Size);
+} // namespace Memory
+
+// A bump allocator that grows to the high-water mark. Requests that do not fit in the current block are served from a
+// new, larger block, and on Reset the arena keeps a single block big enough for everything requested since the last
+// reset. A workload that repeats every step stops touching the system allocator after the first step
+class ScratchArena
+{
+  public:
+    ScratchArena() = default;
+    explicit ScratchArena(usize p_Capacity);
+    ~ScratchArena();
+
+    ScratchArena(const ScratchArena &) = delete;
+    ScratchArena &operator=(const ScratchArena &) = delete;
+
+    ScratchArena(ScratchArena &&p_Other);
+    ScratchArena &operator=(ScratchArena &&p_Other);
+
+    template <typename T> T *Allocate(const usize p_Count)
+    {
+        return static_cast<T *>(allocate(p_Count * sizeof(T), alignof(T)));
+    }
+
+    void Reset();
+
+    usize GetCapacity() const;
+    usize GetHighWaterMark() const;
+
+  private:
+    using Block = Memory::LargeBlock;
+
+    void *allocate(usize p_Size, usize p_Alignment);
+    void release();
+
+    Block m_Block{};
+    TKit::DynamicArray<Block> m_Retired; // Blocks outgrown since the last reset
+
+    usize m_Offset = 0;
+    usize m_Requested = 0;
+    usize m_HighWaterMark = 0;
+};
+} // namespace Driz
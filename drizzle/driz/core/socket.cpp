@@ -0,0 +1,31 @@
+#include "driz/core/socket.hpp"
+#include <cstring>
+#include <iostream>
+
+namespace Driz
+{
+#ifdef DRIZ_HAS_SOCKETS
+namespace Socket
+{
+bool ToAddress(const fs::path &p_Path, sockaddr_un &p_Address)
+{
+    const std::string path = p_Path.string();
+    if (path.size() >= sizeof(p_Address.sun_path))
+    {
+        std::cerr << "The socket path '" << path << "' is too long.\n";
+        return false;
+    }
+    std::memset(&p_Address, 0, sizeof(p_Address));
+    p_Address.sun_family = AF_UNIX;
+    std::memcpy(p_Address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+bool SetNonBlocking(const i32 p_Descriptor)
+{
+    const i32 flags = ::fcntl(p_Descriptor, F_GETFL, 0);
+    return flags >= 0 && ::fcntl(p_Descriptor, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+} // namespace Socket
+#endif
+} // namespace Driz
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "driz/core/core.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#    include <cerrno>
+#    include <fcntl.h>
+#    include <poll.h>
+#    include <sys/socket.h>
+#    include <sys/un.h>
+#    include <unistd.h>
+#    define DRIZ_HAS_SOCKETS
+// Writing to a socket whose peer went away must fail with EPIPE instead of raising SIGPIPE
+#    ifdef MSG_NOSIGNAL
+#        define DRIZ_SEND_FLAGS MSG_NOSIGNAL
+#    else
+#        define DRIZ_SEND_FLAGS 0
+#    endif
+#endif
+
+namespace Driz
+{
+#ifdef DRIZ_HAS_SOCKETS
+namespace Socket
+{
+// Fills a Unix domain socket address. Fails, reporting it, if the path does not fit
+bool ToAddress(const fs::path &p_Path, sockaddr_un &p_Address);
+bool SetNonBlocking(i32 p_Descriptor);
+} // namespace Socket
+#endif
+} // namespace Driz
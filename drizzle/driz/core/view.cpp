@@ -0,0 +1,91 @@
+#include "driz/core/view.hpp"
+
+namespace Driz
+{
+template <Dimension D>
+ViewVolume<D> ViewVolume<D>::FromCorners(const TKit::Array<f32v<D>, CornerCount> &p_Corners)
+{
+    ViewVolume volume{};
+    f32v<D> center{0.f};
+    volume.Min = p_Corners[0];
+    volume.Max = p_Corners[0];
+    for (u32 i = 0; i < CornerCount; ++i)
+    {
+        center += p_Corners[i];
+        for (u32 j = 0; j < D; ++j)
+        {
+            volume.Min[j] = Math::Min(volume.Min[j], p_Corners[i][j]);
+            volume.Max[j] = Math::Max(volume.Max[j], p_Corners[i][j]);
+        }
+    }
+    center /= static_cast<f32>(CornerCount);
+
+    // Normals are flipped towards the center, so the winding of the corners does not matter
+    const auto makePlane = [&center](const f32v<D> &p_Point, f32v<D> p_Normal) {
+        const f32 length = Math::SquareRoot(Math::NormSquared(p_Normal));
+        p_Normal = length > 0.f ? p_Normal / length : f32v<D>{0.f};
+        if (Math::Dot(p_Normal, center - p_Point) < 0.f)
+            p_Normal = -p_Normal;
+        return Plane{p_Normal, -Math::Dot(p_Normal, p_Point)};
+    };
+
+    if constexpr (D == D2)
+    {
+        volume.Origin = center;
+        for (u32 i = 0; i < 4; ++i)
+        {
+            const f32v2 edge = p_Corners[(i + 1) % 4] - p_Corners[i];
+            volume.Planes[i] = makePlane(p_Corners[i], f32v2{-edge[1], edge[0]});
+        }
+    }
+    else
+    {
+        const auto cross = [](const f32v3 &p_Left, const f32v3 &p_Right) {
+            return f32v3{p_Left[1] * p_Right[2] - p_Left[2] * p_Right[1],
+                         p_Left[2] * p_Right[0] - p_Left[0] * p_Right[2],
+                         p_Left[0] * p_Right[1] - p_Left[1] * p_Right[0]};
+        };
+        const auto plane = [&](const u32 p_A, const u32 p_B, const u32 p_C) {
+            return makePlane(p_Corners[p_A], cross(p_Corners[p_B] - p_Corners[p_A], p_Corners[p_C] - p_Corners[p_A]));
+        };
+
+        volume.Origin = 0.25f * (p_Corners[0] + p_Corners[1] + p_Corners[2] + p_Corners[3]);
+        volume.Planes[0] = plane(0, 1, 2);
+        volume.Planes[1] = plane(4, 5, 6);
+        for (u32 i = 0; i < 4; ++i)
+            volume.Planes[2 + i] = plane(i, (i + 1) % 4, 4 + i);
+    }
+    return volume;
+}
+
+template <Dimension D>
+bool ViewVolume<D>::Intersects(const f32v<D> &p_Min, const f32v<D> &p_Max, const f32 p_Margin) const
+{
+    for (u32 i = 0; i < D; ++i)
+        if (p_Max[i] < Min[i] - p_Margin || p_Min[i] > Max[i] + p_Margin)
+            return false;
+
+    // Only the box corner furthest along each normal needs to be checked
+    for (u32 i = 0; i < PlaneCount; ++i)
+    {
+        const Plane &plane = Planes[i];
+        f32v<D> corner;
+        for (u32 j = 0; j < D; ++j)
+            corner[j] = plane.Normal[j] >= 0.f ? p_Max[j] : p_Min[j];
+        if (Math::Dot(plane.Normal, corner) + plane.Offset < -p_Margin)
+            return false;
+    }
+    return true;
+}
+
+template <Dimension D> bool ViewVolume<D>::Contains(const f32v<D> &p_Point, const f32 p_Margin) const
+{
+    for (u32 i = 0; i < PlaneCount; ++i)
+        if (Math::Dot(Planes[i].Normal, p_Point) + Planes[i].Offset < -p_Margin)
+            return false;
+    return true;
+}
+
+template struct ViewVolume<D2>;
+template struct ViewVolume<D3>;
+} // namespace Driz
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "driz/core/math.hpp"
+#include "tkit/container/array.hpp"
+#include <cstdint>
+
+namespace Driz
+{
+// The region of the simulation a camera can see: a convex quad in 2D and a frustum in 3D, bounded by inward facing
+// planes. It is built from the corners of the screen unprojected to simulation space
+template <Dimension D> struct ViewVolume
+{
+    static constexpr u32 CornerCount = 4 * (D - 1);
+    static constexpr u32 PlaneCount = 2 * D;
+
+    struct Plane
+    {
+        f32v<D> Normal; // Unit length
+        f32 Offset;
+    };
+
+    // In 2D, corners go around the screen. In 3D, the first four go around the near plane and the last four around the
+    // far plane, in the same order
+    static ViewVolume FromCorners(const TKit::Array<f32v<D>, CornerCount> &p_Corners);
+
+    // Conservative: a box that is not fully outside any of the planes is considered to intersect
+    bool Intersects(const f32v<D> &p_Min, const f32v<D> &p_Max, f32 p_Margin = 0.f) const;
+    bool Contains(const f32v<D> &p_Point, f32 p_Margin = 0.f) const;
+
+    TKit::Array<Plane, PlaneCount> Planes;
+    f32v<D> Min;
+    f32v<D> Max;
+    f32v<D> Origin; // The center of the screen in 2D and of the near plane in 3D
+};
+
+// Only the particles in the index list are considered, if given. In 3D, interior particles are hidden behind the
+// surface ones, so draw cost may scale with the visible surface instead of the volume. Outlined particles are never
+// culled by their neighbor count
+struct ParticleCulling
+{
+    const u32 *Indices = nullptr;
+    u32 IndexCount = 0;
+
+    // 3D only
+    const u32 *NeighborCounts = nullptr;
+    u32 InteriorNeighbors = UINT32_MAX; // Particles with at least this many neighbors are not drawn
+    f32v3 Viewer{0.f};
+    f32 LodDistance = 0.f;
+};
+} // namespace Driz
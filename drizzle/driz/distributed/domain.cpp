@@ -0,0 +1,483 @@
+#include "driz/distributed/domain.hpp"
+#include "tkit/profiling/clock.hpp"
+#include "tkit/profiling/macros.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#    include <sys/wait.h>
+#    include <unistd.h>
+#    define DRIZ_HAS_FORK
+#endif
+
+namespace Driz
+{
+template <Dimension D>
+SlabDomain<D>::SlabDomain(Transport &p_Transport, const SimulationSettings &p_Settings,
+                          const SimulationState<D> &p_State)
+    : m_Transport(&p_Transport), m_Halo(2.f * p_Settings.SmoothingRadius), m_Periodic(p_Settings.PeriodicAxes & 1u)
+{
+    const u32 ranks = p_Transport.GetRankCount();
+    m_Migrating.Resize(ranks);
+    m_Outgoing.Resize(ranks);
+    m_Boundaries.Resize(ranks + 1);
+    m_Boundaries[0] = p_State.Min[0];
+    m_Boundaries[ranks] = p_State.Max[0];
+
+    SimArray<f32> positions;
+    positions.Reserve(p_State.Positions.GetSize());
+    for (const f32v<D> &position : p_State.Positions)
+        positions.Append(position[0]);
+    std::sort(positions.begin(), positions.end());
+
+    const u64 size = positions.GetSize();
+    const f32 extent = p_State.Max[0] - p_State.Min[0];
+    for (u32 i = 1; i < ranks; ++i)
+        m_Boundaries[i] = size == 0 ? p_State.Min[0] + extent * static_cast<f32>(i) / static_cast<f32>(ranks)
+                                    : positions[static_cast<u32>(size * i / ranks)];
+    enforceMinWidth();
+}
+
+template <Dimension D> SimulationState<D> SlabDomain<D>::Partition(const SimulationState<D> &p_State) const
+{
+    SimulationState<D> state{};
+    state.Min = p_State.Min;
+    state.Max = p_State.Max;
+
+    // Sinks only remove the particles a rank owns, but emitters would spawn their particles once per rank. The first
+    // one runs them all, and migration hands the new particles to their owners
+    const u32 rank = m_Transport->GetRank();
+    state.Materials = p_State.Materials;
+    state.Sinks = p_State.Sinks;
+    if (rank == 0)
+        state.Emitters = p_State.Emitters;
+    const u32 pcount = p_State.Positions.GetSize();
+    const bool ratios = p_State.MassRatios.GetSize() == pcount;
+    const bool materials = p_State.MaterialIndices.GetSize() == pcount;
+    for (u32 i = 0; i < pcount; ++i)
+        if (getOwner(p_State.Positions[i][0]) == rank)
+        {
+            state.Positions.Append(p_State.Positions[i]);
+            state.Velocities.Append(i < p_State.Velocities.GetSize() ? p_State.Velocities[i] : f32v<D>{0.f});
+            if (ratios)
+                state.MassRatios.Append(p_State.MassRatios[i]);
+            if (materials)
+                state.MaterialIndices.Append(p_State.MaterialIndices[i]);
+        }
+    return state;
+}
+
+template <Dimension D> bool SlabDomain<D>::Step(Solver<D> &p_Solver, const f32 p_DeltaTime)
+{
+    TKIT_PROFILE_NSCOPE("Driz::SlabDomain::Step");
+    // Flows run before the halos arrive, as sinks compact the arrays and emitters append to them, which would mix
+    // halo copies up with owned particles. Emitted particles then migrate to their owners along with the rest
+    u32 emitted = 0;
+    for (const Emitter<D> &emitter : p_Solver.Emitters)
+        emitted -= emitter.Emitted;
+    const u32 count = p_Solver.GetParticleCount();
+    p_Solver.ApplyFlows(p_DeltaTime);
+    for (const Emitter<D> &emitter : p_Solver.Emitters)
+        emitted += emitter.Emitted;
+    m_Emitted += emitted;
+    m_Sunk += count + emitted - p_Solver.GetParticleCount();
+
+    if (!migrate(p_Solver))
+        return false;
+
+    const u32 owned = p_Solver.GetParticleCount();
+    if (!exchangeHalos(p_Solver))
+        return false;
+
+    StepInput<D> input{};
+    input.DeltaTime = p_DeltaTime;
+    input.SkipFlows = true;
+
+    TKit::Clock clock{};
+    p_Solver.Step(input);
+    m_StepTime = static_cast<f32>(clock.GetElapsed().AsMilliseconds());
+
+    // Halo particles were appended after the owned ones
+    p_Solver.RemoveParticlesIf([owned](const u32 p_Index) { return p_Index >= owned; });
+    return true;
+}
+
+// Cost is assumed to be spread evenly within each slab, which makes the cumulative cost piecewise linear along the
+// axis. Balanced boundaries are where it crosses every multiple of the mean cost per rank
+template <Dimension D> bool SlabDomain<D>::Rebalance(const f32 p_StepTime, const f32 p_Damping)
+{
+    TKIT_PROFILE_NSCOPE("Driz::SlabDomain::Rebalance");
+    Message gathered;
+    if (!m_Transport->AllGather(&p_StepTime, sizeof(f32), gathered))
+        return false;
+
+    const u32 ranks = m_Transport->GetRankCount();
+    SimArray<f32> times;
+    times.Resize(ranks);
+    std::memcpy(times.GetData(), gathered.GetData(), ranks * sizeof(f32));
+
+    f32 total = 0.f;
+    for (f32 &time : times)
+    {
+        time = Math::Max(time, 1e-6f);
+        total += time;
+    }
+
+    SimArray<f32> boundaries = m_Boundaries;
+    u32 slab = 0;
+    f32 cost = 0.f;
+    for (u32 i = 1; i < ranks; ++i)
+    {
+        const f32 target = total * static_cast<f32>(i) / static_cast<f32>(ranks);
+        while (slab < ranks - 1 && cost + times[slab] < target)
+            cost += times[slab++];
+
+        const f32 fraction = Math::Clamp((target - cost) / times[slab], 0.f, 1.f);
+        const f32 balanced = m_Boundaries[slab] + fraction * (m_Boundaries[slab + 1] - m_Boundaries[slab]);
+        boundaries[i] = m_Boundaries[i] + p_Damping * (balanced - m_Boundaries[i]);
+    }
+    m_Boundaries = boundaries;
+    enforceMinWidth();
+    return true;
+}
+
+template <Dimension D> f32 SlabDomain<D>::GetLower() const
+{
+    return m_Boundaries[m_Transport->GetRank()];
+}
+template <Dimension D> f32 SlabDomain<D>::GetUpper() const
+{
+    return m_Boundaries[m_Transport->GetRank() + 1];
+}
+template <Dimension D> f32 SlabDomain<D>::GetLastStepTime() const
+{
+    return m_StepTime;
+}
+template <Dimension D> u32 SlabDomain<D>::GetEmittedCount() const
+{
+    return m_Emitted;
+}
+template <Dimension D> u32 SlabDomain<D>::GetSunkCount() const
+{
+    return m_Sunk;
+}
+
+// Positions outside of the box belong to the closest slab
+template <Dimension D> u32 SlabDomain<D>::getOwner(const f32 p_Position) const
+{
+    const auto first = m_Boundaries.begin() + 1;
+    return static_cast<u32>(std::upper_bound(first, m_Boundaries.end() - 1, p_Position) - first);
+}
+
+template <Dimension D>
+void SlabDomain<D>::pack(const Solver<D> &p_Solver, const SimArray<u32> &p_Indices, Message &p_Message) const
+{
+    p_Message.Resize(p_Indices.GetSize() * sizeof(Particle));
+    u8 *data = p_Message.GetData();
+    for (const u32 index : p_Indices)
+    {
+        Particle particle{};
+        particle.Position = p_Solver.Data.State.Positions[index];
+        particle.Velocity = p_Solver.Data.State.Velocities[index];
+        particle.Mass = p_Solver.Data.Masses[index];
+        particle.RestDistance = p_Solver.Data.RestDistances[index];
+        particle.Material = p_Solver.Data.MaterialIndices[index];
+        std::memcpy(data, &particle, sizeof(Particle));
+        data += sizeof(Particle);
+    }
+}
+
+template <Dimension D> void SlabDomain<D>::unpack(Solver<D> &p_Solver, const Message &p_Message)
+{
+    const u32 count = p_Message.GetSize() / sizeof(Particle);
+    if (count == 0)
+        return;
+
+    m_Positions.Resize(count);
+    m_Velocities.Resize(count);
+    m_Materials.Resize(count);
+    SimArray<Particle> particles;
+    particles.Resize(count);
+    std::memcpy(particles.GetData(), p_Message.GetData(), count * sizeof(Particle));
+    for (u32 i = 0; i < count; ++i)
+    {
+        m_Positions[i] = particles[i].Position;
+        m_Velocities[i] = particles[i].Velocity;
+        m_Materials[i] = particles[i].Material;
+    }
+
+    const u32 start = p_Solver.GetParticleCount();
+    p_Solver.AddParticles(m_Positions.GetData(), m_Velocities.GetData(), count, m_Materials.GetData());
+    for (u32 i = 0; i < count; ++i)
+    {
+        p_Solver.Data.Masses[start + i] = particles[i].Mass;
+        p_Solver.Data.RestDistances[start + i] = particles[i].RestDistance;
+    }
+}
+
+// Slabs are kept at least two halos wide, so that halos only ever reach the neighboring slabs, and never reach both
+// ends of a slab at once
+template <Dimension D> void SlabDomain<D>::enforceMinWidth()
+{
+    const u32 ranks = m_Boundaries.GetSize() - 1;
+    const f32 width = 2.f * m_Halo;
+    for (u32 i = 1; i < ranks; ++i)
+        m_Boundaries[i] = Math::Max(m_Boundaries[i], m_Boundaries[i - 1] + width);
+    for (u32 i = ranks - 1; i > 0; --i)
+        m_Boundaries[i] = Math::Min(m_Boundaries[i], m_Boundaries[i + 1] - width);
+}
+
+// Every rank sends to the rank r places ahead and receives from the one r places behind in round r, so particles reach
+// their owner in a single step even if they crossed several slabs or the boundaries moved under them
+template <Dimension D> bool SlabDomain<D>::migrate(Solver<D> &p_Solver)
+{
+    TKIT_PROFILE_NSCOPE("Driz::SlabDomain::Migrate");
+    const u32 rank = m_Transport->GetRank();
+    const u32 ranks = m_Transport->GetRankCount();
+    if (ranks == 1)
+        return true;
+
+    const auto &positions = p_Solver.Data.State.Positions;
+    for (SimArray<u32> &indices : m_Migrating)
+        indices.Clear();
+    for (u32 i = 0; i < p_Solver.GetParticleCount(); ++i)
+    {
+        const u32 owner = getOwner(positions[i][0]);
+        if (owner != rank)
+            m_Migrating[owner].Append(i);
+    }
+    for (u32 i = 0; i < ranks; ++i)
+        pack(p_Solver, m_Migrating[i], m_Outgoing[i]);
+
+    p_Solver.RemoveParticlesIf(
+        [this, rank, &positions](const u32 p_Index) { return getOwner(positions[p_Index][0]) != rank; });
+
+    for (u32 i = 1; i < ranks; ++i)
+    {
+        const u32 to = (rank + i) % ranks;
+        const u32 from = (rank + ranks - i) % ranks;
+        if (!m_Transport->Exchange(to, m_Outgoing[to], from, m_Incoming))
+            return false;
+        unpack(p_Solver, m_Incoming);
+    }
+    return true;
+}
+
+// Upper halos travel to the right neighbor first, and lower halos to the left one after. Periodic boxes wrap the
+// first and last slabs around
+template <Dimension D> bool SlabDomain<D>::exchangeHalos(Solver<D> &p_Solver)
+{
+    TKIT_PROFILE_NSCOPE("Driz::SlabDomain::ExchangeHalos");
+    const u32 rank = m_Transport->GetRank();
+    const u32 ranks = m_Transport->GetRankCount();
+    if (ranks == 1)
+        return true;
+
+    const u32 left = rank > 0 ? rank - 1 : (m_Periodic ? ranks - 1 : Transport::NoRank);
+    const u32 right = rank + 1 < ranks ? rank + 1 : (m_Periodic ? 0 : Transport::NoRank);
+
+    const f32 lower = GetLower() + m_Halo;
+    const f32 upper = GetUpper() - m_Halo;
+    const auto &positions = p_Solver.Data.State.Positions;
+    m_LowerHalo.Clear();
+    m_UpperHalo.Clear();
+    for (u32 i = 0; i < p_Solver.GetParticleCount(); ++i)
+    {
+        if (positions[i][0] < lower)
+            m_LowerHalo.Append(i);
+        if (positions[i][0] >= upper)
+            m_UpperHalo.Append(i);
+    }
+    if (right == Transport::NoRank)
+        m_UpperHalo.Clear();
+    if (left == Transport::NoRank)
+        m_LowerHalo.Clear();
+
+    pack(p_Solver, m_UpperHalo, m_Outgoing[0]);
+    pack(p_Solver, m_LowerHalo, m_Outgoing[1]);
+    if (!m_Transport->Exchange(right, m_Outgoing[0], left, m_Incoming))
+        return false;
+    unpack(p_Solver, m_Incoming);
+
+    if (!m_Transport->Exchange(left, m_Outgoing[1], right, m_Incoming))
+        return false;
+    unpack(p_Solver, m_Incoming);
+    return true;
+}
+
+#ifdef DRIZ_HAS_FORK
+static bool s_OwnsDirectory = false;
+
+u32 SpawnRanks(DistributedSpecs &p_Specs)
+{
+    if (p_Specs.Directory.empty())
+    {
+        p_Specs.Directory = fs::temp_directory_path() / ("drizzle-" + std::to_string(::getpid()));
+        s_OwnsDirectory = true;
+    }
+    std::error_code error;
+    fs::create_directories(p_Specs.Directory, error);
+    if (error)
+    {
+        std::cerr << "Failed to create '" << p_Specs.Directory.string() << "': " << error.message() << '\n';
+        return Transport::NoRank;
+    }
+
+    // Anything still buffered would otherwise be written once by every rank
+    std::cout.flush();
+    std::cerr.flush();
+    for (u32 i = 1; i < p_Specs.Ranks; ++i)
+    {
+        const pid_t pid = ::fork();
+        if (pid == 0)
+            return i;
+        if (pid < 0)
+        {
+            std::cerr << "Failed to spawn rank " << i << ".\n";
+            return Transport::NoRank;
+        }
+    }
+    return 0;
+}
+
+bool WaitForRanks(const DistributedSpecs &p_Specs)
+{
+    bool succeeded = true;
+    for (u32 i = 1; i < p_Specs.Ranks; ++i)
+    {
+        i32 status = 0;
+        if (::wait(&status) < 0)
+            return false;
+        succeeded &= WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+    }
+    if (s_OwnsDirectory)
+    {
+        std::error_code error;
+        fs::remove_all(p_Specs.Directory, error);
+    }
+    return succeeded;
+}
+#else
+u32 SpawnRanks(DistributedSpecs &)
+{
+    std::cerr << "Distributed runs need to fork the process, which is not supported on this platform.\n";
+    return Transport::NoRank;
+}
+
+bool WaitForRanks(const DistributedSpecs &)
+{
+    return true;
+}
+#endif
+
+template <Dimension D>
+bool RunDistributed(const HeadlessSpecs &p_Specs, const DistributedSpecs &p_Distributed, const u32 p_Rank,
+                    const SimulationSettings &p_Settings, const SimulationState<D> &p_State)
+{
+    TKIT_PROFILE_NSCOPE("Driz::RunDistributed");
+    SimulationSettings settings = p_Settings;
+    // Splitting and merging would change particles behind the back of the halo exchange
+    settings.AdaptiveResolution = false;
+
+    const f32 extent = p_State.Max[0] - p_State.Min[0];
+    if (extent < 4.f * settings.SmoothingRadius * static_cast<f32>(p_Distributed.Ranks))
+    {
+        if (p_Rank == 0)
+            std::cerr << "The simulation box is too narrow for " << p_Distributed.Ranks
+                      << " ranks. Every slab must be at least four smoothing radii wide.\n";
+        return false;
+    }
+
+    SocketTransport transport{};
+    if (!transport.Connect(p_Distributed.Directory, p_Rank, p_Distributed.Ranks))
+        return false;
+
+    SlabDomain<D> domain{transport, settings, p_State};
+    Solver<D> solver{settings, domain.Partition(p_State)};
+
+    f32 stepTime = 0.f;
+    f64 totalStepTime = 0.0;
+    TKit::Clock clock{};
+    for (u32 i = 0; i < p_Specs.Steps; ++i)
+    {
+        if (!domain.Step(solver, p_Specs.Timestep))
+        {
+            std::cerr << "Rank " << p_Rank << " lost contact with its peers.\n";
+            return false;
+        }
+        stepTime += domain.GetLastStepTime();
+        totalStepTime += domain.GetLastStepTime();
+        if (p_Distributed.RebalanceEvery != 0 && (i + 1) % p_Distributed.RebalanceEvery == 0)
+        {
+            if (!domain.Rebalance(stepTime, p_Distributed.RebalanceDamping))
+                return false;
+            stepTime = 0.f;
+        }
+    }
+    const f64 elapsed = clock.GetElapsed().AsSeconds();
+
+    if (!StepTelemetry::ExportPath.empty())
+    {
+        fs::path path = StepTelemetry::ExportPath;
+        path.replace_filename(path.stem().string() + "-rank" + std::to_string(p_Rank) + path.extension().string());
+        solver.Telemetry.Export(path);
+    }
+
+    struct Summary
+    {
+        f32 Lower;
+        f32 Upper;
+        f32 StepTime;
+        u32 Particles;
+        u32 Emitted;
+        u32 Sunk;
+    };
+    const Summary summary{domain.GetLower(),
+                          domain.GetUpper(),
+                          static_cast<f32>(totalStepTime / Math::Max(p_Specs.Steps, 1u)),
+                          solver.GetParticleCount(),
+                          domain.GetEmittedCount(),
+                          domain.GetSunkCount()};
+    Message gathered;
+    if (!transport.AllGather(&summary, sizeof(Summary), gathered))
+        return false;
+    if (p_Rank != 0)
+        return true;
+
+    SimArray<Summary> summaries;
+    summaries.Resize(p_Distributed.Ranks);
+    std::memcpy(summaries.GetData(), gathered.GetData(), gathered.GetSize());
+
+    u32 particles = 0;
+    u32 expected = p_State.Positions.GetSize();
+    for (const Summary &rank : summaries)
+    {
+        particles += rank.Particles;
+        expected += rank.Emitted - rank.Sunk;
+    }
+    std::cout << "Simulated " << p_Specs.Steps << " steps of " << particles << " particles across "
+              << p_Distributed.Ranks << " ranks in " << elapsed << " s\n";
+    for (u32 i = 0; i < p_Distributed.Ranks; ++i)
+        std::cout << TKit::Format("    Rank {}: [{:.2f}, {:.2f}) with {} particles, {:.3f} ms per step\n", i,
+                                  summaries[i].Lower, summaries[i].Upper, summaries[i].Particles,
+                                  summaries[i].StepTime);
+
+    // Migration and halo exchanges must neither lose nor duplicate particles, so only flows change the total
+    if (particles != expected)
+    {
+        std::cerr << "The ranks hold " << particles << " particles, but " << expected
+                  << " were expected from the initial state and the flows.\n";
+        return false;
+    }
+    return true;
+}
+
+template class SlabDomain<D2>;
+template class SlabDomain<D3>;
+
+template bool RunDistributed<D2>(const HeadlessSpecs &, const DistributedSpecs &, u32, const SimulationSettings &,
+                                 const SimulationState<D2> &);
+template bool RunDistributed<D3>(const HeadlessSpecs &, const DistributedSpecs &, u32, const SimulationSettings &,
+                                 const SimulationState<D3> &);
+} // namespace Driz
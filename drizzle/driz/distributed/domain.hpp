@@ -0,0 +1,93 @@
+#pragma once
+
+#include "driz/distributed/transport.hpp"
+#include "driz/simulation/solver.hpp"
+#include "driz/headless/batch.hpp"
+
+namespace Driz
+{
+struct DistributedSpecs
+{
+    u32 Ranks = 1;
+    fs::path Directory; // Where the rank sockets live. A temporary directory is used if empty
+    u32 RebalanceEvery = 20;
+    f32 RebalanceDamping = 0.5f; // How far slab boundaries move towards their balanced position at each rebalance
+};
+
+// The simulation box is split in slabs along the x axis, one per rank. Every rank owns the particles inside its slab,
+// and before each step receives copies of the particles within two smoothing radii of its slab from its neighbors, so
+// that the halo particles it interacts with have complete densities themselves. Copies are dropped after the step,
+// and particles that left their slab migrate to the rank owning their new position
+template <Dimension D> class SlabDomain
+{
+  public:
+    // Slabs start with the same amount of particles each. Every rank must be given the same state
+    SlabDomain(Transport &p_Transport, const SimulationSettings &p_Settings, const SimulationState<D> &p_State);
+
+    // Keeps only the particles of the own slab
+    SimulationState<D> Partition(const SimulationState<D> &p_State) const;
+
+    // Migrates particles, exchanges halos and runs a whole step. Returns false if a rank went away
+    bool Step(Solver<D> &p_Solver, f32 p_DeltaTime);
+
+    // Moves slab boundaries so that every rank takes about as long to step, assuming that work is spread evenly
+    // within each slab. Every rank computes the same boundaries from the gathered step times
+    bool Rebalance(f32 p_StepTime, f32 p_Damping);
+
+    f32 GetLower() const;
+    f32 GetUpper() const;
+    // Milliseconds the solver took during the last step, leaving communication out
+    f32 GetLastStepTime() const;
+    // Particles the emitters and sinks of this rank added and removed since construction
+    u32 GetEmittedCount() const;
+    u32 GetSunkCount() const;
+
+  private:
+    struct Particle
+    {
+        f32v<D> Position;
+        f32v<D> Velocity;
+        f32 Mass;
+        f32 RestDistance;
+        u8 Material;
+    };
+
+    u32 getOwner(f32 p_Position) const;
+    void pack(const Solver<D> &p_Solver, const SimArray<u32> &p_Indices, Message &p_Message) const;
+    void unpack(Solver<D> &p_Solver, const Message &p_Message);
+    void enforceMinWidth();
+
+    bool migrate(Solver<D> &p_Solver);
+    bool exchangeHalos(Solver<D> &p_Solver);
+
+    Transport *m_Transport;
+    SimArray<f32> m_Boundaries; // Rank count + 1 positions along the split axis
+    f32 m_Halo;
+    bool m_Periodic;
+    f32 m_StepTime = 0.f;
+    u32 m_Emitted = 0;
+    u32 m_Sunk = 0;
+
+    SimArray<SimArray<u32>> m_Migrating; // Indexed by destination rank
+    SimArray<u32> m_LowerHalo;
+    SimArray<u32> m_UpperHalo;
+    SimArray<Message> m_Outgoing;
+    Message m_Incoming;
+
+    SimArray<f32v<D>> m_Positions;
+    SimArray<f32v<D>> m_Velocities;
+    SimArray<u8> m_Materials;
+};
+
+// Forks the process into the requested amount of ranks, which must happen before the core spins up its threads.
+// Returns the rank of the calling process, or Transport::NoRank on failure
+u32 SpawnRanks(DistributedSpecs &p_Specs);
+// Called by rank 0 once it is done. Returns false if any other rank failed
+bool WaitForRanks(const DistributedSpecs &p_Specs);
+
+// Runs a headless simulation split across the ranks of a single host. Frames are not rendered, as no rank holds the
+// whole state
+template <Dimension D>
+bool RunDistributed(const HeadlessSpecs &p_Specs, const DistributedSpecs &p_Distributed, u32 p_Rank,
+                    const SimulationSettings &p_Settings, const SimulationState<D> &p_State);
+} // namespace Driz
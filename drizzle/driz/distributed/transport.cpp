@@ -0,0 +1,270 @@
+#include "driz/distributed/transport.hpp"
+#include "driz/core/socket.hpp"
+#include "tkit/profiling/clock.hpp"
+#include "tkit/profiling/macros.hpp"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+namespace Driz
+{
+u32 Transport::GetRank() const
+{
+    return m_Rank;
+}
+u32 Transport::GetRankCount() const
+{
+    return m_RankCount;
+}
+
+// Round r sends to the rank r places ahead and receives from the one r places behind, so that every rank is busy in
+// every round and the whole gather takes rank count - 1 exchanges
+bool Transport::AllGather(const void *p_Value, const usize p_Size, Message &p_Gathered)
+{
+    p_Gathered.Resize(p_Size * m_RankCount);
+    std::memcpy(p_Gathered.GetData() + p_Size * m_Rank, p_Value, p_Size);
+
+    Message sent;
+    sent.Resize(p_Size);
+    std::memcpy(sent.GetData(), p_Value, p_Size);
+
+    Message received;
+    for (u32 i = 1; i < m_RankCount; ++i)
+    {
+        const u32 to = (m_Rank + i) % m_RankCount;
+        const u32 from = (m_Rank + m_RankCount - i) % m_RankCount;
+        if (!Exchange(to, sent, from, received) || received.GetSize() != p_Size)
+            return false;
+        std::memcpy(p_Gathered.GetData() + p_Size * from, received.GetData(), p_Size);
+    }
+    return true;
+}
+
+bool Transport::Barrier()
+{
+    const u8 token = 0;
+    Message gathered;
+    return AllGather(&token, 1, gathered);
+}
+
+SocketTransport::~SocketTransport()
+{
+    close();
+}
+
+#ifdef DRIZ_HAS_SOCKETS
+static fs::path getSocketPath(const fs::path &p_Directory, const u32 p_Rank)
+{
+    return p_Directory / ("rank-" + std::to_string(p_Rank) + ".sock");
+}
+
+static bool sendAll(const i32 p_Socket, const void *p_Data, const usize p_Size)
+{
+    const u8 *data = static_cast<const u8 *>(p_Data);
+    usize sent = 0;
+    while (sent < p_Size)
+    {
+        const ssize_t result = ::send(p_Socket, data + sent, p_Size - sent, DRIZ_SEND_FLAGS);
+        if (result < 0 && errno == EINTR)
+            continue;
+        if (result <= 0)
+            return false;
+        sent += static_cast<usize>(result);
+    }
+    return true;
+}
+
+static bool receiveAll(const i32 p_Socket, void *p_Data, const usize p_Size)
+{
+    u8 *data = static_cast<u8 *>(p_Data);
+    usize received = 0;
+    while (received < p_Size)
+    {
+        const ssize_t result = ::recv(p_Socket, data + received, p_Size - received, 0);
+        if (result < 0 && errno == EINTR)
+            continue;
+        if (result <= 0)
+            return false;
+        received += static_cast<usize>(result);
+    }
+    return true;
+}
+
+bool SocketTransport::Connect(const fs::path &p_Directory, const u32 p_Rank, const u32 p_RankCount,
+                              const f32 p_Timeout)
+{
+    TKIT_PROFILE_NSCOPE("Driz::SocketTransport::Connect");
+    close();
+    m_Rank = p_Rank;
+    m_RankCount = p_RankCount;
+    m_Sockets.Resize(p_RankCount, -1);
+    m_Path = getSocketPath(p_Directory, p_Rank);
+
+    sockaddr_un address;
+    if (!Socket::ToAddress(m_Path, address))
+        return false;
+
+    // Listening before connecting to the lower ranks means no rank ever waits on one that is itself still waiting
+    std::error_code error;
+    fs::remove(m_Path, error);
+    m_Listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m_Listener < 0 || ::bind(m_Listener, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0 ||
+        ::listen(m_Listener, static_cast<i32>(p_RankCount)) != 0)
+    {
+        std::cerr << "Rank " << p_Rank << " failed to listen on '" << m_Path.string() << "': " << std::strerror(errno)
+                  << '\n';
+        return false;
+    }
+
+    TKit::Clock clock{};
+    for (u32 i = 0; i < p_Rank; ++i)
+    {
+        sockaddr_un peer;
+        if (!Socket::ToAddress(getSocketPath(p_Directory, i), peer))
+            return false;
+
+        const i32 socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (socket < 0)
+            return false;
+        while (::connect(socket, reinterpret_cast<const sockaddr *>(&peer), sizeof(peer)) != 0)
+        {
+            if (clock.GetElapsed().AsSeconds() > p_Timeout)
+            {
+                std::cerr << "Rank " << p_Rank << " timed out connecting to rank " << i << ".\n";
+                ::close(socket);
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        m_Sockets[i] = socket;
+        if (!sendAll(socket, &m_Rank, sizeof(m_Rank)))
+            return false;
+    }
+
+    for (u32 i = p_Rank + 1; i < p_RankCount; ++i)
+    {
+        pollfd listener{m_Listener, POLLIN, 0};
+        const f32 remaining = p_Timeout - static_cast<f32>(clock.GetElapsed().AsSeconds());
+        if (remaining <= 0.f || ::poll(&listener, 1, static_cast<i32>(1000.f * remaining)) <= 0)
+        {
+            std::cerr << "Rank " << p_Rank << " timed out waiting for the higher ranks to connect.\n";
+            return false;
+        }
+
+        const i32 socket = ::accept(m_Listener, nullptr, nullptr);
+        u32 rank = NoRank;
+        if (socket < 0 || !receiveAll(socket, &rank, sizeof(rank)) || rank <= p_Rank || rank >= p_RankCount ||
+            m_Sockets[rank] != -1)
+        {
+            std::cerr << "Rank " << p_Rank << " received an invalid connection.\n";
+            if (socket >= 0)
+                ::close(socket);
+            return false;
+        }
+        m_Sockets[rank] = socket;
+    }
+    return true;
+}
+
+// Messages are prefixed with their size. Both directions are driven by a single poll loop, and the sockets are only
+// ever read or written when they are ready, so a full socket buffer on one side never blocks the other
+bool SocketTransport::Exchange(const u32 p_To, const Message &p_Sent, const u32 p_From, Message &p_Received)
+{
+    TKIT_PROFILE_NSCOPE("Driz::SocketTransport::Exchange");
+    const bool sending = p_To != NoRank;
+    const bool receiving = p_From != NoRank;
+
+    const u64 sentSize = p_Sent.GetSize();
+    usize sentBytes = sending ? 0 : sizeof(u64) + sentSize;
+    u64 receivedSize = 0;
+    usize receivedBytes = 0;
+    bool receivedAll = !receiving;
+    p_Received.Clear();
+
+    while (sentBytes < sizeof(u64) + sentSize || !receivedAll)
+    {
+        TKit::Array<pollfd, 2> fds;
+        u32 count = 0;
+        if (sentBytes < sizeof(u64) + sentSize)
+            fds[count++] = pollfd{m_Sockets[p_To], POLLOUT, 0};
+        if (!receivedAll)
+            fds[count++] = pollfd{m_Sockets[p_From], POLLIN, 0};
+
+        if (::poll(&fds[0], count, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        for (u32 i = 0; i < count; ++i)
+        {
+            if (fds[i].revents & (POLLERR | POLLNVAL))
+                return false;
+            if (fds[i].events == POLLOUT && (fds[i].revents & POLLOUT))
+            {
+                const bool header = sentBytes < sizeof(u64);
+                const u8 *data = header ? reinterpret_cast<const u8 *>(&sentSize) + sentBytes
+                                        : p_Sent.GetData() + (sentBytes - sizeof(u64));
+                const usize size = header ? sizeof(u64) - sentBytes : sizeof(u64) + sentSize - sentBytes;
+                const ssize_t result = ::send(fds[i].fd, data, size, MSG_DONTWAIT | DRIZ_SEND_FLAGS);
+                if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+                    continue;
+                if (result <= 0)
+                    return false;
+                sentBytes += static_cast<usize>(result);
+            }
+            else if (fds[i].events == POLLIN && (fds[i].revents & (POLLIN | POLLHUP)))
+            {
+                const bool header = receivedBytes < sizeof(u64);
+                u8 *data = header ? reinterpret_cast<u8 *>(&receivedSize) + receivedBytes
+                                  : p_Received.GetData() + (receivedBytes - sizeof(u64));
+                const usize size = header ? sizeof(u64) - receivedBytes : sizeof(u64) + receivedSize - receivedBytes;
+                const ssize_t result = ::recv(fds[i].fd, data, size, MSG_DONTWAIT);
+                if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+                    continue;
+                if (result <= 0)
+                    return false;
+
+                receivedBytes += static_cast<usize>(result);
+                if (header && receivedBytes == sizeof(u64))
+                    p_Received.Resize(static_cast<u32>(receivedSize));
+                receivedAll = receivedBytes >= sizeof(u64) && receivedBytes == sizeof(u64) + receivedSize;
+            }
+        }
+    }
+    return true;
+}
+
+void SocketTransport::close()
+{
+    for (const i32 socket : m_Sockets)
+        if (socket >= 0)
+            ::close(socket);
+    m_Sockets.Clear();
+    if (m_Listener >= 0)
+    {
+        ::close(m_Listener);
+        m_Listener = -1;
+        std::error_code error;
+        fs::remove(m_Path, error);
+    }
+}
+#else
+bool SocketTransport::Connect(const fs::path &, const u32, const u32, const f32)
+{
+    std::cerr << "Distributed runs need Unix domain sockets, which are not available on this platform.\n";
+    return false;
+}
+
+bool SocketTransport::Exchange(const u32, const Message &, const u32, Message &)
+{
+    return false;
+}
+
+void SocketTransport::close()
+{
+}
+#endif
+} // namespace Driz
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "driz/core/core.hpp"
+
+namespace Driz
+{
+using Message = SimArray<u8>;
+
+// Point to point messaging between the ranks of a distributed run. Every call blocks until it is done, and returns
+// false if a peer went away, after which the transport should not be used anymore
+class Transport
+{
+  public:
+    virtual ~Transport() = default;
+
+    // Sends a message to one rank while receiving another from a possibly different one. Doing both at once is what
+    // keeps ranks that send to each other from deadlocking. Either side is skipped if its rank is NoRank
+    virtual bool Exchange(u32 p_To, const Message &p_Sent, u32 p_From, Message &p_Received) = 0;
+
+    // Every rank contributes a value of the same size, and receives all of them ordered by rank
+    bool AllGather(const void *p_Value, usize p_Size, Message &p_Gathered);
+    bool Barrier();
+
+    u32 GetRank() const;
+    u32 GetRankCount() const;
+
+    static constexpr u32 NoRank = UINT32_MAX;
+
+  protected:
+    u32 m_Rank = 0;
+    u32 m_RankCount = 1;
+};
+
+// Ranks talk over Unix domain sockets, one per pair of ranks, so every rank must run on the same host. Each rank
+// listens on a socket named after it in a shared directory, and connects to every rank below its own
+class SocketTransport final : public Transport
+{
+  public:
+    ~SocketTransport() override;
+
+    // Blocks until every rank is connected, or the timeout expires
+    bool Connect(const fs::path &p_Directory, u32 p_Rank, u32 p_RankCount, f32 p_Timeout = 30.f);
+    bool Exchange(u32 p_To, const Message &p_Sent, u32 p_From, Message &p_Received) override;
+
+  private:
+    void close();
+
+    SimArray<i32> m_Sockets; // Indexed by rank, and -1 for the own one
+    i32 m_Listener = -1;
+    fs::path m_Path;
+};
+} // namespace Driz
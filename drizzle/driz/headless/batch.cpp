@@ -0,0 +1,73 @@
+#include "driz/headless/batch.hpp"
+#include "driz/simulation/autotune.hpp"
+#include "driz/simulation/publisher.hpp"
+#include "tkit/profiling/clock.hpp"
+#include "tkit/profiling/macros.hpp"
+#include <iostream>
+#include <optional>
+
+namespace Driz
+{
+template <Dimension D>
+void RunHeadless(const HeadlessSpecs &p_Specs, const SimulationSettings &p_Settings, const SimulationState<D> &p_State)
+{
+    TKIT_PROFILE_NSCOPE("Driz::RunHeadless");
+    Solver<D> solver{p_Settings, p_State};
+    Autotuner<D> autotuner{};
+    StatePublisher publisher{};
+
+    SoftwareRasterizer<D> rasterizer{};
+    rasterizer.Settings = p_Specs.Raster;
+    std::optional<FrameWriter> writer;
+    if (!p_Specs.FramesPath.empty())
+        writer.emplace(p_Specs.FramesPath, p_Specs.Format);
+
+    const u32 every = Math::Max(p_Specs.FrameEvery, 1u);
+    // Only accepted frames take an index, so that written files stay numbered contiguously
+    u32 frames = 0;
+    u32 dropped = 0;
+    f64 renderTime = 0.0;
+    const auto render = [&]() {
+        TKit::Clock clock{};
+        Image image = writer->Acquire();
+        rasterizer.Render(solver.Settings, solver.Data.State, image);
+        if (writer->Submit(std::move(image), frames))
+            ++frames;
+        else
+            ++dropped;
+        renderTime += clock.GetElapsed().AsMilliseconds();
+    };
+
+    TKit::Clock clock{};
+    for (u32 i = 0; i < p_Specs.Steps; ++i)
+    {
+        if (IAutotuner::Enabled && autotuner.NeedsTuning(solver.GetParticleCount()))
+            autotuner.Tune(solver, p_Specs.Timestep);
+        if (writer && i % every == 0)
+            render();
+        solver.Step(p_Specs.Timestep);
+        publisher.Publish(solver);
+    }
+    if (writer && p_Specs.Steps % every == 0)
+        render();
+    const f64 elapsed = clock.GetElapsed().AsSeconds();
+
+    if (!StepTelemetry::ExportPath.empty())
+        solver.Telemetry.Export(StepTelemetry::ExportPath);
+
+    std::cout << "Simulated " << p_Specs.Steps << " steps of " << solver.GetParticleCount() << " particles in "
+              << elapsed << " s\n";
+    if (!writer)
+        return;
+
+    // Destroying the writer flushes every pending frame
+    writer.reset();
+    const u32 rendered = frames + dropped;
+    std::cout << "Rendered " << rendered << " frames in " << (rendered > 0 ? renderTime / rendered : 0.0)
+              << " ms on average. " << frames << " were written to " << p_Specs.FramesPath << " and " << dropped
+              << " dropped because the disk fell behind\n";
+}
+
+template void RunHeadless<D2>(const HeadlessSpecs &, const SimulationSettings &, const SimulationState<D2> &);
+template void RunHeadless<D3>(const HeadlessSpecs &, const SimulationSettings &, const SimulationState<D3> &);
+} // namespace Driz
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "driz/headless/raster.hpp"
+
+namespace Driz
+{
+struct HeadlessSpecs
+{
+    u32 Steps = 600;
+    f32 Timestep = 1.f / 60.f;
+
+    fs::path FramesPath; // No frames are written if empty
+    u32 FrameEvery = 1;
+    ImageFormat Format = ImageFormat::PNG;
+    RasterSettings Raster{};
+};
+
+// Runs the simulation without a window for a fixed amount of steps, optionally writing a frame every few steps. Frames
+// are rendered on the solver's own worker team between steps, but encoding and disk writes never block it
+template <Dimension D>
+void RunHeadless(const HeadlessSpecs &p_Specs, const SimulationSettings &p_Settings, const SimulationState<D> &p_State);
+} // namespace Driz
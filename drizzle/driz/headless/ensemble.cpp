@@ -0,0 +1,189 @@
+#include "driz/headless/ensemble.hpp"
+#include "driz/simulation/fields.hpp"
+#include "tkit/profiling/clock.hpp"
+#include "tkit/profiling/macros.hpp"
+#include <atomic>
+#include <fstream>
+#include <iostream>
+
+namespace Driz
+{
+struct EnsembleResult
+{
+    f32 StepTime; // Milliseconds
+    f32 ParticleStepsPerSecond;
+    f32 KineticEnergy;
+    f32 DensityError;
+    u32 Particles;
+};
+
+static bool setField(SimulationSettings &p_Settings, const std::string &p_Field, const std::string &p_Value)
+{
+    const FieldResult result = SetCommandLineField(p_Settings, p_Field, p_Value);
+    if (result == FieldResult::Unknown)
+        std::cerr << "'" << p_Field << "' is not a simulation setting that can be swept.\n";
+    else if (result == FieldResult::Invalid)
+        std::cerr << "'" << p_Value << "' is not a valid value for '" << p_Field << "'.\n";
+    return result == FieldResult::Set;
+}
+
+bool ParseSweepAxis(const std::string_view p_Spec, SweepAxis &p_Axis)
+{
+    const usize equal = p_Spec.find('=');
+    if (equal == std::string_view::npos || equal == 0 || equal + 1 == p_Spec.size())
+    {
+        std::cerr << "Sweeps must be specified as 'Field=value,value,...', but got '" << p_Spec << "'.\n";
+        return false;
+    }
+
+    p_Axis.Field = std::string{p_Spec.substr(0, equal)};
+    p_Axis.Values.Clear();
+    std::string_view values = p_Spec.substr(equal + 1);
+    SimulationSettings settings{};
+    while (true)
+    {
+        const usize comma = values.find(',');
+        const std::string value{values.substr(0, comma)};
+        if (!setField(settings, p_Axis.Field, value))
+            return false;
+        p_Axis.Values.Append(value);
+        if (comma == std::string_view::npos)
+            return true;
+        values = values.substr(comma + 1);
+    }
+}
+
+static void writeCsv(std::ostream &p_Stream, const EnsembleSpecs &p_Ensemble, const SimArray<EnsembleResult> &p_Results,
+                     const SimArray<SimArray<u32>> &p_Combinations)
+{
+    p_Stream << "run";
+    for (const SweepAxis &axis : p_Ensemble.Axes)
+        p_Stream << ',' << axis.Field;
+    p_Stream << ",particles,step_ms,particle_steps_per_second,kinetic_energy,density_error\n";
+
+    for (u32 i = 0; i < p_Results.GetSize(); ++i)
+    {
+        const EnsembleResult &result = p_Results[i];
+        p_Stream << i;
+        for (u32 j = 0; j < p_Ensemble.Axes.GetSize(); ++j)
+            p_Stream << ',' << p_Ensemble.Axes[j].Values[p_Combinations[i][j]];
+        p_Stream << ',' << result.Particles << ',' << result.StepTime << ',' << result.ParticleStepsPerSecond << ','
+                 << result.KineticEnergy << ',' << result.DensityError << '\n';
+    }
+}
+
+static void writeJson(std::ostream &p_Stream, const EnsembleSpecs &p_Ensemble,
+                      const SimArray<EnsembleResult> &p_Results, const SimArray<SimArray<u32>> &p_Combinations)
+{
+    p_Stream << "[";
+    for (u32 i = 0; i < p_Results.GetSize(); ++i)
+    {
+        const EnsembleResult &result = p_Results[i];
+        p_Stream << (i == 0 ? "\n  " : ",\n  ") << "{\"run\": " << i << ", \"settings\": {";
+        for (u32 j = 0; j < p_Ensemble.Axes.GetSize(); ++j)
+            p_Stream << (j == 0 ? "" : ", ") << '"' << p_Ensemble.Axes[j].Field << "\": \""
+                     << p_Ensemble.Axes[j].Values[p_Combinations[i][j]] << '"';
+        p_Stream << "}, \"particles\": " << result.Particles << ", \"step_ms\": " << result.StepTime
+                 << ", \"particle_steps_per_second\": " << result.ParticleStepsPerSecond
+                 << ", \"kinetic_energy\": " << result.KineticEnergy << ", \"density_error\": " << result.DensityError
+                 << '}';
+    }
+    p_Stream << "\n]\n";
+}
+
+// Small scenes barely benefit from splitting a step across threads, so every instance runs on a single one and the
+// parallelism comes from running many of them at once. Workers pull the next run from a shared counter, which keeps
+// them busy even when some combinations step much slower than others
+template <Dimension D>
+bool RunEnsemble(const HeadlessSpecs &p_Specs, const EnsembleSpecs &p_Ensemble, const SimulationSettings &p_Settings,
+                 const SimulationState<D> &p_State)
+{
+    TKIT_PROFILE_NSCOPE("Driz::RunEnsemble");
+    // The last axis varies the fastest
+    SimArray<SimArray<u32>> combinations;
+    combinations.Append(SimArray<u32>{});
+    for (const SweepAxis &axis : p_Ensemble.Axes)
+    {
+        SimArray<SimArray<u32>> expanded;
+        expanded.Reserve(combinations.GetSize() * axis.Values.GetSize());
+        for (const SimArray<u32> &combination : combinations)
+            for (u32 i = 0; i < axis.Values.GetSize(); ++i)
+            {
+                SimArray<u32> next = combination;
+                next.Append(i);
+                expanded.Append(next);
+            }
+        combinations = expanded;
+    }
+
+    const u32 runs = combinations.GetSize();
+    SimArray<SimulationSettings> settings;
+    settings.Resize(runs, p_Settings);
+    for (u32 i = 0; i < runs; ++i)
+    {
+        for (u32 j = 0; j < p_Ensemble.Axes.GetSize(); ++j)
+            if (!setField(settings[i], p_Ensemble.Axes[j].Field, p_Ensemble.Axes[j].Values[combinations[i][j]]))
+                return false;
+        settings[i].Partitions = 1;
+    }
+
+    const u32 threads = Core::GetThreadCount();
+    const u32 maxWorkers = p_Ensemble.Workers == 0 ? threads : Math::Min(p_Ensemble.Workers, threads);
+    const u32 workers = Math::Clamp(runs, 1u, maxWorkers);
+
+    SimArray<EnsembleResult> results;
+    results.Resize(runs);
+    std::atomic<u32> next{0};
+
+    TKit::Clock clock{};
+    Core::ForEach(0, workers, workers, [&](const u32, const u32) {
+        for (u32 i = next.fetch_add(1, std::memory_order_relaxed); i < runs;
+             i = next.fetch_add(1, std::memory_order_relaxed))
+        {
+            TKIT_PROFILE_NSCOPE("Driz::RunEnsemble::Instance");
+            Solver<D> solver{settings[i], p_State};
+            for (u32 j = 0; j < p_Specs.Steps; ++j)
+                solver.Step(p_Specs.Timestep);
+
+            const StepSample average = solver.Telemetry.GetAverage(solver.Telemetry.GetSampleCount());
+            results[i] = EnsembleResult{.StepTime = average.StepTime,
+                                        .ParticleStepsPerSecond = average.GetParticleStepsPerSecond(),
+                                        .KineticEnergy = solver.ComputeKineticEnergy(),
+                                        .DensityError = solver.ComputeDensityError(),
+                                        .Particles = solver.GetParticleCount()};
+        }
+    });
+    const f64 elapsed = clock.GetElapsed().AsSeconds();
+
+    f64 particleSteps = 0.0;
+    for (const EnsembleResult &result : results)
+        particleSteps += static_cast<f64>(result.Particles) * p_Specs.Steps;
+    std::cout << "Ran " << runs << " instances of " << p_Specs.Steps << " steps on " << workers << " workers in "
+              << elapsed << " s, " << (elapsed > 0.0 ? particleSteps / elapsed : 0.0)
+              << " particle steps per second overall\n";
+
+    if (p_Ensemble.ResultsPath.empty())
+    {
+        writeCsv(std::cout, p_Ensemble, results, combinations);
+        return true;
+    }
+
+    std::ofstream file{p_Ensemble.ResultsPath};
+    if (p_Ensemble.ResultsPath.extension() == ".json")
+        writeJson(file, p_Ensemble, results, combinations);
+    else
+        writeCsv(file, p_Ensemble, results, combinations);
+    if (!file)
+    {
+        std::cerr << "Failed to write the ensemble results to " << p_Ensemble.ResultsPath << ".\n";
+        return false;
+    }
+    std::cout << "Results were written to " << p_Ensemble.ResultsPath << '\n';
+    return true;
+}
+
+template bool RunEnsemble<D2>(const HeadlessSpecs &, const EnsembleSpecs &, const SimulationSettings &,
+                              const SimulationState<D2> &);
+template bool RunEnsemble<D3>(const HeadlessSpecs &, const EnsembleSpecs &, const SimulationSettings &,
+                              const SimulationState<D3> &);
+} // namespace Driz
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "driz/headless/batch.hpp"
+#include <string>
+#include <string_view>
+
+namespace Driz
+{
+struct SweepAxis
+{
+    std::string Field;
+    SimArray<std::string> Values;
+};
+
+struct EnsembleSpecs
+{
+    SimArray<SweepAxis> Axes; // Every combination of their values is run
+    fs::path ResultsPath;     // Printed to the standard output if empty
+    u32 Workers = 0;          // Instances running at once. Zero uses every thread
+};
+
+// Parses a 'Field=value,value,...' specification. Fields are those of the command line group of the simulation
+// settings, named either as in the settings files or as their command line options
+bool ParseSweepAxis(std::string_view p_Spec, SweepAxis &p_Axis);
+
+// Runs one single threaded solver per combination of swept values, as many at once as there are workers. Instances
+// share nothing but the starting state, and every one of them reports its throughput and final physical invariants to
+// a single results table
+template <Dimension D>
+bool RunEnsemble(const HeadlessSpecs &p_Specs, const EnsembleSpecs &p_Ensemble, const SimulationSettings &p_Settings,
+                 const SimulationState<D> &p_State);
+} // namespace Driz
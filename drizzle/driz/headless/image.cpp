@@ -0,0 +1,237 @@
+#include "driz/headless/image.hpp"
+#include "tkit/container/array.hpp"
+#include "tkit/profiling/macros.hpp"
+#include <fstream>
+
+namespace Driz
+{
+void Image::Resize(const u32 p_Width, const u32 p_Height)
+{
+    Width = p_Width;
+    Height = p_Height;
+    Pixels.Resize(p_Width * p_Height * 3);
+}
+
+const char *GetImageExtension(const ImageFormat p_Format)
+{
+    return p_Format == ImageFormat::PNG ? ".png" : ".ppm";
+}
+
+static const TKit::Array<u32, 256> &getCrcTable()
+{
+    static const TKit::Array<u32, 256> table = [] {
+        TKit::Array<u32, 256> t{};
+        for (u32 i = 0; i < 256; ++i)
+        {
+            u32 c = i;
+            for (u32 j = 0; j < 8; ++j)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    return table;
+}
+
+static u32 updateCrc(u32 p_Crc, const u8 *p_Data, const u32 p_Size)
+{
+    const TKit::Array<u32, 256> &table = getCrcTable();
+    for (u32 i = 0; i < p_Size; ++i)
+        p_Crc = table[(p_Crc ^ p_Data[i]) & 0xFF] ^ (p_Crc >> 8);
+    return p_Crc;
+}
+
+static void appendBigEndian(SimArray<u8> &p_Buffer, const u32 p_Value)
+{
+    p_Buffer.Append(static_cast<u8>(p_Value >> 24));
+    p_Buffer.Append(static_cast<u8>(p_Value >> 16));
+    p_Buffer.Append(static_cast<u8>(p_Value >> 8));
+    p_Buffer.Append(static_cast<u8>(p_Value));
+}
+
+static void appendChunk(SimArray<u8> &p_Buffer, const char *p_Type, const SimArray<u8> &p_Data)
+{
+    appendBigEndian(p_Buffer, p_Data.GetSize());
+    const u32 start = p_Buffer.GetSize();
+    for (u32 i = 0; i < 4; ++i)
+        p_Buffer.Append(static_cast<u8>(p_Type[i]));
+    for (const u8 byte : p_Data)
+        p_Buffer.Append(byte);
+
+    const u32 crc = updateCrc(0xFFFFFFFFu, p_Buffer.GetData() + start, p_Buffer.GetSize() - start);
+    appendBigEndian(p_Buffer, crc ^ 0xFFFFFFFFu);
+}
+
+static bool writeFile(const fs::path &p_Path, const u8 *p_Data, const u32 p_Size)
+{
+    std::ofstream file{p_Path, std::ios::binary};
+    if (!file)
+        return false;
+    file.write(reinterpret_cast<const char *>(p_Data), static_cast<std::streamsize>(p_Size));
+    return static_cast<bool>(file);
+}
+
+bool WritePng(const fs::path &p_Path, const Image &p_Image)
+{
+    TKIT_PROFILE_NSCOPE("Driz::WritePng");
+    SimArray<u8> png;
+    constexpr TKit::Array<u8, 8> signature{0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    for (const u8 byte : signature)
+        png.Append(byte);
+
+    SimArray<u8> header;
+    appendBigEndian(header, p_Image.Width);
+    appendBigEndian(header, p_Image.Height);
+    header.Append(8); // Bit depth
+    header.Append(2); // Truecolor
+    header.Append(0); // Deflate
+    header.Append(0); // Adaptive filtering, although every row uses none
+    header.Append(0); // No interlacing
+    appendChunk(png, "IHDR", header);
+
+    // Every row is prefixed with its filter type. The zlib stream is split in stored blocks of at most 65535 bytes
+    const u32 row = 3 * p_Image.Width;
+    const u32 raw = (row + 1) * p_Image.Height;
+    constexpr u32 maxBlock = 65535;
+    SimArray<u8> zlib;
+    zlib.Reserve(raw + 5 * (raw / maxBlock + 1) + 6);
+    zlib.Append(0x78);
+    zlib.Append(0x01);
+
+    u32 adlerA = 1;
+    u32 adlerB = 0;
+    u32 blockLeft = 0;
+    u32 written = 0;
+    const auto put = [&](const u8 p_Byte) {
+        if (blockLeft == 0)
+        {
+            blockLeft = Math::Min(maxBlock, raw - written);
+            zlib.Append(written + blockLeft == raw ? 1 : 0);
+            zlib.Append(static_cast<u8>(blockLeft));
+            zlib.Append(static_cast<u8>(blockLeft >> 8));
+            zlib.Append(static_cast<u8>(~blockLeft));
+            zlib.Append(static_cast<u8>(~blockLeft >> 8));
+        }
+        zlib.Append(p_Byte);
+        --blockLeft;
+        ++written;
+        adlerA = (adlerA + p_Byte) % 65521;
+        adlerB = (adlerB + adlerA) % 65521;
+    };
+    for (u32 y = 0; y < p_Image.Height; ++y)
+    {
+        put(0);
+        const u8 *pixels = p_Image.Pixels.GetData() + y * row;
+        for (u32 x = 0; x < row; ++x)
+            put(pixels[x]);
+    }
+    appendBigEndian(zlib, (adlerB << 16) | adlerA);
+    appendChunk(png, "IDAT", zlib);
+    appendChunk(png, "IEND", SimArray<u8>{});
+
+    return writeFile(p_Path, png.GetData(), png.GetSize());
+}
+
+bool WritePpm(const fs::path &p_Path, const Image &p_Image)
+{
+    TKIT_PROFILE_NSCOPE("Driz::WritePpm");
+    std::ofstream file{p_Path, std::ios::binary};
+    if (!file)
+        return false;
+    file << "P6\n" << p_Image.Width << ' ' << p_Image.Height << "\n255\n";
+    file.write(reinterpret_cast<const char *>(p_Image.Pixels.GetData()),
+               static_cast<std::streamsize>(p_Image.Pixels.GetSize()));
+    return static_cast<bool>(file);
+}
+
+FrameWriter::FrameWriter(const fs::path &p_Directory, const ImageFormat p_Format, const u32 p_MaxPending)
+    : m_Directory(p_Directory), m_Format(p_Format), m_MaxPending(Math::Max(p_MaxPending, 1u))
+{
+    fs::create_directories(m_Directory);
+    m_Thread = std::thread{[this] { run(); }};
+}
+
+FrameWriter::~FrameWriter()
+{
+    {
+        std::scoped_lock lock{m_Mutex};
+        m_Running = false;
+    }
+    m_Condition.notify_all();
+    m_Thread.join();
+}
+
+Image FrameWriter::Acquire()
+{
+    std::scoped_lock lock{m_Mutex};
+    const u32 size = m_Free.GetSize();
+    if (size == 0)
+        return Image{};
+    Image image = std::move(m_Free[size - 1]);
+    m_Free.Resize(size - 1);
+    return image;
+}
+
+bool FrameWriter::Submit(Image &&p_Image, const u32 p_Index)
+{
+    {
+        std::scoped_lock lock{m_Mutex};
+        if (m_Pending.GetSize() + m_InFlight >= m_MaxPending)
+        {
+            ++m_Dropped;
+            m_Free.Append(std::move(p_Image));
+            return false;
+        }
+        m_Pending.Append(Frame{std::move(p_Image), p_Index});
+    }
+    m_Condition.notify_all();
+    return true;
+}
+
+u32 FrameWriter::GetWrittenCount() const
+{
+    std::scoped_lock lock{m_Mutex};
+    return m_Written;
+}
+u32 FrameWriter::GetDroppedCount() const
+{
+    std::scoped_lock lock{m_Mutex};
+    return m_Dropped;
+}
+u32 FrameWriter::GetFailedCount() const
+{
+    std::scoped_lock lock{m_Mutex};
+    return m_Failed;
+}
+
+// Pending frames are taken as a whole batch, and are still written when the writer is destroyed
+void FrameWriter::run()
+{
+    SimArray<Frame> batch;
+    for (;;)
+    {
+        {
+            std::unique_lock lock{m_Mutex};
+            m_Condition.wait(lock, [this] { return !m_Pending.IsEmpty() || !m_Running; });
+            if (m_Pending.IsEmpty())
+                break;
+            std::swap(batch, m_Pending);
+            m_InFlight = batch.GetSize();
+        }
+
+        for (Frame &frame : batch)
+        {
+            const fs::path path =
+                m_Directory / TKit::Format("frame_{:06}{}", frame.Index, GetImageExtension(m_Format));
+            const bool ok =
+                m_Format == ImageFormat::PNG ? WritePng(path, frame.Data) : WritePpm(path, frame.Data);
+
+            std::scoped_lock lock{m_Mutex};
+            ++(ok ? m_Written : m_Failed);
+            --m_InFlight;
+            m_Free.Append(std::move(frame.Data));
+        }
+        batch.Clear();
+    }
+}
+} // namespace Driz
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "driz/core/core.hpp"
+#include "driz/core/math.hpp"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace Driz
+{
+struct Image
+{
+    u32 Width = 0;
+    u32 Height = 0;
+    SimArray<u8> Pixels; // Tightly packed 8 bit RGB rows, from top to bottom
+
+    void Resize(u32 p_Width, u32 p_Height);
+};
+
+enum class ImageFormat : u8
+{
+    PNG,
+    PPM
+};
+
+const char *GetImageExtension(ImageFormat p_Format);
+
+// PNG files are not compressed: the deflate stream is made of stored blocks, which keeps encoding far cheaper than the
+// rendering itself
+bool WritePng(const fs::path &p_Path, const Image &p_Image);
+bool WritePpm(const fs::path &p_Path, const Image &p_Image);
+
+// Encodes and writes frames on a thread of its own, so that slow disks never stall the caller. Frames submitted while
+// too many are still pending are dropped instead. Written images are recycled by Acquire() to avoid reallocations
+class FrameWriter
+{
+  public:
+    FrameWriter(const fs::path &p_Directory, ImageFormat p_Format, u32 p_MaxPending = 4);
+    ~FrameWriter();
+
+    Image Acquire();
+    // Files are named after the given index. Returns false if the frame was dropped
+    bool Submit(Image &&p_Image, u32 p_Index);
+
+    u32 GetWrittenCount() const;
+    u32 GetDroppedCount() const;
+    u32 GetFailedCount() const;
+
+  private:
+    struct Frame
+    {
+        Image Data;
+        u32 Index;
+    };
+
+    void run();
+
+    fs::path m_Directory;
+    ImageFormat m_Format;
+    u32 m_MaxPending;
+
+    std::thread m_Thread;
+    mutable std::mutex m_Mutex;
+    std::condition_variable m_Condition;
+
+    SimArray<Frame> m_Pending;
+    SimArray<Image> m_Free;
+    u32 m_InFlight = 0;
+    u32 m_Written = 0;
+    u32 m_Dropped = 0;
+    u32 m_Failed = 0;
+    bool m_Running = true;
+};
+} // namespace Driz
@@ -0,0 +1,252 @@
+#include "driz/headless/raster.hpp"
+#include "tkit/profiling/macros.hpp"
+#include <cfloat>
+
+namespace Driz
+{
+static constexpr f32 s_HalfFovTangent = 0.414214f; // 45 degrees of vertical field of view
+
+static u8 toByte(const f32 p_Channel)
+{
+    return static_cast<u8>(Math::Clamp(p_Channel, 0.f, 1.f) * 255.f + 0.5f);
+}
+
+static f32v3 normalize(const f32v3 &p_Vector)
+{
+    return p_Vector / Math::Norm(p_Vector);
+}
+
+template <Dimension D>
+void SoftwareRasterizer<D>::Render(const SimulationSettings &p_Settings, const SimulationState<D> &p_State,
+                                   Image &p_Image)
+{
+    TKIT_PROFILE_NSCOPE("Driz::SoftwareRasterizer::Render");
+    p_Image.Resize(Settings.Width, Settings.Height);
+    m_Tiles = u32v2{(Settings.Width + s_TileSize - 1) / s_TileSize, (Settings.Height + s_TileSize - 1) / s_TileSize};
+
+    project(p_Settings, p_State);
+    bin(p_Settings.Partitions);
+    rasterize(p_Settings.Partitions, p_Image);
+}
+
+template <Dimension D>
+void SoftwareRasterizer<D>::project(const SimulationSettings &p_Settings, const SimulationState<D> &p_State)
+{
+    TKIT_PROFILE_NSCOPE("Driz::SoftwareRasterizer::Project");
+    m_Colors.Build(p_Settings);
+    const u32 size = p_State.Positions.GetSize();
+    m_Splats.Resize(size);
+
+    const f32 width = static_cast<f32>(Settings.Width);
+    const f32 height = static_cast<f32>(Settings.Height);
+    const f32v<D> center = 0.5f * (p_State.Min + p_State.Max);
+    const f32v<D> extent = p_State.Max - p_State.Min;
+    const f32 radius = p_Settings.ParticleRadius;
+
+    // The whole box is always in view: fit to the screen in 2D, and seen from a fixed corner direction in 3D
+    f32 scale;
+    f32v3 eye{0.f};
+    f32v3 right{0.f};
+    f32v3 up{0.f};
+    f32v3 forward{0.f};
+    if constexpr (D == D2)
+        scale = 0.95f * Math::Min(width / extent[0], height / extent[1]);
+    else
+    {
+        const f32 distance = 0.6f * Math::Norm(extent) / s_HalfFovTangent;
+        forward = normalize(f32v3{-0.5f, -0.4f, -1.f});
+        right = normalize(Cross(forward, f32v3{0.f, 1.f, 0.f}));
+        up = Cross(right, forward);
+        eye = center - distance * forward;
+        scale = 0.5f * height / s_HalfFovTangent;
+    }
+
+    Core::ForEach(0, size, p_Settings.Partitions, [&](const u32 p_Start, const u32 p_End) {
+        for (u32 i = p_Start; i < p_End; ++i)
+        {
+            Splat &splat = m_Splats[i];
+            const f32v4 &color = m_Colors.Evaluate(Math::NormSquared(p_State.Velocities[i])).RGBA;
+            splat.Color = f32v3{color[0], color[1], color[2]};
+            if constexpr (D == D2)
+            {
+                const f32v2 offset = p_State.Positions[i] - center;
+                splat.Center = f32v2{0.5f * width + scale * offset[0], 0.5f * height - scale * offset[1]};
+                splat.Radius = scale * radius;
+                splat.Depth = 0.f;
+                splat.DepthRadius = 0.f;
+            }
+            else
+            {
+                const f32v3 offset = p_State.Positions[i] - eye;
+                const f32 depth = Math::Dot(offset, forward);
+                splat.Depth = depth;
+                splat.DepthRadius = radius;
+                if (depth <= radius)
+                {
+                    splat.Radius = 0.f;
+                    continue;
+                }
+                const f32 focal = scale / depth;
+                splat.Center = f32v2{0.5f * width + focal * Math::Dot(offset, right),
+                                     0.5f * height - focal * Math::Dot(offset, up)};
+                splat.Radius = focal * radius;
+            }
+            // Particles smaller than a pixel would flicker in and out of existence
+            if (splat.Radius > 0.f)
+                splat.Radius = Math::Max(splat.Radius, 0.75f);
+        }
+    });
+}
+
+template <Dimension D>
+bool SoftwareRasterizer<D>::getTileRange(const Splat &p_Splat, u32v2 &p_Min, u32v2 &p_Max) const
+{
+    if (p_Splat.Radius <= 0.f)
+        return false;
+    const f32v2 size{static_cast<f32>(Settings.Width), static_cast<f32>(Settings.Height)};
+    for (u32 i = 0; i < 2; ++i)
+    {
+        const f32 low = p_Splat.Center[i] - p_Splat.Radius;
+        const f32 high = p_Splat.Center[i] + p_Splat.Radius;
+        if (high < 0.f || low >= size[i])
+            return false;
+        p_Min[i] = static_cast<u32>(Math::Max(low, 0.f)) / s_TileSize;
+        p_Max[i] = static_cast<u32>(Math::Min(high, size[i] - 1.f)) / s_TileSize;
+    }
+    return true;
+}
+
+// Splats are counted per partition and tile first, so that every partition knows where to write its indices. Tiles
+// end up listing their splats in particle order, which keeps 2D overlaps stable between frames
+template <Dimension D> void SoftwareRasterizer<D>::bin(const u32 p_Partitions)
+{
+    TKIT_PROFILE_NSCOPE("Driz::SoftwareRasterizer::Bin");
+    const u32 tiles = m_Tiles[0] * m_Tiles[1];
+    const u32 size = m_Splats.GetSize();
+    m_TileCounts.Resize(p_Partitions * tiles);
+    m_TileOffsets.Resize(tiles + 1);
+
+    const auto forEachTile = [this](const Splat &p_Splat, const auto &p_Function) {
+        u32v2 min;
+        u32v2 max;
+        if (!getTileRange(p_Splat, min, max))
+            return;
+        for (u32 y = min[1]; y <= max[1]; ++y)
+            for (u32 x = min[0]; x <= max[0]; ++x)
+                p_Function(y * m_Tiles[0] + x);
+    };
+
+    Core::ForEachChunk(0, size, p_Partitions,
+                       [this, tiles, &forEachTile](const u32 p_Chunk, const u32 p_Start, const u32 p_End) {
+                           u32 *counts = m_TileCounts.GetData() + p_Chunk * tiles;
+                           for (u32 t = 0; t < tiles; ++t)
+                               counts[t] = 0;
+                           for (u32 i = p_Start; i < p_End; ++i)
+                               forEachTile(m_Splats[i], [counts](const u32 p_Tile) { ++counts[p_Tile]; });
+                       });
+
+    u32 total = 0;
+    for (u32 t = 0; t < tiles; ++t)
+    {
+        m_TileOffsets[t] = total;
+        for (u32 c = 0; c < p_Partitions; ++c)
+        {
+            const u32 count = m_TileCounts[c * tiles + t];
+            m_TileCounts[c * tiles + t] = total;
+            total += count;
+        }
+    }
+    m_TileOffsets[tiles] = total;
+    m_TileSplats.Resize(total);
+
+    Core::ForEachChunk(0, size, p_Partitions,
+                       [this, tiles, &forEachTile](const u32 p_Chunk, const u32 p_Start, const u32 p_End) {
+                           u32 *offsets = m_TileCounts.GetData() + p_Chunk * tiles;
+                           u32 *splats = m_TileSplats.GetData();
+                           for (u32 i = p_Start; i < p_End; ++i)
+                               forEachTile(m_Splats[i],
+                                           [offsets, splats, i](const u32 p_Tile) { splats[offsets[p_Tile]++] = i; });
+                       });
+}
+
+template <Dimension D> void SoftwareRasterizer<D>::rasterize(const u32 p_Partitions, Image &p_Image)
+{
+    TKIT_PROFILE_NSCOPE("Driz::SoftwareRasterizer::Rasterize");
+    const u32 width = Settings.Width;
+    const u32 height = Settings.Height;
+    if constexpr (D == D3)
+        m_Depth.Resize(width * height);
+
+    const TKit::Array<u8, 3> background{toByte(Settings.Background[0]), toByte(Settings.Background[1]),
+                                        toByte(Settings.Background[2])};
+    const f32v3 light = normalize(f32v3{-0.4f, 0.6f, 0.7f});
+
+    Core::ForEach(0, m_Tiles[0] * m_Tiles[1], p_Partitions, [&](const u32 p_Start, const u32 p_End) {
+        for (u32 tile = p_Start; tile < p_End; ++tile)
+        {
+            const u32 x0 = (tile % m_Tiles[0]) * s_TileSize;
+            const u32 y0 = (tile / m_Tiles[0]) * s_TileSize;
+            const u32 x1 = Math::Min(x0 + s_TileSize, width);
+            const u32 y1 = Math::Min(y0 + s_TileSize, height);
+
+            for (u32 y = y0; y < y1; ++y)
+                for (u32 x = x0; x < x1; ++x)
+                {
+                    u8 *pixel = p_Image.Pixels.GetData() + 3 * (y * width + x);
+                    pixel[0] = background[0];
+                    pixel[1] = background[1];
+                    pixel[2] = background[2];
+                    if constexpr (D == D3)
+                        m_Depth[y * width + x] = FLT_MAX;
+                }
+
+            for (u32 k = m_TileOffsets[tile]; k < m_TileOffsets[tile + 1]; ++k)
+            {
+                const Splat &splat = m_Splats[m_TileSplats[k]];
+                const f32 r2 = splat.Radius * splat.Radius;
+
+                const u32 sx0 = static_cast<u32>(Math::Max(splat.Center[0] - splat.Radius, static_cast<f32>(x0)));
+                const u32 sy0 = static_cast<u32>(Math::Max(splat.Center[1] - splat.Radius, static_cast<f32>(y0)));
+                const u32 sx1 = static_cast<u32>(
+                    Math::Clamp(splat.Center[0] + splat.Radius + 1.f, static_cast<f32>(x0), static_cast<f32>(x1)));
+                const u32 sy1 = static_cast<u32>(
+                    Math::Clamp(splat.Center[1] + splat.Radius + 1.f, static_cast<f32>(y0), static_cast<f32>(y1)));
+
+                for (u32 y = sy0; y < sy1; ++y)
+                {
+                    const f32 dy = static_cast<f32>(y) + 0.5f - splat.Center[1];
+                    for (u32 x = sx0; x < sx1; ++x)
+                    {
+                        const f32 dx = static_cast<f32>(x) + 0.5f - splat.Center[0];
+                        const f32 d2 = dx * dx + dy * dy;
+                        if (d2 > r2)
+                            continue;
+
+                        const u32 index = y * width + x;
+                        f32v3 color = splat.Color;
+                        if constexpr (D == D3)
+                        {
+                            // The splat bulges towards the camera like the sphere it stands for
+                            const f32 bulge = Math::SquareRoot(Math::Max(1.f - d2 / r2, 0.f));
+                            const f32 depth = splat.Depth - bulge * splat.DepthRadius;
+                            if (depth >= m_Depth[index])
+                                continue;
+                            m_Depth[index] = depth;
+
+                            const f32v3 normal{dx / splat.Radius, -dy / splat.Radius, bulge};
+                            color *= 0.35f + 0.65f * Math::Max(Math::Dot(normal, light), 0.f);
+                        }
+                        u8 *pixel = p_Image.Pixels.GetData() + 3 * index;
+                        pixel[0] = toByte(color[0]);
+                        pixel[1] = toByte(color[1]);
+                        pixel[2] = toByte(color[2]);
+                    }
+                }
+            }
+        }
+    });
+}
+
+template class SoftwareRasterizer<D2>;
+template class SoftwareRasterizer<D3>;
+} // namespace Driz
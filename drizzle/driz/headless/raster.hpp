@@ -0,0 +1,53 @@
+#pragma once
+
+#include "driz/headless/image.hpp"
+#include "driz/app/visualization.hpp"
+
+namespace Driz
+{
+struct RasterSettings
+{
+    u32 Width = 1280;
+    u32 Height = 720;
+    f32v3 Background{0.1f, 0.1f, 0.12f};
+};
+
+// Renders particles straight into an image without a GPU. Splats are projected and binned into screen tiles in
+// parallel, and every tile is then rasterized by a single thread, so that no two threads ever touch the same pixel.
+// 2D particles are flat discs fit to the simulation box, and 3D particles are shaded spheres seen through a fixed
+// perspective camera, depth tested per pixel
+template <Dimension D> class SoftwareRasterizer
+{
+  public:
+    void Render(const SimulationSettings &p_Settings, const SimulationState<D> &p_State, Image &p_Image);
+
+    RasterSettings Settings{};
+
+  private:
+    static constexpr u32 s_TileSize = 64;
+
+    struct Splat
+    {
+        f32v2 Center; // In pixels
+        f32 Radius;   // In pixels
+        f32 Depth;    // View space distance of the center, 3D only
+        f32 DepthRadius;
+        f32v3 Color;
+    };
+
+    void project(const SimulationSettings &p_Settings, const SimulationState<D> &p_State);
+    void bin(u32 p_Partitions);
+    void rasterize(u32 p_Partitions, Image &p_Image);
+
+    bool getTileRange(const Splat &p_Splat, u32v2 &p_Min, u32v2 &p_Max) const;
+
+    SpeedColorTable m_Colors;
+    SimArray<Splat> m_Splats;
+
+    u32v2 m_Tiles{0};
+    SimArray<u32> m_TileCounts; // One row of tiles per partition, turned into offsets once counted
+    SimArray<u32> m_TileOffsets;
+    SimArray<u32> m_TileSplats;
+    SimArray<f32> m_Depth;
+};
+} // namespace Driz
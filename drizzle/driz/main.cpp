@@ -13,12 +13,83 @@ void SetIntroLayer(Onyx::Application &p_App, const Driz::ParseResult &p_Result)
         p_App.SetUserLayer<Driz::IntroLayer>(&p_App, p_Result.Settings, p_Result.Dim);
 }
 
+void GenerateScene(Driz::ParseResult &p_Result)
+{
+    if (p_Result.Dim == Driz::D2)
+    {
+        if (!p_Result.State2)
+            p_Result.State2.emplace();
+        Driz::Scene<Driz::D2>::Generate(*p_Result.State2, *p_Result.Scene, DRIZ_MAX_THREADS);
+    }
+    else
+    {
+        if (!p_Result.State3)
+            p_Result.State3.emplace();
+        Driz::Scene<Driz::D3>::Generate(*p_Result.State3, *p_Result.Scene, DRIZ_MAX_THREADS);
+    }
+}
+
 int main(int argc, char **argv)
 {
     TKIT_PROFILE_NOOP();
-    const Driz::ParseResult result = Driz::ParseArgs(argc, argv);
+    Driz::ParseResult result = Driz::ParseArgs(argc, argv);
+
+    Driz::Core::HugePages = result.HugePages;
+    Driz::StepTelemetry::ExportPath = result.TelemetryPath;
+    Driz::StatePublisher::Name = result.PublishName;
+    Driz::StatePublisher::SlotCount = result.PublishSlots;
+    Driz::IAutotuner::Enabled = result.Autotune;
+    Driz::IAutotuner::RetuneThreshold = result.AutotuneThreshold;
+    if (result.Service)
+    {
+        Driz::Core::Initialize(true);
+        const bool succeeded = Driz::RunService(*result.Service);
+        Driz::Core::Terminate();
+        return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (result.Distributed)
+    {
+        // Ranks are forked before any thread exists, and every one of them generates the same scene
+        const Driz::u32 rank = Driz::SpawnRanks(*result.Distributed);
+        if (rank == Driz::Transport::NoRank)
+            return EXIT_FAILURE;
+
+        Driz::Core::Initialize(true);
+        if (result.Scene)
+            GenerateScene(result);
+        const bool succeeded =
+            result.Dim == Driz::D2
+                ? Driz::RunDistributed<Driz::D2>(*result.Headless, *result.Distributed, rank, result.Settings,
+                                                 *result.State2)
+                : Driz::RunDistributed<Driz::D3>(*result.Headless, *result.Distributed, rank, result.Settings,
+                                                 *result.State3);
+        Driz::Core::Terminate();
+        if (rank != 0)
+            return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
+        return Driz::WaitForRanks(*result.Distributed) && succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (result.Headless)
+    {
+        Driz::Core::Initialize(true);
+        if (result.Scene)
+            GenerateScene(result);
+        bool succeeded = true;
+        if (result.Ensemble)
+            succeeded = result.Dim == Driz::D2 ? Driz::RunEnsemble<Driz::D2>(*result.Headless, *result.Ensemble,
+                                                                             result.Settings, *result.State2)
+                                               : Driz::RunEnsemble<Driz::D3>(*result.Headless, *result.Ensemble,
+                                                                             result.Settings, *result.State3);
+        else if (result.Dim == Driz::D2)
+            Driz::RunHeadless<Driz::D2>(*result.Headless, result.Settings, *result.State2);
+        else
+            Driz::RunHeadless<Driz::D3>(*result.Headless, result.Settings, *result.State3);
+        Driz::Core::Terminate();
+        return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
     Driz::Core::Initialize();
+    if (result.Scene)
+        GenerateScene(result);
     {
         Onyx::Window::Specs specs{};
         specs.Name = "Drizzle " DRIZ_VERSION;
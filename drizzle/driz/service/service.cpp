@@ -0,0 +1,702 @@
+#include "driz/service/service.hpp"
+#include "driz/core/socket.hpp"
+#include "driz/simulation/fields.hpp"
+#include "driz/simulation/solver.hpp"
+#include "tkit/serialization/yaml/container.hpp"
+#include "tkit/serialization/yaml/tensor.hpp"
+#include "tkit/serialization/yaml/driz/simulation/settings.hpp"
+#include "tkit/serialization/yaml/driz/simulation/material.hpp"
+#include "tkit/serialization/yaml/driz/simulation/flow.hpp"
+#include "tkit/profiling/clock.hpp"
+#include "tkit/profiling/macros.hpp"
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+namespace Driz
+{
+static constexpr usize s_MaxCommandSize = 64 * 1024;
+
+static std::string_view nextToken(std::string_view &p_Text)
+{
+    const usize start = p_Text.find_first_not_of(' ');
+    if (start == std::string_view::npos)
+    {
+        p_Text = {};
+        return {};
+    }
+    const usize end = p_Text.find(' ', start);
+    const std::string_view token = p_Text.substr(start, end == std::string_view::npos ? end : end - start);
+    p_Text = end == std::string_view::npos ? std::string_view{} : p_Text.substr(end);
+    return token;
+}
+
+static bool parseU32(const std::string_view p_Text, u32 &p_Value)
+{
+    const auto [end, error] = std::from_chars(p_Text.data(), p_Text.data() + p_Text.size(), p_Value);
+    return !p_Text.empty() && error == std::errc{} && end == p_Text.data() + p_Text.size();
+}
+
+// The YAML parser throws on malformed files and on values that do not fit their field, which includes a state of the
+// wrong dimension
+template <typename T> static std::string loadFile(const std::string_view p_Path, T &p_Instance)
+{
+    const fs::path path{p_Path};
+    if (!fs::exists(path))
+        return TKit::Format("error the file '{}' does not exist\n", path.string());
+    try
+    {
+        p_Instance = TKit::Yaml::Deserialize<T>(path.string());
+    }
+    catch (const std::exception &p_Exception)
+    {
+        return TKit::Format("error the file '{}' could not be loaded: {}\n", path.string(), p_Exception.what());
+    }
+    return {};
+}
+
+template <Dimension D> static std::string loadState(const std::string_view p_Path, ServiceJob &p_Job)
+{
+    auto state = std::make_shared<SimulationState<D>>();
+    std::string error = loadFile(p_Path, *state);
+    if (!error.empty())
+        return error;
+    for (u32 i = 0; i < D; ++i)
+        if (!(state->Min[i] < state->Max[i]))
+            return TKit::Format("error the state file '{}' has an empty box\n", p_Path);
+
+    if constexpr (D == D2)
+        p_Job.State2 = std::move(state);
+    else
+        p_Job.State3 = std::move(state);
+    return {};
+}
+
+// A value the solver divides by or loops on would otherwise stall or crash the job thread, and every job queued behind
+// it with it
+static std::string validateJob(const ServiceJob &p_Job)
+{
+    const SimulationSettings &settings = p_Job.Settings;
+    const std::pair<const char *, f32> positives[] = {{"ParticleRadius", settings.ParticleRadius},
+                                                      {"ParticleMass", settings.ParticleMass},
+                                                      {"TargetDensity", settings.TargetDensity},
+                                                      {"SmoothingRadius", settings.SmoothingRadius},
+                                                      {"scene-Spacing", p_Job.Scene.Spacing}};
+    for (const auto &[name, value] : positives)
+        if (!std::isfinite(value) || value <= 0.f)
+            return TKit::Format("error '{}' must be positive, but got {}\n", name, value);
+
+    if (settings.CellRatio == 0)
+        return "error 'CellRatio' must be at least 1\n";
+    if (settings.AdaptiveResolution && (settings.AdaptiveInterval == 0 || settings.AdaptiveMaxMassRatio == 0))
+        return "error 'AdaptiveInterval' and 'AdaptiveMaxMassRatio' must be at least 1\n";
+    return {};
+}
+
+static const char *getStatusName(const JobStatus p_Status)
+{
+    switch (p_Status)
+    {
+    case JobStatus::Queued:
+        return "queued";
+    case JobStatus::Running:
+        return "running";
+    case JobStatus::Done:
+        return "done";
+    case JobStatus::Cancelled:
+        return "cancelled";
+    }
+    return "unknown";
+}
+
+static std::string getFinalLine(const u32 p_Job, const ServiceJob &p_Specs)
+{
+    if (p_Specs.Status == JobStatus::Cancelled)
+        return TKit::Format("cancelled {} {}\n", p_Job, p_Specs.Step);
+    return TKit::Format("done {} {} {} {} {} {}\n", p_Job, p_Specs.Step, p_Specs.Particles, p_Specs.Elapsed,
+                        p_Specs.KineticEnergy, p_Specs.DensityError);
+}
+
+SimulationService::SimulationService(const ServiceSpecs &p_Specs) : m_Specs(p_Specs)
+{
+}
+SimulationService::~SimulationService()
+{
+    close();
+}
+
+std::string SimulationService::submit(std::string_view p_Arguments)
+{
+    ServiceJob job{};
+    const std::string_view dim = nextToken(p_Arguments);
+    if (dim != "2" && dim != "3")
+        return "error the first argument of a submission must be its dimension, either 2 or 3\n";
+    job.Dim = dim == "2" ? D2 : D3;
+
+    // Settings files are loaded first, so that the fields given next the file override it regardless of their order
+    for (std::string_view arguments = p_Arguments, token = nextToken(arguments); !token.empty();
+         token = nextToken(arguments))
+        if (token.starts_with("settings="))
+        {
+            const std::string error = loadFile(token.substr(9), job.Settings);
+            if (!error.empty())
+                return error;
+        }
+
+    for (std::string_view token = nextToken(p_Arguments); !token.empty(); token = nextToken(p_Arguments))
+    {
+        const usize equal = token.find('=');
+        if (equal == std::string_view::npos)
+            return TKit::Format("error expected 'key=value', but got '{}'\n", token);
+
+        const std::string_view key = token.substr(0, equal);
+        const std::string value{token.substr(equal + 1)};
+        if (key == "settings")
+            continue;
+        if (key == "steps" || key == "every")
+        {
+            if (!parseU32(value, key == "steps" ? job.Steps : job.ReportEvery))
+                return TKit::Format("error '{}' is not a valid value for '{}'\n", value, key);
+            continue;
+        }
+        if (key == "timestep")
+        {
+            char *end = nullptr;
+            job.Timestep = std::strtof(value.c_str(), &end);
+            if (value.empty() || *end != '\0' || job.Timestep <= 0.f)
+                return TKit::Format("error '{}' is not a valid timestep\n", value);
+            continue;
+        }
+        if (key == "state")
+        {
+            const std::string error = job.Dim == D2 ? loadState<D2>(value, job) : loadState<D3>(value, job);
+            if (!error.empty())
+                return error;
+            continue;
+        }
+
+        const bool scene = key.starts_with("scene-");
+        const FieldResult result = scene ? SetCommandLineField(job.Scene, key.substr(6), value)
+                                         : SetCommandLineField(job.Settings, key, value);
+        if (result == FieldResult::Unknown)
+            return TKit::Format("error '{}' is not a known setting\n", key);
+        if (result == FieldResult::Invalid)
+            return TKit::Format("error '{}' is not a valid value for '{}'\n", value, key);
+    }
+    job.ReportEvery = Math::Max(job.ReportEvery, 1u);
+    job.Settings.Partitions = Math::Clamp(job.Settings.Partitions, 1u, static_cast<u32>(DRIZ_MAX_THREADS));
+    const std::string error = validateJob(job);
+    if (!error.empty())
+        return error;
+
+    u32 id;
+    {
+        std::scoped_lock lock{m_Mutex};
+        id = m_Jobs.GetSize();
+        m_Jobs.Append(job);
+    }
+    m_Condition.notify_all();
+    return TKit::Format("ok {}\n", id);
+}
+
+std::string SimulationService::subscribe(Client &p_Client, std::string_view p_Arguments)
+{
+    u32 id;
+    if (!parseU32(nextToken(p_Arguments), id))
+        return "error expected a job id\n";
+    const bool frames = nextToken(p_Arguments) == "frames";
+
+    std::scoped_lock lock{m_Mutex};
+    if (id >= m_Jobs.GetSize())
+        return TKit::Format("error there is no job {}\n", id);
+
+    ServiceJob &job = m_Jobs[id];
+    if (job.Status == JobStatus::Done || job.Status == JobStatus::Cancelled)
+        return "ok\n" + getFinalLine(id, job);
+
+    for (Subscription &subscription : p_Client.Subscriptions)
+        if (subscription.Job == id)
+        {
+            if (frames && !subscription.Frames)
+                ++job.FrameSubscribers;
+            else if (!frames && subscription.Frames)
+                --job.FrameSubscribers;
+            subscription.Frames = frames;
+            return "ok\n";
+        }
+    p_Client.Subscriptions.Append(Subscription{id, frames});
+    job.FrameSubscribers += frames;
+    return "ok\n";
+}
+
+std::string SimulationService::cancel(std::string_view p_Arguments)
+{
+    u32 id;
+    if (!parseU32(nextToken(p_Arguments), id))
+        return "error expected a job id\n";
+
+    std::string line;
+    {
+        std::scoped_lock lock{m_Mutex};
+        if (id >= m_Jobs.GetSize())
+            return TKit::Format("error there is no job {}\n", id);
+
+        ServiceJob &job = m_Jobs[id];
+        if (job.Status == JobStatus::Done || job.Status == JobStatus::Cancelled)
+            return TKit::Format("error job {} already finished\n", id);
+        if (job.Status == JobStatus::Running)
+        {
+            // The job thread reports the cancellation itself once it notices
+            m_CancelJob.store(id, std::memory_order_relaxed);
+            return "ok\n";
+        }
+        job.Status = JobStatus::Cancelled;
+        line = getFinalLine(id, job);
+    }
+    publish(id, std::move(line), false, true);
+    return "ok\n";
+}
+
+std::string SimulationService::status()
+{
+    std::scoped_lock lock{m_Mutex};
+    std::string reply = TKit::Format("ok {}\n", m_Jobs.GetSize());
+    for (u32 i = 0; i < m_Jobs.GetSize(); ++i)
+        reply += TKit::Format("job {} {} {} {} {}\n", i, getStatusName(m_Jobs[i].Status), m_Jobs[i].Step,
+                              m_Jobs[i].Steps, m_Jobs[i].Particles);
+    return reply;
+}
+
+void SimulationService::handleCommand(Client &p_Client, std::string_view p_Command)
+{
+    const std::string_view command = nextToken(p_Command);
+    if (command.empty())
+        return;
+
+    if (command == "submit")
+        p_Client.Output += submit(p_Command);
+    else if (command == "subscribe")
+        p_Client.Output += subscribe(p_Client, p_Command);
+    else if (command == "unsubscribe")
+    {
+        u32 id;
+        if (!parseU32(nextToken(p_Command), id))
+        {
+            p_Client.Output += "error expected a job id\n";
+            return;
+        }
+        SimArray<Subscription> &subscriptions = p_Client.Subscriptions;
+        for (u32 i = 0; i < subscriptions.GetSize(); ++i)
+            if (subscriptions[i].Job == id)
+            {
+                if (subscriptions[i].Frames)
+                {
+                    std::scoped_lock lock{m_Mutex};
+                    --m_Jobs[id].FrameSubscribers;
+                }
+                subscriptions[i] = subscriptions[subscriptions.GetSize() - 1];
+                subscriptions.Resize(subscriptions.GetSize() - 1);
+                break;
+            }
+        p_Client.Output += "ok\n";
+    }
+    else if (command == "cancel")
+        p_Client.Output += cancel(p_Command);
+    else if (command == "status")
+        p_Client.Output += status();
+    else if (command == "shutdown")
+    {
+        m_Shutdown = true;
+        p_Client.Output += "ok\n";
+    }
+    else
+        p_Client.Output += TKit::Format("error unknown command '{}'\n", command);
+}
+
+void SimulationService::publish(const u32 p_Job, std::string &&p_Data, const bool p_Frame, const bool p_Final)
+{
+    {
+        std::scoped_lock lock{m_Mutex};
+        m_Events.Append(Event{p_Job, p_Frame, p_Final, std::move(p_Data)});
+    }
+#ifdef DRIZ_HAS_SOCKETS
+    // A full pipe already guarantees a wake up, so a failed write is harmless
+    const u8 token = 0;
+    [[maybe_unused]] const ssize_t result = ::write(m_Wake[1], &token, 1);
+#endif
+}
+
+// Frames are dropped for clients that fall too far behind, but progress and final lines are always delivered
+void SimulationService::dispatchEvents()
+{
+    TKIT_PROFILE_NSCOPE("Driz::SimulationService::DispatchEvents");
+    SimArray<Event> events;
+    {
+        std::scoped_lock lock{m_Mutex};
+        std::swap(events, m_Events);
+    }
+
+    for (const Event &event : events)
+        for (Client &client : m_Clients)
+        {
+            SimArray<Subscription> &subscriptions = client.Subscriptions;
+            const u32 size = subscriptions.GetSize();
+            u32 index = 0;
+            while (index < size && subscriptions[index].Job != event.Job)
+                ++index;
+            if (index == size || (event.Frame && !subscriptions[index].Frames))
+                continue;
+
+            if (event.Final)
+            {
+                subscriptions[index] = subscriptions[size - 1];
+                subscriptions.Resize(size - 1);
+            }
+            if (!event.Frame || client.Output.size() - client.Sent < m_Specs.MaxBufferedBytes)
+                client.Output += event.Data;
+        }
+}
+
+template <Dimension D> void SimulationService::runJob(const u32 p_Job, const ServiceJob &p_Specs)
+{
+    TKIT_PROFILE_NSCOPE("Driz::SimulationService::RunJob");
+    TKit::Clock clock{};
+    const SimulationState<D> *loaded;
+    if constexpr (D == D2)
+        loaded = p_Specs.State2.get();
+    else
+        loaded = p_Specs.State3.get();
+
+    SimulationState<D> state{};
+    if (loaded)
+        state = *loaded;
+    else
+        Scene<D>::Generate(state, p_Specs.Scene, DRIZ_MAX_THREADS);
+
+    Solver<D> solver{p_Specs.Settings, state};
+    u32 step = 0;
+    bool cancelled = false;
+    for (; step < p_Specs.Steps; ++step)
+    {
+        if (m_CancelJob.load(std::memory_order_relaxed) == p_Job)
+        {
+            cancelled = true;
+            break;
+        }
+        solver.Step(p_Specs.Timestep);
+        if ((step + 1) % p_Specs.ReportEvery != 0 && step + 1 != p_Specs.Steps)
+            continue;
+
+        const u32 particles = solver.GetParticleCount();
+        bool frames;
+        {
+            std::scoped_lock lock{m_Mutex};
+            m_Jobs[p_Job].Step = step + 1;
+            m_Jobs[p_Job].Particles = particles;
+            frames = m_Jobs[p_Job].FrameSubscribers != 0;
+        }
+
+        const StepSample average = solver.Telemetry.GetAverage(p_Specs.ReportEvery);
+        publish(p_Job, TKit::Format("progress {} {} {} {} {} {} {}\n", p_Job, step + 1, p_Specs.Steps, particles,
+                                    average.StepTime, average.GetParticleStepsPerSecond(), average.MeanNeighbors));
+        if (!frames)
+            continue;
+
+        const SimulationState<D> &current = solver.Data.State;
+        std::string frame = TKit::Format("frame {} {} {} {}", p_Job, step + 1, static_cast<u32>(D), particles);
+        for (u32 i = 0; i < D; ++i)
+            frame += TKit::Format(" {}", current.Min[i]);
+        for (u32 i = 0; i < D; ++i)
+            frame += TKit::Format(" {}", current.Max[i]);
+        frame += '\n';
+
+        const usize header = frame.size();
+        frame.resize(header + particles * D * sizeof(u16));
+        u8 *data = reinterpret_cast<u8 *>(frame.data() + header);
+        f32v<D> scale;
+        for (u32 i = 0; i < D; ++i)
+            scale[i] = 65535.f / Math::Max(current.Max[i] - current.Min[i], 1e-6f);
+        Core::ForEach(0, particles, p_Specs.Settings.Partitions, [&](const u32 p_Start, const u32 p_End) {
+            for (u32 i = p_Start; i < p_End; ++i)
+                for (u32 j = 0; j < D; ++j)
+                {
+                    const f32 scaled = (current.Positions[i][j] - current.Min[j]) * scale[j];
+                    const u16 quantized = static_cast<u16>(Math::Clamp(scaled, 0.f, 65535.f) + 0.5f);
+                    std::memcpy(data + (i * D + j) * sizeof(u16), &quantized, sizeof(u16));
+                }
+        });
+        publish(p_Job, std::move(frame), true);
+    }
+
+    std::string line;
+    {
+        std::scoped_lock lock{m_Mutex};
+        ServiceJob &job = m_Jobs[p_Job];
+        job.Status = cancelled ? JobStatus::Cancelled : JobStatus::Done;
+        job.Step = step;
+        job.Particles = solver.GetParticleCount();
+        job.Elapsed = static_cast<f32>(clock.GetElapsed().AsSeconds());
+        job.KineticEnergy = solver.ComputeKineticEnergy();
+        job.DensityError = solver.ComputeDensityError();
+        line = getFinalLine(p_Job, job);
+    }
+    publish(p_Job, std::move(line), false, true);
+}
+
+void SimulationService::runJobs()
+{
+    for (;;)
+    {
+        u32 id;
+        ServiceJob job;
+        {
+            std::unique_lock lock{m_Mutex};
+            m_Condition.wait(lock, [this] { return m_NextJob < m_Jobs.GetSize() || !m_Running; });
+            if (!m_Running)
+                return;
+            id = m_NextJob++;
+            if (m_Jobs[id].Status == JobStatus::Cancelled)
+                continue;
+            m_Jobs[id].Status = JobStatus::Running;
+            job = m_Jobs[id];
+        }
+        if (job.Dim == D2)
+            runJob<D2>(id, job);
+        else
+            runJob<D3>(id, job);
+    }
+}
+
+#ifdef DRIZ_HAS_SOCKETS
+bool SimulationService::Open()
+{
+    const std::string path = m_Specs.SocketPath.string();
+    sockaddr_un address;
+    if (!Socket::ToAddress(m_Specs.SocketPath, address))
+        return false;
+
+    std::error_code error;
+    fs::remove(m_Specs.SocketPath, error);
+    m_Listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m_Listener < 0 || ::bind(m_Listener, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0 ||
+        ::listen(m_Listener, 16) != 0 || !Socket::SetNonBlocking(m_Listener))
+    {
+        std::cerr << "Failed to listen on '" << path << "': " << std::strerror(errno) << '\n';
+        return false;
+    }
+    if (::pipe(&m_Wake[0]) != 0 || !Socket::SetNonBlocking(m_Wake[0]) || !Socket::SetNonBlocking(m_Wake[1]))
+    {
+        std::cerr << "Failed to create the service wake up pipe: " << std::strerror(errno) << '\n';
+        return false;
+    }
+
+    m_Running = true;
+    m_Runner = std::thread{[this] { runJobs(); }};
+    std::cout << "Serving simulations on " << path << '\n';
+    return true;
+}
+
+void SimulationService::Run()
+{
+    SimArray<pollfd> fds;
+    while (!m_Shutdown)
+    {
+        fds.Clear();
+        fds.Append(pollfd{m_Listener, POLLIN, 0});
+        fds.Append(pollfd{m_Wake[0], POLLIN, 0});
+        for (const Client &client : m_Clients)
+        {
+            const bool pending = client.Sent < client.Output.size();
+            fds.Append(pollfd{client.Socket, static_cast<short>(pending ? POLLIN | POLLOUT : POLLIN), 0});
+        }
+
+        if (::poll(fds.GetData(), fds.GetSize(), -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            std::cerr << "The service failed to poll its clients: " << std::strerror(errno) << '\n';
+            break;
+        }
+
+        if (fds[1].revents & POLLIN)
+        {
+            TKit::Array<u8, 256> drain;
+            while (::read(m_Wake[0], &drain[0], sizeof(drain)) > 0)
+                ;
+            dispatchEvents();
+        }
+
+        // Clients accepted below are not part of this poll round
+        const u32 polled = fds.GetSize() - 2;
+        SimArray<Client> clients;
+        for (u32 i = 0; i < m_Clients.GetSize(); ++i)
+        {
+            Client &client = m_Clients[i];
+            const short events = i < polled ? fds[i + 2].revents : 0;
+            bool alive = !(events & (POLLERR | POLLNVAL));
+            if (alive && (events & (POLLIN | POLLHUP)))
+                alive = readClient(client);
+            if (alive && client.Sent < client.Output.size())
+                alive = writeClient(client);
+
+            if (alive)
+                clients.Append(std::move(client));
+            else
+                closeClient(client);
+        }
+        m_Clients = std::move(clients);
+
+        if (fds[0].revents & POLLIN)
+            for (i32 socket = ::accept(m_Listener, nullptr, nullptr); socket >= 0;
+                 socket = ::accept(m_Listener, nullptr, nullptr))
+            {
+                if (!Socket::SetNonBlocking(socket))
+                {
+                    ::close(socket);
+                    continue;
+                }
+                Client client{};
+                client.Socket = socket;
+                m_Clients.Append(std::move(client));
+            }
+    }
+}
+
+bool SimulationService::readClient(Client &p_Client)
+{
+    TKit::Array<char, 4096> buffer;
+    for (;;)
+    {
+        const ssize_t result = ::recv(p_Client.Socket, &buffer[0], sizeof(buffer), 0);
+        if (result < 0 && errno == EINTR)
+            continue;
+        if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (result <= 0)
+            return false;
+        p_Client.Input.append(&buffer[0], static_cast<usize>(result));
+    }
+
+    usize start = 0;
+    for (usize end = p_Client.Input.find('\n'); end != std::string::npos; end = p_Client.Input.find('\n', start))
+    {
+        std::string_view command{p_Client.Input.data() + start, end - start};
+        if (command.ends_with('\r'))
+            command.remove_suffix(1);
+        handleCommand(p_Client, command);
+        start = end + 1;
+    }
+    p_Client.Input.erase(0, start);
+    return p_Client.Input.size() < s_MaxCommandSize;
+}
+
+bool SimulationService::writeClient(Client &p_Client)
+{
+    while (p_Client.Sent < p_Client.Output.size())
+    {
+        const ssize_t result = ::send(p_Client.Socket, p_Client.Output.data() + p_Client.Sent,
+                                      p_Client.Output.size() - p_Client.Sent, MSG_DONTWAIT | DRIZ_SEND_FLAGS);
+        if (result < 0 && errno == EINTR)
+            continue;
+        if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            // Keeps the sent bytes of clients that never fully catch up from piling up
+            if (p_Client.Sent > p_Client.Output.size() / 2)
+            {
+                p_Client.Output.erase(0, p_Client.Sent);
+                p_Client.Sent = 0;
+            }
+            return true;
+        }
+        if (result <= 0)
+            return false;
+        p_Client.Sent += static_cast<usize>(result);
+    }
+    p_Client.Output.clear();
+    p_Client.Sent = 0;
+    return true;
+}
+
+void SimulationService::closeClient(Client &p_Client)
+{
+    {
+        std::scoped_lock lock{m_Mutex};
+        for (const Subscription &subscription : p_Client.Subscriptions)
+            if (subscription.Frames)
+                --m_Jobs[subscription.Job].FrameSubscribers;
+    }
+    p_Client.Subscriptions.Clear();
+    if (p_Client.Socket >= 0)
+        ::close(p_Client.Socket);
+    p_Client.Socket = -1;
+}
+
+void SimulationService::close()
+{
+    {
+        std::scoped_lock lock{m_Mutex};
+        for (u32 i = 0; i < m_Jobs.GetSize(); ++i)
+            if (m_Jobs[i].Status == JobStatus::Running)
+                m_CancelJob.store(i, std::memory_order_relaxed);
+        m_Running = false;
+    }
+    m_Condition.notify_all();
+    if (m_Runner.joinable())
+        m_Runner.join();
+
+    for (Client &client : m_Clients)
+    {
+        // Replies to the last commands, such as the shutdown itself, are worth a last attempt
+        writeClient(client);
+        closeClient(client);
+    }
+    m_Clients.Clear();
+    for (i32 &descriptor : m_Wake)
+        if (descriptor >= 0)
+        {
+            ::close(descriptor);
+            descriptor = -1;
+        }
+    if (m_Listener >= 0)
+    {
+        ::close(m_Listener);
+        m_Listener = -1;
+        std::error_code error;
+        fs::remove(m_Specs.SocketPath, error);
+    }
+}
+#else
+bool SimulationService::Open()
+{
+    std::cerr << "The simulation service needs Unix domain sockets, which are not available on this platform.\n";
+    return false;
+}
+void SimulationService::Run()
+{
+}
+bool SimulationService::readClient(Client &)
+{
+    return false;
+}
+bool SimulationService::writeClient(Client &)
+{
+    return false;
+}
+void SimulationService::closeClient(Client &)
+{
+}
+void SimulationService::close()
+{
+}
+#endif
+
+bool RunService(const ServiceSpecs &p_Specs)
+{
+    SimulationService service{p_Specs};
+    if (!service.Open())
+        return false;
+    service.Run();
+    return true;
+}
+} // namespace Driz
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "driz/simulation/settings.hpp"
+#include "driz/simulation/scene.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+
+namespace Driz
+{
+struct ServiceSpecs
+{
+    fs::path SocketPath;
+    usize MaxBufferedBytes = 64 * 1024 * 1024; // Frames are dropped for clients with more output pending than this
+};
+
+enum class JobStatus : u8
+{
+    Queued = 0,
+    Running,
+    Done,
+    Cancelled
+};
+
+struct ServiceJob
+{
+    Dimension Dim = D2;
+    JobStatus Status = JobStatus::Queued;
+
+    u32 Steps = 600;
+    f32 Timestep = 1.f / 60.f;
+    u32 ReportEvery = 10; // Steps between progress reports and frames
+
+    SimulationSettings Settings{};
+    // States are loaded on submission, and shared so that copying the job stays cheap. The scene is generated if the
+    // one matching the dimension is missing
+    std::shared_ptr<const SimulationState<D2>> State2;
+    std::shared_ptr<const SimulationState<D3>> State3;
+    SceneSettings Scene{};
+
+    u32 Step = 0;
+    u32 Particles = 0;
+    u32 FrameSubscribers = 0;
+    f32 Elapsed = 0.f; // Seconds
+    f32 KineticEnergy = 0.f;
+    f32 DensityError = 0.f;
+};
+
+// A long lived process that runs simulation jobs submitted over a Unix domain socket, keeping the worker threads and
+// their scratch arenas warm between jobs. Clients talk in text lines:
+//
+//   submit <2|3> [steps=N] [timestep=S] [every=N] [state=PATH] [settings=PATH] [Field=V]... [scene-Field=V]...
+//   subscribe <job> [frames]
+//   unsubscribe <job>
+//   cancel <job>
+//   status
+//   shutdown
+//
+// Every command is answered with a line starting with 'ok' or 'error'. Submissions are loaded and validated before
+// being queued, so malformed files and settings are rejected right away. Subscribers then receive 'progress' lines
+// with the step timings of a job and a final 'done' or 'cancelled' line. Frame subscribers also receive a 'frame' line
+// holding the box and the particle count, followed by every position quantized to 16 bits per axis within the box
+class SimulationService
+{
+  public:
+    explicit SimulationService(const ServiceSpecs &p_Specs);
+    ~SimulationService();
+
+    bool Open();
+    // Serves clients until one of them asks for a shutdown
+    void Run();
+
+  private:
+    struct Subscription
+    {
+        u32 Job;
+        bool Frames;
+    };
+    struct Client
+    {
+        i32 Socket = -1;
+        std::string Input;
+        std::string Output;
+        usize Sent = 0;
+        SimArray<Subscription> Subscriptions;
+    };
+    struct Event
+    {
+        u32 Job;
+        bool Frame;
+        bool Final; // Subscriptions to the job end with it
+        std::string Data;
+    };
+
+    bool readClient(Client &p_Client);
+    void closeClient(Client &p_Client);
+    bool writeClient(Client &p_Client);
+    void handleCommand(Client &p_Client, std::string_view p_Command);
+
+    std::string submit(std::string_view p_Arguments);
+    std::string subscribe(Client &p_Client, std::string_view p_Arguments);
+    std::string cancel(std::string_view p_Arguments);
+    std::string status();
+
+    void runJobs();
+    template <Dimension D> void runJob(u32 p_Job, const ServiceJob &p_Specs);
+    void publish(u32 p_Job, std::string &&p_Data, bool p_Frame = false, bool p_Final = false);
+    void dispatchEvents();
+    void close();
+
+    ServiceSpecs m_Specs;
+    i32 m_Listener = -1;
+    TKit::Array<i32, 2> m_Wake{-1, -1}; // Lets the job thread interrupt the poll loop when it publishes events
+    SimArray<Client> m_Clients;
+    bool m_Shutdown = false;
+
+    // Guarded by the mutex, and shared with the job thread. Jobs run one after the other in submission order, each one
+    // using the whole thread pool
+    std::mutex m_Mutex;
+    std::condition_variable m_Condition;
+    SimArray<ServiceJob> m_Jobs;
+    SimArray<Event> m_Events;
+    u32 m_NextJob = 0;
+    bool m_Running = false;
+
+    std::atomic<u32> m_CancelJob{UINT32_MAX};
+    std::thread m_Runner;
+};
+
+bool RunService(const ServiceSpecs &p_Specs);
+} // namespace Driz
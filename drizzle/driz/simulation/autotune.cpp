@@ -0,0 +1,263 @@
+#include "driz/simulation/autotune.hpp"
+#include "tkit/profiling/clock.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#    include <unistd.h>
+#endif
+
+namespace Driz
+{
+void IAutotuner::Apply(const TuneConfiguration &p_Configuration, SimulationSettings &p_Settings)
+{
+    p_Settings.Partitions = p_Configuration.Partitions;
+    p_Settings.Lookup = p_Configuration.Lookup;
+    p_Settings.CellRatio = p_Configuration.CellRatio;
+    p_Settings.Schedule = p_Configuration.Schedule;
+}
+
+const fs::path &IAutotuner::GetCachePath()
+{
+    static const fs::path path = Core::GetSettingsPath().parent_path() / "autotune.csv";
+    return path;
+}
+
+const std::string &IAutotuner::getMachine()
+{
+    static const std::string machine = [] {
+        std::string name = "unknown";
+#if defined(__unix__) || defined(__APPLE__)
+        char host[256] = {0};
+        if (gethostname(host, sizeof(host) - 1) == 0)
+            name = host;
+#endif
+        std::replace(name.begin(), name.end(), ',', '_');
+        return name + "-" + std::to_string(std::thread::hardware_concurrency());
+    }();
+    return machine;
+}
+
+u32 IAutotuner::getBucket(const u32 p_Particles)
+{
+    return static_cast<u32>(std::log(static_cast<f64>(std::max(p_Particles, 1u))) / s_BucketWidth);
+}
+
+bool IAutotuner::findInCache(const u32 p_Dim, const u32 p_Bucket, CacheEntry &p_Entry)
+{
+    std::ifstream file{GetCachePath()};
+    if (!file)
+        return false;
+
+    const std::string &machine = getMachine();
+    std::string line;
+    while (std::getline(file, line))
+    {
+        // Lines written before the cell ratio and the schedule were tuned have fewer columns and are ignored
+        if (std::count(line.begin(), line.end(), ',') != 7)
+            continue;
+        std::replace(line.begin(), line.end(), ',', ' ');
+        std::istringstream stream{line};
+        CacheEntry entry{};
+        u32 lookup;
+        u32 schedule;
+        if (!(stream >> entry.Machine >> entry.Dim >> entry.Bucket >> entry.Configuration.Partitions >> lookup >>
+              entry.Configuration.CellRatio >> schedule >> entry.StepTime) ||
+            lookup > static_cast<u32>(LookupMode::Tree) || entry.Configuration.CellRatio < 1 ||
+            entry.Configuration.CellRatio > LookupMethod<D2>::MaxCellRatio ||
+            schedule > static_cast<u32>(PairSchedule::Particles))
+            continue;
+        entry.Configuration.Lookup = static_cast<LookupMode>(lookup);
+        entry.Configuration.Schedule = static_cast<PairSchedule>(schedule);
+
+        if (entry.Machine == machine && entry.Dim == p_Dim && entry.Bucket == p_Bucket &&
+            entry.Configuration.Partitions >= 1 && entry.Configuration.Partitions <= DRIZ_MAX_THREADS)
+        {
+            p_Entry = entry;
+            return true;
+        }
+    }
+    return false;
+}
+
+void IAutotuner::storeInCache(const CacheEntry &p_Entry)
+{
+    TKit::DynamicArray<std::string> lines;
+    {
+        std::ifstream file{GetCachePath()};
+        std::string line;
+        const std::string prefix =
+            p_Entry.Machine + ',' + std::to_string(p_Entry.Dim) + ',' + std::to_string(p_Entry.Bucket) + ',';
+        while (std::getline(file, line))
+            if (!line.empty() && line.rfind(prefix, 0) != 0)
+                lines.Append(line);
+    }
+
+    fs::create_directories(GetCachePath().parent_path());
+    std::ofstream file{GetCachePath()};
+    for (const std::string &line : lines)
+        file << line << '\n';
+    file << p_Entry.Machine << ',' << p_Entry.Dim << ',' << p_Entry.Bucket << ',' << p_Entry.Configuration.Partitions
+         << ',' << static_cast<u32>(p_Entry.Configuration.Lookup) << ',' << p_Entry.Configuration.CellRatio << ','
+         << static_cast<u32>(p_Entry.Configuration.Schedule) << ',' << p_Entry.StepTime << '\n';
+}
+
+template <Dimension D> bool Autotuner<D>::NeedsTuning(const u32 p_Particles) const
+{
+    if (p_Particles == 0)
+        return false;
+    if (!m_HasDecision)
+        return true;
+
+    const f32 previous = static_cast<f32>(std::max(m_Decision.Particles, 1u));
+    return Math::Absolute(static_cast<f32>(p_Particles) - previous) / previous > RetuneThreshold;
+}
+
+template <Dimension D>
+const TuneDecision &Autotuner<D>::Tune(Solver<D> &p_Solver, const f32 p_DeltaTime, const bool p_UseCache)
+{
+    TKIT_PROFILE_NSCOPE("Driz::Autotuner::Tune");
+    if (BeginTune(p_Solver, p_UseCache))
+        while (Advance(p_Solver, p_DeltaTime))
+            ;
+    return m_Decision;
+}
+
+template <Dimension D> bool Autotuner<D>::BeginTune(Solver<D> &p_Solver, const bool p_UseCache)
+{
+    const u32 particles = p_Solver.GetParticleCount();
+    m_HasDecision = true;
+    m_Decision = TuneDecision{};
+    m_Decision.Particles = particles;
+    m_Decision.StepTime = FLT_MAX;
+    m_Candidates.Clear();
+    m_NextCandidate = 0;
+
+    CacheEntry entry{};
+    if (p_UseCache && findInCache(D, getBucket(particles), entry))
+    {
+        m_Decision.Configuration = entry.Configuration;
+        m_Decision.StepTime = entry.StepTime;
+        m_Decision.FromCache = true;
+        Apply(m_Decision.Configuration, p_Solver.Settings);
+        return false;
+    }
+
+    m_Candidates = getCandidates(particles);
+    m_Decision.Candidates = m_Candidates.GetSize();
+    return !m_Candidates.IsEmpty();
+}
+
+template <Dimension D> bool Autotuner<D>::Advance(Solver<D> &p_Solver, const f32 p_DeltaTime)
+{
+    if (!IsTuning())
+        return false;
+    TKIT_PROFILE_NSCOPE("Driz::Autotuner::Advance");
+
+    // Trials must not emit nor remove particles, and must leave the simulation exactly as it was. Obstacles move and
+    // spin with every step, and the trial steps must not show up in the telemetry
+    const SimulationState<D> state = p_Solver.Data.State;
+    const SimArray<f32> rest = p_Solver.Data.RestDistances;
+    const SimArray<Obstacle<D>> obstacles = p_Solver.Obstacles.Obstacles;
+    const StepTelemetry telemetry = p_Solver.Telemetry;
+    const SimulationSettings settings = p_Solver.Settings;
+    p_Solver.Settings.AdaptiveResolution = false;
+    SimArray<Emitter<D>> emitters = std::move(p_Solver.Emitters);
+    SimArray<Sink<D>> sinks = std::move(p_Solver.Sinks);
+    p_Solver.Emitters.Clear();
+    p_Solver.Sinks.Clear();
+
+    const TuneConfiguration &candidate = m_Candidates[m_NextCandidate++];
+    const f32 time = runTrial(p_Solver, candidate, p_DeltaTime);
+    if (time < m_Decision.StepTime)
+    {
+        m_Decision.StepTime = time;
+        m_Decision.Configuration = candidate;
+    }
+
+    p_Solver.Data.State = state;
+    p_Solver.Data.RestDistances = rest;
+    p_Solver.Obstacles.Obstacles = obstacles;
+    p_Solver.Telemetry = telemetry;
+    p_Solver.Settings = settings;
+    p_Solver.Emitters = std::move(emitters);
+    p_Solver.Sinks = std::move(sinks);
+    if (IsTuning())
+        return true;
+
+    Apply(m_Decision.Configuration, p_Solver.Settings);
+    storeInCache(CacheEntry{.Machine = getMachine(),
+                            .Dim = static_cast<u32>(D),
+                            .Bucket = getBucket(m_Decision.Particles),
+                            .Configuration = m_Decision.Configuration,
+                            .StepTime = m_Decision.StepTime});
+    return false;
+}
+
+template <Dimension D> bool Autotuner<D>::IsTuning() const
+{
+    return m_NextCandidate < m_Candidates.GetSize();
+}
+
+template <Dimension D> const TuneDecision *Autotuner<D>::GetDecision() const
+{
+    return m_HasDecision ? &m_Decision : nullptr;
+}
+
+template <Dimension D>
+TKit::DynamicArray<TuneConfiguration> Autotuner<D>::getCandidates(const u32 p_Particles) const
+{
+    TKit::DynamicArray<TuneConfiguration> candidates;
+    const u32 hardware = std::clamp(std::thread::hardware_concurrency(), 1u, static_cast<u32>(DRIZ_MAX_THREADS));
+
+    const auto addPartitions = [&candidates, hardware](const LookupMode p_Lookup) {
+        for (u32 partitions = 1; partitions < hardware; partitions *= 2)
+            candidates.Append(TuneConfiguration{.Partitions = partitions, .Lookup = p_Lookup});
+        candidates.Append(TuneConfiguration{.Partitions = hardware, .Lookup = p_Lookup});
+    };
+
+    addPartitions(LookupMode::Grid);
+    // Finer cells only pay off once the pair tests outweigh the extra cell visits, which needs every thread busy
+    const u32 maxRatio = std::min(MaxCellRatio, LookupMethod<D>::MaxCellRatio);
+    for (u32 ratio = 2; ratio <= maxRatio; ++ratio)
+        candidates.Append(TuneConfiguration{.Partitions = hardware, .Lookup = LookupMode::Grid, .CellRatio = ratio});
+    // Splitting cells by particle count only matters with several partitions, and mostly on uneven scenes
+    if (hardware > 1)
+        for (u32 ratio = 1; ratio <= maxRatio; ++ratio)
+            candidates.Append(TuneConfiguration{.Partitions = hardware,
+                                                .Lookup = LookupMode::Grid,
+                                                .CellRatio = ratio,
+                                                .Schedule = PairSchedule::Particles});
+    // The tree rarely beats the grid on compact scenes, so a single run at full parallelism is enough to catch the
+    // sparse ones
+    candidates.Append(TuneConfiguration{.Partitions = hardware, .Lookup = LookupMode::Tree});
+    if (p_Particles <= MaxBruteForceParticles)
+        addPartitions(LookupMode::BruteForce);
+    return candidates;
+}
+
+template <Dimension D>
+f32 Autotuner<D>::runTrial(Solver<D> &p_Solver, const TuneConfiguration &p_Configuration, const f32 p_DeltaTime) const
+{
+    Apply(p_Configuration, p_Solver.Settings);
+    for (u32 i = 0; i < WarmupSteps; ++i)
+        p_Solver.Step(p_DeltaTime);
+
+    TKit::DynamicArray<f32> samples;
+    for (u32 i = 0; i < TrialSteps; ++i)
+    {
+        TKit::Clock clock{};
+        p_Solver.Step(p_DeltaTime);
+        samples.Append(static_cast<f32>(clock.GetElapsed().AsMilliseconds()));
+    }
+    std::sort(samples.begin(), samples.end());
+    return samples.IsEmpty() ? 0.f : samples[samples.GetSize() / 2];
+}
+
+template class Autotuner<Dimension::D2>;
+template class Autotuner<Dimension::D3>;
+} // namespace Driz
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "driz/simulation/solver.hpp"
+#include <string>
+
+namespace Driz
+{
+struct TuneConfiguration
+{
+    u32 Partitions = 1;
+    LookupMode Lookup = LookupMode::Grid;
+    u32 CellRatio = 1;
+    PairSchedule Schedule = PairSchedule::Cells;
+};
+
+struct TuneDecision
+{
+    TuneConfiguration Configuration{};
+    f32 StepTime = 0.f; // Median trial step time, in milliseconds
+    u32 Particles = 0;
+    u32 Candidates = 0;
+    bool FromCache = false;
+};
+
+// Decisions are cached per machine, dimension and particle count bucket. Buckets are a fixed quarter of an e-fold
+// wide (about 28% more particles), so that cached entries do not depend on the retune threshold
+class IAutotuner
+{
+  public:
+    static void Apply(const TuneConfiguration &p_Configuration, SimulationSettings &p_Settings);
+    static const fs::path &GetCachePath();
+
+    static inline bool Enabled = false;
+    static inline f32 RetuneThreshold = 0.25f;
+
+  protected:
+    static constexpr f64 s_BucketWidth = 0.25; // In natural logarithm units
+
+    struct CacheEntry
+    {
+        std::string Machine;
+        u32 Dim;
+        u32 Bucket;
+        TuneConfiguration Configuration;
+        f32 StepTime;
+    };
+
+    static const std::string &getMachine();
+    static u32 getBucket(u32 p_Particles);
+
+    static bool findInCache(u32 p_Dim, u32 p_Bucket, CacheEntry &p_Entry);
+    static void storeInCache(const CacheEntry &p_Entry);
+};
+
+template <Dimension D> class Autotuner : public IAutotuner
+{
+  public:
+    bool NeedsTuning(u32 p_Particles) const;
+
+    // Runs short trial steps for every candidate configuration, restoring the solver state after each of them, and
+    // leaves the solver with the fastest one. The cache is checked first unless explicitly bypassed
+    const TuneDecision &Tune(Solver<D> &p_Solver, f32 p_DeltaTime, bool p_UseCache = true);
+
+    // Same as Tune, but the sweep is spread over several calls to Advance, which run the trial of a single candidate
+    // each, so that a windowed run keeps drawing in between. The solver is left as it was after every call. Returns
+    // false if the decision was taken from the cache, in which case it is applied right away
+    bool BeginTune(Solver<D> &p_Solver, bool p_UseCache = true);
+    // Returns true while candidates remain. The fastest configuration is applied once the last one ran
+    bool Advance(Solver<D> &p_Solver, f32 p_DeltaTime);
+    bool IsTuning() const;
+
+    const TuneDecision *GetDecision() const;
+
+    u32 WarmupSteps = 2;
+    u32 TrialSteps = 5;
+
+    // Brute force only competes with the grid on tiny scenes, so it is not even tried beyond this count
+    u32 MaxBruteForceParticles = 2048;
+    // Finer grid cells are tried up to this ratio, and never beyond the one the lookup supports
+    u32 MaxCellRatio = 3;
+
+  private:
+    TKit::DynamicArray<TuneConfiguration> getCandidates(u32 p_Particles) const;
+    f32 runTrial(Solver<D> &p_Solver, const TuneConfiguration &p_Configuration, f32 p_DeltaTime) const;
+
+    TuneDecision m_Decision{};
+    TKit::DynamicArray<TuneConfiguration> m_Candidates;
+    u32 m_NextCandidate = 0;
+    bool m_HasDecision = false;
+};
+} // namespace Driz
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "driz/simulation/settings.hpp"
+#include "driz/simulation/scene.hpp"
+#include "tkit/reflection/driz/simulation/settings.hpp"
+#include "tkit/reflection/driz/simulation/kernel.hpp"
+#include "tkit/reflection/driz/simulation/scene.hpp"
+#include <cctype>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+
+namespace Driz
+{
+enum class FieldResult : u8
+{
+    Set = 0,
+    Unknown,
+    Invalid
+};
+
+// 'PressureStiffness', 'pressure-stiffness' and 'pressure_stiffness' all name the same field
+inline bool IsSameField(const std::string_view p_Name, const std::string_view p_Field)
+{
+    const auto skip = [&p_Name](usize p_Index) {
+        while (p_Index < p_Name.size() && (p_Name[p_Index] == '-' || p_Name[p_Index] == '_'))
+            ++p_Index;
+        return p_Index;
+    };
+
+    usize j = 0;
+    for (const char c : p_Field)
+    {
+        if (c == '-' || c == '_')
+            continue;
+        j = skip(j);
+        if (j == p_Name.size() || std::tolower(p_Name[j]) != std::tolower(c))
+            return false;
+        ++j;
+    }
+    return skip(j) == p_Name.size();
+}
+
+// Sets a field of the command line group of a reflected type from its textual value, which lets anything outside of
+// the argument parser, such as sweeps or service jobs, edit settings by name
+template <typename T>
+FieldResult SetCommandLineField(T &p_Instance, const std::string_view p_Field, const std::string &p_Value)
+{
+    FieldResult result = FieldResult::Unknown;
+    TKit::Reflect<T>::ForEachCommandLineMemberField([&](const auto &p_MemberField) {
+        using Type = TKIT_REFLECT_FIELD_TYPE(p_MemberField);
+        if (result != FieldResult::Unknown || !IsSameField(p_Field, p_MemberField.Name))
+            return;
+
+        char *end = nullptr;
+        bool valid = false;
+        if constexpr (std::is_enum_v<Type>)
+        {
+            p_MemberField.Set(p_Instance, TKit::Reflect<Type>::FromString(p_Value));
+            valid = true;
+        }
+        else if constexpr (std::is_same_v<Type, f32>)
+        {
+            const f32 value = std::strtof(p_Value.c_str(), &end);
+            valid = !p_Value.empty() && *end == '\0';
+            p_MemberField.Set(p_Instance, value);
+        }
+        else if constexpr (std::is_same_v<Type, u32>)
+        {
+            const u32 value = static_cast<u32>(std::strtoul(p_Value.c_str(), &end, 10));
+            valid = !p_Value.empty() && p_Value[0] != '-' && *end == '\0';
+            p_MemberField.Set(p_Instance, value);
+        }
+        result = valid ? FieldResult::Set : FieldResult::Invalid;
+    });
+    return result;
+}
+} // namespace Driz
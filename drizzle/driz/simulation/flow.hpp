@@ -0,0 +1,36 @@
+#pragma once
+
+#include "driz/core/math.hpp"
+#include "tkit/reflection/reflect.hpp"
+#include "tkit/serialization/yaml/serialize.hpp"
+
+namespace Driz
+{
+// An inflow volume. Particles are spawned uniformly inside the box at a fixed rate, in batches at step boundaries
+template <Dimension D> struct Emitter
+{
+    TKIT_REFLECT_DECLARE(Emitter)
+    TKIT_YAML_SERIALIZE_DECLARE(Emitter)
+
+    f32v<D> Min{0.f};
+    f32v<D> Max{1.f};
+    f32v<D> Velocity{0.f};
+
+    f32 Rate = 60.f; // Particles per second
+    u32 Seed = 0;
+    u32 Material = 0; // Index into the material table of the solver
+
+    f32 Pending = 0.f;
+    u32 Emitted = 0;
+};
+
+// An outflow plane. Particles lying on the side the normal points to are removed at step boundaries
+template <Dimension D> struct Sink
+{
+    TKIT_REFLECT_DECLARE(Sink)
+    TKIT_YAML_SERIALIZE_DECLARE(Sink)
+
+    f32v<D> Point{0.f};
+    f32v<D> Normal{0.f};
+};
+} // namespace Driz
@@ -150,6 +150,50 @@ template <Dimension D> f32 Kernel<D>::WendlandC4Slope(const f32 p_Radius, const
     return -wendlandC4Sigma<D>(p_Radius) * 7.f * q2 * q2 * q2 * q2 * q2 * q * (5 * q + 2.f) / 3.f;
 }
 
+template <Dimension D> f32 Kernel<D>::Evaluate(const KernelType p_Kernel, const f32 p_Radius, const f32 p_Distance)
+{
+    switch (p_Kernel)
+    {
+    case KernelType::Spiky2:
+        return Spiky2(p_Radius, p_Distance);
+    case KernelType::Spiky3:
+        return Spiky3(p_Radius, p_Distance);
+    case KernelType::Spiky5:
+        return Spiky5(p_Radius, p_Distance);
+    case KernelType::Poly6:
+        return Poly6(p_Radius, p_Distance);
+    case KernelType::CubicSpline:
+        return CubicSpline(p_Radius, p_Distance);
+    case KernelType::WendlandC2:
+        return WendlandC2(p_Radius, p_Distance);
+    case KernelType::WendlandC4:
+        return WendlandC4(p_Radius, p_Distance);
+    }
+    return 0.f;
+}
+template <Dimension D>
+f32 Kernel<D>::EvaluateSlope(const KernelType p_Kernel, const f32 p_Radius, const f32 p_Distance)
+{
+    switch (p_Kernel)
+    {
+    case KernelType::Spiky2:
+        return Spiky2Slope(p_Radius, p_Distance);
+    case KernelType::Spiky3:
+        return Spiky3Slope(p_Radius, p_Distance);
+    case KernelType::Spiky5:
+        return Spiky5Slope(p_Radius, p_Distance);
+    case KernelType::Poly6:
+        return Poly6Slope(p_Radius, p_Distance);
+    case KernelType::CubicSpline:
+        return CubicSplineSlope(p_Radius, p_Distance);
+    case KernelType::WendlandC2:
+        return WendlandC2Slope(p_Radius, p_Distance);
+    case KernelType::WendlandC4:
+        return WendlandC4Slope(p_Radius, p_Distance);
+    }
+    return 0.f;
+}
+
 template struct Kernel<Dimension::D2>;
 template struct Kernel<Dimension::D3>;
 
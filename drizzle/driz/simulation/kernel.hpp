@@ -22,6 +22,9 @@ enum class KernelType
 // Kernels expect the distance to be inferior to the radius
 template <Dimension D> struct Kernel
 {
+    static f32 Evaluate(KernelType p_Kernel, f32 p_Radius, f32 p_Distance);
+    static f32 EvaluateSlope(KernelType p_Kernel, f32 p_Radius, f32 p_Distance);
+
     static f32 Spiky2(f32 p_Radius, f32 p_Distance);
     static f32 Spiky2Slope(f32 p_Radius, f32 p_Distance);
 
@@ -2,6 +2,11 @@
 #include "driz/app/visualization.hpp"
 #include "tkit/utils/hash.hpp"
 #include "tkit/profiling/macros.hpp"
+#include "tkit/profiling/clock.hpp"
+#include <algorithm>
+#include <bit>
+#include <cfloat>
+#include <cstdlib>
 
 namespace Driz
 {
@@ -10,24 +15,87 @@ template <Dimension D> void LookupMethod<D>::SetPositions(const SimArray<f32v<D>
     m_Positions = p_Positions;
 }
 
+const char *GetLookupModeName(const LookupMode p_Mode)
+{
+    switch (p_Mode)
+    {
+    case LookupMode::Grid:
+        return "Grid";
+    case LookupMode::BruteForce:
+        return "BruteForce";
+    case LookupMode::Tree:
+        return "Tree";
+    }
+    return "Unknown";
+}
+
+const char *GetPairScheduleName(const PairSchedule p_Schedule)
+{
+    switch (p_Schedule)
+    {
+    case PairSchedule::Cells:
+        return "Cells";
+    case PairSchedule::Particles:
+        return "Particles";
+    }
+    return "Unknown";
+}
+
+template <Dimension D>
+void LookupMethod<D>::Update(const LookupMode p_Mode, const f32 p_Radius, const u32 p_Partitions)
+{
+    if (p_Mode == LookupMode::BruteForce)
+        UpdateBruteForceLookup(p_Radius);
+    else if (p_Mode == LookupMode::Tree)
+        UpdateTreeLookup(p_Radius, p_Partitions);
+    else
+        UpdateGridLookup(p_Radius, p_Partitions);
+}
+
 template <Dimension D> void LookupMethod<D>::UpdateBruteForceLookup(const f32 p_Radius)
 {
     Radius = p_Radius;
+    m_Mode = LookupMode::BruteForce;
+    m_SortTime = 0.f;
+
+    Statistics.Occupancy = {};
+    Statistics.ClashPairs = 0;
+    Statistics.Clashes = 0;
+    Statistics.MaxOccupancy = 0;
+    Statistics.Cells = 0;
+}
+
+template <Dimension D> LookupMode LookupMethod<D>::GetMode() const
+{
+    return m_Mode;
 }
 
-struct IndexPair
+template <Dimension D>
+void LookupMethod<D>::SetPeriodicity(const u32 p_Axes, const f32v<D> &p_Min, const f32v<D> &p_Max)
+{
+    m_PeriodicAxes = p_Axes & ((1u << D) - 1);
+    m_PeriodicMin = p_Min;
+    m_Extent = p_Max - p_Min;
+}
+template <Dimension D> u32 LookupMethod<D>::GetPeriodicAxes() const
 {
-    u32 ParticleIndex;
-    u32 CellKey;
-};
+    return m_PeriodicAxes;
+}
 
-enum class RadixSort : u32
+template <Dimension D> void LookupMethod<D>::SetCellRatio(const u32 p_Ratio)
+{
+    m_CellRatio = Math::Clamp(p_Ratio, 1u, MaxCellRatio);
+}
+template <Dimension D> u32 LookupMethod<D>::GetCellRatio() const
+{
+    return m_CellRatio;
+}
+template <Dimension D> u32 LookupMethod<D>::GetStencilSize() const
 {
-    Base8 = 8,
-    Base16 = 16
-};
+    return m_OffsetCount;
+}
 
-template <RadixSort Base> IndexPair *radixSort(IndexPair *p_Keys, const u32 p_Count)
+template <RadixSort Base> IndexPair *RadixSortKeys(IndexPair *p_Keys, IndexPair *p_Scratch, const u32 p_Count)
 {
     constexpr u32 base = static_cast<u32>(Base);
     constexpr u32 bcount = 1 << base;
@@ -35,9 +103,7 @@ template <RadixSort Base> IndexPair *radixSort(IndexPair *p_Keys, const u32 p_Co
     constexpr u32 mask = bcount - 1;
 
     TKit::Array<u32, bcount> buckets{};
-    TKit::ArenaAllocator &arena = Core::GetArena();
-
-    IndexPair *sorted = arena.Allocate<IndexPair>(p_Count);
+    IndexPair *sorted = p_Scratch;
 
     for (u32 i = 0; i < passes; ++i)
     {
@@ -61,37 +127,62 @@ template <RadixSort Base> IndexPair *radixSort(IndexPair *p_Keys, const u32 p_Co
         }
         std::swap(p_Keys, sorted);
     }
-    return sorted;
+    return p_Keys;
 }
 
-template <Dimension D> void LookupMethod<D>::UpdateGridLookup(const f32 p_Radius)
+template <Dimension D> void LookupMethod<D>::UpdateGridLookup(const f32 p_Radius, const u32 p_Partitions)
 {
     TKIT_PROFILE_NSCOPE("Driz::LookupMethod::UpdateGridLookup");
+    Radius = p_Radius;
+    m_Mode = LookupMode::Grid;
+    if (m_OffsetRatio != m_CellRatio)
+        buildOffsets();
+
+    const f32 size = Radius / static_cast<f32>(m_CellRatio);
+    for (u32 i = 0; i < D; ++i)
+    {
+        m_CellCounts[i] = 1;
+        m_CellSize[i] = size;
+        if (m_PeriodicAxes & (1u << i))
+        {
+            m_CellCounts[i] = Math::Max(static_cast<i32>(m_Extent[i] / size), 1);
+            m_CellSize[i] = m_Extent[i] / static_cast<f32>(m_CellCounts[i]);
+        }
+    }
     if (m_Positions->IsEmpty())
+    {
+        Grid.Cells.Clear();
+        Statistics = LookupStatistics{};
         return;
-    Radius = p_Radius;
+    }
     const u32 particles = m_Positions->GetSize();
 
     Grid.CellKeyToCellIndex.Resize(particles);
     Grid.ParticleIndices.Resize(particles);
     Grid.Cells.Clear();
 
-    TKit::ArenaAllocator &arena = Core::GetArena();
-    IndexPair *keys = arena.Allocate<IndexPair>(particles);
+    m_Arena.Reset();
+    IndexPair *keys = m_Arena.Allocate<IndexPair>(particles);
+    IndexPair *scratch = m_Arena.Allocate<IndexPair>(particles);
 
     const auto &positions = *m_Positions;
-    for (u32 i = 0; i < particles; ++i)
-    {
-        const i32v<D> cellPosition = getCellPosition(positions[i]);
-        const u32 key = getCellKey(cellPosition);
-        keys[i] = IndexPair{i, key};
-        Grid.CellKeyToCellIndex[i] = UINT32_MAX;
-    }
+    Core::ForEach(0, particles, p_Partitions, [this, keys, &positions](const u32 p_Start, const u32 p_End) {
+        TKIT_PROFILE_NSCOPE("Driz::LookupMethod::CellKeys");
+        for (u32 i = p_Start; i < p_End; ++i)
+        {
+            const i32v<D> cellPosition = GetCellPosition(positions[i]);
+            const u32 key = getCellKey(cellPosition);
+            keys[i] = IndexPair{i, key};
+            Grid.CellKeyToCellIndex[i] = UINT32_MAX;
+        }
+    });
 
     IndexPair *sortedKeys;
     {
         TKIT_PROFILE_NSCOPE("Driz::LookupMethod::CellKeySorting");
-        sortedKeys = radixSort<RadixSort::Base16>(keys, particles);
+        TKit::Clock clock{};
+        sortedKeys = RadixSortKeys<RadixSort::Base16>(keys, scratch, particles);
+        m_SortTime = static_cast<f32>(clock.GetElapsed().AsMilliseconds());
     }
 
     u32 prevKey = sortedKeys[0].CellKey;
@@ -116,10 +207,382 @@ template <Dimension D> void LookupMethod<D>::UpdateGridLookup(const f32 p_Radius
 
     cell.End = particles;
     Grid.Cells.Append(cell);
-    arena.Reset();
+
+    if (CollectStatistics)
+        computeCellStatistics(p_Partitions);
 }
 
-template <Dimension D> u32 LookupMethod<D>::DrawCells(Onyx::RenderContext<D> *p_Context) const
+// Spreads the bits of a cell coordinate so that the coordinates of every axis can be interleaved
+template <Dimension D> static u32 spreadBits(u32 p_Value)
+{
+    if constexpr (D == D2)
+    {
+        p_Value &= 0x0000FFFF;
+        p_Value = (p_Value | (p_Value << 8)) & 0x00FF00FF;
+        p_Value = (p_Value | (p_Value << 4)) & 0x0F0F0F0F;
+        p_Value = (p_Value | (p_Value << 2)) & 0x33333333;
+        return (p_Value | (p_Value << 1)) & 0x55555555;
+    }
+    else
+    {
+        p_Value &= 0x000003FF;
+        p_Value = (p_Value | (p_Value << 16)) & 0x030000FF;
+        p_Value = (p_Value | (p_Value << 8)) & 0x0300F00F;
+        p_Value = (p_Value | (p_Value << 4)) & 0x030C30C3;
+        return (p_Value | (p_Value << 2)) & 0x09249249;
+    }
+}
+
+template <Dimension D> void LookupMethod<D>::UpdateTreeLookup(const f32 p_Radius, const u32 p_Partitions)
+{
+    TKIT_PROFILE_NSCOPE("Driz::LookupMethod::UpdateTreeLookup");
+    Radius = p_Radius;
+    m_Mode = LookupMode::Tree;
+    m_SortTime = 0.f;
+
+    Tree.Nodes.Clear();
+    Tree.Leaves.Clear();
+    Statistics.Occupancy = {};
+    Statistics.ClashPairs = 0;
+    Statistics.Clashes = 0;
+    Statistics.MaxOccupancy = 0;
+    Statistics.Cells = 0;
+    if (m_Positions->IsEmpty())
+        return;
+
+    const u32 particles = m_Positions->GetSize();
+    const auto &positions = *m_Positions;
+
+    TKit::Array<f32v<D>, DRIZ_MAX_THREADS> mins;
+    TKit::Array<f32v<D>, DRIZ_MAX_THREADS> maxs;
+    Core::ForEachChunk(0, particles, p_Partitions,
+                       [&mins, &maxs, &positions](const u32 p_Chunk, const u32 p_Start, const u32 p_End) {
+                           f32v<D> min{FLT_MAX};
+                           f32v<D> max{-FLT_MAX};
+                           for (u32 i = p_Start; i < p_End; ++i)
+                               for (u32 j = 0; j < D; ++j)
+                               {
+                                   min[j] = Math::Min(min[j], positions[i][j]);
+                                   max[j] = Math::Max(max[j], positions[i][j]);
+                               }
+                           mins[p_Chunk] = min;
+                           maxs[p_Chunk] = max;
+                       });
+
+    f32v<D> min = mins[0];
+    f32v<D> max = maxs[0];
+    for (u32 i = 1; i < p_Partitions; ++i)
+        for (u32 j = 0; j < D; ++j)
+        {
+            min[j] = Math::Min(min[j], mins[i][j]);
+            max[j] = Math::Max(max[j], maxs[i][j]);
+        }
+
+    // Octants stay square by quantizing every axis with the scale of the widest one
+    f32 extent = 0.f;
+    for (u32 i = 0; i < D; ++i)
+        extent = Math::Max(extent, max[i] - min[i]);
+    constexpr u32 cells = 1u << s_MortonBits;
+    const f32 scale = extent > 0.f ? static_cast<f32>(cells) / extent : 0.f;
+
+    Tree.ParticleIndices.Resize(particles);
+    Tree.Codes.Resize(particles);
+
+    m_Arena.Reset();
+    IndexPair *keys = m_Arena.Allocate<IndexPair>(particles);
+    IndexPair *scratch = m_Arena.Allocate<IndexPair>(particles);
+
+    Core::ForEach(0, particles, p_Partitions, [keys, &positions, min, scale](const u32 p_Start, const u32 p_End) {
+        TKIT_PROFILE_NSCOPE("Driz::LookupMethod::MortonCodes");
+        constexpr u32 last = (1u << s_MortonBits) - 1;
+        for (u32 i = p_Start; i < p_End; ++i)
+        {
+            u32 code = 0;
+            for (u32 j = 0; j < D; ++j)
+            {
+                const u32 cell = Math::Min(static_cast<u32>((positions[i][j] - min[j]) * scale), last);
+                code |= spreadBits<D>(cell) << j;
+            }
+            keys[i] = IndexPair{i, code};
+        }
+    });
+
+    IndexPair *sortedKeys;
+    {
+        TKIT_PROFILE_NSCOPE("Driz::LookupMethod::MortonSorting");
+        TKit::Clock clock{};
+        sortedKeys = RadixSortKeys<RadixSort::Base16>(keys, scratch, particles);
+        m_SortTime = static_cast<f32>(clock.GetElapsed().AsMilliseconds());
+    }
+
+    Core::ForEach(0, particles, p_Partitions, [this, sortedKeys](const u32 p_Start, const u32 p_End) {
+        for (u32 i = p_Start; i < p_End; ++i)
+        {
+            Tree.ParticleIndices[i] = sortedKeys[i].ParticleIndex;
+            Tree.Codes[i] = sortedKeys[i].CellKey;
+        }
+    });
+
+    // Nodes are split breadth first, one level at a time, so children always come after their parent. A node skips
+    // every level its particles share, and splits on the digit holding the highest bit their codes differ in. Every
+    // node of a level finds its child ranges in parallel, and a scan of the child counts places the next level. Leaves
+    // mark where their range starts, which is what later orders them by range without sorting
+    constexpr u32 mask = (1u << D) - 1;
+    constexpr u32 bounds = mask + 2;
+    const u32 *codes = Tree.Codes.GetData();
+    u32 *leafStarts = m_Arena.Allocate<u32>(particles);
+    Core::ForEach(0, particles, p_Partitions, [leafStarts](const u32 p_Start, const u32 p_End) {
+        std::fill(leafStarts + p_Start, leafStarts + p_End, UINT32_MAX);
+    });
+
+    TKit::Array<u32, s_MortonBits + 2> levels;
+    u32 levelCount = 0;
+    Tree.Nodes.Append(TreeNode<D>{min, max, 0, particles, 0, 0});
+    for (u32 levelStart = 0; levelStart < Tree.Nodes.GetSize();)
+    {
+        const u32 levelEnd = Tree.Nodes.GetSize();
+        const u32 partitions = Math::Min(p_Partitions, levelEnd - levelStart);
+        levels[levelCount++] = levelStart;
+
+        u32 *childBounds = m_Arena.Allocate<u32>((levelEnd - levelStart) * bounds);
+        Core::ForEach(levelStart, levelEnd, partitions,
+                      [this, codes, childBounds, leafStarts, levelStart](const u32 p_Start, const u32 p_End) {
+                          TKIT_PROFILE_NSCOPE("Driz::LookupMethod::TreeSplit");
+                          for (u32 i = p_Start; i < p_End; ++i)
+                          {
+                              TreeNode<D> &node = Tree.Nodes[i];
+                              const u32 diff = codes[node.Start] ^ codes[node.End - 1];
+                              // Particles too close to be told apart by their codes stay in a single leaf, however
+                              // many they are
+                              if (node.End - node.Start <= s_LeafSize || diff == 0)
+                              {
+                                  leafStarts[node.Start] = i;
+                                  continue;
+                              }
+
+                              const u32 shift = (static_cast<u32>(std::bit_width(diff) - 1) / D) * D;
+                              const u64 base = codes[node.Start] & ~((u64{1} << (shift + D)) - 1);
+                              u32 *childBound = childBounds + (i - levelStart) * bounds;
+                              childBound[0] = node.Start;
+                              for (u32 digit = 1; digit <= mask + 1; ++digit)
+                              {
+                                  const u32 value = static_cast<u32>(base + (u64{digit} << shift));
+                                  childBound[digit] =
+                                      digit > mask ? node.End
+                                                   : static_cast<u32>(std::lower_bound(codes + childBound[digit - 1],
+                                                                                       codes + node.End, value) -
+                                                                      codes);
+                                  node.ChildCount += childBound[digit] > childBound[digit - 1];
+                              }
+                          }
+                      });
+
+        u32 next = levelEnd;
+        for (u32 i = levelStart; i < levelEnd; ++i)
+        {
+            TreeNode<D> &node = Tree.Nodes[i];
+            node.FirstChild = node.ChildCount > 0 ? next : 0;
+            next += node.ChildCount;
+        }
+        Tree.Nodes.Resize(next);
+
+        Core::ForEach(levelStart, levelEnd, partitions,
+                      [this, childBounds, levelStart, min, max](const u32 p_Start, const u32 p_End) {
+                          for (u32 i = p_Start; i < p_End; ++i)
+                          {
+                              const TreeNode<D> &node = Tree.Nodes[i];
+                              if (node.ChildCount == 0)
+                                  continue;
+                              const u32 *childBound = childBounds + (i - levelStart) * bounds;
+                              u32 child = node.FirstChild;
+                              for (u32 digit = 1; digit <= mask + 1; ++digit)
+                                  if (childBound[digit] > childBound[digit - 1])
+                                      Tree.Nodes[child++] =
+                                          TreeNode<D>{min, max, childBound[digit - 1], childBound[digit], 0, 0};
+                          }
+                      });
+        levelStart = levelEnd;
+    }
+
+    TKit::Array<u32, DRIZ_MAX_THREADS> offsets{};
+    Core::ForEachChunk(0, particles, p_Partitions,
+                       [&offsets, leafStarts](const u32 p_Chunk, const u32 p_Start, const u32 p_End) {
+                           u32 count = 0;
+                           for (u32 i = p_Start; i < p_End; ++i)
+                               count += leafStarts[i] != UINT32_MAX;
+                           offsets[p_Chunk] = count;
+                       });
+    u32 leaves = 0;
+    for (u32 i = 0; i < p_Partitions; ++i)
+    {
+        const u32 count = offsets[i];
+        offsets[i] = leaves;
+        leaves += count;
+    }
+    Tree.Leaves.Resize(leaves);
+    Core::ForEachChunk(0, particles, p_Partitions,
+                       [this, &offsets, leafStarts](const u32 p_Chunk, const u32 p_Start, const u32 p_End) {
+                           u32 index = offsets[p_Chunk];
+                           for (u32 i = p_Start; i < p_End; ++i)
+                               if (leafStarts[i] != UINT32_MAX)
+                                   Tree.Leaves[index++] = leafStarts[i];
+                       });
+
+    Core::ForEach(0, Tree.Leaves.GetSize(), p_Partitions, [this, &positions](const u32 p_Start, const u32 p_End) {
+        TKIT_PROFILE_NSCOPE("Driz::LookupMethod::LeafBounds");
+        for (u32 i = p_Start; i < p_End; ++i)
+        {
+            TreeNode<D> &leaf = Tree.Nodes[Tree.Leaves[i]];
+            leaf.Min = positions[Tree.ParticleIndices[leaf.Start]];
+            leaf.Max = leaf.Min;
+            for (u32 j = leaf.Start + 1; j < leaf.End; ++j)
+            {
+                const f32v<D> &position = positions[Tree.ParticleIndices[j]];
+                for (u32 k = 0; k < D; ++k)
+                {
+                    leaf.Min[k] = Math::Min(leaf.Min[k], position[k]);
+                    leaf.Max[k] = Math::Max(leaf.Max[k], position[k]);
+                }
+            }
+        }
+    });
+
+    // Inner node bounds go bottom up, a level at a time, as every level only reads the one below it
+    for (u32 level = levelCount - 1; level < levelCount; --level)
+    {
+        const u32 levelStart = levels[level];
+        const u32 levelEnd = level + 1 < levelCount ? levels[level + 1] : Tree.Nodes.GetSize();
+        Core::ForEach(levelStart, levelEnd, Math::Min(p_Partitions, levelEnd - levelStart),
+                      [this](const u32 p_Start, const u32 p_End) {
+                          for (u32 i = p_Start; i < p_End; ++i)
+                          {
+                              TreeNode<D> &node = Tree.Nodes[i];
+                              if (node.ChildCount == 0)
+                                  continue;
+                              node.Min = Tree.Nodes[node.FirstChild].Min;
+                              node.Max = Tree.Nodes[node.FirstChild].Max;
+                              for (u32 j = node.FirstChild + 1; j < node.FirstChild + node.ChildCount; ++j)
+                                  for (u32 k = 0; k < D; ++k)
+                                  {
+                                      node.Min[k] = Math::Min(node.Min[k], Tree.Nodes[j].Min[k]);
+                                      node.Max[k] = Math::Max(node.Max[k], Tree.Nodes[j].Max[k]);
+                                  }
+                          }
+                      });
+    }
+
+    if (!CollectStatistics)
+        return;
+    Statistics.Cells = Tree.Leaves.GetSize();
+    for (const u32 index : Tree.Leaves)
+    {
+        const u32 size = Tree.Nodes[index].End - Tree.Nodes[index].Start;
+        ++Statistics.Occupancy[Math::Min(size, LookupStatistics::HistogramSize - 1)];
+        Statistics.MaxOccupancy = Math::Max(Statistics.MaxOccupancy, size);
+    }
+}
+
+template <Dimension D>
+bool LookupMethod<D>::isStencilNeighbor(const i32v<D> &p_Cell1, const i32v<D> &p_Cell2) const
+{
+    // Same rule the stencil offsets are built with
+    const i32 ratio = static_cast<i32>(m_OffsetRatio);
+    i32 gap = 0;
+    for (u32 i = 0; i < D; ++i)
+    {
+        i32 offset = std::abs(p_Cell2[i] - p_Cell1[i]);
+        if (m_PeriodicAxes & (1u << i))
+            offset = Math::Min(offset % m_CellCounts[i], m_CellCounts[i] - offset % m_CellCounts[i]);
+        const i32 cells = Math::Max(offset - 1, 0);
+        gap += cells * cells;
+    }
+    return gap < ratio * ratio;
+}
+
+template <Dimension D>
+void LookupMethod<D>::collectTreeNeighbors(const TreeNode<D> &p_Leaf, SimArray<u32> &p_Neighbors) const
+{
+    p_Neighbors.Clear();
+    const f32 r2 = Radius * Radius;
+
+    TKit::Array<u32, s_TreeStackSize> stack;
+    u32 size = 0;
+    stack[size++] = 0;
+    while (size > 0)
+    {
+        const u32 index = stack[--size];
+        const TreeNode<D> &node = Tree.Nodes[index];
+        // Nodes hold contiguous ranges, so a node ending before the leaf does only holds leaves that come before it
+        if (node.End <= p_Leaf.End || getGapSquared(p_Leaf.Min, p_Leaf.Max, node.Min, node.Max) >= r2)
+            continue;
+        if (node.ChildCount == 0)
+            p_Neighbors.Append(index);
+        else
+            for (u32 i = 0; i < node.ChildCount; ++i)
+                stack[size++] = node.FirstChild + i;
+    }
+}
+
+template <Dimension D> void LookupMethod<D>::computeCellStatistics(const u32 p_Partitions)
+{
+    TKIT_PROFILE_NSCOPE("Driz::LookupMethod::CellStatistics");
+    struct ChunkStatistics
+    {
+        TKit::Array<u32, LookupStatistics::HistogramSize> Occupancy{};
+        u32 Clashes = 0;
+        u32 MaxOccupancy = 0;
+    };
+    TKit::Array<ChunkStatistics, DRIZ_MAX_THREADS> chunks{};
+
+    const auto &positions = *m_Positions;
+    Core::ForEachChunk(0, Grid.Cells.GetSize(), p_Partitions,
+                       [this, &chunks, &positions](const u32 p_Chunk, const u32 p_Start, const u32 p_End) {
+                           ChunkStatistics &stats = chunks[p_Chunk];
+                           for (u32 i = p_Start; i < p_End; ++i)
+                           {
+                               const GridCell &cell = Grid.Cells[i];
+                               const u32 size = cell.End - cell.Start;
+                               ++stats.Occupancy[Math::Min(size, LookupStatistics::HistogramSize - 1)];
+                               stats.MaxOccupancy = Math::Max(stats.MaxOccupancy, size);
+
+                               // Particles sharing a key may come from different cells. Past the group capacity,
+                               // the remaining particles are assumed to be alone in their cells, which slightly
+                               // overestimates. Pairs tested because of clashes are counted by the traversal
+                               constexpr u32 capacity = 32;
+                               TKit::Array<i32v<D>, capacity> groups;
+                               u32 groupCount = 0;
+                               u32 ungrouped = 0;
+                               for (u32 j = cell.Start; j < cell.End; ++j)
+                               {
+                                   const i32v<D> position = GetCellPosition(positions[Grid.ParticleIndices[j]]);
+                                   u32 k = 0;
+                                   while (k < groupCount && groups[k] != position)
+                                       ++k;
+                                   if (k == groupCount && groupCount < capacity)
+                                       groups[groupCount++] = position;
+                                   else if (k == groupCount)
+                                       ++ungrouped;
+                               }
+                               stats.Clashes += groupCount + ungrouped - 1;
+                           }
+                       });
+
+    Statistics.Occupancy = {};
+    Statistics.Clashes = 0;
+    Statistics.MaxOccupancy = 0;
+    Statistics.Cells = Grid.Cells.GetSize();
+    for (u32 i = 0; i < p_Partitions; ++i)
+    {
+        const ChunkStatistics &stats = chunks[i];
+        for (u32 j = 0; j < LookupStatistics::HistogramSize; ++j)
+            Statistics.Occupancy[j] += stats.Occupancy[j];
+        Statistics.Clashes += stats.Clashes;
+        Statistics.MaxOccupancy = Math::Max(Statistics.MaxOccupancy, stats.MaxOccupancy);
+    }
+}
+
+template <Dimension D>
+void LookupMethod<D>::DrawCells(Onyx::RenderContext<D> *p_Context, const ViewVolume<D> *p_View) const
 {
     TKIT_PROFILE_NSCOPE("Driz::LookupMethod::DrawCells");
     const auto isUnique = [](const auto it1, const auto it2, const i32v<D> &p_Position) {
@@ -129,30 +592,37 @@ template <Dimension D> u32 LookupMethod<D>::DrawCells(Onyx::RenderContext<D> *p_
         return true;
     };
 
+    // The grid may be stale when pairs are found some other way
+    if (m_Mode != LookupMode::Grid)
+        return;
     const auto &positions = *m_Positions;
 
-    u32 cellClashes = 0;
     for (const GridCell &cell : Grid.Cells)
     {
+        if (p_View && !isCellInView(*p_View, GetCellPosition(positions[Grid.ParticleIndices[cell.Start]])))
+            continue;
+
         TKit::Array<i32v<D>, 16> uniquePositions;
         u32 uniqueSize = 0;
         for (u32 i = cell.Start; i < cell.End; ++i)
         {
             const u32 index = Grid.ParticleIndices[i];
-            const i32v<D> cellPosition = getCellPosition(positions[index]);
-            if (isUnique(uniquePositions.begin(), uniquePositions.begin() + uniqueSize, cellPosition))
+            const i32v<D> cellPosition = GetCellPosition(positions[index]);
+            if (uniqueSize < 16 &&
+                isUnique(uniquePositions.begin(), uniquePositions.begin() + uniqueSize, cellPosition))
                 uniquePositions[uniqueSize++] = cellPosition;
         }
 
         const Onyx::Color color = uniqueSize == 1 ? Onyx::Color::WHITE : Onyx::Color::RED;
-        Visualization<D>::DrawCell(p_Context, uniquePositions[0], Radius, color, 0.1f);
-        cellClashes += uniqueSize - 1;
+        const f32v<D> size = getCellSize();
+        Visualization<D>::DrawCell(p_Context, getCellMin(uniquePositions[0]), size, color, 0.1f);
 
+        // Cells sharing a key are linked by their centers
         for (u32 i = 1; i < uniqueSize; ++i)
         {
-            Visualization<D>::DrawCell(p_Context, uniquePositions[i], Radius, color, 0.1f);
-            const f32v<D> pos1 = f32v<D>{uniquePositions[i - 1]} + 0.5f * Radius;
-            const f32v<D> pos2 = f32v<D>{uniquePositions[i]} + 0.5f * Radius;
+            Visualization<D>::DrawCell(p_Context, getCellMin(uniquePositions[i]), size, color, 0.1f);
+            const f32v<D> pos1 = getCellMin(uniquePositions[i - 1]) + 0.5f * size;
+            const f32v<D> pos2 = getCellMin(uniquePositions[i]) + 0.5f * size;
 
             p_Context->Fill(Onyx::Color::YELLOW);
             if constexpr (D == D2)
@@ -161,35 +631,302 @@ template <Dimension D> u32 LookupMethod<D>::DrawCells(Onyx::RenderContext<D> *p_
                 p_Context->Line(pos1, pos2, {.Thickness = 0.1f, .Resolution = Core::Resolution});
         }
     }
-    return cellClashes;
 }
 
-template <Dimension D> i32v<D> LookupMethod<D>::getCellPosition(const f32v<D> &p_Position) const
+template <Dimension D>
+void LookupMethod<D>::CollectVisibleParticles(const ViewVolume<D> &p_View, const u32 p_Partitions,
+                                              SimArray<u32> &p_Indices) const
+{
+    TKIT_PROFILE_NSCOPE("Driz::LookupMethod::CollectVisibleParticles");
+    p_Indices.Clear();
+    if (Grid.Cells.IsEmpty())
+        return;
+
+    const auto &positions = *m_Positions;
+    const f32 margin = Radius;
+    auto &chunks = m_VisibleChunks;
+    const auto gather = [&chunks, &p_Indices, p_Partitions] {
+        for (u32 i = 0; i < p_Partitions; ++i)
+        {
+            for (const u32 index : chunks[i])
+                p_Indices.Append(index);
+            chunks[i].Clear();
+        }
+    };
+
+    const i32v<D> first = GetCellPosition(p_View.Min - f32v<D>{margin});
+    const i32v<D> last = GetCellPosition(p_View.Max + f32v<D>{margin});
+    u32v<D> extent;
+    f64 count = 1.0;
+    for (u32 i = 0; i < D; ++i)
+    {
+        extent[i] = static_cast<u32>(last[i] - first[i] + 1);
+        count *= extent[i];
+    }
+
+    if (count > static_cast<f64>(Grid.Cells.GetSize()))
+    {
+        // Most of the grid is in view, so every cell is tested instead. A rejected cell may still share its key with a
+        // visible one, so its particles are checked one by one
+        Core::ForEachChunk(
+            0, Grid.Cells.GetSize(), p_Partitions,
+            [this, &p_View, &positions, &chunks, margin](const u32 p_Chunk, const u32 p_Start, const u32 p_End) {
+                SimArray<u32> &indices = chunks[p_Chunk];
+                for (u32 i = p_Start; i < p_End; ++i)
+                {
+                    const GridCell &cell = Grid.Cells[i];
+                    const i32v<D> position = GetCellPosition(positions[Grid.ParticleIndices[cell.Start]]);
+                    const bool visible = isCellInView(p_View, position, margin);
+                    for (u32 j = cell.Start; j < cell.End; ++j)
+                    {
+                        const u32 index = Grid.ParticleIndices[j];
+                        if (visible || p_View.Contains(positions[index], margin))
+                            indices.Append(index);
+                    }
+                }
+            });
+        gather();
+        return;
+    }
+
+    // Few enough cells are in view to enumerate them, which makes the cost independent of the simulation size
+    Core::ForEachChunk(0, static_cast<u32>(count), p_Partitions,
+                       [this, &p_View, &chunks, &first, &extent, margin](const u32 p_Chunk, const u32 p_Start,
+                                                                         const u32 p_End) {
+                           SimArray<u32> &cells = chunks[p_Chunk];
+                           for (u32 i = p_Start; i < p_End; ++i)
+                           {
+                               i32v<D> position;
+                               u32 index = i;
+                               for (u32 j = 0; j < D; ++j)
+                               {
+                                   position[j] = first[j] + static_cast<i32>(index % extent[j]);
+                                   index /= extent[j];
+                               }
+                               if (!isCellInView(p_View, position, margin))
+                                   continue;
+                               const u32 cellIndex = Grid.CellKeyToCellIndex[getCellKey(position)];
+                               if (cellIndex != UINT32_MAX)
+                                   cells.Append(cellIndex);
+                           }
+                       });
+
+    // Clashing positions lead to the same cell, which must only be gathered once. The cell buffer swaps places with
+    // the output one, so that both keep their capacity from one call to the next
+    SimArray<u32> &cells = m_VisibleCells;
+    cells.Clear();
+    gather();
+    std::swap(cells, p_Indices);
+    std::sort(cells.begin(), cells.end());
+    cells.Resize(static_cast<u32>(std::unique(cells.begin(), cells.end()) - cells.begin()));
+
+    Core::ForEachChunk(0, cells.GetSize(), p_Partitions,
+                       [this, &cells, &chunks](const u32 p_Chunk, const u32 p_Start, const u32 p_End) {
+                           SimArray<u32> &indices = chunks[p_Chunk];
+                           for (u32 i = p_Start; i < p_End; ++i)
+                           {
+                               const GridCell &cell = Grid.Cells[cells[i]];
+                               for (u32 j = cell.Start; j < cell.End; ++j)
+                                   indices.Append(Grid.ParticleIndices[j]);
+                           }
+                       });
+    gather();
+}
+
+template <Dimension D>
+bool LookupMethod<D>::isCellInView(const ViewVolume<D> &p_View, const i32v<D> &p_CellPosition,
+                                   const f32 p_Margin) const
+{
+    const f32v<D> min = getCellMin(p_CellPosition);
+    return p_View.Intersects(min, min + getCellSize(), p_Margin);
+}
+
+template <Dimension D>
+void LookupMethod<D>::CollectOccupiedCells(const u32 p_Partitions, SimArray<i32v<D>> &p_Cells) const
+{
+    TKIT_PROFILE_NSCOPE("Driz::LookupMethod::CollectOccupiedCells");
+    p_Cells.Clear();
+    const auto &positions = *m_Positions;
+    TKit::Array<SimArray<i32v<D>>, DRIZ_MAX_THREADS> chunks{};
+    Core::ForEachChunk(0, Grid.Cells.GetSize(), p_Partitions,
+                       [this, &positions, &chunks](const u32 p_Chunk, const u32 p_Start, const u32 p_End) {
+                           SimArray<i32v<D>> &cells = chunks[p_Chunk];
+                           for (u32 i = p_Start; i < p_End; ++i)
+                           {
+                               // Positions sharing a key all land in the same cell, so duplicates are local to it
+                               const GridCell &cell = Grid.Cells[i];
+                               const u32 first = cells.GetSize();
+                               for (u32 j = cell.Start; j < cell.End; ++j)
+                               {
+                                   const i32v<D> position = GetCellPosition(positions[Grid.ParticleIndices[j]]);
+                                   bool unique = true;
+                                   for (u32 k = first; k < cells.GetSize() && unique; ++k)
+                                       unique = cells[k] != position;
+                                   if (unique)
+                                       cells.Append(position);
+                               }
+                           }
+                       });
+    for (u32 i = 0; i < p_Partitions; ++i)
+        for (const i32v<D> &cell : chunks[i])
+            p_Cells.Append(cell);
+}
+
+template <Dimension D>
+void LookupMethod<D>::CollectNeighborhood(const i32v<D> &p_Cell, SimArray<u32> &p_Indices) const
+{
+    p_Indices.Clear();
+    if (Grid.Cells.IsEmpty())
+        return;
+    TKit::Array<u32, s_MaxOffsets + 1> visited;
+    u32 visitedSize = 0;
+    for (u32 i = 0; i <= m_OffsetCount; ++i)
+    {
+        const i32v<D> position = i == m_OffsetCount ? p_Cell : p_Cell + m_Offsets[i];
+        const u32 cellIndex = Grid.CellKeyToCellIndex[getCellKey(position)];
+        if (cellIndex == UINT32_MAX)
+            continue;
+
+        bool unique = true;
+        for (u32 j = 0; j < visitedSize && unique; ++j)
+            unique = visited[j] != cellIndex;
+        if (!unique)
+            continue;
+        visited[visitedSize++] = cellIndex;
+
+        const GridCell &cell = Grid.Cells[cellIndex];
+        for (u32 j = cell.Start; j < cell.End; ++j)
+            p_Indices.Append(Grid.ParticleIndices[j]);
+    }
+}
+
+template <Dimension D> f32 LookupMethod<D>::GetLastSortTime() const
+{
+    return m_SortTime;
+}
+
+template <Dimension D> i32v<D> LookupMethod<D>::GetCellPosition(const f32v<D> &p_Position) const
 {
     i32v<D> cellPosition{0};
     for (u32 i = 0; i < D; ++i)
-        cellPosition[i] = static_cast<i32>(p_Position[i] / Radius) - (p_Position[i] < 0.f);
-    return cellPosition;
+        if (m_PeriodicAxes & (1u << i))
+        {
+            const f32 offset = (p_Position[i] - m_PeriodicMin[i]) / m_CellSize[i];
+            cellPosition[i] = static_cast<i32>(offset) - (offset < 0.f);
+        }
+        else
+            cellPosition[i] = static_cast<i32>(p_Position[i] / m_CellSize[i]) - (p_Position[i] < 0.f);
+    return m_PeriodicAxes == 0 ? cellPosition : wrapCell(cellPosition);
 }
 template <Dimension D> u32 LookupMethod<D>::getCellKey(const i32v<D> &p_CellPosition) const
 {
-    return TKit::Hash(p_CellPosition) % m_Positions->GetSize();
+    if (m_PeriodicAxes == 0)
+        return TKit::Hash(p_CellPosition) % m_Positions->GetSize();
+    return TKit::Hash(wrapCell(p_CellPosition)) % m_Positions->GetSize();
 }
 
-template <Dimension D> LookupMethod<D>::OffsetArray LookupMethod<D>::getGridOffsets() const
+template <Dimension D> i32v<D> LookupMethod<D>::wrapCell(const i32v<D> &p_CellPosition) const
 {
-    if constexpr (D == D2)
-        return {i32v<D>{-1, -1}, i32v<D>{-1, 0}, i32v<D>{-1, 1}, i32v<D>{0, -1},
-                i32v<D>{0, 1},   i32v<D>{1, -1}, i32v<D>{1, 0},  i32v<D>{1, 1}};
+    i32v<D> wrapped = p_CellPosition;
+    for (u32 i = 0; i < D; ++i)
+        if (m_PeriodicAxes & (1u << i))
+            wrapped[i] = ((wrapped[i] % m_CellCounts[i]) + m_CellCounts[i]) % m_CellCounts[i];
+    return wrapped;
+}
+
+template <Dimension D> f32v<D> LookupMethod<D>::getCellMin(const i32v<D> &p_CellPosition) const
+{
+    f32v<D> min = f32v<D>{p_CellPosition} * m_CellSize;
+    for (u32 i = 0; i < D; ++i)
+        if (m_PeriodicAxes & (1u << i))
+            min[i] += m_PeriodicMin[i];
+    return min;
+}
+template <Dimension D> f32v<D> LookupMethod<D>::getCellSize() const
+{
+    return m_CellSize;
+}
+
+template <Dimension D> void LookupMethod<D>::computeBlockTags(const u8 *p_Tags, const u32 p_Partitions) const
+{
+    TKIT_PROFILE_NSCOPE("Driz::LookupMethod::BlockTags");
+    const auto getTag = [p_Tags](const u32 *p_Indices, const u32 p_Start, const u32 p_End) {
+        const u32 tag = p_Tags[p_Indices ? p_Indices[p_Start] : p_Start];
+        for (u32 i = p_Start + 1; i < p_End; ++i)
+            if (p_Tags[p_Indices ? p_Indices[i] : i] != tag)
+                return s_MixedBlock;
+        return tag;
+    };
+
+    if (m_Mode == LookupMode::BruteForce)
+    {
+        const u32 particles = m_Positions->GetSize();
+        const u32 tiles = (particles + s_TileSize - 1) / s_TileSize;
+        m_BlockTags.Resize(tiles);
+        Core::ForEach(0, tiles, p_Partitions, [this, &getTag, particles](const u32 p_Start, const u32 p_End) {
+            for (u32 i = p_Start; i < p_End; ++i)
+                m_BlockTags[i] = getTag(nullptr, i * s_TileSize, Math::Min((i + 1) * s_TileSize, particles));
+        });
+    }
+    else if (m_Mode == LookupMode::Tree)
+    {
+        // Indexed by node, as that is what leaf neighbors are gathered as
+        m_BlockTags.Resize(Tree.Nodes.GetSize());
+        Core::ForEach(0, Tree.Leaves.GetSize(), p_Partitions, [this, &getTag](const u32 p_Start, const u32 p_End) {
+            for (u32 i = p_Start; i < p_End; ++i)
+            {
+                const TreeNode<D> &leaf = Tree.Nodes[Tree.Leaves[i]];
+                m_BlockTags[Tree.Leaves[i]] = getTag(Tree.ParticleIndices.GetData(), leaf.Start, leaf.End);
+            }
+        });
+    }
     else
-        return {i32v<D>{-1, -1, -1}, i32v<D>{-1, -1, 0}, i32v<D>{-1, -1, 1}, i32v<D>{-1, 0, -1}, i32v<D>{-1, 0, 0},
-                i32v<D>{-1, 0, 1},   i32v<D>{-1, 1, -1}, i32v<D>{-1, 1, 0},  i32v<D>{-1, 1, 1},  i32v<D>{0, -1, -1},
-                i32v<D>{0, -1, 0},   i32v<D>{0, -1, 1},  i32v<D>{0, 0, -1},  i32v<D>{0, 0, 1},   i32v<D>{0, 1, -1},
-                i32v<D>{0, 1, 0},    i32v<D>{0, 1, 1},   i32v<D>{1, -1, -1}, i32v<D>{1, -1, 0},  i32v<D>{1, -1, 1},
-                i32v<D>{1, 0, -1},   i32v<D>{1, 0, 0},   i32v<D>{1, 0, 1},   i32v<D>{1, 1, -1},  i32v<D>{1, 1, 0},
-                i32v<D>{1, 1, 1}};
+    {
+        m_BlockTags.Resize(Grid.Cells.GetSize());
+        Core::ForEach(0, Grid.Cells.GetSize(), p_Partitions, [this, &getTag](const u32 p_Start, const u32 p_End) {
+            for (u32 i = p_Start; i < p_End; ++i)
+            {
+                const GridCell &cell = Grid.Cells[i];
+                m_BlockTags[i] = getTag(Grid.ParticleIndices.GetData(), cell.Start, cell.End);
+            }
+        });
+    }
+}
+
+// With cells 1/k of the radius wide, two cells can only hold particles within the radius if the gap between them is
+// shorter than k cells. The gap along an axis is one cell less than the offset, and none for adjacent cells
+template <Dimension D> void LookupMethod<D>::buildOffsets()
+{
+    const i32 ratio = static_cast<i32>(m_CellRatio);
+    const u32 side = 2 * m_CellRatio + 1;
+    u32 total = 1;
+    for (u32 i = 0; i < D; ++i)
+        total *= side;
+
+    m_OffsetCount = 0;
+    for (u32 i = 0; i < total; ++i)
+    {
+        i32v<D> offset;
+        u32 index = i;
+        i32 gap = 0;
+        bool center = true;
+        for (u32 j = 0; j < D; ++j)
+        {
+            offset[j] = static_cast<i32>(index % side) - ratio;
+            index /= side;
+            const i32 cells = Math::Max(std::abs(offset[j]) - 1, 0);
+            gap += cells * cells;
+            center &= offset[j] == 0;
+        }
+        if (!center && gap < ratio * ratio)
+            m_Offsets[m_OffsetCount++] = offset;
+    }
+    m_OffsetRatio = m_CellRatio;
 }
 
+template IndexPair *RadixSortKeys<RadixSort::Base8>(IndexPair *, IndexPair *, u32);
+template IndexPair *RadixSortKeys<RadixSort::Base16>(IndexPair *, IndexPair *, u32);
+
 template class LookupMethod<D2>;
 template class LookupMethod<D3>;
 
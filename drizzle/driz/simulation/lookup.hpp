@@ -2,8 +2,13 @@
 
 #include "driz/core/math.hpp"
 #include "driz/core/core.hpp"
+#include "driz/core/view.hpp"
+#include "driz/simulation/settings.hpp"
+#include "driz/simulation/telemetry.hpp"
 #include "onyx/rendering/render_context.hpp"
 #include "tkit/profiling/macros.hpp"
+#include <algorithm>
+#include <cmath>
 
 namespace Driz
 {
@@ -14,6 +19,24 @@ struct GridCell
     u32 End;
 };
 
+struct IndexPair
+{
+    u32 ParticleIndex;
+    u32 CellKey;
+};
+
+enum class RadixSort : u32
+{
+    Base8 = 8,
+    Base16 = 16
+};
+
+const char *GetLookupModeName(LookupMode p_Mode);
+const char *GetPairScheduleName(PairSchedule p_Schedule);
+
+// Sorts by cell key. Both buffers must hold p_Count elements, and the returned pointer is the one holding the result
+template <RadixSort Base> IndexPair *RadixSortKeys(IndexPair *p_Keys, IndexPair *p_Scratch, u32 p_Count);
+
 struct GridData
 {
     SimArray<GridCell> Cells;
@@ -21,83 +44,487 @@ struct GridData
     SimArray<u32> CellKeyToCellIndex;
 };
 
+template <Dimension D> struct TreeNode
+{
+    f32v<D> Min; // Bounds of the particles the node holds, not of its octant
+    f32v<D> Max;
+    u32 Start; // Range of sorted particles
+    u32 End;
+    u32 FirstChild; // Children are stored contiguously, and leaves have none
+    u32 ChildCount;
+};
+
+// A linear quadtree or octree. Particles are sorted by their Morton code, so that every node holds a contiguous range
+// of them, and nodes are split where the codes of their particles first differ until they are small enough
+template <Dimension D> struct TreeData
+{
+    SimArray<TreeNode<D>> Nodes;
+    SimArray<u32> Leaves; // Node indices, sorted by particle range
+    SimArray<u32> ParticleIndices;
+    SimArray<u32> Codes;
+};
+
+// Passed to tagged pair functions when every particle of both blocks of the pair holds the same tag
+struct SharedTag
+{
+    u32 Tag;
+};
+// Passed to tagged pair functions otherwise
+struct MixedTags
+{
+};
+
 template <Dimension D> class LookupMethod
 {
   public:
     void SetPositions(const SimArray<f32v<D>> *p_Positions);
 
+    void Update(LookupMode p_Mode, f32 p_Radius, u32 p_Partitions = 1);
     void UpdateBruteForceLookup(f32 p_Radius);
-    void UpdateGridLookup(f32 p_Radius);
+    void UpdateGridLookup(f32 p_Radius, u32 p_Partitions = 1);
+    void UpdateTreeLookup(f32 p_Radius, u32 p_Partitions = 1);
+
+    LookupMode GetMode() const;
+
+    // Bit i makes axis i wrap around between the given bounds. Periodic axes are split in a whole number of cells at
+    // least as wide as the radius, so the usual stencil reaches across the seam, and pairs are measured with the
+    // minimum image convention. Takes effect on the next update
+    void SetPeriodicity(u32 p_Axes, const f32v<D> &p_Min, const f32v<D> &p_Max);
+    u32 GetPeriodicAxes() const;
+
+    // Grid cells are a fraction 1/k of the radius wide, and the stencil only keeps the cells that may hold a particle
+    // within the radius. Finer cells test far fewer pairs that are then rejected, at the cost of visiting more cells.
+    // Takes effect on the next update
+    void SetCellRatio(u32 p_Ratio);
+    u32 GetCellRatio() const;
+    u32 GetStencilSize() const;
+
+    // Difference between two positions, taken between their closest images along periodic axes
+    f32v<D> ComputeOffset(const f32v<D> &p_From, const f32v<D> &p_To) const
+    {
+        f32v<D> offset = p_From - p_To;
+        for (u32 i = 0; i < D; ++i)
+            if (m_PeriodicAxes & (1u << i))
+                offset[i] -= m_Extent[i] * std::round(offset[i] / m_Extent[i]);
+        return offset;
+    }
+
+    // When a view volume is given, cells are tested by the first particle they hold. Clashing cells sharing its key
+    // may be skipped, which is fine for a debug overlay
+    void DrawCells(Onyx::RenderContext<D> *p_Context, const ViewVolume<D> *p_View = nullptr) const;
+
+    // Gathers the particles held by grid cells that may intersect the view volume. Cells are rejected as a whole, and
+    // the volume is grown by one cell to account for particles that moved since the grid was built, so some of the
+    // gathered particles may be slightly outside of it. The grid must be up to date with the particle count
+    void CollectVisibleParticles(const ViewVolume<D> &p_View, u32 p_Partitions, SimArray<u32> &p_Indices) const;
+
+    i32v<D> GetCellPosition(const f32v<D> &p_Position) const;
+
+    // Positions of every occupied grid cell, in no particular order and without duplicates even if their keys clash
+    void CollectOccupiedCells(u32 p_Partitions, SimArray<i32v<D>> &p_Cells) const;
+    // Gathers the particles held by a cell and its neighbors, each of them once. Cells sharing their keys are gathered
+    // as well, so callers must still check distances
+    void CollectNeighborhood(const i32v<D> &p_Cell, SimArray<u32> &p_Indices) const;
 
-    u32 DrawCells(Onyx::RenderContext<D> *p_Context) const;
+    // Milliseconds spent sorting cell keys during the last grid update
+    f32 GetLastSortTime() const;
 
+    // The function also receives the partition the pair was found in, always below the partition count, so that callers
+    // may accumulate into one scratch array per partition. Pair and per partition work statistics are only refreshed
+    // when collecting statistics. The traversal is compiled twice, so that the counters cost nothing otherwise
     template <typename F> void ForEachPair(F &&p_Function, const u32 p_Partitions) const
     {
-        const OffsetArray offsets = getGridOffsets();
-        Core::ForEach(
-            0, Grid.Cells.GetSize(), p_Partitions, [this, &offsets, &p_Function](const u32 p_Start, const u32 p_End) {
+        const auto untagged = [&p_Function](const u32 p_Index1, const u32 p_Index2, const f32 p_Distance,
+                                            const u32 p_Partition, const auto) {
+            p_Function(p_Index1, p_Index2, p_Distance, p_Partition);
+        };
+        if (CollectStatistics)
+            forEachPair<true>(untagged, p_Partitions, nullptr);
+        else
+            forEachPair<false>(untagged, p_Partitions, nullptr);
+    }
+
+    // Pairs are visited by pairs of blocks (grid cells, tree leaves or brute force tiles). The function also receives
+    // a SharedTag when every particle of both blocks holds the same tag, or MixedTags otherwise, so that it may be
+    // specialized at compile time on homogeneous block pairs while only branching once per block pair. Without tags,
+    // every pair is mixed
+    template <typename F> void ForEachTaggedPair(F &&p_Function, const u8 *p_Tags, const u32 p_Partitions) const
+    {
+        if (p_Tags)
+            computeBlockTags(p_Tags, p_Partitions);
+        const u32 *blockTags = p_Tags ? m_BlockTags.GetData() : nullptr;
+        if (CollectStatistics)
+            forEachPair<true>(std::forward<F>(p_Function), p_Partitions, blockTags);
+        else
+            forEachPair<false>(std::forward<F>(p_Function), p_Partitions, blockTags);
+    }
+
+    GridData Grid;
+    TreeData<D> Tree;
+    // Written by the pair traversal, which is otherwise read only
+    mutable LookupStatistics Statistics;
+    f32 Radius;
+
+    // Occupancy and clash statistics need an extra pass over the grid when it is built, and pair statistics need a few
+    // counters in the innermost loop of the traversal
+    bool CollectStatistics = false;
+    // Only the grid traversal is affected. Tree leaves and brute force tiles are already about the same size
+    PairSchedule Schedule = PairSchedule::Cells;
+
+    static constexpr u32 MaxCellRatio = 4;
+
+  private:
+    static constexpr u32 s_TileSize = 256;
+    static constexpr u32 s_LeafSize = 32;
+    // Morton codes fit in 32 bits, so that they can go through the same radix sort as the grid keys
+    static constexpr u32 s_MortonBits = D == D2 ? 16 : 10;
+    static constexpr u32 s_TreeStackSize = s_MortonBits * (1 << D);
+
+    static constexpr u32 s_MixedBlock = UINT32_MAX;
+
+    // Block tags are indexed by grid cell, tree node or brute force tile, and hold s_MixedBlock for blocks whose
+    // particles do not share a tag. Without block tags, every block pair is treated as mixed
+    template <typename L> static void forBlockPair(const u32 *p_BlockTags, const u32 p_Block1, const u32 p_Block2,
+                                                   L &&p_Loop)
+    {
+        if (p_BlockTags && p_BlockTags[p_Block1] != s_MixedBlock && p_BlockTags[p_Block1] == p_BlockTags[p_Block2])
+            p_Loop(SharedTag{p_BlockTags[p_Block1]});
+        else
+            p_Loop(MixedTags{});
+    }
+
+    template <bool Collect, typename F>
+    void forEachPair(F &&p_Function, const u32 p_Partitions, const u32 *p_BlockTags) const
+    {
+        if (m_Mode == LookupMode::BruteForce)
+            forEachBruteForcePair<Collect>(std::forward<F>(p_Function), p_Partitions, p_BlockTags);
+        else if (m_Mode == LookupMode::Tree)
+            forEachTreePair<Collect>(std::forward<F>(p_Function), p_Partitions, p_BlockTags);
+        else
+            forEachGridPair<Collect>(std::forward<F>(p_Function), p_Partitions, p_BlockTags);
+
+        Statistics.CandidatePairs = 0;
+        Statistics.AcceptedPairs = 0;
+        Statistics.ClashPairs = 0;
+        if constexpr (!Collect)
+        {
+            Statistics.Partitions = 0;
+            return;
+        }
+        Statistics.Partitions = p_Partitions;
+        for (u32 i = 0; i < p_Partitions; ++i)
+        {
+            Statistics.CandidatePairs += Statistics.Work[i].Candidates;
+            Statistics.AcceptedPairs += Statistics.Work[i].Accepted;
+            Statistics.ClashPairs += Statistics.Work[i].ClashPairs;
+        }
+    }
+
+    // Every partition receives a contiguous range of cells holding about the same number of particles. Cells hold
+    // contiguous and increasing particle ranges, so the boundaries are found with a binary search
+    template <typename F> void forEachGridChunk(const u32 p_Partitions, F &&p_Function) const
+    {
+        if (Schedule == PairSchedule::Cells)
+        {
+            Core::ForEachChunk(0, Grid.Cells.GetSize(), p_Partitions, std::forward<F>(p_Function));
+            return;
+        }
+        const u64 particles = Grid.ParticleIndices.GetSize();
+        const auto firstCell = [this, particles, p_Partitions](const u32 p_Chunk) {
+            const u32 target = static_cast<u32>(particles * p_Chunk / p_Partitions);
+            const auto cell = std::partition_point(Grid.Cells.begin(), Grid.Cells.end(),
+                                                   [target](const GridCell &p_Cell) { return p_Cell.Start < target; });
+            return static_cast<u32>(cell - Grid.Cells.begin());
+        };
+        Core::ForEach(0, p_Partitions, p_Partitions, [&](const u32 p_First, const u32 p_Last) {
+            for (u32 i = p_First; i < p_Last; ++i)
+                p_Function(i, firstCell(i), i + 1 == p_Partitions ? Grid.Cells.GetSize() : firstCell(i + 1));
+        });
+    }
+
+    // The neighbor cells of a particle are gathered once for every run of particles sharing a cell position, which is
+    // usually the whole grid cell unless its key clashes. Pairs whose cells are out of each other's stencil, whether
+    // they share a cell key or were reached through a neighbor one, are counted as clash pairs
+    template <bool Collect, typename F>
+    void forEachGridPair(F &&p_Function, const u32 p_Partitions, const u32 *p_BlockTags) const
+    {
+        forEachGridChunk(
+            p_Partitions,
+            [this, &p_Function, p_BlockTags](const u32 p_Chunk, const u32 p_Start, const u32 p_End) {
                 TKIT_PROFILE_NSCOPE("Driz::Solver::ForEachPair");
-                const u32 tindex = Core::GetThreadIndex();
-                for (u32 i = p_Start; i < p_End; ++i)
-                {
-                    const f32 r2 = Radius * Radius;
-                    const auto &positions = *m_Positions;
+                const f32 r2 = Radius * Radius;
+                const auto &positions = *m_Positions;
 
-                    const auto processPair = [r2, tindex, &positions](const u32 p_Index1, const u32 p_Index2,
-                                                                      F &&p_Function) {
-                        const f32 distance = Math::DistanceSquared(positions[p_Index1], positions[p_Index2]);
-                        if (distance < r2)
-                            std::forward<F>(p_Function)(p_Index1, p_Index2, Math::SquareRoot(distance), tindex);
-                    };
+                u64 candidates = 0;
+                u64 accepted = 0;
+                u64 clashes = 0;
+                const auto processPair = [this, r2, p_Chunk, &positions, &candidates, &accepted, &clashes](
+                                             const u32 p_Index1, const u32 p_Index2, const auto p_Tag,
+                                             F &&p_Function) {
+                    if constexpr (Collect)
+                    {
+                        ++candidates;
+                        clashes += !isStencilNeighbor(GetCellPosition(positions[p_Index1]),
+                                                      GetCellPosition(positions[p_Index2]));
+                    }
+                    const f32 distance = getDistanceSquared(positions[p_Index1], positions[p_Index2]);
+                    if (distance < r2)
+                    {
+                        if constexpr (Collect)
+                            ++accepted;
+                        std::forward<F>(p_Function)(p_Index1, p_Index2, Math::SquareRoot(distance), p_Chunk, p_Tag);
+                    }
+                };
 
+                TKit::Array<u32, s_MaxOffsets> neighbors;
+                u32 neighborCount = 0;
+                const auto collectNeighbors = [this, &neighbors, &neighborCount](const i32v<D> &p_Center,
+                                                                                 const u32 p_CellKey) {
+                    neighborCount = 0;
+                    for (u32 k = 0; k < m_OffsetCount; ++k)
+                    {
+                        const u32 cellKey = getCellKey(p_Center + m_Offsets[k]);
+                        const u32 cellIndex = Grid.CellKeyToCellIndex[cellKey];
+                        if (cellKey <= p_CellKey || cellIndex == UINT32_MAX)
+                            continue;
+
+                        bool unique = true;
+                        for (u32 l = 0; l < neighborCount && unique; ++l)
+                            unique = neighbors[l] != cellIndex;
+                        if (unique)
+                            neighbors[neighborCount++] = cellIndex;
+                    }
+                };
+
+                for (u32 i = p_Start; i < p_End; ++i)
+                {
                     const GridCell &cell = Grid.Cells[i];
+                    i32v<D> center{0};
                     for (u32 j = cell.Start; j < cell.End; ++j)
                     {
                         const u32 index1 = Grid.ParticleIndices[j];
-                        for (u32 k = j + 1; k < cell.End; ++k)
-                            processPair(index1, Grid.ParticleIndices[k], std::forward<F>(p_Function));
-
-                        const i32v<D> center = getCellPosition(positions[index1]);
-                        const u32 cellKey1 = cell.Key;
-
-                        TKit::Array<u32, s_OffsetCount> visited;
-                        u32 visitedSize = 0;
-                        const auto checkVisited = [&visited, &visitedSize](const u32 p_CellKey) {
-                            for (u32 k = 0; k < visitedSize; ++k)
-                                if (visited[k] == p_CellKey)
-                                    return false;
-                            visited[visitedSize++] = p_CellKey;
-                            return true;
-                        };
-
-                        for (const i32v<D> &offset : offsets)
+                        forBlockPair(p_BlockTags, i, i, [&](const auto p_Tag) {
+                            for (u32 k = j + 1; k < cell.End; ++k)
+                                processPair(index1, Grid.ParticleIndices[k], p_Tag, std::forward<F>(p_Function));
+                        });
+
+                        const i32v<D> position = GetCellPosition(positions[index1]);
+                        if (j == cell.Start || position != center)
                         {
-                            const u32 cellKey2 = getCellKey(center + offset);
-                            const u32 cellIndex = Grid.CellKeyToCellIndex[cellKey2];
-                            if (cellKey2 > cellKey1 && cellIndex != UINT32_MAX && checkVisited(cellKey2))
-                            {
-                                const GridCell &cell2 = Grid.Cells[cellIndex];
-                                for (u32 k = cell2.Start; k < cell2.End; ++k)
-                                    processPair(index1, Grid.ParticleIndices[k], std::forward<F>(p_Function));
-                            }
+                            center = position;
+                            collectNeighbors(center, cell.Key);
+                        }
+
+                        for (u32 k = 0; k < neighborCount; ++k)
+                        {
+                            const GridCell &cell2 = Grid.Cells[neighbors[k]];
+                            forBlockPair(p_BlockTags, i, neighbors[k], [&](const auto p_Tag) {
+                                for (u32 l = cell2.Start; l < cell2.End; ++l)
+                                    processPair(index1, Grid.ParticleIndices[l], p_Tag, std::forward<F>(p_Function));
+                            });
                         }
                     }
                 }
+                if constexpr (Collect)
+                    Statistics.Work[p_Chunk] = PartitionWork{candidates, accepted, clashes, p_End - p_Start};
             });
     }
 
-    GridData Grid;
-    f32 Radius;
+    // Particles are split in tiles, and the upper triangle of tile pairs is split evenly among partitions. Work is
+    // recorded per tile pair instead of per cell
+    template <bool Collect, typename F>
+    void forEachBruteForcePair(F &&p_Function, const u32 p_Partitions, const u32 *p_BlockTags) const
+    {
+        const u32 particles = m_Positions->GetSize();
+        const u32 tiles = (particles + s_TileSize - 1) / s_TileSize;
+        // Fits in 32 bits for up to ~23M particles, far beyond what a quadratic traversal can handle anyway
+        const u32 tilePairs = static_cast<u32>(static_cast<u64>(tiles) * (tiles + 1) / 2);
+
+        Core::ForEachChunk(
+            0, tilePairs, p_Partitions,
+            [this, &p_Function, p_BlockTags, particles, tiles](const u32 p_Chunk, const u32 p_Start,
+                                                               const u32 p_End) {
+                TKIT_PROFILE_NSCOPE("Driz::Solver::ForEachBruteForcePair");
+                const f32 r2 = Radius * Radius;
+                const auto &positions = *m_Positions;
+
+                u64 candidates = 0;
+                u64 accepted = 0;
+                const auto processPair = [this, r2, p_Chunk, &positions, &candidates, &accepted](
+                                             const u32 p_Index1, const u32 p_Index2, const auto p_Tag,
+                                             F &&p_Function) {
+                    if constexpr (Collect)
+                        ++candidates;
+                    const f32 distance = getDistanceSquared(positions[p_Index1], positions[p_Index2]);
+                    if (distance < r2)
+                    {
+                        if constexpr (Collect)
+                            ++accepted;
+                        std::forward<F>(p_Function)(p_Index1, p_Index2, Math::SquareRoot(distance), p_Chunk, p_Tag);
+                    }
+                };
+
+                u32 row = 0;
+                u32 rowStart = 0;
+                while (p_Start < p_End && rowStart + tiles - row <= p_Start)
+                {
+                    rowStart += tiles - row;
+                    ++row;
+                }
+                u32 col = row + p_Start - rowStart;
+
+                for (u32 i = p_Start; i < p_End; ++i)
+                {
+                    const u32 start1 = row * s_TileSize;
+                    const u32 end1 = Math::Min(start1 + s_TileSize, particles);
+                    forBlockPair(p_BlockTags, row, col, [&](const auto p_Tag) {
+                        if (row == col)
+                        {
+                            for (u32 j = start1; j < end1; ++j)
+                                for (u32 k = j + 1; k < end1; ++k)
+                                    processPair(j, k, p_Tag, std::forward<F>(p_Function));
+                        }
+                        else
+                        {
+                            const u32 start2 = col * s_TileSize;
+                            const u32 end2 = Math::Min(start2 + s_TileSize, particles);
+                            for (u32 j = start1; j < end1; ++j)
+                                for (u32 k = start2; k < end2; ++k)
+                                    processPair(j, k, p_Tag, std::forward<F>(p_Function));
+                        }
+                    });
+
+                    if (++col == tiles)
+                        col = ++row;
+                }
+                if constexpr (Collect)
+                    Statistics.Work[p_Chunk] = PartitionWork{candidates, accepted, 0, p_End - p_Start};
+            });
+    }
+
+    // Every leaf gathers the leaves after it whose bounds come within the radius of its own. Each of its particles is
+    // then only tested against the gathered leaves its position comes close enough to
+    template <bool Collect, typename F>
+    void forEachTreePair(F &&p_Function, const u32 p_Partitions, const u32 *p_BlockTags) const
+    {
+        Core::ForEachChunk(
+            0, Tree.Leaves.GetSize(), p_Partitions,
+            [this, &p_Function, p_BlockTags](const u32 p_Chunk, const u32 p_Start, const u32 p_End) {
+                TKIT_PROFILE_NSCOPE("Driz::Solver::ForEachTreePair");
+                const f32 r2 = Radius * Radius;
+                const auto &positions = *m_Positions;
+
+                u64 candidates = 0;
+                u64 accepted = 0;
+                const auto processPair = [this, r2, p_Chunk, &positions, &candidates, &accepted](
+                                             const u32 p_Index1, const u32 p_Index2, const auto p_Tag,
+                                             F &&p_Function) {
+                    if constexpr (Collect)
+                        ++candidates;
+                    const f32 distance = getDistanceSquared(positions[p_Index1], positions[p_Index2]);
+                    if (distance < r2)
+                    {
+                        if constexpr (Collect)
+                            ++accepted;
+                        std::forward<F>(p_Function)(p_Index1, p_Index2, Math::SquareRoot(distance), p_Chunk, p_Tag);
+                    }
+                };
+
+                SimArray<u32> &neighbors = m_TreeNeighbors[p_Chunk];
+                for (u32 i = p_Start; i < p_End; ++i)
+                {
+                    const u32 node = Tree.Leaves[i];
+                    const TreeNode<D> &leaf = Tree.Nodes[node];
+                    collectTreeNeighbors(leaf, neighbors);
+                    for (u32 j = leaf.Start; j < leaf.End; ++j)
+                    {
+                        const u32 index1 = Tree.ParticleIndices[j];
+                        forBlockPair(p_BlockTags, node, node, [&](const auto p_Tag) {
+                            for (u32 k = j + 1; k < leaf.End; ++k)
+                                processPair(index1, Tree.ParticleIndices[k], p_Tag, std::forward<F>(p_Function));
+                        });
+
+                        const f32v<D> &position = positions[index1];
+                        for (const u32 neighbor : neighbors)
+                        {
+                            const TreeNode<D> &other = Tree.Nodes[neighbor];
+                            if (getGapSquared(position, position, other.Min, other.Max) >= r2)
+                                continue;
+                            forBlockPair(p_BlockTags, node, neighbor, [&](const auto p_Tag) {
+                                for (u32 k = other.Start; k < other.End; ++k)
+                                    processPair(index1, Tree.ParticleIndices[k], p_Tag, std::forward<F>(p_Function));
+                            });
+                        }
+                    }
+                }
+                if constexpr (Collect)
+                    Statistics.Work[p_Chunk] = PartitionWork{candidates, accepted, 0, p_End - p_Start};
+            });
+    }
+
+    f32 getDistanceSquared(const f32v<D> &p_Position1, const f32v<D> &p_Position2) const
+    {
+        return m_PeriodicAxes == 0 ? Math::DistanceSquared(p_Position1, p_Position2)
+                                   : Math::NormSquared(ComputeOffset(p_Position1, p_Position2));
+    }
+
+    // Squared distance between two boxes, or zero if they overlap. Periodic axes take the closest image of the second
+    f32 getGapSquared(const f32v<D> &p_Min1, const f32v<D> &p_Max1, const f32v<D> &p_Min2, const f32v<D> &p_Max2) const
+    {
+        f32 gap2 = 0.f;
+        for (u32 i = 0; i < D; ++i)
+        {
+            const auto gap = [&](const f32 p_Shift) {
+                return Math::Max(Math::Max(p_Min2[i] + p_Shift - p_Max1[i], p_Min1[i] - p_Max2[i] - p_Shift), 0.f);
+            };
+            f32 g = gap(0.f);
+            if (m_PeriodicAxes & (1u << i))
+                g = Math::Min(g, Math::Min(gap(m_Extent[i]), gap(-m_Extent[i])));
+            gap2 += g * g;
+        }
+        return gap2;
+    }
+
+    // Whether the stencil of the first cell reaches the second one, taking periodic axes into account
+    bool isStencilNeighbor(const i32v<D> &p_Cell1, const i32v<D> &p_Cell2) const;
+
+    // Only leaves whose particles come after the given ones are gathered, so that every pair is visited once
+    void collectTreeNeighbors(const TreeNode<D> &p_Leaf, SimArray<u32> &p_Neighbors) const;
 
-  private:
-    i32v<D> getCellPosition(const f32v<D> &p_Position) const;
     u32 getCellKey(const i32v<D> &p_CellPosition) const;
+    i32v<D> wrapCell(const i32v<D> &p_CellPosition) const;
+    // Lower corner and size of a cell in simulation space
+    f32v<D> getCellMin(const i32v<D> &p_CellPosition) const;
+    f32v<D> getCellSize() const;
+    bool isCellInView(const ViewVolume<D> &p_View, const i32v<D> &p_CellPosition, f32 p_Margin = 0.f) const;
+
+    static constexpr u32 s_MaxOffsets = D == D2 ? 80 : 728; // (2 * MaxCellRatio + 1)^D - 1
 
-    static constexpr u32 s_OffsetCount = D * D * D + 2 - D;
-    using OffsetArray = TKit::Array<i32v<D>, s_OffsetCount>;
+    void buildOffsets();
 
-    OffsetArray getGridOffsets() const;
+    void computeCellStatistics(u32 p_Partitions);
+    void computeBlockTags(const u8 *p_Tags, u32 p_Partitions) const;
 
     const SimArray<f32v<D>> *m_Positions = nullptr;
+    ScratchArena m_Arena;
+    LookupMode m_Mode = LookupMode::Grid;
+    f32 m_SortTime = 0.f;
+
+    u32 m_PeriodicAxes = 0;
+    f32v<D> m_PeriodicMin{0.f};
+    f32v<D> m_Extent{1.f};
+    f32v<D> m_CellSize{1.f};
+    i32v<D> m_CellCounts{1}; // Along periodic axes only
+
+    u32 m_CellRatio = 1;
+    TKit::Array<i32v<D>, s_MaxOffsets> m_Offsets;
+    u32 m_OffsetCount = 0;
+    u32 m_OffsetRatio = 0; // The ratio the offsets were built for
+
+    mutable TKit::Array<SimArray<u32>, DRIZ_MAX_THREADS> m_TreeNeighbors;
+    mutable SimArray<u32> m_BlockTags;
+    // Scratch for CollectVisibleParticles, kept around so that culling does not allocate every frame
+    mutable TKit::Array<SimArray<u32>, DRIZ_MAX_THREADS> m_VisibleChunks;
+    mutable SimArray<u32> m_VisibleCells;
 };
 } // namespace Driz
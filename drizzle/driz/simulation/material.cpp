@@ -0,0 +1,61 @@
+#include "driz/simulation/material.hpp"
+#include "driz/simulation/settings.hpp"
+
+namespace Driz
+{
+Material Material::FromSettings(const SimulationSettings &p_Settings)
+{
+    return Material{.Mass = p_Settings.ParticleMass,
+                    .TargetDensity = p_Settings.TargetDensity,
+                    .PressureStiffness = p_Settings.PressureStiffness,
+                    .NearPressureStiffness = p_Settings.NearPressureStiffness,
+                    .ViscLinearTerm = p_Settings.ViscLinearTerm,
+                    .ViscQuadraticTerm = p_Settings.ViscQuadraticTerm,
+                    .ElasticityStrength = p_Settings.ElasticityStrength,
+                    .PlasticAlpha = p_Settings.PlasticAlpha,
+                    .PlasticYield = p_Settings.PlasticYield,
+                    .PlasticMaxStep = p_Settings.PlasticMaxStep};
+}
+
+void MaterialTable::Build(const SimulationSettings &p_Settings, const SimArray<Material> &p_Materials)
+{
+    Count = Math::Min(static_cast<u32>(p_Materials.GetSize()) + 1, MaxMaterials);
+    const auto get = [&p_Settings, &p_Materials](const u32 p_Index) {
+        return p_Index == 0 ? Material::FromSettings(p_Settings) : p_Materials[p_Index - 1];
+    };
+
+    for (u32 i = 0; i < Count; ++i)
+    {
+        const Material material = get(i);
+        Masses[i] = material.Mass;
+        TargetDensities[i] = material.TargetDensity;
+        PressureStiffnesses[i] = material.PressureStiffness;
+        NearPressureStiffnesses[i] = material.NearPressureStiffness;
+        PlasticAlphas[i] = material.PlasticAlpha;
+        PlasticYields[i] = material.PlasticYield;
+        PlasticMaxSteps[i] = material.PlasticMaxStep;
+    }
+
+    // Mixed pairs share the mean viscosity, but only hold together as strongly as the weaker material does
+    for (u32 i = 0; i < Count; ++i)
+    {
+        const Material material1 = get(i);
+        for (u32 j = 0; j < Count; ++j)
+        {
+            const Material material2 = get(j);
+            const u32 pair = GetPairIndex(static_cast<u8>(i), static_cast<u8>(j));
+            ViscLinearTerms[pair] = 0.5f * (material1.ViscLinearTerm + material2.ViscLinearTerm);
+            ViscQuadraticTerms[pair] = 0.5f * (material1.ViscQuadraticTerm + material2.ViscQuadraticTerm);
+            ElasticityStrengths[pair] = Math::Min(material1.ElasticityStrength, material2.ElasticityStrength);
+        }
+    }
+}
+
+bool MaterialTable::HasUniformMass() const
+{
+    for (u32 i = 1; i < Count; ++i)
+        if (Masses[i] != Masses[0])
+            return false;
+    return true;
+}
+} // namespace Driz
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "driz/core/math.hpp"
+#include "driz/core/core.hpp"
+#include "tkit/container/array.hpp"
+#include "tkit/reflection/reflect.hpp"
+#include "tkit/serialization/yaml/serialize.hpp"
+
+namespace Driz
+{
+struct SimulationSettings;
+
+// The properties of a single fluid. Material 0 is always described by the simulation settings themselves, so that
+// single fluid scenes behave as before, and further materials are added to the solver
+struct Material
+{
+    TKIT_REFLECT_DECLARE(Material)
+    TKIT_YAML_SERIALIZE_DECLARE(Material)
+
+    f32 Mass = 1.f;
+    f32 TargetDensity = 10.f;
+    f32 PressureStiffness = 100.f;
+    f32 NearPressureStiffness = 25.f;
+
+    f32 ViscLinearTerm = 0.06f;
+    f32 ViscQuadraticTerm = 0.f;
+
+    f32 ElasticityStrength = 1.f;
+    f32 PlasticAlpha = 2.f;
+    f32 PlasticYield = 0.05f;
+    f32 PlasticMaxStep = 0.05f;
+
+    static Material FromSettings(const SimulationSettings &p_Settings);
+};
+
+// Materials laid out property by property. Pair properties are blended beforehand for every pair of materials, so that
+// pair loops read a single entry instead of the properties of both particles
+struct MaterialTable
+{
+    static constexpr u32 MaxMaterials = 8;
+
+    // Materials past the maximum are ignored
+    void Build(const SimulationSettings &p_Settings, const SimArray<Material> &p_Materials);
+
+    u32 GetPairIndex(const u8 p_Material1, const u8 p_Material2) const
+    {
+        return p_Material1 * MaxMaterials + p_Material2;
+    }
+    bool HasUniformMass() const;
+
+    u32 Count = 1;
+
+    TKit::Array<f32, MaxMaterials> Masses{};
+    TKit::Array<f32, MaxMaterials> TargetDensities{};
+    TKit::Array<f32, MaxMaterials> PressureStiffnesses{};
+    TKit::Array<f32, MaxMaterials> NearPressureStiffnesses{};
+    TKit::Array<f32, MaxMaterials> PlasticAlphas{};
+    TKit::Array<f32, MaxMaterials> PlasticYields{};
+    TKit::Array<f32, MaxMaterials> PlasticMaxSteps{};
+
+    TKit::Array<f32, MaxMaterials * MaxMaterials> ViscLinearTerms{};
+    TKit::Array<f32, MaxMaterials * MaxMaterials> ViscQuadraticTerms{};
+    TKit::Array<f32, MaxMaterials * MaxMaterials> ElasticityStrengths{};
+};
+} // namespace Driz
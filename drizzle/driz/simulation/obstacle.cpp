@@ -0,0 +1,321 @@
+#include "driz/simulation/obstacle.hpp"
+#include "tkit/profiling/macros.hpp"
+#include "tkit/utils/hash.hpp"
+#include <cfloat>
+#include <cmath>
+
+namespace Driz
+{
+// Rotations only ever act on the first two axes
+template <Dimension D> static f32v<D> rotate(const f32v<D> &p_Vector, const f32v2 &p_Rotation)
+{
+    f32v<D> result = p_Vector;
+    result[0] = p_Rotation[0] * p_Vector[0] - p_Rotation[1] * p_Vector[1];
+    result[1] = p_Rotation[1] * p_Vector[0] + p_Rotation[0] * p_Vector[1];
+    return result;
+}
+static f32v2 getRotation(const f32 p_Angle)
+{
+    return f32v2{std::cos(p_Angle), std::sin(p_Angle)};
+}
+
+template <Dimension D>
+f32 ObstacleSet<D>::computeLocalDistance(const Obstacle<D> &p_Obstacle, const f32v<D> &p_Position) const
+{
+    switch (p_Obstacle.Shape)
+    {
+    case ObstacleShape::Box: {
+        f32 outside = 0.f;
+        f32 inside = -FLT_MAX;
+        for (u32 i = 0; i < D; ++i)
+        {
+            const f32 q = Math::Absolute(p_Position[i]) - p_Obstacle.HalfExtents[i];
+            outside += q > 0.f ? q * q : 0.f;
+            inside = Math::Max(inside, q);
+        }
+        return Math::SquareRoot(outside) + Math::Min(inside, 0.f);
+    }
+    case ObstacleShape::Sphere:
+        return Math::Norm(p_Position) - p_Obstacle.Radius;
+    case ObstacleShape::Capsule: {
+        f32v<D> offset = p_Position;
+        offset[0] -= Math::Clamp(offset[0], -p_Obstacle.HalfExtents[0], p_Obstacle.HalfExtents[0]);
+        return Math::Norm(offset) - p_Obstacle.Radius;
+    }
+    }
+    return FLT_MAX;
+}
+
+// Normals are taken from central differences, so that every shape gets them the same way. They are only needed for
+// penetrating particles, which keeps the extra queries off the common path
+template <Dimension D>
+f32 ObstacleSet<D>::computeDistance(const Obstacle<D> &p_Obstacle, const f32v2 &p_Rotation, const f32v<D> &p_Position,
+                                    f32v<D> *p_Normal) const
+{
+    const f32v<D> local = rotate<D>(computeOffset(p_Position, p_Obstacle.Center), f32v2{p_Rotation[0], -p_Rotation[1]});
+    const f32 distance = computeLocalDistance(p_Obstacle, local);
+    if (!p_Normal)
+        return distance;
+
+    const f32 step = 1e-3f * m_CellSize;
+    f32v<D> gradient{0.f};
+    for (u32 i = 0; i < D; ++i)
+    {
+        f32v<D> offset{0.f};
+        offset[i] = step;
+        gradient[i] =
+            computeLocalDistance(p_Obstacle, local + offset) - computeLocalDistance(p_Obstacle, local - offset);
+    }
+    const f32 length = Math::Norm(gradient);
+    if (length > 0.f)
+        *p_Normal = rotate<D>(gradient / length, p_Rotation);
+    else
+    {
+        *p_Normal = f32v<D>{0.f};
+        (*p_Normal)[1] = 1.f;
+    }
+    return distance;
+}
+
+template <Dimension D>
+f32 ObstacleSet<D>::ComputeDistance(const Obstacle<D> &p_Obstacle, const f32v<D> &p_Position,
+                                    f32v<D> *p_Normal) const
+{
+    return computeDistance(p_Obstacle, getRotation(p_Obstacle.Rotation), p_Position, p_Normal);
+}
+
+template <Dimension D>
+void ObstacleSet<D>::ComputeBounds(const Obstacle<D> &p_Obstacle, f32v<D> &p_Min, f32v<D> &p_Max) const
+{
+    f32v<D> lo{-p_Obstacle.Radius};
+    f32v<D> hi{p_Obstacle.Radius};
+    if (p_Obstacle.Shape == ObstacleShape::Box)
+    {
+        lo = -p_Obstacle.HalfExtents;
+        hi = p_Obstacle.HalfExtents;
+    }
+    else if (p_Obstacle.Shape == ObstacleShape::Capsule)
+    {
+        lo[0] -= p_Obstacle.HalfExtents[0];
+        hi[0] += p_Obstacle.HalfExtents[0];
+    }
+
+    const bool round = p_Obstacle.Shape == ObstacleShape::Sphere;
+    const f32v2 rotation = round ? f32v2{1.f, 0.f} : getRotation(p_Obstacle.Rotation);
+    p_Min = f32v<D>{FLT_MAX};
+    p_Max = f32v<D>{-FLT_MAX};
+    for (u32 corner = 0; corner < 4; ++corner)
+    {
+        f32v<D> point = lo;
+        point[0] = (corner & 1) ? hi[0] : lo[0];
+        point[1] = (corner & 2) ? hi[1] : lo[1];
+        point = rotate<D>(point, rotation);
+        for (u32 i = 0; i < 2; ++i)
+        {
+            p_Min[i] = Math::Min(p_Min[i], point[i]);
+            p_Max[i] = Math::Max(p_Max[i], point[i]);
+        }
+    }
+    for (u32 i = 2; i < D; ++i)
+    {
+        p_Min[i] = lo[i];
+        p_Max[i] = hi[i];
+    }
+    p_Min += p_Obstacle.Center;
+    p_Max += p_Obstacle.Center;
+}
+
+template <Dimension D>
+void ObstacleSet<D>::SetPeriodicity(const u32 p_Axes, const f32v<D> &p_Min, const f32v<D> &p_Max)
+{
+    m_PeriodicAxes = p_Axes & ((1u << D) - 1);
+    m_PeriodicMin = p_Min;
+    m_Extent = p_Max - p_Min;
+}
+
+template <Dimension D> u32 ObstacleSet<D>::getBucket(const i32v<D> &p_Cell) const
+{
+    return TKit::Hash(p_Cell) % (m_BucketOffsets.GetSize() - 1);
+}
+
+// Periodic axes are split in a whole number of cells and measured from the lower bound, so that cells wrap around
+template <Dimension D> i32v<D> ObstacleSet<D>::getCell(const f32v<D> &p_Position) const
+{
+    i32v<D> cell;
+    for (u32 i = 0; i < D; ++i)
+    {
+        const bool periodic = m_PeriodicAxes & (1u << i);
+        const f32 position = periodic ? p_Position[i] - m_PeriodicMin[i] : p_Position[i];
+        cell[i] = static_cast<i32>(std::floor(position / m_CellSizes[i]));
+        if (periodic)
+            cell[i] = ((cell[i] % m_CellCounts[i]) + m_CellCounts[i]) % m_CellCounts[i];
+    }
+    return cell;
+}
+
+template <Dimension D> f32v<D> ObstacleSet<D>::computeOffset(const f32v<D> &p_From, const f32v<D> &p_To) const
+{
+    f32v<D> offset = p_From - p_To;
+    for (u32 i = 0; i < D; ++i)
+        if (m_PeriodicAxes & (1u << i))
+            offset[i] -= m_Extent[i] * std::round(offset[i] / m_Extent[i]);
+    return offset;
+}
+
+template <Dimension D> void ObstacleSet<D>::Update(const f32 p_DeltaTime, const f32 p_CellSize, const f32 p_Margin)
+{
+    TKIT_PROFILE_NSCOPE("Driz::ObstacleSet::Update");
+    m_CellSize = p_CellSize;
+    for (u32 i = 0; i < D; ++i)
+    {
+        m_CellCounts[i] = 1;
+        m_CellSizes[i] = p_CellSize;
+        if (m_PeriodicAxes & (1u << i))
+        {
+            m_CellCounts[i] = Math::Max(static_cast<i32>(m_Extent[i] / p_CellSize), 1);
+            m_CellSizes[i] = m_Extent[i] / static_cast<f32>(m_CellCounts[i]);
+        }
+    }
+    const u32 size = Obstacles.GetSize();
+    m_Rotations.Resize(size);
+    m_Unbucketed.Clear();
+
+    // Ranges along periodic axes are capped to a single lap, and their cells wrap around when visited
+    const auto getCellRange = [this, p_Margin](const Obstacle<D> &p_Obstacle, i32v<D> &p_Min, u32v<D> &p_Count) {
+        f32v<D> mn;
+        f32v<D> mx;
+        ComputeBounds(p_Obstacle, mn, mx);
+        u64 cells = 1;
+        for (u32 i = 0; i < D; ++i)
+        {
+            const bool periodic = m_PeriodicAxes & (1u << i);
+            const f32 origin = periodic ? m_PeriodicMin[i] : 0.f;
+            p_Min[i] = static_cast<i32>(std::floor((mn[i] - p_Margin - origin) / m_CellSizes[i]));
+            const i32 max = static_cast<i32>(std::floor((mx[i] + p_Margin - origin) / m_CellSizes[i]));
+            p_Count[i] = static_cast<u32>(max - p_Min[i] + 1);
+            if (periodic)
+                p_Count[i] = Math::Min(p_Count[i], static_cast<u32>(m_CellCounts[i]));
+            cells *= p_Count[i];
+        }
+        return cells;
+    };
+    const auto forEachCell = [this](const i32v<D> &p_Min, const u32v<D> &p_Count, const u32 p_Cells,
+                                    auto &&p_Function) {
+        for (u32 c = 0; c < p_Cells; ++c)
+        {
+            i32v<D> cell = p_Min;
+            u32 index = c;
+            for (u32 i = 0; i < D; ++i)
+            {
+                cell[i] += static_cast<i32>(index % p_Count[i]);
+                index /= p_Count[i];
+                if (m_PeriodicAxes & (1u << i))
+                    cell[i] = ((cell[i] % m_CellCounts[i]) + m_CellCounts[i]) % m_CellCounts[i];
+            }
+            p_Function(cell);
+        }
+    };
+
+    u32 total = 0;
+    for (u32 i = 0; i < size; ++i)
+    {
+        Obstacle<D> &obstacle = Obstacles[i];
+        obstacle.Center += obstacle.Velocity * p_DeltaTime;
+        for (u32 j = 0; j < D; ++j)
+            if (m_PeriodicAxes & (1u << j))
+                obstacle.Center[j] -= m_Extent[j] * std::floor((obstacle.Center[j] - m_PeriodicMin[j]) / m_Extent[j]);
+        obstacle.Rotation += obstacle.AngularVelocity * p_DeltaTime;
+        m_Rotations[i] = getRotation(obstacle.Rotation);
+
+        i32v<D> mn;
+        u32v<D> count;
+        const u64 cells = getCellRange(obstacle, mn, count);
+        if (cells > s_MaxBucketedCells)
+            m_Unbucketed.Append(i);
+        else
+            total += static_cast<u32>(cells);
+    }
+
+    const u32 buckets = Math::Max(2 * total, 64u);
+    m_BucketOffsets.Resize(buckets + 1);
+    m_BucketStamps.Resize(buckets);
+    for (u32 &offset : m_BucketOffsets)
+        offset = 0;
+
+    // Counted first and filled afterwards, walking the offsets back to their starting points. Stamps skip the cells of
+    // an obstacle whose keys clash into a bucket it is already listed in
+    for (u32 pass = 0; pass < 2; ++pass)
+    {
+        for (u32 &stamp : m_BucketStamps)
+            stamp = 0;
+        u32 unbucketed = 0;
+        for (u32 i = 0; i < size; ++i)
+        {
+            if (unbucketed < m_Unbucketed.GetSize() && m_Unbucketed[unbucketed] == i)
+            {
+                ++unbucketed;
+                continue;
+            }
+            i32v<D> mn;
+            u32v<D> count;
+            const u32 cells = static_cast<u32>(getCellRange(Obstacles[i], mn, count));
+            forEachCell(mn, count, cells, [this, i, pass](const i32v<D> &p_Cell) {
+                const u32 bucket = getBucket(p_Cell);
+                if (m_BucketStamps[bucket] == i + 1)
+                    return;
+                m_BucketStamps[bucket] = i + 1;
+                if (pass == 0)
+                    ++m_BucketOffsets[bucket];
+                else
+                    m_BucketObstacles[--m_BucketOffsets[bucket]] = i;
+            });
+        }
+        if (pass == 0)
+        {
+            for (u32 b = 1; b <= buckets; ++b)
+                m_BucketOffsets[b] += m_BucketOffsets[b - 1];
+            m_BucketObstacles.Resize(m_BucketOffsets[buckets]);
+        }
+    }
+}
+
+template <Dimension D>
+void ObstacleSet<D>::Resolve(f32v<D> &p_Position, f32v<D> &p_Velocity, const f32 p_Radius,
+                             const f32 p_Restitution) const
+{
+    const auto resolve = [&](const u32 p_Index) {
+        const Obstacle<D> &obstacle = Obstacles[p_Index];
+        const f32v2 &rotation = m_Rotations[p_Index];
+        if (computeDistance(obstacle, rotation, p_Position) >= p_Radius)
+            return;
+
+        f32v<D> normal;
+        const f32 distance = computeDistance(obstacle, rotation, p_Position, &normal);
+        p_Position += (p_Radius - distance) * normal;
+
+        // The surface velocity accounts for the spin, so that paddles drag particles along
+        const f32v<D> arm = computeOffset(p_Position, obstacle.Center);
+        f32v<D> surface = obstacle.Velocity;
+        surface[0] -= obstacle.AngularVelocity * arm[1];
+        surface[1] += obstacle.AngularVelocity * arm[0];
+
+        const f32 approach = Math::Dot(p_Velocity - surface, normal);
+        if (approach < 0.f)
+            p_Velocity -= (1.f + p_Restitution) * approach * normal;
+    };
+
+    const u32 bucket = getBucket(getCell(p_Position));
+    for (u32 i = m_BucketOffsets[bucket]; i < m_BucketOffsets[bucket + 1]; ++i)
+        resolve(m_BucketObstacles[i]);
+    for (const u32 index : m_Unbucketed)
+        resolve(index);
+}
+
+template <Dimension D> bool ObstacleSet<D>::IsEmpty() const
+{
+    return Obstacles.IsEmpty();
+}
+
+template class ObstacleSet<D2>;
+template class ObstacleSet<D3>;
+} // namespace Driz
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "driz/core/math.hpp"
+#include "driz/core/core.hpp"
+
+namespace Driz
+{
+enum class ObstacleShape : u8
+{
+    Box = 0,
+    Sphere,
+    Capsule
+};
+
+// Obstacles are rigid and may move and spin around the z axis, which makes them act like paddles in 2D and 3D alike.
+// Every shape is centered on the origin of its local frame
+template <Dimension D> struct Obstacle
+{
+    ObstacleShape Shape = ObstacleShape::Box;
+    f32v<D> Center{0.f};
+    // Boxes span the whole extents. Capsules only use the first one, as the half length of their segment
+    f32v<D> HalfExtents{1.f};
+    f32 Radius = 1.f; // Spheres and capsules
+
+    f32 Rotation = 0.f; // In radians
+    f32v<D> Velocity{0.f};
+    f32 AngularVelocity = 0.f;
+};
+
+// Obstacles are bucketed by the cells of the lookup grid their bounds overlap, so that a particle only tests the
+// obstacles sharing its cell. Cells are hashed into a fixed amount of buckets, and clashing cells merely add a few
+// needless distance queries. An obstacle is only listed once per bucket, however many of its cells land there
+template <Dimension D> class ObstacleSet
+{
+  public:
+    // Bit i makes axis i wrap around between the given bounds, as for the lookup. Obstacles are bucketed across the
+    // seam and measured against their closest image. Takes effect on the next update
+    void SetPeriodicity(u32 p_Axes, const f32v<D> &p_Min, const f32v<D> &p_Max);
+    // Moves every obstacle and buckets them again. Bounds are grown by the given margin, usually the particle radius
+    void Update(f32 p_DeltaTime, f32 p_CellSize, f32 p_Margin);
+
+    // Pushes a particle out of every obstacle it overlaps, and reflects its velocity relative to the obstacle surface.
+    // Safe to call from several threads at once once the set has been updated
+    void Resolve(f32v<D> &p_Position, f32v<D> &p_Velocity, f32 p_Radius, f32 p_Restitution) const;
+
+    // The normal is only written if requested, and always points away from the obstacle
+    f32 ComputeDistance(const Obstacle<D> &p_Obstacle, const f32v<D> &p_Position, f32v<D> *p_Normal = nullptr) const;
+    void ComputeBounds(const Obstacle<D> &p_Obstacle, f32v<D> &p_Min, f32v<D> &p_Max) const;
+
+    bool IsEmpty() const;
+
+    SimArray<Obstacle<D>> Obstacles;
+
+  private:
+    // Obstacles covering more cells than this are tested by every particle instead of being bucketed
+    static constexpr u32 s_MaxBucketedCells = 4096;
+
+    f32 computeLocalDistance(const Obstacle<D> &p_Obstacle, const f32v<D> &p_Position) const;
+    f32 computeDistance(const Obstacle<D> &p_Obstacle, const f32v2 &p_Rotation, const f32v<D> &p_Position,
+                        f32v<D> *p_Normal = nullptr) const;
+    u32 getBucket(const i32v<D> &p_Cell) const;
+    i32v<D> getCell(const f32v<D> &p_Position) const;
+    // Difference between two positions, taken between their closest images along periodic axes
+    f32v<D> computeOffset(const f32v<D> &p_From, const f32v<D> &p_To) const;
+
+    SimArray<u32> m_BucketOffsets;
+    SimArray<u32> m_BucketObstacles;
+    SimArray<u32> m_Unbucketed;
+    SimArray<u32> m_BucketStamps; // Last obstacle + 1 listed in every bucket
+    SimArray<f32v2> m_Rotations;  // Cosine and sine of every obstacle rotation
+    f32 m_CellSize = 1.f;
+
+    u32 m_PeriodicAxes = 0;
+    f32v<D> m_PeriodicMin{0.f};
+    f32v<D> m_Extent{1.f};
+    f32v<D> m_CellSizes{1.f};
+    i32v<D> m_CellCounts{1}; // Along periodic axes only
+};
+} // namespace Driz
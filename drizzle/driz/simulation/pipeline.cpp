@@ -0,0 +1,127 @@
+#include "driz/simulation/pipeline.hpp"
+#include "tkit/profiling/macros.hpp"
+
+namespace Driz
+{
+template <Dimension D> SimulationPipeline<D>::SimulationPipeline(Solver<D> &p_Solver) : m_Solver(p_Solver)
+{
+}
+template <Dimension D> SimulationPipeline<D>::~SimulationPipeline()
+{
+    Stop();
+}
+
+template <Dimension D> void SimulationPipeline<D>::Start()
+{
+    if (m_Running)
+        return;
+
+    Publish();
+    // The default pool is shared with the renderer, so the solver gets a team of its own to keep both busy at once,
+    // made of the workers the core left out of it
+    m_ThreadPool.Construct(Math::Max(Core::GetReservedWorkerCount(), 1u));
+    m_Running = true;
+    m_Thread = std::thread{[this] { run(); }};
+}
+
+template <Dimension D> void SimulationPipeline<D>::Stop()
+{
+    if (!m_Running)
+        return;
+    {
+        std::scoped_lock lock{m_Mutex};
+        m_Running = false;
+    }
+    m_Condition.notify_all();
+    m_Thread.join();
+    m_Pending = false;
+    m_ThreadPool.Destruct();
+}
+
+template <Dimension D> bool SimulationPipeline<D>::IsRunning() const
+{
+    return m_Running;
+}
+
+template <Dimension D> void SimulationPipeline<D>::Kick(const StepInput<D> &p_Input)
+{
+    {
+        std::scoped_lock lock{m_Mutex};
+        m_Input = p_Input;
+        m_Pending = true;
+    }
+    m_Condition.notify_all();
+}
+
+template <Dimension D> void SimulationPipeline<D>::Wait()
+{
+    TKIT_PROFILE_NSCOPE("Driz::SimulationPipeline::Wait");
+    std::unique_lock lock{m_Mutex};
+    m_Condition.wait(lock, [this] { return !m_Pending; });
+}
+
+template <Dimension D> const RenderSnapshot<D> &SimulationPipeline<D>::AcquireSnapshot()
+{
+    m_Snapshots.Acquire();
+    return m_Snapshots.GetFront();
+}
+
+template <Dimension D> void SimulationPipeline<D>::run()
+{
+    Core::SetThreadPool(m_ThreadPool.Get());
+    for (;;)
+    {
+        StepInput<D> input;
+        {
+            std::unique_lock lock{m_Mutex};
+            m_Condition.wait(lock, [this] { return m_Pending || !m_Running; });
+            if (!m_Running)
+                break;
+            input = m_Input;
+        }
+
+        m_Solver.Step(input);
+        Publish();
+        {
+            std::scoped_lock lock{m_Mutex};
+            m_Pending = false;
+        }
+        m_Condition.notify_all();
+    }
+    Core::SetThreadPool(nullptr);
+}
+
+template <Dimension D> void SimulationPipeline<D>::Publish()
+{
+    TKIT_PROFILE_NSCOPE("Driz::SimulationPipeline::Publish");
+    const SimulationData<D> &data = m_Solver.Data;
+    RenderSnapshot<D> &snapshot = m_Snapshots.GetBack();
+
+    const u32 size = m_Solver.GetParticleCount();
+    const bool counts = data.NeighborCounts.GetSize() == size;
+    snapshot.State.Positions.Resize(size);
+    snapshot.State.Velocities.Resize(size);
+    snapshot.NeighborCounts.Resize(counts ? size : 0);
+    if constexpr (D == D3)
+        snapshot.UnderMouseInfluence.Resize(size);
+
+    Core::ForEach(0, size, m_Solver.Settings.Partitions, [&](const u32 p_Start, const u32 p_End) {
+        for (u32 i = p_Start; i < p_End; ++i)
+        {
+            snapshot.State.Positions[i] = data.State.Positions[i];
+            snapshot.State.Velocities[i] = data.State.Velocities[i];
+            if (counts)
+                snapshot.NeighborCounts[i] = data.NeighborCounts[i];
+            if constexpr (D == D3)
+                snapshot.UnderMouseInfluence[i] = data.UnderMouseInfluence[i];
+        }
+    });
+    snapshot.State.Min = data.State.Min;
+    snapshot.State.Max = data.State.Max;
+    snapshot.Step = m_Steps++;
+    m_Snapshots.Publish();
+}
+
+template class SimulationPipeline<D2>;
+template class SimulationPipeline<D3>;
+} // namespace Driz
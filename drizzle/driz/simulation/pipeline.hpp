@@ -0,0 +1,99 @@
+#pragma once
+
+#include "driz/simulation/solver.hpp"
+#include "tkit/memory/storage.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace Driz
+{
+// A single producer, single consumer triple buffer. The producer always owns the back slot and the consumer always owns
+// the front one, so neither ever waits for the other: publishing and acquiring only exchange slot indices
+template <typename T> class TripleBuffer
+{
+  public:
+    T &GetBack()
+    {
+        return m_Slots[m_Back];
+    }
+    const T &GetFront() const
+    {
+        return m_Slots[m_Front];
+    }
+
+    // Hands the back slot over. If the consumer did not acquire the previous one, it is simply overwritten later on
+    void Publish()
+    {
+        m_Back = m_Middle.exchange(m_Back | s_Fresh, std::memory_order_acq_rel) & ~s_Fresh;
+    }
+
+    // Returns true if a newer slot was published since the last call, in which case it becomes the front slot
+    bool Acquire()
+    {
+        if (!(m_Middle.load(std::memory_order_relaxed) & s_Fresh))
+            return false;
+        m_Front = m_Middle.exchange(m_Front, std::memory_order_acq_rel) & ~s_Fresh;
+        return true;
+    }
+
+  private:
+    static constexpr u32 s_Fresh = 4;
+
+    TKit::Array<T, 3> m_Slots{};
+    u32 m_Front = 0;
+    std::atomic<u32> m_Middle{1};
+    u32 m_Back = 2;
+};
+
+// Only the arrays drawing needs, copied at the end of a step
+template <Dimension D> struct RenderSnapshot
+{
+    SimulationState<D> State;
+    SimArray<u32> NeighborCounts;
+    SimArray<u8> UnderMouseInfluence; // 3D only
+    u64 Step = 0;
+};
+
+// Runs the solver on a thread of its own, driving a worker team of its own, while the caller draws the last published
+// snapshot. Steps are requested one at a time: between Wait() and Kick() the solver is idle and may be freely read and
+// edited, and outside of that window only snapshots may be touched
+template <Dimension D> class SimulationPipeline
+{
+  public:
+    SimulationPipeline(Solver<D> &p_Solver);
+    ~SimulationPipeline();
+
+    // Publishes a snapshot of the current state right away, so that there is always something to draw
+    void Start();
+    void Stop();
+    bool IsRunning() const;
+
+    // Snapshots are published at the end of every step. This one is meant for changes made while idle
+    void Publish();
+
+    void Kick(const StepInput<D> &p_Input);
+    // Blocks until the last requested step is done. It is a no-op if no step is in flight
+    void Wait();
+
+    // The returned snapshot stays untouched until the next call
+    const RenderSnapshot<D> &AcquireSnapshot();
+
+  private:
+    void run();
+
+    Solver<D> &m_Solver;
+    TKit::Storage<TKit::ThreadPool> m_ThreadPool;
+    std::thread m_Thread;
+
+    std::mutex m_Mutex;
+    std::condition_variable m_Condition;
+    StepInput<D> m_Input{};
+    bool m_Pending = false;
+    bool m_Running = false;
+
+    TripleBuffer<RenderSnapshot<D>> m_Snapshots;
+    u64 m_Steps = 0;
+};
+} // namespace Driz
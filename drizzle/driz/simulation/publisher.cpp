@@ -0,0 +1,214 @@
+#include "driz/simulation/publisher.hpp"
+#include "tkit/profiling/macros.hpp"
+#include <atomic>
+#include <cstring>
+#include <iostream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#    include <cerrno>
+#    include <csignal>
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#    define DRIZ_HAS_SHM
+#endif
+
+namespace Driz
+{
+static constexpr u32 s_Version = 2;
+static constexpr usize s_Alignment = 64;
+
+static usize alignUp(const usize p_Size)
+{
+    return (p_Size + s_Alignment - 1) & ~(s_Alignment - 1);
+}
+
+static usize getSlotSize(const u32 p_Dimension, const u32 p_Capacity)
+{
+    return alignUp(sizeof(SharedSlotHeader) + static_cast<usize>(p_Capacity) * (2 * p_Dimension + 2) * sizeof(f32));
+}
+
+StatePublisher::~StatePublisher()
+{
+    close();
+}
+
+SharedStateHeader *StatePublisher::getHeader() const
+{
+    return reinterpret_cast<SharedStateHeader *>(m_Memory);
+}
+SharedSlotHeader *StatePublisher::getSlot(const u64 p_Frame) const
+{
+    const SharedStateHeader *header = getHeader();
+    const usize offset = alignUp(sizeof(SharedStateHeader)) + (p_Frame % header->SlotCount) * header->SlotSize;
+    return reinterpret_cast<SharedSlotHeader *>(m_Memory + offset);
+}
+
+// Readers copy the slot between two loads of its sequence. Bumping it to an odd value before writing and to the next
+// even one after, with release ordering, is what lets them detect a write that overlapped their copy
+template <Dimension D> void StatePublisher::Publish(const Solver<D> &p_Solver)
+{
+    static_assert(sizeof(f32v<D>) == D * sizeof(f32) && sizeof(Density) == 2 * sizeof(f32),
+                  "Published arrays must be tightly packed");
+    const u64 step = p_Solver.Telemetry.GetStepCount();
+    if (Name.empty() || m_Failed || step == m_LastStep)
+        return;
+
+    TKIT_PROFILE_NSCOPE("Driz::StatePublisher::Publish");
+    const u32 pcount = p_Solver.GetParticleCount();
+    if (!m_Memory || getHeader()->Dimension != D || pcount > getHeader()->Capacity)
+    {
+        // Some headroom keeps emitters and adaptive resolution from forcing readers to reopen the segment every step
+        const u32 capacity = Math::Max(pcount + pcount / 2, 1024u);
+        if (!open(D, capacity))
+        {
+            m_Failed = true;
+            return;
+        }
+    }
+    m_LastStep = step;
+
+    SharedStateHeader *header = getHeader();
+    const u64 frame = std::atomic_ref<u64>{header->Published}.load(std::memory_order_relaxed);
+    SharedSlotHeader *slot = getSlot(frame);
+
+    std::atomic_ref<u64> sequence{slot->Sequence};
+    const u64 current = sequence.load(std::memory_order_relaxed);
+    sequence.store(current + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    const SimulationState<D> &state = p_Solver.Data.State;
+    slot->Step = step;
+    slot->Particles = pcount;
+    slot->Dimension = D;
+    for (u32 i = 0; i < 3; ++i)
+    {
+        slot->Min[i] = i < D ? state.Min[i] : 0.f;
+        slot->Max[i] = i < D ? state.Max[i] : 0.f;
+    }
+
+    u8 *positions = reinterpret_cast<u8 *>(slot) + sizeof(SharedSlotHeader);
+    u8 *velocities = positions + static_cast<usize>(header->Capacity) * sizeof(f32v<D>);
+    u8 *densities = velocities + static_cast<usize>(header->Capacity) * sizeof(f32v<D>);
+    Core::ForEach(0, pcount, p_Solver.Settings.Partitions, [&](const u32 p_Start, const u32 p_End) {
+        const usize count = p_End - p_Start;
+        if (count == 0)
+            return;
+        std::memcpy(positions + p_Start * sizeof(f32v<D>), &state.Positions[p_Start], count * sizeof(f32v<D>));
+        std::memcpy(velocities + p_Start * sizeof(f32v<D>), &state.Velocities[p_Start], count * sizeof(f32v<D>));
+        std::memcpy(densities + p_Start * sizeof(Density), &p_Solver.Data.Densities[p_Start],
+                    count * sizeof(Density));
+    });
+
+    sequence.store(current + 2, std::memory_order_release);
+    std::atomic_ref<u64>{header->Published}.store(frame + 1, std::memory_order_release);
+}
+
+#ifdef DRIZ_HAS_SHM
+// A segment is only abandoned if it has a header of this version whose owner is gone. Anything else may belong to a
+// live process, or to another program altogether
+static bool isAbandoned(const std::string &p_Name)
+{
+    const i32 descriptor = ::shm_open(p_Name.c_str(), O_RDONLY, 0);
+    if (descriptor < 0)
+        return false;
+
+    struct stat info{};
+    const bool sized =
+        ::fstat(descriptor, &info) == 0 && info.st_size >= static_cast<off_t>(sizeof(SharedStateHeader));
+    void *memory =
+        sized ? ::mmap(nullptr, sizeof(SharedStateHeader), PROT_READ, MAP_SHARED, descriptor, 0) : MAP_FAILED;
+    ::close(descriptor);
+    if (memory == MAP_FAILED)
+        return false;
+
+    SharedStateHeader header;
+    std::memcpy(&header, memory, sizeof(SharedStateHeader));
+    ::munmap(memory, sizeof(SharedStateHeader));
+    if (header.Magic != SharedStateHeader::MagicNumber || header.Version != s_Version || header.Owner == 0)
+        return false;
+    return ::kill(static_cast<pid_t>(header.Owner), 0) != 0 && errno == ESRCH;
+}
+
+// Readers that still map a replaced segment keep it alive, and find out through its stale flag
+bool StatePublisher::open(const u32 p_Dimension, const u32 p_Capacity)
+{
+    close();
+    const u32 slots = Math::Max(SlotCount, 1u);
+    const usize slotSize = getSlotSize(p_Dimension, p_Capacity);
+    const usize size = alignUp(sizeof(SharedStateHeader)) + slots * slotSize;
+
+    i32 descriptor = ::shm_open(Name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (descriptor < 0 && errno == EEXIST)
+    {
+        if (!isAbandoned(Name))
+        {
+            std::cerr << "The shared memory object '" << Name
+                      << "' already exists and may be in use by another process. Publish under another name, or "
+                         "remove it if it was left behind.\n";
+            return false;
+        }
+        ::shm_unlink(Name.c_str());
+        descriptor = ::shm_open(Name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    }
+    if (descriptor < 0 || ::ftruncate(descriptor, static_cast<off_t>(size)) != 0)
+    {
+        std::cerr << "Failed to create the shared memory object '" << Name << "': " << std::strerror(errno) << '\n';
+        if (descriptor >= 0)
+        {
+            ::close(descriptor);
+            ::shm_unlink(Name.c_str());
+        }
+        return false;
+    }
+
+    void *memory = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    ::close(descriptor);
+    if (memory == MAP_FAILED)
+    {
+        std::cerr << "Failed to map the shared memory object '" << Name << "': " << std::strerror(errno) << '\n';
+        ::shm_unlink(Name.c_str());
+        return false;
+    }
+
+    // Freshly truncated memory is zeroed, so every slot already starts with an even sequence
+    m_Memory = static_cast<u8 *>(memory);
+    m_Size = size;
+    SharedStateHeader *header = getHeader();
+    header->Version = s_Version;
+    header->Dimension = p_Dimension;
+    header->SlotCount = slots;
+    header->Capacity = p_Capacity;
+    header->SlotSize = slotSize;
+    header->Owner = static_cast<u32>(::getpid());
+    // The magic number goes last, so that a reader seeing it also sees a complete header
+    std::atomic_ref<u32>{header->Magic}.store(SharedStateHeader::MagicNumber, std::memory_order_release);
+    return true;
+}
+
+void StatePublisher::close()
+{
+    if (!m_Memory)
+        return;
+    std::atomic_ref<u32>{getHeader()->Stale}.store(1, std::memory_order_release);
+    ::munmap(m_Memory, m_Size);
+    ::shm_unlink(Name.c_str());
+    m_Memory = nullptr;
+    m_Size = 0;
+}
+#else
+bool StatePublisher::open(const u32, const u32)
+{
+    std::cerr << "Publishing the state needs POSIX shared memory, which is not available on this platform.\n";
+    return false;
+}
+
+void StatePublisher::close()
+{
+}
+#endif
+
+template void StatePublisher::Publish<D2>(const Solver<D2> &);
+template void StatePublisher::Publish<D3>(const Solver<D3> &);
+} // namespace Driz
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "driz/simulation/solver.hpp"
+#include <string>
+
+namespace Driz
+{
+// Layout of the shared memory segment, which external readers rely on. The segment header is followed by a ring of
+// slots, each one starting with its own header and holding the positions, velocities and densities (density and near
+// density) of up to Capacity particles as tightly packed f32 arrays of D, D and 2 components per particle
+struct SharedStateHeader
+{
+    static constexpr u32 MagicNumber = 0x535A5244; // 'DRZS'
+
+    u32 Magic;
+    u32 Version;
+    u32 Dimension;
+    u32 SlotCount;
+    u32 Capacity;
+    u32 Stale; // Set once the segment is replaced by a larger one or the publisher goes away. Readers should reopen it
+    u64 SlotSize;  // In bytes, headers included
+    u64 Published; // Frames published so far. Frame i lives in slot i % SlotCount
+    u32 Owner;     // Process id of the publisher, so that a new one only takes over the name once it is gone
+};
+
+// Slots are guarded by a sequence lock. The sequence is odd while the slot is written, and a reader holds a consistent
+// frame only if the sequence was even and did not change while it copied the slot
+struct alignas(64) SharedSlotHeader
+{
+    u64 Sequence;
+    u64 Step;
+    u32 Particles;
+    u32 Dimension;
+    f32 Min[3];
+    f32 Max[3];
+};
+
+// Writes the state of every step into a POSIX shared memory ring, so that viewers and analysis tools in other
+// processes may follow a simulation without any coupling to it. The solver never waits on readers: slow ones just
+// miss frames, or notice through the sequence lock that a slot was overwritten under them
+class StatePublisher
+{
+  public:
+    ~StatePublisher();
+
+    // Does nothing if the step was already published. The segment grows the first time the particles do not fit.
+    // Publishing fails if a live process already publishes under the same name, while segments left behind by
+    // processes that are gone are replaced
+    template <Dimension D> void Publish(const Solver<D> &p_Solver);
+
+    static inline std::string Name{}; // Shared memory object name, such as '/drizzle'. Nothing is published if empty
+    static inline u32 SlotCount = 4;
+
+  private:
+    bool open(u32 p_Dimension, u32 p_Capacity);
+    void close();
+
+    SharedStateHeader *getHeader() const;
+    SharedSlotHeader *getSlot(u64 p_Frame) const;
+
+    u8 *m_Memory = nullptr;
+    usize m_Size = 0;
+    u64 m_LastStep = UINT64_MAX;
+    bool m_Failed = false;
+};
+} // namespace Driz
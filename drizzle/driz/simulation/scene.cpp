@@ -0,0 +1,131 @@
+#include "driz/simulation/scene.hpp"
+
+namespace Driz
+{
+template <Dimension D>
+void Scene<D>::Generate(SimulationState<D> &p_State, const SceneSettings &p_Settings, const u32 p_Partitions)
+{
+    TKIT_PROFILE_NSCOPE("Driz::Scene::Generate");
+    f32v<D> center;
+    f32v<D> extents;
+    center[0] = p_Settings.CenterX;
+    center[1] = p_Settings.CenterY;
+    extents[0] = p_Settings.Width;
+    extents[1] = p_Settings.Height;
+    if constexpr (D == D3)
+    {
+        center[2] = p_Settings.CenterZ;
+        extents[2] = p_Settings.Depth;
+    }
+
+    const f32 spacing = Math::Max(p_Settings.Spacing, 1e-3f);
+    if (p_Settings.Shape == SceneShape::Box)
+    {
+        const f32v<D> half = 0.5f * extents;
+        const auto sdf = [&center, &half](const f32v<D> &p_Position) {
+            return BoxDistance(p_Position, center, half);
+        };
+        Fill(p_State, sdf, center - half, center + half, p_Settings.Pattern, spacing, p_Settings.Jitter,
+             p_Settings.Seed, p_Partitions);
+    }
+    else
+    {
+        const f32 radius = p_Settings.Radius;
+        const auto sdf = [&center, radius](const f32v<D> &p_Position) {
+            return SphereDistance(p_Position, center, radius);
+        };
+        Fill(p_State, sdf, center - radius, center + radius, p_Settings.Pattern, spacing, p_Settings.Jitter,
+             p_Settings.Seed, p_Partitions);
+    }
+}
+
+template <Dimension D>
+void Scene<D>::Lattice(SimulationState<D> &p_State, const u32v<D> &p_Dimensions, const f32 p_Separation,
+                       const u32 p_Partitions)
+{
+    TKIT_PROFILE_NSCOPE("Driz::Scene::Lattice");
+    const f32v<D> midPoint = 0.5f * p_Separation * f32v<D>{p_Dimensions - 1u};
+    const u32 size = getProduct(p_Dimensions);
+    resize(p_State, size);
+
+    Core::ForEach(0, size, p_Partitions, [&](const u32 p_Start, const u32 p_End) {
+        TKIT_PROFILE_NSCOPE("Driz::Scene::WriteLattice");
+        for (u32 i = p_Start; i < p_End; ++i)
+        {
+            const u32v<D> coords = getGridCoordinates(i, p_Dimensions);
+            p_State.Positions[i] = p_Separation * f32v<D>{coords} - midPoint;
+            p_State.Velocities[i] = f32v<D>{0.f};
+        }
+    });
+}
+
+template <Dimension D>
+f32 Scene<D>::BoxDistance(const f32v<D> &p_Position, const f32v<D> &p_Center, const f32v<D> &p_HalfExtents)
+{
+    f32 outside = 0.f;
+    f32 inside = -FLT_MAX;
+    for (u32 i = 0; i < D; ++i)
+    {
+        const f32 q = Math::Absolute(p_Position[i] - p_Center[i]) - p_HalfExtents[i];
+        if (q > 0.f)
+            outside += q * q;
+        inside = Math::Max(inside, q);
+    }
+    return outside > 0.f ? Math::SquareRoot(outside) : inside;
+}
+template <Dimension D>
+f32 Scene<D>::SphereDistance(const f32v<D> &p_Position, const f32v<D> &p_Center, const f32 p_Radius)
+{
+    return Math::Norm(p_Position - p_Center) - p_Radius;
+}
+
+// A stateless integer hash so that every candidate draws the same numbers no matter which thread evaluates it
+template <Dimension D> f32 Scene<D>::Random(const u32 p_Seed, const u32 p_Index, const u32 p_Stream)
+{
+    u32 h = p_Seed * 0x9E3779B9u ^ (p_Index + 0x7F4A7C15u) * 0x85EBCA6Bu ^ p_Stream * 0xC2B2AE35u;
+    h ^= h >> 16;
+    h *= 0x7FEB352Du;
+    h ^= h >> 15;
+    h *= 0x846CA68Bu;
+    h ^= h >> 16;
+    return static_cast<f32>(h >> 8) / static_cast<f32>(1u << 24);
+}
+
+template <Dimension D>
+u32v<D> Scene<D>::getGridDimensions(const f32v<D> &p_Min, const f32v<D> &p_Max, const f32 p_CellSize)
+{
+    u32v<D> dims;
+    for (u32 i = 0; i < D; ++i)
+        dims[i] = p_Max[i] > p_Min[i] ? static_cast<u32>((p_Max[i] - p_Min[i]) / p_CellSize) + 1 : 0;
+    return dims;
+}
+template <Dimension D> u32v<D> Scene<D>::getGridCoordinates(u32 p_Index, const u32v<D> &p_Dimensions)
+{
+    u32v<D> coords;
+    for (u32 i = 0; i < D; ++i)
+    {
+        coords[i] = p_Index % p_Dimensions[i];
+        p_Index /= p_Dimensions[i];
+    }
+    return coords;
+}
+template <Dimension D> u32 Scene<D>::getProduct(const u32v<D> &p_Dimensions)
+{
+    u32 product = 1;
+    for (u32 i = 0; i < D; ++i)
+        product *= p_Dimensions[i];
+    return product;
+}
+
+template <Dimension D> void Scene<D>::resize(SimulationState<D> &p_State, const u32 p_Size)
+{
+    p_State.Positions.Resize(p_Size);
+    p_State.Velocities.Resize(p_Size);
+    p_State.MassRatios.Clear();
+    p_State.MaterialIndices.Clear();
+}
+
+template struct Scene<D2>;
+template struct Scene<D3>;
+
+} // namespace Driz
@@ -0,0 +1,247 @@
+#pragma once
+
+#include "driz/simulation/settings.hpp"
+#include "driz/core/math.hpp"
+#include "driz/core/core.hpp"
+#include "tkit/reflection/reflect.hpp"
+#include "tkit/serialization/yaml/serialize.hpp"
+#include "tkit/profiling/macros.hpp"
+
+namespace Driz
+{
+TKIT_REFLECT_DECLARE_ENUM(SceneShape)
+TKIT_YAML_SERIALIZE_DECLARE_ENUM(SceneShape)
+enum class SceneShape
+{
+    Box = 0,
+    Sphere
+};
+
+TKIT_REFLECT_DECLARE_ENUM(ScenePattern)
+TKIT_YAML_SERIALIZE_DECLARE_ENUM(ScenePattern)
+enum class ScenePattern
+{
+    Lattice = 0,
+    JitteredLattice,
+    PoissonDisk
+};
+
+struct SceneSettings
+{
+    TKIT_REFLECT_DECLARE(SceneSettings)
+    TKIT_YAML_SERIALIZE_DECLARE(SceneSettings)
+
+    TKIT_REFLECT_GROUP_BEGIN("CommandLine")
+    SceneShape Shape = SceneShape::Box;
+    ScenePattern Pattern = ScenePattern::Lattice;
+
+    f32 Spacing = 0.4f;
+    f32 Jitter = 0.25f;
+
+    f32 Width = 10.f;
+    f32 Height = 10.f;
+    f32 Depth = 10.f;
+    f32 Radius = 5.f;
+
+    f32 CenterX = 0.f;
+    f32 CenterY = 0.f;
+    f32 CenterZ = 0.f;
+
+    u32 Seed = 0;
+    TKIT_REFLECT_GROUP_END()
+};
+
+// Scene generators write directly into preallocated state arrays. Shapes are described by a signed distance function,
+// negative inside. Every pattern is deterministic for a given seed, regardless of the partition count
+template <Dimension D> struct Scene
+{
+    static void Generate(SimulationState<D> &p_State, const SceneSettings &p_Settings, u32 p_Partitions);
+    static void Lattice(SimulationState<D> &p_State, const u32v<D> &p_Dimensions, f32 p_Separation,
+                        u32 p_Partitions);
+
+    static f32 BoxDistance(const f32v<D> &p_Position, const f32v<D> &p_Center, const f32v<D> &p_HalfExtents);
+    static f32 SphereDistance(const f32v<D> &p_Position, const f32v<D> &p_Center, f32 p_Radius);
+
+    static f32 Random(u32 p_Seed, u32 p_Index, u32 p_Stream);
+
+    template <typename SDF>
+    static void Fill(SimulationState<D> &p_State, SDF &&p_Distance, const f32v<D> &p_Min, const f32v<D> &p_Max,
+                     const ScenePattern p_Pattern, const f32 p_Spacing, const f32 p_Jitter, const u32 p_Seed,
+                     const u32 p_Partitions)
+    {
+        TKIT_PROFILE_NSCOPE("Driz::Scene::Fill");
+        if (p_Pattern == ScenePattern::PoissonDisk)
+            fillPoissonDisk(p_State, std::forward<SDF>(p_Distance), p_Min, p_Max, p_Spacing, p_Seed, p_Partitions);
+        else
+            fillLattice(p_State, std::forward<SDF>(p_Distance), p_Min, p_Max,
+                        p_Pattern == ScenePattern::JitteredLattice ? p_Jitter : 0.f, p_Spacing, p_Seed, p_Partitions);
+    }
+
+  private:
+    static u32v<D> getGridDimensions(const f32v<D> &p_Min, const f32v<D> &p_Max, f32 p_CellSize);
+    static u32v<D> getGridCoordinates(u32 p_Index, const u32v<D> &p_Dimensions);
+    static u32 getProduct(const u32v<D> &p_Dimensions);
+
+    static void resize(SimulationState<D> &p_State, u32 p_Size);
+
+    template <typename SDF>
+    static void fillLattice(SimulationState<D> &p_State, SDF &&p_Distance, const f32v<D> &p_Min, const f32v<D> &p_Max,
+                            const f32 p_Jitter, const f32 p_Spacing, const u32 p_Seed, const u32 p_Partitions)
+    {
+        const u32v<D> dims = getGridDimensions(p_Min, p_Max, p_Spacing);
+        const u32 candidates = getProduct(dims);
+
+        const auto candidate = [&](const u32 p_Index) {
+            const u32v<D> coords = getGridCoordinates(p_Index, dims);
+            f32v<D> pos = p_Min + p_Spacing * f32v<D>{coords};
+            if (p_Jitter > 0.f)
+                for (u32 i = 0; i < D; ++i)
+                    pos[i] += p_Jitter * p_Spacing * (Random(p_Seed, p_Index, i) - 0.5f);
+            return pos;
+        };
+
+        TKit::Array<u32, DRIZ_MAX_THREADS + 1> offsets{};
+        Core::ForEachChunk(0, candidates, p_Partitions, [&](const u32 p_Chunk, const u32 p_Start, const u32 p_End) {
+            TKIT_PROFILE_NSCOPE("Driz::Scene::CountLattice");
+            u32 count = 0;
+            for (u32 i = p_Start; i < p_End; ++i)
+                count += p_Distance(candidate(i)) <= 0.f;
+            offsets[p_Chunk + 1] = count;
+        });
+        for (u32 i = 1; i <= p_Partitions; ++i)
+            offsets[i] += offsets[i - 1];
+
+        resize(p_State, offsets[p_Partitions]);
+        Core::ForEachChunk(0, candidates, p_Partitions, [&](const u32 p_Chunk, const u32 p_Start, const u32 p_End) {
+            TKIT_PROFILE_NSCOPE("Driz::Scene::WriteLattice");
+            u32 index = offsets[p_Chunk];
+            for (u32 i = p_Start; i < p_End; ++i)
+            {
+                const f32v<D> pos = candidate(i);
+                if (p_Distance(pos) > 0.f)
+                    continue;
+                p_State.Positions[index] = pos;
+                p_State.Velocities[index++] = f32v<D>{0.f};
+            }
+        });
+    }
+
+    // Poisson disk sampling on a background grid with cells of size r / sqrt(D), so that every cell holds at most one
+    // sample. Cells are processed in 3^D interleaved phases: two cells of the same phase are at least two cells apart
+    // along some axis, which is farther than r, so they can be sampled concurrently without any synchronization
+    template <typename SDF>
+    static void fillPoissonDisk(SimulationState<D> &p_State, SDF &&p_Distance, const f32v<D> &p_Min,
+                                const f32v<D> &p_Max, const f32 p_Spacing, const u32 p_Seed, const u32 p_Partitions)
+    {
+        constexpr u32 attempts = 16;
+        constexpr u32 rounds = 2;
+        constexpr u32 phases = D == D2 ? 9 : 27;
+
+        const f32 csize = p_Spacing / Math::SquareRoot(static_cast<f32>(D));
+        const f32 r2 = p_Spacing * p_Spacing;
+        const u32v<D> dims = getGridDimensions(p_Min, p_Max, csize);
+        const u32 ccount = getProduct(dims);
+
+        SimArray<f32v<D>> samples;
+        SimArray<u8> occupied;
+        samples.Resize(ccount);
+        occupied.Resize(ccount, u8{0});
+
+        const auto toIndex = [&dims](const i32v<D> &p_Coords) {
+            u32 index = 0;
+            for (u32 i = D - 1; i < D; --i)
+                index = index * dims[i] + static_cast<u32>(p_Coords[i]);
+            return index;
+        };
+
+        const auto isFarEnough = [&](const i32v<D> &p_Coords, const f32v<D> &p_Position) {
+            i32v<D> lo;
+            i32v<D> hi;
+            for (u32 i = 0; i < D; ++i)
+            {
+                lo[i] = Math::Max(p_Coords[i] - 2, 0);
+                hi[i] = Math::Min(p_Coords[i] + 2, static_cast<i32>(dims[i]) - 1);
+            }
+            i32v<D> c = lo;
+            for (;;)
+            {
+                const u32 index = toIndex(c);
+                if (occupied[index] && Math::DistanceSquared(samples[index], p_Position) < r2)
+                    return false;
+
+                u32 axis = 0;
+                while (axis < D && ++c[axis] > hi[axis])
+                {
+                    c[axis] = lo[axis];
+                    ++axis;
+                }
+                if (axis == D)
+                    return true;
+            }
+        };
+
+        for (u32 round = 0; round < rounds; ++round)
+            for (u32 phase = 0; phase < phases; ++phase)
+            {
+                u32v<D> pdims;
+                i32v<D> poffset;
+                u32 pphase = phase;
+                for (u32 i = 0; i < D; ++i)
+                {
+                    poffset[i] = static_cast<i32>(pphase % 3);
+                    pphase /= 3;
+                    const u32 offset = static_cast<u32>(poffset[i]);
+                    pdims[i] = dims[i] > offset ? (dims[i] - offset + 2) / 3 : 0;
+                }
+
+                Core::ForEach(0, getProduct(pdims), p_Partitions, [&](const u32 p_Start, const u32 p_End) {
+                    TKIT_PROFILE_NSCOPE("Driz::Scene::PoissonPhase");
+                    for (u32 i = p_Start; i < p_End; ++i)
+                    {
+                        const i32v<D> coords = poffset + 3 * i32v<D>{getGridCoordinates(i, pdims)};
+                        const u32 index = toIndex(coords);
+                        if (occupied[index])
+                            continue;
+
+                        for (u32 j = 0; j < attempts; ++j)
+                        {
+                            f32v<D> pos;
+                            for (u32 k = 0; k < D; ++k)
+                                pos[k] = p_Min[k] +
+                                         csize * (static_cast<f32>(coords[k]) +
+                                                  Random(p_Seed, index, (round * attempts + j) * D + k));
+
+                            if (p_Distance(pos) <= 0.f && isFarEnough(coords, pos))
+                            {
+                                samples[index] = pos;
+                                occupied[index] = 1;
+                                break;
+                            }
+                        }
+                    }
+                });
+            }
+
+        TKit::Array<u32, DRIZ_MAX_THREADS + 1> offsets{};
+        Core::ForEachChunk(0, ccount, p_Partitions, [&](const u32 p_Chunk, const u32 p_Start, const u32 p_End) {
+            u32 count = 0;
+            for (u32 i = p_Start; i < p_End; ++i)
+                count += occupied[i];
+            offsets[p_Chunk + 1] = count;
+        });
+        for (u32 i = 1; i <= p_Partitions; ++i)
+            offsets[i] += offsets[i - 1];
+
+        resize(p_State, offsets[p_Partitions]);
+        Core::ForEachChunk(0, ccount, p_Partitions, [&](const u32 p_Chunk, const u32 p_Start, const u32 p_End) {
+            u32 index = offsets[p_Chunk];
+            for (u32 i = p_Start; i < p_End; ++i)
+                if (occupied[i])
+                {
+                    p_State.Positions[index] = samples[i];
+                    p_State.Velocities[index++] = f32v<D>{0.f};
+                }
+        });
+    }
+};
+} // namespace Driz
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "driz/simulation/kernel.hpp"
+#include "driz/simulation/material.hpp"
+#include "driz/simulation/flow.hpp"
 #include "driz/core/math.hpp"
 #include "driz/core/core.hpp"
 #include "onyx/property/color.hpp"
@@ -9,6 +11,25 @@
 
 namespace Driz
 {
+TKIT_REFLECT_DECLARE_ENUM(LookupMode)
+TKIT_YAML_SERIALIZE_DECLARE_ENUM(LookupMode)
+enum class LookupMode
+{
+    Grid = 0,
+    BruteForce,
+    Tree
+};
+
+TKIT_REFLECT_DECLARE_ENUM(PairSchedule)
+TKIT_YAML_SERIALIZE_DECLARE_ENUM(PairSchedule)
+// How the grid pair traversal splits its cells among partitions. Cells hands every partition as many cells, while
+// Particles hands it as many particles, which evens out the work of scenes where dense and sparse regions coexist
+enum class PairSchedule
+{
+    Cells = 0,
+    Particles
+};
+
 struct SimulationSettings
 {
     TKIT_REFLECT_DECLARE(SimulationSettings)
@@ -44,9 +65,45 @@ struct SimulationSettings
 
     KernelType KType = KernelType::Spiky3;
     KernelType NearKType = KernelType::Spiky5;
+
+    LookupMode Lookup = LookupMode::Grid;
+    // Grid cells are this many times smaller than the smoothing radius. Finer cells search a tighter volume around
+    // each particle at the cost of visiting more cells
+    u32 CellRatio = 1;
+    PairSchedule Schedule = PairSchedule::Cells;
+
+    // Bit i makes axis i wrap around the simulation box instead of walling it off. Periodic axes should be at least
+    // two smoothing radii long
+    u32 PeriodicAxes = 0;
     TKIT_REFLECT_GROUP_END()
 
     TKit::Array<Onyx::Color, 3> Gradient = {Onyx::Color::CYAN, Onyx::Color::YELLOW, Onyx::Color::RED};
+
+    // Grid cells outside of the camera view are skipped when drawing
+    bool CullOutsideView = true;
+
+    // 3D rendering only. Interior particles have at least this fraction of the mean neighbor count, and particles
+    // further away from the viewer than the LOD distance are drawn at the lowest resolution (0 disables it)
+    bool CullInterior = false;
+    f32 InteriorNeighborRatio = 0.9f;
+    f32 LodDistance = 0.f;
+
+    // Rendering only. The fluid may be drawn as the isosurface of its density field instead of as particles. Every
+    // lookup cell is sampled with this many voxels per axis, and the surface sits at the given fraction of the target
+    // density
+    bool DrawSurface = false;
+    u32 SurfaceSubdivisions = 4;
+    f32 SurfaceIsoLevel = 0.5f;
+
+    // Calm interior particles merge in pairs into heavier ones, and heavy particles near the surface or in sheared flow
+    // split back in two. Masses are always the base mass times a power of two, up to the given ratio. Particles are
+    // sheared when the mean speed relative to their neighbors exceeds the threshold, and are near the surface when they
+    // have less than the given fraction of the mean neighbor count
+    bool AdaptiveResolution = false;
+    u32 AdaptiveInterval = 10; // Steps between adaptations
+    u32 AdaptiveMaxMassRatio = 8;
+    f32 AdaptiveShear = 1.f;
+    f32 AdaptiveSurfaceRatio = 0.75f;
 };
 
 template <Dimension D> struct SimulationState
@@ -56,6 +113,16 @@ template <Dimension D> struct SimulationState
 
     SimArray<f32v<D>> Positions;
     SimArray<f32v<D>> Velocities;
+    // Adaptive resolution and materials. Arrays not holding one entry per particle are ignored, in which case every
+    // particle is a base particle of the first material. Masses are multiples of the base mass of their material
+    SimArray<f32> MassRatios;
+    SimArray<u32> MaterialIndices;
+
+    // Materials past the first one, which is always described by the settings, and the inflows and outflows that go
+    // with the scene
+    SimArray<Material> Materials;
+    SimArray<Emitter<D>> Emitters;
+    SimArray<Sink<D>> Sinks;
 
     f32v<D> Min{-30.f + 25.f * (D - 2)};
     f32v<D> Max{30.f - 25.f * (D - 2)};
@@ -70,10 +137,20 @@ template <Dimension D> struct ISimulationData
     SimArray<f32v<D>> StagedPositions;
 
     SimArray<Density> Densities; // Density and Near Density
+    SimArray<f32v2> Pressures;   // Pressure and Near Pressure, from the density and the particle material
 
     SimArray<f32> RestDistances;
     SimArray<f32> NeighborDistances;
     SimArray<u32> NeighborCounts;
+
+    // Particles may have different masses under adaptive resolution. Their smoothing radius scales with the length
+    // their mass spans, and shear is the summed speed relative to their neighbors, only computed when adapting
+    SimArray<f32> Masses;
+    SimArray<f32> SmoothingRadii;
+    SimArray<f32> Shear;
+
+    // Indices into the material table of the solver
+    SimArray<u8> MaterialIndices;
 };
 template <Dimension D> struct SimulationData;
 
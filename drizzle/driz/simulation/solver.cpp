@@ -1,108 +1,268 @@
 #include "driz/simulation/solver.hpp"
+#include "driz/simulation/scene.hpp"
 #include "driz/app/visualization.hpp"
 #include "tkit/profiling/macros.hpp"
+#include <cmath>
+#include <type_traits>
 
 namespace Driz
 {
-template <Dimension D> static f32 computeKernel(const KernelType p_Kernel, const f32 p_Radius, const f32 p_Distance)
+template <Dimension D> f32 Solver<D>::getInfluence(const f32 p_Distance, const f32 p_Radius) const
 {
-    switch (p_Kernel)
-    {
-    case KernelType::Spiky2:
-        return Kernel<D>::Spiky2(p_Radius, p_Distance);
-    case KernelType::Spiky3:
-        return Kernel<D>::Spiky3(p_Radius, p_Distance);
-    case KernelType::Spiky5:
-        return Kernel<D>::Spiky5(p_Radius, p_Distance);
-    case KernelType::Poly6:
-        return Kernel<D>::Poly6(p_Radius, p_Distance);
-    case KernelType::CubicSpline:
-        return Kernel<D>::CubicSpline(p_Radius, p_Distance);
-    case KernelType::WendlandC2:
-        return Kernel<D>::WendlandC2(p_Radius, p_Distance);
-    case KernelType::WendlandC4:
-        return Kernel<D>::WendlandC4(p_Radius, p_Distance);
-    }
-    return 0.f;
+    return Kernel<D>::Evaluate(Settings.KType, p_Radius, p_Distance);
 }
-template <Dimension D>
-static f32 computeKernelSlope(const KernelType p_Kernel, const f32 p_Radius, const f32 p_Distance)
+template <Dimension D> f32 Solver<D>::getInfluenceSlope(const f32 p_Distance, const f32 p_Radius) const
 {
-    switch (p_Kernel)
-    {
-    case KernelType::Spiky2:
-        return Kernel<D>::Spiky2Slope(p_Radius, p_Distance);
-    case KernelType::Spiky3:
-        return Kernel<D>::Spiky3Slope(p_Radius, p_Distance);
-    case KernelType::Spiky5:
-        return Kernel<D>::Spiky5Slope(p_Radius, p_Distance);
-    case KernelType::Poly6:
-        return Kernel<D>::Poly6Slope(p_Radius, p_Distance);
-    case KernelType::CubicSpline:
-        return Kernel<D>::CubicSplineSlope(p_Radius, p_Distance);
-    case KernelType::WendlandC2:
-        return Kernel<D>::WendlandC2Slope(p_Radius, p_Distance);
-    case KernelType::WendlandC4:
-        return Kernel<D>::WendlandC4Slope(p_Radius, p_Distance);
-    }
-    return 0.f;
+    return Kernel<D>::EvaluateSlope(Settings.KType, p_Radius, p_Distance);
 }
 
-template <Dimension D> f32 Solver<D>::getInfluence(const f32 p_Distance) const
+template <Dimension D> f32 Solver<D>::getNearInfluence(const f32 p_Distance, const f32 p_Radius) const
 {
-    return computeKernel<D>(Settings.KType, Settings.SmoothingRadius, p_Distance);
+    return Kernel<D>::Evaluate(Settings.NearKType, p_Radius, p_Distance);
 }
-template <Dimension D> f32 Solver<D>::getInfluenceSlope(const f32 p_Distance) const
+template <Dimension D> f32 Solver<D>::getNearInfluenceSlope(const f32 p_Distance, const f32 p_Radius) const
 {
-    return computeKernelSlope<D>(Settings.KType, Settings.SmoothingRadius, p_Distance);
+    return Kernel<D>::EvaluateSlope(Settings.NearKType, p_Radius, p_Distance);
 }
 
-template <Dimension D> f32 Solver<D>::getNearInfluence(const f32 p_Distance) const
+template <Dimension D> f32 Solver<D>::getViscosityInfluence(const f32 p_Distance, const f32 p_Radius) const
 {
-    return computeKernel<D>(Settings.NearKType, Settings.SmoothingRadius, p_Distance);
+    return Kernel<D>::Evaluate(Settings.ViscosityKType, p_Radius, p_Distance);
 }
-template <Dimension D> f32 Solver<D>::getNearInfluenceSlope(const f32 p_Distance) const
+
+// A particle keeps the amount of neighbors of a base particle by spanning the same volume per unit mass
+template <Dimension D> f32 Solver<D>::getSmoothingRadius(const f32 p_Mass, const u8 p_Material) const
 {
-    return computeKernelSlope<D>(Settings.NearKType, Settings.SmoothingRadius, p_Distance);
+    const f32 ratio = p_Mass / m_MaterialTable.Masses[p_Material];
+    return Settings.SmoothingRadius * std::pow(ratio, 1.f / static_cast<f32>(D));
 }
-
-template <Dimension D> f32 Solver<D>::getViscosityInfluence(const f32 p_Distance) const
+template <Dimension D> f32 Solver<D>::getLookupRadius() const
 {
-    return computeKernel<D>(Settings.ViscosityKType, Settings.SmoothingRadius, p_Distance);
+    return Settings.SmoothingRadius * std::pow(m_MaxMassRatio, 1.f / static_cast<f32>(D));
 }
 
 template <Dimension D>
 Solver<D>::Solver(const SimulationSettings &p_Settings, const SimulationState<D> &p_State) : Settings(p_Settings)
 {
+    Settings.Partitions = Math::Clamp(Settings.Partitions, 1u, static_cast<u32>(DRIZ_MAX_THREADS));
+    m_BaseRadius = Settings.SmoothingRadius;
+    SetState(p_State);
+}
+
+template <Dimension D> void Solver<D>::SetState(const SimulationState<D> &p_State)
+{
+    Materials = p_State.Materials;
+    Emitters = p_State.Emitters;
+    Sinks = p_State.Sinks;
+    syncResolution();
+
     Data.State = p_State;
-    resizeState(p_State.Positions.GetSize());
+    Data.State.MassRatios.Clear();
+    Data.State.MaterialIndices.Clear();
+    Data.State.Materials.Clear();
+    Data.State.Emitters.Clear();
+    Data.State.Sinks.Clear();
+    const u32 pcount = GetParticleCount();
+    Data.State.Velocities.Resize(pcount, f32v<D>{0.f});
+    resizeState(pcount);
+
+    const bool ratios = p_State.MassRatios.GetSize() == pcount;
+    const bool materials = p_State.MaterialIndices.GetSize() == pcount;
+    Core::ForEach(0, pcount, Settings.Partitions, [&](const u32 p_Start, const u32 p_End) {
+        for (u32 i = p_Start; i < p_End; ++i)
+        {
+            const u8 material =
+                materials ? static_cast<u8>(Math::Min(p_State.MaterialIndices[i], m_MaterialTable.Count - 1)) : u8{0};
+            const f32 ratio = ratios && p_State.MassRatios[i] > 0.f ? p_State.MassRatios[i] : 1.f;
+            Data.MaterialIndices[i] = material;
+            Data.Masses[i] = ratio * m_MaterialTable.Masses[material];
+            Data.SmoothingRadii[i] = getSmoothingRadius(Data.Masses[i], material);
+            Data.RestDistances[i] = Settings.SmoothingRadius;
+        }
+    });
+    updateResolutionBounds();
+}
+
+template <Dimension D> SimulationState<D> Solver<D>::GetState() const
+{
+    SimulationState<D> state = Data.State;
+    state.Materials = Materials;
+    state.Emitters = Emitters;
+    state.Sinks = Sinks;
+
+    const u32 pcount = GetParticleCount();
+    bool base = true;
+    for (u32 i = 0; i < pcount && base; ++i)
+        base = Data.MaterialIndices[i] == 0 && Data.Masses[i] == m_MaterialTable.Masses[0];
+    if (base)
+        return state;
+
+    state.MassRatios.Resize(pcount);
+    state.MaterialIndices.Resize(pcount);
+    Core::ForEach(0, pcount, Settings.Partitions, [this, &state](const u32 p_Start, const u32 p_End) {
+        for (u32 i = p_Start; i < p_End; ++i)
+        {
+            const u8 material = Data.MaterialIndices[i];
+            state.MassRatios[i] = Data.Masses[i] / m_MaterialTable.Masses[material];
+            state.MaterialIndices[i] = material;
+        }
+    });
+    return state;
+}
+// Per particle arrays grow geometrically, and per-thread scratch arrays are always sized to the capacity. That way,
+// adding or removing particles only touches the scratch arrays when the capacity is exceeded
+template <Dimension D> void Solver<D>::reserveState(const u32 p_Size)
+{
+    if (p_Size <= m_Capacity)
+        return;
+    m_Capacity = Math::Max(p_Size, m_Capacity + m_Capacity / 2);
+
+    Data.State.Positions.Reserve(m_Capacity);
+    Data.State.Velocities.Reserve(m_Capacity);
+    Data.Accelerations.Reserve(m_Capacity);
+    Data.StagedPositions.Reserve(m_Capacity);
+
+    Data.Densities.Reserve(m_Capacity);
+    Data.Pressures.Reserve(m_Capacity);
+
+    Data.RestDistances.Reserve(m_Capacity);
+    Data.NeighborDistances.Reserve(m_Capacity);
+    Data.NeighborCounts.Reserve(m_Capacity);
+
+    Data.Masses.Reserve(m_Capacity);
+    Data.SmoothingRadii.Reserve(m_Capacity);
+    Data.Shear.Reserve(m_Capacity);
+    Data.MaterialIndices.Reserve(m_Capacity);
+
+    reserveScratch(m_ScratchSlots);
+
+    if constexpr (D == D3)
+        Data.UnderMouseInfluence.Reserve(m_Capacity);
+
+    const auto advise = [this](auto &p_Array) {
+        using T = std::remove_reference_t<decltype(p_Array[0])>;
+        Memory::AdviseHugePages(p_Array.GetData(), m_Capacity * sizeof(T));
+    };
+    advise(Data.State.Positions);
+    advise(Data.State.Velocities);
+    advise(Data.Accelerations);
+    advise(Data.StagedPositions);
+    advise(Data.Densities);
+    for (u32 i = 0; i < m_ScratchSlots; ++i)
+    {
+        advise(m_Accelerations[i]);
+        advise(m_Densities[i]);
+    }
 }
+// Slots only ever grow, and are always sized to the capacity. Those past the current partition count stay zeroed
+template <Dimension D> void Solver<D>::reserveScratch(const u32 p_Slots)
+{
+    for (u32 i = 0; i < p_Slots; ++i)
+    {
+        m_Densities[i].Resize(m_Capacity, f32v2{0.f});
+        m_Accelerations[i].Resize(m_Capacity, f32v<D>{0.f});
+        m_NeighborDistances[i].Resize(m_Capacity, 0.f);
+        m_NeighborCounts[i].Resize(m_Capacity, 0);
+        m_Shear[i].Resize(m_Capacity, 0.f);
+    }
+    m_ScratchSlots = Math::Max(m_ScratchSlots, p_Slots);
+}
+
+// Pair passes accumulate into one scratch array per partition, merged once the pass is done. A single partition
+// accumulates straight into the particle data instead, and leaves nothing to merge
+template <Dimension D>
+template <typename T>
+TKit::Array<T *, DRIZ_MAX_THREADS> Solver<D>::getScratch(TKit::Array<SimArray<T>, DRIZ_MAX_THREADS> &p_Scratch,
+                                                         SimArray<T> &p_Data)
+{
+    TKit::Array<T *, DRIZ_MAX_THREADS> scratch;
+    if (Settings.Partitions == 1)
+    {
+        scratch[0] = p_Data.GetData();
+        return scratch;
+    }
+    reserveScratch(Settings.Partitions);
+    for (u32 i = 0; i < Settings.Partitions; ++i)
+        scratch[i] = p_Scratch[i].GetData();
+    return scratch;
+}
+
 template <Dimension D> void Solver<D>::resizeState(const u32 p_Size)
 {
+    reserveState(p_Size);
     Data.Accelerations.Resize(p_Size, f32v<D>{0.f});
     Data.StagedPositions.Resize(p_Size);
 
     Data.Densities.Resize(p_Size, f32v2{Settings.ParticleMass});
+    Data.Pressures.Resize(p_Size, f32v2{0.f});
 
     Data.RestDistances.Resize(p_Size, Settings.SmoothingRadius);
     Data.NeighborDistances.Resize(p_Size, 0.f);
     Data.NeighborCounts.Resize(p_Size, 0);
 
-    for (auto &densities : m_Densities)
-        densities.Resize(p_Size, f32v2{0.f});
-    for (auto &accelerations : m_Accelerations)
-        accelerations.Resize(p_Size, f32v<D>{0.f});
-    for (auto &ndistances : m_NeighborDistances)
-        ndistances.Resize(p_Size, 0.f);
-    for (auto &ncounts : m_NeighborCounts)
-        ncounts.Resize(p_Size, 0);
+    Data.Masses.Resize(p_Size, Settings.ParticleMass);
+    Data.SmoothingRadii.Resize(p_Size, Settings.SmoothingRadius);
+    Data.Shear.Resize(p_Size, 0.f);
+    Data.MaterialIndices.Resize(p_Size, u8{0});
 
     if constexpr (D == D3)
         Data.UnderMouseInfluence.Resize(p_Size, u8{0});
 }
 
+template <Dimension D> void Solver<D>::Step(const f32 p_DeltaTime, const f32v<D> *p_MousePos)
+{
+    StepInput<D> input{};
+    input.DeltaTime = p_DeltaTime;
+    if (p_MousePos)
+    {
+        input.MousePosition = *p_MousePos;
+        input.Mouse = MouseAction::Push;
+    }
+    Step(input);
+}
+
+template <Dimension D> void Solver<D>::Step(const StepInput<D> &p_Input)
+{
+    // Scratch arrays are indexed by partition, so settings edited after construction are clamped here again
+    Settings.Partitions = Math::Clamp(Settings.Partitions, 1u, static_cast<u32>(DRIZ_MAX_THREADS));
+    syncResolution();
+    // The interval only advances while adapting, so pausing it (the autotuner does during its trials) keeps the phase
+    if (Settings.AdaptiveResolution)
+        adaptResolution();
+    if (!p_Input.SkipFlows)
+        ApplyFlows(p_Input.DeltaTime);
+    BeginStep(p_Input.DeltaTime);
+    UpdateLookup();
+    ComputeDensitiesAndDistances(p_Input.DeltaTime);
+    AddPressureAndViscosity();
+    if (p_Input.Mouse == MouseAction::Push)
+        AddMouseForce(p_Input.MousePosition);
+    else if (p_Input.Mouse == MouseAction::Highlight)
+        highlight(p_Input.MousePosition);
+    if (!p_Input.Dummy)
+        ApplyComputedForces(p_Input.DeltaTime);
+    EndStep();
+}
+
+template <Dimension D> void Solver<D>::highlight(const f32v<D> &p_MousePos)
+{
+    if constexpr (D == D3)
+    {
+        const f32 radius2 = Settings.MouseRadius * Settings.MouseRadius;
+        Core::ForEach(0, GetParticleCount(), Settings.Partitions,
+                      [this, &p_MousePos, radius2](const u32 p_Start, const u32 p_End) {
+                          for (u32 i = p_Start; i < p_End; ++i)
+                              if (Math::DistanceSquared(Data.State.Positions[i], p_MousePos) < radius2)
+                                  Data.UnderMouseInfluence[i] = 2;
+                      });
+    }
+}
+
 template <Dimension D> void Solver<D>::BeginStep(const f32 p_DeltaTime)
 {
+    Telemetry.BeginStep();
+    StepTelemetry::Scope scope{Telemetry, StepPhase::Predict};
+
     Data.StagedPositions.Resize(GetParticleCount());
     std::swap(Data.State.Positions, Data.StagedPositions);
 
@@ -111,8 +271,11 @@ template <Dimension D> void Solver<D>::BeginStep(const f32 p_DeltaTime)
         for (u32 i = p_Start; i < p_End; ++i)
         {
             Data.State.Positions[i] = Data.StagedPositions[i] + Data.State.Velocities[i] * p_DeltaTime;
-            Data.Densities[i] = f32v2{Settings.ParticleMass};
+            Data.Densities[i] = f32v2{Data.Masses[i]};
+            Data.NeighborDistances[i] = 0.f;
+            Data.NeighborCounts[i] = 0;
             Data.Accelerations[i] = f32v<D>{0.f};
+            Data.Shear[i] = 0.f;
             if constexpr (D == D3)
                 Data.UnderMouseInfluence[i] = 0;
         }
@@ -122,16 +285,30 @@ template <Dimension D> void Solver<D>::BeginStep(const f32 p_DeltaTime)
 template <Dimension D> void Solver<D>::EndStep()
 {
     std::swap(Data.State.Positions, Data.StagedPositions);
+
+    Telemetry.EndStep(GetParticleCount(), Lookup.Statistics);
 }
 template <Dimension D> void Solver<D>::ApplyComputedForces(const f32 p_DeltaTime)
 {
-    const auto fn = [this, p_DeltaTime](const u32 p_Start, const u32 p_End) {
+    StepTelemetry::Scope scope{Telemetry, StepPhase::Integrate};
+    const bool obstacles = !Obstacles.IsEmpty();
+    if (obstacles)
+    {
+        Obstacles.SetPeriodicity(Settings.PeriodicAxes, Data.State.Min, Data.State.Max);
+        Obstacles.Update(p_DeltaTime, Settings.SmoothingRadius, Settings.ParticleRadius);
+    }
+
+    const auto fn = [this, p_DeltaTime, obstacles](const u32 p_Start, const u32 p_End) {
         TKIT_PROFILE_NSCOPE("Driz::Solver::ApplyComputedForces");
+        const f32 restitution = 1.f - Settings.EncaseFriction;
         for (u32 i = p_Start; i < p_End; ++i)
         {
             Data.State.Velocities[i][1] += Settings.Gravity * p_DeltaTime / Settings.ParticleMass;
             Data.State.Velocities[i] += Data.Accelerations[i] * p_DeltaTime;
             Data.StagedPositions[i] += Data.State.Velocities[i] * p_DeltaTime;
+            if (obstacles)
+                Obstacles.Resolve(Data.StagedPositions[i], Data.State.Velocities[i], Settings.ParticleRadius,
+                                  restitution);
             encase(i);
         }
     };
@@ -139,6 +316,7 @@ template <Dimension D> void Solver<D>::ApplyComputedForces(const f32 p_DeltaTime
 }
 template <Dimension D> void Solver<D>::AddMouseForce(const f32v<D> &p_MousePos)
 {
+    StepTelemetry::Scope scope{Telemetry, StepPhase::Forces};
     for (u32 i = 0; i < GetParticleCount(); ++i)
     {
         const f32v<D> diff = Data.State.Positions[i] - p_MousePos;
@@ -156,9 +334,12 @@ template <Dimension D> void Solver<D>::AddMouseForce(const f32v<D> &p_MousePos)
 
 template <Dimension D> void Solver<D>::mergeDensityAndDistanceArrays()
 {
+    if (Settings.Partitions == 1)
+        return;
+    StepTelemetry::Scope scope{Telemetry, StepPhase::Merge};
     Core::ForEach(0, GetParticleCount(), Settings.Partitions, [this](const u32 p_Start, const u32 p_End) {
         TKIT_PROFILE_NSCOPE("Driz::Solver::mergeDensityAndDistanceArrays");
-        for (u32 i = 0; i < DRIZ_MAX_THREADS; ++i)
+        for (u32 i = 0; i < Settings.Partitions; ++i)
             for (u32 j = p_Start; j < p_End; ++j)
             {
                 Data.Densities[j] += m_Densities[i][j];
@@ -171,16 +352,63 @@ template <Dimension D> void Solver<D>::mergeDensityAndDistanceArrays()
             }
     });
 }
+template <Dimension D> void Solver<D>::computeNeighborStatistics()
+{
+    struct Extremes
+    {
+        u64 Sum = 0;
+        u32 Min = UINT32_MAX;
+        u32 Max = 0;
+    };
+    TKit::Array<Extremes, DRIZ_MAX_THREADS> extremes{};
+    Core::ForEachChunk(0, GetParticleCount(), Settings.Partitions,
+                       [this, &extremes](const u32 p_Chunk, const u32 p_Start, const u32 p_End) {
+                           Extremes &ext = extremes[p_Chunk];
+                           for (u32 i = p_Start; i < p_End; ++i)
+                           {
+                               const u32 count = Data.NeighborCounts[i];
+                               ext.Sum += count;
+                               ext.Min = Math::Min(ext.Min, count);
+                               ext.Max = Math::Max(ext.Max, count);
+                           }
+                       });
+
+    Extremes total{};
+    for (u32 i = 0; i < Settings.Partitions; ++i)
+    {
+        total.Sum += extremes[i].Sum;
+        total.Min = Math::Min(total.Min, extremes[i].Min);
+        total.Max = Math::Max(total.Max, extremes[i].Max);
+    }
+
+    const u32 particles = GetParticleCount();
+    LookupStatistics &stats = Lookup.Statistics;
+    stats.MinNeighbors = particles > 0 ? total.Min : 0;
+    stats.MaxNeighbors = total.Max;
+    stats.MeanNeighbors = particles > 0 ? static_cast<f32>(total.Sum) / static_cast<f32>(particles) : 0.f;
+}
+
 template <Dimension D> void Solver<D>::mergeAccelerationArrays()
 {
+    if (Settings.Partitions == 1)
+        return;
+    StepTelemetry::Scope scope{Telemetry, StepPhase::Merge};
     Core::ForEach(0, GetParticleCount(), Settings.Partitions, [this](const u32 p_Start, const u32 p_End) {
         TKIT_PROFILE_NSCOPE("Driz::Solver::MergeAccelerationArrays");
-        for (u32 i = 0; i < DRIZ_MAX_THREADS; ++i)
+        for (u32 i = 0; i < Settings.Partitions; ++i)
             for (u32 j = p_Start; j < p_End; ++j)
             {
                 Data.Accelerations[j] += m_Accelerations[i][j];
                 m_Accelerations[i][j] = f32v<D>{0.f};
             }
+        if (!Settings.AdaptiveResolution)
+            return;
+        for (u32 i = 0; i < Settings.Partitions; ++i)
+            for (u32 j = p_Start; j < p_End; ++j)
+            {
+                Data.Shear[j] += m_Shear[i][j];
+                m_Shear[i][j] = 0.f;
+            }
     });
 }
 
@@ -188,25 +416,57 @@ template <Dimension D> void Solver<D>::ComputeDensitiesAndDistances(const f32 p_
 {
     TKIT_PROFILE_NSCOPE("Driz::Solver::ComputeDensitiesAndDistances");
 
-    const auto fn1 = [this](const u32 p_Index1, const u32 p_Index2, const f32 p_Distance, const u32 p_ThreadIndex) {
-        const f32v2 densities = Settings.ParticleMass * f32v2{getInfluence(p_Distance), getNearInfluence(p_Distance)};
+    // The lookup radius is the largest smoothing radius, so pairs of lighter particles may still be out of reach
+    const bool uniform = m_UniformMass;
+    const auto densities = getScratch(m_Densities, Data.Densities);
+    const auto distances = getScratch(m_NeighborDistances, Data.NeighborDistances);
+    const auto counts = getScratch(m_NeighborCounts, Data.NeighborCounts);
+    const auto fn1 = [this, uniform, &densities, &distances, &counts](const u32 p_Index1, const u32 p_Index2,
+                                                                     const f32 p_Distance, const u32 p_Partition) {
+        f32 radius = Settings.SmoothingRadius;
+        f32v2 densities1;
+        f32v2 densities2;
+        if (uniform)
+        {
+            densities1 = Settings.ParticleMass *
+                         f32v2{getInfluence(p_Distance, radius), getNearInfluence(p_Distance, radius)};
+            densities2 = densities1;
+        }
+        else
+        {
+            radius = 0.5f * (Data.SmoothingRadii[p_Index1] + Data.SmoothingRadii[p_Index2]);
+            if (p_Distance >= radius)
+                return;
+            const f32v2 kernels{getInfluence(p_Distance, radius), getNearInfluence(p_Distance, radius)};
+            densities1 = Data.Masses[p_Index2] * kernels;
+            densities2 = Data.Masses[p_Index1] * kernels;
+        }
 
-        m_Densities[p_ThreadIndex][p_Index1] += densities;
-        m_Densities[p_ThreadIndex][p_Index2] += densities;
+        densities[p_Partition][p_Index1] += densities1;
+        densities[p_Partition][p_Index2] += densities2;
 
-        m_NeighborDistances[p_ThreadIndex][p_Index1] += p_Distance;
-        m_NeighborDistances[p_ThreadIndex][p_Index2] += p_Distance;
+        distances[p_Partition][p_Index1] += p_Distance;
+        distances[p_Partition][p_Index2] += p_Distance;
 
-        ++m_NeighborCounts[p_ThreadIndex][p_Index1];
-        ++m_NeighborCounts[p_ThreadIndex][p_Index2];
+        ++counts[p_Partition][p_Index1];
+        ++counts[p_Partition][p_Index2];
     };
-    Lookup.ForEachPair(fn1, Settings.Partitions);
+    {
+        StepTelemetry::Scope scope{Telemetry, StepPhase::Density};
+        Lookup.ForEachPair(fn1, Settings.Partitions);
+    }
     mergeDensityAndDistanceArrays();
+    // Interior culling reads the mean neighbor count, so it needs the statistics even when they are not collected
+    if (Lookup.CollectStatistics || (D == D3 && Settings.CullInterior))
+        computeNeighborStatistics();
 
     const auto fn2 = [this, p_DeltaTime](const u32 p_Start, const u32 p_End) {
-        const f32 maxStep = Settings.SmoothingRadius * Settings.PlasticMaxStep;
+        const MaterialTable &materials = m_MaterialTable;
         for (u32 i = p_Start; i < p_End; ++i)
         {
+            const u8 material = Data.MaterialIndices[i];
+            Data.Pressures[i] = getPressureFromDensity(Data.Densities[i], material);
+
             const u32 count = Data.NeighborCounts[i];
             if (count == 0)
                 continue;
@@ -214,30 +474,55 @@ template <Dimension D> void Solver<D>::ComputeDensitiesAndDistances(const f32 p_
             const f32 dist = Data.NeighborDistances[i] / static_cast<f32>(count);
             const f32 rest = Data.RestDistances[i];
 
-            const f32 yield = Settings.PlasticYield * rest;
+            const f32 yield = materials.PlasticYields[material] * rest;
             const f32 diff = dist - rest;
             const f32 adiff = Math::Absolute(diff);
             if (adiff <= yield)
                 continue;
 
+            const f32 maxStep = Settings.SmoothingRadius * materials.PlasticMaxSteps[material];
             const f32 excess = (diff >= 0.f) ? (adiff - yield) : (yield - adiff);
-            const f32 drest = Math::Clamp(Settings.PlasticAlpha * excess * p_DeltaTime, -maxStep, maxStep);
+            const f32 drest = Math::Clamp(materials.PlasticAlphas[material] * excess * p_DeltaTime, -maxStep, maxStep);
 
             Data.RestDistances[i] = rest + drest;
         }
     };
+    StepTelemetry::Scope scope{Telemetry, StepPhase::Density};
     Core::ForEach(0, GetParticleCount(), Settings.Partitions, fn2);
 }
+// Whether masses are uniform, shear is summed and particles mix materials is fixed for the whole step, so each
+// combination gets its own pair loop instead of branching on every pair. Mixtures are further split by block pair, so
+// that pairs within a region of a single material take the same path as single material scenes
 template <Dimension D> void Solver<D>::AddPressureAndViscosity()
 {
     TKIT_PROFILE_NSCOPE("Driz::Solver::AddPressureAndViscosity");
-    const auto computeAccelerations = [this](const u32 p_Index1, const u32 p_Index2, const f32 p_Distance) {
+    using PairLoop = void (Solver::*)();
+    static constexpr TKit::Array<PairLoop, 8> loops{
+        &Solver::addPressureAndViscosity<false, false, false>, &Solver::addPressureAndViscosity<false, false, true>,
+        &Solver::addPressureAndViscosity<false, true, false>,  &Solver::addPressureAndViscosity<false, true, true>,
+        &Solver::addPressureAndViscosity<true, false, false>,  &Solver::addPressureAndViscosity<true, false, true>,
+        &Solver::addPressureAndViscosity<true, true, false>,   &Solver::addPressureAndViscosity<true, true, true>};
+
+    const u32 index = (static_cast<u32>(m_UniformMass) << 2) | (static_cast<u32>(Settings.AdaptiveResolution) << 1) |
+                      static_cast<u32>(m_MaterialTable.Count > 1);
+    {
+        StepTelemetry::Scope scope{Telemetry, StepPhase::Forces};
+        (this->*loops[index])();
+    }
+    mergeAccelerationArrays();
+}
+
+template <Dimension D> template <bool Uniform, bool Shear, bool Mixed> void Solver<D>::addPressureAndViscosity()
+{
+    const auto computeAccelerations = [this](const u32 p_Index1, const u32 p_Index2, const f32 p_Distance,
+                                             const f32 p_Radius, const u32 p_Pair) {
         // Gradient
-        const f32v<D> dir = (Data.State.Positions[p_Index1] - Data.State.Positions[p_Index2]) / p_Distance;
-        const f32v2 kernels{getInfluenceSlope(p_Distance), getNearInfluenceSlope(p_Distance)};
+        const f32v<D> dir =
+            Lookup.ComputeOffset(Data.State.Positions[p_Index1], Data.State.Positions[p_Index2]) / p_Distance;
+        const f32v2 kernels{getInfluenceSlope(p_Distance, p_Radius), getNearInfluenceSlope(p_Distance, p_Radius)};
 
-        const f32v2 pressures1 = getPressureFromDensity(Data.Densities[p_Index1]);
-        const f32v2 pressures2 = getPressureFromDensity(Data.Densities[p_Index2]);
+        const f32v2 pressures1 = Data.Pressures[p_Index1];
+        const f32v2 pressures2 = Data.Pressures[p_Index2];
 
         const f32v2 d1 = Data.Densities[p_Index1];
         const f32v2 d2 = Data.Densities[p_Index2];
@@ -249,15 +534,18 @@ template <Dimension D> void Solver<D>::AddPressureAndViscosity()
 
         // Viscosity
         const f32v<D> diff = Data.State.Velocities[p_Index2] - Data.State.Velocities[p_Index1];
-        const f32 kernel = getViscosityInfluence(p_Distance);
+        const f32 kernel = getViscosityInfluence(p_Distance, p_Radius);
 
         const f32 u = Math::Norm(diff);
 
-        const f32v<D> vterm = ((Settings.ViscLinearTerm + Settings.ViscQuadraticTerm * u) * kernel) * diff;
+        const f32 linear = m_MaterialTable.ViscLinearTerms[p_Pair];
+        const f32 quadratic = m_MaterialTable.ViscQuadraticTerms[p_Pair];
+        const f32v<D> vterm = ((linear + quadratic * u) * kernel) * diff;
 
         // Elasticity and plasticity
         const f32 rest = 0.5f * (Data.RestDistances[p_Index1] + Data.RestDistances[p_Index2]);
-        const f32 factor = Settings.ElasticityStrength * (1.f - rest / Settings.SmoothingRadius) * (rest - p_Distance);
+        const f32 strength = m_MaterialTable.ElasticityStrengths[p_Pair];
+        const f32 factor = strength * (1.f - rest / p_Radius) * (rest - p_Distance);
 
         const f32v<D> eterm = factor * dir;
         const f32v<D> acc = eterm + vterm - gradient;
@@ -265,43 +553,424 @@ template <Dimension D> void Solver<D>::AddPressureAndViscosity()
         return std::make_pair(acc / d1[0], acc / d2[0]);
     };
 
-    const auto fn = [this, &computeAccelerations](const u32 p_Index1, const u32 p_Index2, const f32 p_Distance,
-                                                  const u32 p_ThreadIndex) {
-        const auto [acc1, acc2] = computeAccelerations(p_Index1, p_Index2, p_Distance);
-        m_Accelerations[p_ThreadIndex][p_Index1] += acc1;
-        m_Accelerations[p_ThreadIndex][p_Index2] -= acc2;
-    };
+    // Accelerations are computed as if the neighbor had the base mass, and then scaled by its actual mass. A single
+    // material always uses the first entry of the pair table, and block pairs holding a single material know theirs
+    // up front, so only pairs across materials read material indices
+    const auto accelerations = getScratch(m_Accelerations, Data.Accelerations);
+    const auto shear = getScratch(m_Shear, Data.Shear);
+    const auto fn = [this, &computeAccelerations, &accelerations, &shear](const u32 p_Index1, const u32 p_Index2,
+                                                                          const f32 p_Distance, const u32 p_Partition,
+                                                                          const auto p_Tag) {
+        u32 pair = 0;
+        if constexpr (std::is_same_v<std::remove_const_t<decltype(p_Tag)>, SharedTag>)
+            pair = m_MaterialTable.GetPairIndex(static_cast<u8>(p_Tag.Tag), static_cast<u8>(p_Tag.Tag));
+        else if constexpr (Mixed)
+            pair = m_MaterialTable.GetPairIndex(Data.MaterialIndices[p_Index1], Data.MaterialIndices[p_Index2]);
 
-    Lookup.ForEachPair(fn, Settings.Partitions);
-    mergeAccelerationArrays();
+        if constexpr (Uniform)
+        {
+            const auto [acc1, acc2] =
+                computeAccelerations(p_Index1, p_Index2, p_Distance, Settings.SmoothingRadius, pair);
+            accelerations[p_Partition][p_Index1] += acc1;
+            accelerations[p_Partition][p_Index2] -= acc2;
+        }
+        else
+        {
+            const f32 radius = 0.5f * (Data.SmoothingRadii[p_Index1] + Data.SmoothingRadii[p_Index2]);
+            if (p_Distance >= radius)
+                return;
+            const auto [acc1, acc2] = computeAccelerations(p_Index1, p_Index2, p_Distance, radius, pair);
+            accelerations[p_Partition][p_Index1] += (Data.Masses[p_Index2] / Settings.ParticleMass) * acc1;
+            accelerations[p_Partition][p_Index2] -= (Data.Masses[p_Index1] / Settings.ParticleMass) * acc2;
+        }
+        if constexpr (Shear)
+        {
+            const f32 u = Math::Norm(Data.State.Velocities[p_Index2] - Data.State.Velocities[p_Index1]);
+            shear[p_Partition][p_Index1] += u;
+            shear[p_Partition][p_Index2] += u;
+        }
+    };
+    Lookup.ForEachTaggedPair(fn, Mixed ? Data.MaterialIndices.GetData() : nullptr, Settings.Partitions);
 }
 
-template <Dimension D> f32v2 Solver<D>::getPressureFromDensity(const Density &p_Density) const
+template <Dimension D> f32v2 Solver<D>::getPressureFromDensity(const Density &p_Density, const u8 p_Material) const
 {
-    const f32 p1 = Settings.PressureStiffness * (p_Density[0] - Settings.TargetDensity);
-    const f32 p2 = Settings.NearPressureStiffness * p_Density[1];
+    const MaterialTable &materials = m_MaterialTable;
+    const f32 p1 = materials.PressureStiffnesses[p_Material] * (p_Density[0] - materials.TargetDensities[p_Material]);
+    const f32 p2 = materials.NearPressureStiffnesses[p_Material] * p_Density[1];
     return f32v2{p1, p2};
 }
 
 template <Dimension D> void Solver<D>::UpdateLookup()
 {
+    TKit::Clock clock{};
     Lookup.SetPositions(&Data.State.Positions);
-    Lookup.UpdateGridLookup(Settings.SmoothingRadius);
+    Lookup.SetPeriodicity(Settings.PeriodicAxes, Data.State.Min, Data.State.Max);
+    Lookup.SetCellRatio(Settings.CellRatio);
+    Lookup.Schedule = Settings.Schedule;
+    Lookup.Update(Settings.Lookup, getLookupRadius(), Settings.Partitions);
+
+    const f32 sort = Lookup.GetLastSortTime();
+    Telemetry.AddPhaseTime(StepPhase::LookupBuild, static_cast<f32>(clock.GetElapsed().AsMilliseconds()) - sort);
+    Telemetry.AddPhaseTime(StepPhase::Sort, sort);
 }
 
 template <Dimension D> void Solver<D>::UpdateAllLookups()
 {
     Lookup.SetPositions(&Data.State.Positions);
-    Lookup.UpdateBruteForceLookup(Settings.SmoothingRadius);
-    Lookup.UpdateGridLookup(Settings.SmoothingRadius);
+    Lookup.SetPeriodicity(Settings.PeriodicAxes, Data.State.Min, Data.State.Max);
+    Lookup.SetCellRatio(Settings.CellRatio);
+    Lookup.Schedule = Settings.Schedule;
+    Lookup.UpdateGridLookup(getLookupRadius(), Settings.Partitions);
+    if (Settings.Lookup != LookupMode::Grid)
+        Lookup.Update(Settings.Lookup, getLookupRadius(), Settings.Partitions);
 }
 
 template <Dimension D> void Solver<D>::AddParticle(const f32v<D> &p_Position)
 {
-    Data.State.Positions.Append(p_Position);
-    Data.State.Velocities.Append(f32v<D>{0.f});
+    AddParticles(&p_Position, nullptr, 1);
+}
+
+template <Dimension D>
+void Solver<D>::AddParticles(const f32v<D> *p_Positions, const f32v<D> *p_Velocities, const u32 p_Count,
+                             const u8 *p_Materials)
+{
+    syncResolution();
+    const u32 start = GetParticleCount();
+    const u32 size = start + p_Count;
+    reserveState(size);
+
+    Data.State.Positions.Resize(size);
+    Data.State.Velocities.Resize(size);
+    for (u32 i = 0; i < p_Count; ++i)
+    {
+        Data.State.Positions[start + i] = p_Positions[i];
+        Data.State.Velocities[start + i] = p_Velocities ? p_Velocities[i] : f32v<D>{0.f};
+    }
+    resizeState(size);
+    if (!p_Materials)
+        return;
+
+    for (u32 i = 0; i < p_Count; ++i)
+    {
+        const u8 material = static_cast<u8>(Math::Min(static_cast<u32>(p_Materials[i]), m_MaterialTable.Count - 1));
+        Data.MaterialIndices[start + i] = material;
+        Data.Masses[start + i] = m_MaterialTable.Masses[material];
+    }
+}
+
+template <Dimension D> void Solver<D>::ApplyFlows(const f32 p_DeltaTime)
+{
+    TKIT_PROFILE_NSCOPE("Driz::Solver::ApplyFlows");
+    if (!Sinks.IsEmpty() && GetParticleCount() != 0)
+        removeSunkParticles();
+
+    m_EmittedPositions.Clear();
+    m_EmittedVelocities.Clear();
+    m_EmittedMaterials.Clear();
+    for (Emitter<D> &emitter : Emitters)
+        emit(emitter, p_DeltaTime);
+
+    if (!m_EmittedPositions.IsEmpty())
+        AddParticles(&m_EmittedPositions[0], &m_EmittedVelocities[0], m_EmittedPositions.GetSize(),
+                     &m_EmittedMaterials[0]);
+}
+
+template <Dimension D> void Solver<D>::emit(Emitter<D> &p_Emitter, const f32 p_DeltaTime)
+{
+    p_Emitter.Pending += p_Emitter.Rate * p_DeltaTime;
+    const u32 count = static_cast<u32>(p_Emitter.Pending);
+    if (count == 0)
+        return;
+    p_Emitter.Pending -= static_cast<f32>(count);
+
+    const u32 start = m_EmittedPositions.GetSize();
+    m_EmittedPositions.Resize(start + count);
+    m_EmittedVelocities.Resize(start + count, p_Emitter.Velocity);
+    const u8 material = static_cast<u8>(Math::Min(p_Emitter.Material, MaterialTable::MaxMaterials - 1));
+    m_EmittedMaterials.Resize(start + count, material);
+
+    const f32v<D> extent = p_Emitter.Max - p_Emitter.Min;
+    for (u32 i = 0; i < count; ++i)
+        for (u32 j = 0; j < D; ++j)
+            m_EmittedPositions[start + i][j] =
+                p_Emitter.Min[j] + extent[j] * Scene<D>::Random(p_Emitter.Seed, p_Emitter.Emitted + i, j);
+
+    p_Emitter.Emitted += count;
+}
+
+template <Dimension D> void Solver<D>::removeSunkParticles()
+{
+    RemoveParticlesIf([this](const u32 p_Index) {
+        for (const Sink<D> &sink : Sinks)
+            if (Math::Dot(Data.State.Positions[p_Index] - sink.Point, sink.Normal) > 0.f)
+                return true;
+        return false;
+    });
+}
+
+template <Dimension D> void Solver<D>::compactState(const u32 p_Size)
+{
+    compact(Data.State.Positions, m_CompactVectors, p_Size);
+    compact(Data.State.Velocities, m_CompactVectors, p_Size);
+    compact(Data.RestDistances, m_CompactScalars, p_Size);
+    compact(Data.NeighborDistances, m_CompactScalars, p_Size);
+    compact(Data.NeighborCounts, m_CompactCounts, p_Size);
+    compact(Data.Masses, m_CompactScalars, p_Size);
+    compact(Data.SmoothingRadii, m_CompactScalars, p_Size);
+    compact(Data.Shear, m_CompactScalars, p_Size);
+    compact(Data.MaterialIndices, m_CompactIndices, p_Size);
+    resizeState(p_Size);
+}
+
+template <Dimension D>
+template <typename T>
+void Solver<D>::compact(SimArray<T> &p_Array, SimArray<T> &p_Scratch, const u32 p_Size)
+{
+    p_Scratch.Reserve(m_Capacity);
+    p_Scratch.Resize(p_Size);
+    Core::ForEachChunk(0, p_Array.GetSize(), Settings.Partitions,
+                       [this, &p_Array, &p_Scratch](const u32 p_Chunk, const u32 p_Start, const u32 p_End) {
+                           TKIT_PROFILE_NSCOPE("Driz::Solver::Compact");
+                           u32 index = m_KeepOffsets[p_Chunk];
+                           for (u32 i = p_Start; i < p_End; ++i)
+                               if (m_Keep[i])
+                                   p_Scratch[index++] = p_Array[i];
+                       });
+    std::swap(p_Array, p_Scratch);
+}
+
+// The material table is rebuilt every step. Particles follow the mass of their material and the smoothing radius if
+// either is changed, keeping whatever multiple of them adaptive resolution gave them
+template <Dimension D> void Solver<D>::syncResolution()
+{
+    m_MaterialTable.Build(Settings, Materials);
+
+    TKit::Array<f32, MaterialTable::MaxMaterials> masses;
+    bool changed = false;
+    for (u32 i = 0; i < m_MaterialTable.Count; ++i)
+    {
+        masses[i] = i < m_BaseCount ? m_MaterialTable.Masses[i] / m_BaseMasses[i] : 1.f;
+        changed |= masses[i] != 1.f;
+        m_BaseMasses[i] = m_MaterialTable.Masses[i];
+    }
+    m_BaseCount = m_MaterialTable.Count;
+    m_UniformMass = m_MaxMassRatio < 1.5f && m_MaterialTable.HasUniformMass();
+
+    const f32 radius = Settings.SmoothingRadius / m_BaseRadius;
+    m_BaseRadius = Settings.SmoothingRadius;
+    if (!changed && radius == 1.f)
+        return;
+
+    Core::ForEach(0, GetParticleCount(), Settings.Partitions,
+                  [this, &masses, radius](const u32 p_Start, const u32 p_End) {
+                      for (u32 i = p_Start; i < p_End; ++i)
+                      {
+                          Data.Masses[i] *= masses[Data.MaterialIndices[i]];
+                          Data.SmoothingRadii[i] *= radius;
+                      }
+                  });
+}
+
+// Particles are split and merged every few steps from the neighbor counts and shear left by the last step. Both
+// conserve mass and momentum: merged particles sit at the center of mass of the pair, and split ones share the velocity
+// of their parent
+template <Dimension D> void Solver<D>::adaptResolution()
+{
+    if (++m_StepsSinceAdaptation < Settings.AdaptiveInterval)
+        return;
+    m_StepsSinceAdaptation = 0;
+    if (GetParticleCount() == 0)
+        return;
+
+    TKIT_PROFILE_NSCOPE("Driz::Solver::AdaptResolution");
+    computeNeighborStatistics();
+    const f32 mean = Lookup.Statistics.MeanNeighbors;
+    if (mean <= 0.f)
+        return;
+
+    splitParticles(mean);
+    mergeParticles(mean);
+    appendSplitParticles();
+    updateResolutionBounds();
+    ++m_Adaptations;
+}
+
+template <Dimension D> void Solver<D>::splitParticles(const f32 p_MeanNeighbors)
+{
+    for (auto &splits : m_Splits)
+        splits.Clear();
+
+    const f32 surface = Settings.AdaptiveSurfaceRatio * p_MeanNeighbors;
+    Core::ForEachChunk(0, GetParticleCount(), Settings.Partitions,
+                       [this, surface](const u32 p_Chunk, const u32 p_Start, const u32 p_End) {
+                           TKIT_PROFILE_NSCOPE("Driz::Solver::SplitParticles");
+                           for (u32 i = p_Start; i < p_End; ++i)
+                           {
+                               const u8 material = Data.MaterialIndices[i];
+                               const f32 mass = Data.Masses[i];
+                               if (mass < 1.5f * m_MaterialTable.Masses[material])
+                                   continue;
+
+                               const f32 count = static_cast<f32>(Data.NeighborCounts[i]);
+                               const bool sheared = Data.Shear[i] > Settings.AdaptiveShear * count;
+                               if (!sheared && count >= surface)
+                                   continue;
+
+                               f32v<D> dir;
+                               for (u32 j = 0; j < D; ++j)
+                                   dir[j] = Scene<D>::Random(m_Adaptations, i, j) - 0.5f;
+                               const f32 norm = Math::Norm(dir);
+                               if (norm > 0.f)
+                                   dir /= norm;
+                               else
+                                   dir[0] = 1.f;
+
+                               // Children end up as far apart as the particles of a freshly spawned lattice
+                               const f32 half = 0.5f * mass;
+                               const f32 radius = getSmoothingRadius(half, material);
+                               const f32v<D> offset = (0.2f * radius) * dir;
+
+                               m_Splits[p_Chunk].Append(SplitParticle{.Position = Data.State.Positions[i] + offset,
+                                                                      .Velocity = Data.State.Velocities[i],
+                                                                      .Mass = half,
+                                                                      .RestDistance = Data.RestDistances[i],
+                                                                      .Material = material});
+                               Data.State.Positions[i] -= offset;
+                               Data.Masses[i] = half;
+                               Data.SmoothingRadii[i] = radius;
+                           }
+                       });
+}
+
+// Eligible particles are paired with the next eligible particle of the same mass and material in their grid cell, so
+// merging only runs when the grid is up to date. Particles of a cell are owned by a single thread, so pairs never race
+template <Dimension D> void Solver<D>::mergeParticles(const f32 p_MeanNeighbors)
+{
+    const u32 pcount = GetParticleCount();
+    if (Lookup.GetMode() != LookupMode::Grid || Lookup.Grid.ParticleIndices.GetSize() != pcount)
+        return;
+
+    const u32 partitions = Settings.Partitions;
+    m_Keep.Resize(pcount);
+    Core::ForEach(0, pcount, partitions, [this](const u32 p_Start, const u32 p_End) {
+        for (u32 i = p_Start; i < p_End; ++i)
+            m_Keep[i] = 1;
+    });
+
+    const f32 maxRatio = static_cast<f32>(Settings.AdaptiveMaxMassRatio) + 0.5f;
+    const f32 calm = 0.5f * Settings.AdaptiveShear;
+    const auto canMerge = [this, p_MeanNeighbors, maxRatio, calm](const u32 p_Index) {
+        const f32 count = static_cast<f32>(Data.NeighborCounts[p_Index]);
+        const f32 base = m_MaterialTable.Masses[Data.MaterialIndices[p_Index]];
+        return count > 0.f && count >= p_MeanNeighbors && Data.Shear[p_Index] < calm * count &&
+               2.f * Data.Masses[p_Index] < maxRatio * base;
+    };
+
+    Core::ForEach(0, Lookup.Grid.Cells.GetSize(), partitions, [this, &canMerge](const u32 p_Start, const u32 p_End) {
+        TKIT_PROFILE_NSCOPE("Driz::Solver::MergeParticles");
+        for (u32 c = p_Start; c < p_End; ++c)
+        {
+            const GridCell &cell = Lookup.Grid.Cells[c];
+            u32 pending = UINT32_MAX;
+            for (u32 j = cell.Start; j < cell.End; ++j)
+            {
+                const u32 index = Lookup.Grid.ParticleIndices[j];
+                if (!canMerge(index))
+                    continue;
+                if (pending == UINT32_MAX || Data.Masses[pending] != Data.Masses[index] ||
+                    Data.MaterialIndices[pending] != Data.MaterialIndices[index])
+                {
+                    pending = index;
+                    continue;
+                }
+
+                const f32v<D> offset = Lookup.ComputeOffset(Data.State.Positions[index], Data.State.Positions[pending]);
+                const f32 radius = Data.SmoothingRadii[index];
+                if (Math::NormSquared(offset) >= radius * radius)
+                {
+                    pending = index;
+                    continue;
+                }
+
+                const f32 mass1 = Data.Masses[pending];
+                const f32 mass2 = Data.Masses[index];
+                const f32 mass = mass1 + mass2;
+
+                Data.State.Positions[pending] += (mass2 / mass) * offset;
+                Data.State.Velocities[pending] =
+                    (mass1 * Data.State.Velocities[pending] + mass2 * Data.State.Velocities[index]) / mass;
+                Data.RestDistances[pending] = 0.5f * (Data.RestDistances[pending] + Data.RestDistances[index]);
+                Data.Masses[pending] = mass;
+                Data.SmoothingRadii[pending] = getSmoothingRadius(mass, Data.MaterialIndices[pending]);
+
+                m_Keep[index] = 0;
+                pending = UINT32_MAX;
+            }
+        }
+    });
+
+    Core::ForEachChunk(0, pcount, partitions, [this](const u32 p_Chunk, const u32 p_Start, const u32 p_End) {
+        u32 kept = 0;
+        for (u32 i = p_Start; i < p_End; ++i)
+            kept += m_Keep[i];
+        m_KeepOffsets[p_Chunk + 1] = kept;
+    });
+
+    m_KeepOffsets[0] = 0;
+    for (u32 i = 1; i <= partitions; ++i)
+        m_KeepOffsets[i] += m_KeepOffsets[i - 1];
+
+    const u32 kept = m_KeepOffsets[partitions];
+    if (kept != pcount)
+        compactState(kept);
+}
+
+template <Dimension D> void Solver<D>::appendSplitParticles()
+{
+    u32 count = 0;
+    for (const auto &splits : m_Splits)
+        count += splits.GetSize();
+    if (count == 0)
+        return;
+
+    const u32 start = GetParticleCount();
+    const u32 size = start + count;
+    reserveState(size);
+    Data.State.Positions.Resize(size);
+    Data.State.Velocities.Resize(size);
+    resizeState(size);
+
+    u32 index = start;
+    for (const auto &splits : m_Splits)
+        for (const SplitParticle &split : splits)
+        {
+            Data.State.Positions[index] = split.Position;
+            Data.State.Velocities[index] = split.Velocity;
+            Data.Masses[index] = split.Mass;
+            Data.SmoothingRadii[index] = getSmoothingRadius(split.Mass, split.Material);
+            Data.RestDistances[index] = split.RestDistance;
+            Data.MaterialIndices[index] = split.Material;
+            ++index;
+        }
+}
+
+template <Dimension D> void Solver<D>::updateResolutionBounds()
+{
+    TKit::Array<f32, DRIZ_MAX_THREADS> maxima{};
+    Core::ForEachChunk(0, GetParticleCount(), Settings.Partitions,
+                       [this, &maxima](const u32 p_Chunk, const u32 p_Start, const u32 p_End) {
+                           f32 ratio = 0.f;
+                           for (u32 i = p_Start; i < p_End; ++i)
+                               ratio = Math::Max(ratio,
+                                                 Data.Masses[i] / m_MaterialTable.Masses[Data.MaterialIndices[i]]);
+                           maxima[p_Chunk] = ratio;
+                       });
 
-    resizeState(GetParticleCount());
+    m_MaxMassRatio = 1.f;
+    for (u32 i = 0; i < Settings.Partitions; ++i)
+        m_MaxMassRatio = Math::Max(m_MaxMassRatio, maxima[i]);
+    m_UniformMass = m_MaxMassRatio < 1.5f && m_MaterialTable.HasUniformMass();
 }
 
 template <Dimension D> void Solver<D>::encase(const u32 p_Index)
@@ -309,7 +978,13 @@ template <Dimension D> void Solver<D>::encase(const u32 p_Index)
     const f32 factor = 1.f - Settings.EncaseFriction;
     for (u32 j = 0; j < D; ++j)
     {
-        if (Data.StagedPositions[p_Index][j] - Settings.ParticleRadius < Data.State.Min[j])
+        if (Settings.PeriodicAxes & (1u << j))
+        {
+            const f32 extent = Data.State.Max[j] - Data.State.Min[j];
+            f32 &position = Data.StagedPositions[p_Index][j];
+            position -= extent * std::floor((position - Data.State.Min[j]) / extent);
+        }
+        else if (Data.StagedPositions[p_Index][j] - Settings.ParticleRadius < Data.State.Min[j])
         {
             Data.StagedPositions[p_Index][j] = Data.State.Min[j] + Settings.ParticleRadius;
             Data.State.Velocities[p_Index][j] = -factor * Data.State.Velocities[p_Index][j];
@@ -327,12 +1002,48 @@ template <Dimension D> void Solver<D>::DrawBoundingBox(Onyx::RenderContext<D> *p
     Visualization<D>::DrawBoundingBox(p_Context, Data.State.Min, Data.State.Max,
                                       Onyx::Color::FromHexadecimal("A6B1E1"));
 }
-template <Dimension D> void Solver<D>::DrawParticles(Onyx::RenderContext<D> *p_Context) const
+template <Dimension D>
+void Solver<D>::DrawParticles(Onyx::RenderContext<D> *p_Context, const ViewVolume<D> *p_View) const
 {
+    const ParticleCulling culling = GetCulling(p_View);
     if constexpr (D == D2)
-        Visualization<D2>::DrawParticles(p_Context, Settings, Data.State);
+        Visualization<D2>::DrawParticles(p_Context, Settings, Data.State, &culling);
     else
-        Visualization<D3>::DrawParticles(p_Context, Settings, Data, Onyx::Color::GREEN, Onyx::Color::ORANGE);
+        Visualization<D3>::DrawParticles(p_Context, Settings, Data.State, Data.UnderMouseInfluence.GetData(),
+                                         Onyx::Color::GREEN, Onyx::Color::ORANGE, &culling);
+}
+
+template <Dimension D> ParticleCulling Solver<D>::GetCulling(const ViewVolume<D> *p_View) const
+{
+    ParticleCulling culling{};
+    // The grid is skipped if particles were added or removed since it was built. Periodic cells do not map to a single
+    // region of space, so they are not used either
+    if (p_View && Settings.CullOutsideView && Lookup.GetMode() == LookupMode::Grid &&
+        Lookup.GetPeriodicAxes() == 0 && Lookup.Grid.ParticleIndices.GetSize() == GetParticleCount())
+    {
+        Lookup.CollectVisibleParticles(*p_View, Settings.Partitions, m_VisibleParticles);
+        culling.Indices = m_VisibleParticles.GetData();
+        culling.IndexCount = m_VisibleParticles.GetSize();
+    }
+
+    if constexpr (D == D3)
+    {
+        // Neighbor counts are only meaningful once a density pass has run, which also refreshes their mean whenever
+        // interior culling is enabled
+        const f32 mean = Lookup.Statistics.MeanNeighbors;
+        if (Settings.CullInterior && mean > 0.f && Data.NeighborCounts.GetSize() == GetParticleCount())
+        {
+            culling.NeighborCounts = Data.NeighborCounts.GetData();
+            const u32 interior = static_cast<u32>(std::ceil(Settings.InteriorNeighborRatio * mean));
+            culling.InteriorNeighbors = Math::Max(1u, interior);
+        }
+        if (p_View)
+        {
+            culling.Viewer = p_View->Origin;
+            culling.LodDistance = Settings.LodDistance;
+        }
+    }
+    return culling;
 }
 
 template <Dimension D> u32 Solver<D>::GetParticleCount() const
@@ -340,6 +1051,47 @@ template <Dimension D> u32 Solver<D>::GetParticleCount() const
     return Data.State.Positions.GetSize();
 }
 
+template <Dimension D> f32 Solver<D>::ComputeKineticEnergy() const
+{
+    TKit::Array<f64, DRIZ_MAX_THREADS> energies{};
+    Core::ForEachChunk(0, GetParticleCount(), Settings.Partitions,
+                       [this, &energies](const u32 p_Chunk, const u32 p_Start, const u32 p_End) {
+                           f64 energy = 0.0;
+                           for (u32 i = p_Start; i < p_End; ++i)
+                               energy += Data.Masses[i] * Math::NormSquared(Data.State.Velocities[i]);
+                           energies[p_Chunk] = energy;
+                       });
+
+    f64 energy = 0.0;
+    for (u32 i = 0; i < Settings.Partitions; ++i)
+        energy += energies[i];
+    return static_cast<f32>(0.5 * energy);
+}
+
+template <Dimension D> f32 Solver<D>::ComputeDensityError() const
+{
+    const u32 size = Math::Min(GetParticleCount(), Data.Densities.GetSize());
+    if (size == 0)
+        return 0.f;
+
+    TKit::Array<f64, DRIZ_MAX_THREADS> errors{};
+    Core::ForEachChunk(0, size, Settings.Partitions,
+                       [this, &errors](const u32 p_Chunk, const u32 p_Start, const u32 p_End) {
+                           f64 error = 0.0;
+                           for (u32 i = p_Start; i < p_End; ++i)
+                           {
+                               const f32 target = m_MaterialTable.TargetDensities[Data.MaterialIndices[i]];
+                               error += Math::Absolute(Data.Densities[i][0] - target) / target;
+                           }
+                           errors[p_Chunk] = error;
+                       });
+
+    f64 error = 0.0;
+    for (u32 i = 0; i < Settings.Partitions; ++i)
+        error += errors[i];
+    return static_cast<f32>(error / size);
+}
+
 template class Solver<Dimension::D2>;
 template class Solver<Dimension::D3>;
 
@@ -2,15 +2,46 @@
 
 #include "driz/simulation/settings.hpp"
 #include "driz/simulation/lookup.hpp"
+#include "driz/simulation/flow.hpp"
+#include "driz/simulation/obstacle.hpp"
+#include "driz/simulation/material.hpp"
+#include "driz/simulation/telemetry.hpp"
 #include "onyx/rendering/render_context.hpp"
 
 namespace Driz
 {
+enum class MouseAction : u8
+{
+    None,
+    Push,
+    Highlight // Only marks the particles under the mouse, and only in 3D
+};
+
+// Everything a step needs from the user, gathered beforehand so that the step can run away from the window
+template <Dimension D> struct StepInput
+{
+    f32 DeltaTime = 1.f / 60.f;
+    f32v<D> MousePosition{0.f};
+    MouseAction Mouse = MouseAction::None;
+    // The whole step is computed, but its forces are not applied
+    bool Dummy = false;
+    // Emitters and sinks are left alone, for callers that already applied them and rely on particle indices staying
+    // put during the step
+    bool SkipFlows = false;
+};
+
+// Solvers are move only, as the lookup owns a scratch arena. Telemetry readers on other threads must be done with a
+// solver before it is moved
 template <Dimension D> class Solver
 {
   public:
     Solver(const SimulationSettings &p_Settings, const SimulationState<D> &p_State);
 
+    // Runs a whole step without user interaction: flows, prediction, lookup, densities, forces and integration. A mouse
+    // position may be provided to script the mouse force
+    void Step(f32 p_DeltaTime, const f32v<D> *p_MousePos = nullptr);
+    void Step(const StepInput<D> &p_Input);
+
     void BeginStep(f32 p_DeltaTime);
     void EndStep();
 
@@ -21,39 +52,159 @@ template <Dimension D> class Solver
 
     u32 GetParticleCount() const;
 
+    // Replaces every particle. Mass ratios and materials are kept when the state holds one of each per particle
+    void SetState(const SimulationState<D> &p_State);
+    // A copy of the particles that keeps their mass ratios and materials, unless they are all base particles of the
+    // first material. Handing it to a new solver or saving it conserves the mass of the fluid
+    SimulationState<D> GetState() const;
+
+    f32 ComputeKineticEnergy() const;
+    // Mean relative deviation of the last computed densities from the target density
+    f32 ComputeDensityError() const;
+
     void UpdateLookup();
     void UpdateAllLookups();
 
     void AddParticle(const f32v<D> &p_Position);
+    // Particles belong to the first material if no materials are given
+    void AddParticles(const f32v<D> *p_Positions, const f32v<D> *p_Velocities, u32 p_Count,
+                      const u8 *p_Materials = nullptr);
+
+    // Removal is a parallel stream compaction: every partition flags and counts the particles it keeps, an exclusive
+    // scan over those counts gives each partition its output offset, and the surviving particles are then scattered in
+    // order. The predicate receives particle indices, and may be called from several threads at once
+    template <typename F> void RemoveParticlesIf(F &&p_Predicate)
+    {
+        const u32 pcount = GetParticleCount();
+        const u32 partitions = Settings.Partitions;
+        m_Keep.Resize(pcount);
+
+        Core::ForEachChunk(0, pcount, partitions,
+                           [this, &p_Predicate](const u32 p_Chunk, const u32 p_Start, const u32 p_End) {
+                               TKIT_PROFILE_NSCOPE("Driz::Solver::FlagRemovedParticles");
+                               u32 kept = 0;
+                               for (u32 i = p_Start; i < p_End; ++i)
+                               {
+                                   const u8 keep = p_Predicate(i) ? 0 : 1;
+                                   m_Keep[i] = keep;
+                                   kept += keep;
+                               }
+                               m_KeepOffsets[p_Chunk + 1] = kept;
+                           });
+
+        m_KeepOffsets[0] = 0;
+        for (u32 i = 1; i <= partitions; ++i)
+            m_KeepOffsets[i] += m_KeepOffsets[i - 1];
+
+        const u32 kept = m_KeepOffsets[partitions];
+        if (kept != pcount)
+            compactState(kept);
+    }
+
+    void ApplyFlows(f32 p_DeltaTime);
 
     void DrawBoundingBox(Onyx::RenderContext<D> *p_Context) const;
-    void DrawParticles(Onyx::RenderContext<D> *p_Context) const;
+    // The view volume is used to skip grid cells out of sight and, in 3D, for level of detail
+    void DrawParticles(Onyx::RenderContext<D> *p_Context, const ViewVolume<D> *p_View = nullptr) const;
+    // Reads the grid, so it must not overlap with a step. The returned indices are valid until the next call
+    ParticleCulling GetCulling(const ViewVolume<D> *p_View = nullptr) const;
 
     LookupMethod<D> Lookup;
     SimulationData<D> Data;
     SimulationSettings Settings;
 
+    SimArray<Emitter<D>> Emitters;
+    SimArray<Sink<D>> Sinks;
+    ObstacleSet<D> Obstacles;
+    // Materials past the first one, which is always described by the settings
+    SimArray<Material> Materials;
+
+    StepTelemetry Telemetry;
+
   private:
-    f32v2 getPressureFromDensity(const Density &p_Density) const;
+    f32v2 getPressureFromDensity(const Density &p_Density, u8 p_Material) const;
 
     void encase(u32 p_Index);
+    void highlight(const f32v<D> &p_MousePos);
 
     void mergeDensityAndDistanceArrays();
+    void computeNeighborStatistics();
+    template <bool Uniform, bool Shear, bool Mixed> void addPressureAndViscosity();
     void mergeAccelerationArrays();
 
-    f32 getInfluence(f32 p_Distance) const;
-    f32 getInfluenceSlope(f32 p_Distance) const;
+    f32 getInfluence(f32 p_Distance, f32 p_Radius) const;
+    f32 getInfluenceSlope(f32 p_Distance, f32 p_Radius) const;
 
-    f32 getNearInfluence(f32 p_Distance) const;
-    f32 getNearInfluenceSlope(f32 p_Distance) const;
+    f32 getNearInfluence(f32 p_Distance, f32 p_Radius) const;
+    f32 getNearInfluenceSlope(f32 p_Distance, f32 p_Radius) const;
 
-    f32 getViscosityInfluence(f32 p_Distance) const;
+    f32 getViscosityInfluence(f32 p_Distance, f32 p_Radius) const;
 
-    void resizeState(u32 p_Size);
+    f32 getSmoothingRadius(f32 p_Mass, u8 p_Material) const;
+    f32 getLookupRadius() const;
 
+    void resizeState(u32 p_Size);
+    void reserveState(u32 p_Size);
+    void reserveScratch(u32 p_Slots);
+    template <typename T>
+    TKit::Array<T *, DRIZ_MAX_THREADS> getScratch(TKit::Array<SimArray<T>, DRIZ_MAX_THREADS> &p_Scratch,
+                                                  SimArray<T> &p_Data);
+
+    void emit(Emitter<D> &p_Emitter, f32 p_DeltaTime);
+    void removeSunkParticles();
+    // Compacts every per particle array according to the keep flags and offsets
+    void compactState(u32 p_Size);
+    template <typename T> void compact(SimArray<T> &p_Array, SimArray<T> &p_Scratch, u32 p_Size);
+
+    void syncResolution();
+    void adaptResolution();
+    void splitParticles(f32 p_MeanNeighbors);
+    void mergeParticles(f32 p_MeanNeighbors);
+    void appendSplitParticles();
+    void updateResolutionBounds();
+
+    mutable SimArray<u32> m_VisibleParticles;
+
+    // One scratch array per partition, but only once there is more than one. Only the first slots are allocated
     TKit::Array<SimArray<f32v<D>>, DRIZ_MAX_THREADS> m_Accelerations;
     TKit::Array<SimArray<Density>, DRIZ_MAX_THREADS> m_Densities;
     TKit::Array<SimArray<f32>, DRIZ_MAX_THREADS> m_NeighborDistances;
     TKit::Array<SimArray<u32>, DRIZ_MAX_THREADS> m_NeighborCounts;
+    TKit::Array<SimArray<f32>, DRIZ_MAX_THREADS> m_Shear;
+
+    SimArray<f32v<D>> m_EmittedPositions;
+    SimArray<f32v<D>> m_EmittedVelocities;
+    SimArray<u8> m_EmittedMaterials;
+
+    SimArray<u8> m_Keep;
+    TKit::Array<u32, DRIZ_MAX_THREADS + 1> m_KeepOffsets{};
+    SimArray<f32v<D>> m_CompactVectors;
+    SimArray<f32> m_CompactScalars;
+    SimArray<u32> m_CompactCounts;
+    SimArray<u8> m_CompactIndices;
+
+    struct SplitParticle
+    {
+        f32v<D> Position;
+        f32v<D> Velocity;
+        f32 Mass;
+        f32 RestDistance;
+        u8 Material;
+    };
+    TKit::Array<SimArray<SplitParticle>, DRIZ_MAX_THREADS> m_Splits;
+
+    MaterialTable m_MaterialTable;
+
+    // Masses and smoothing radii are rescaled when their base values change
+    TKit::Array<f32, MaterialTable::MaxMaterials> m_BaseMasses{};
+    u32 m_BaseCount = 0;
+    f32 m_BaseRadius = 0.f;
+    f32 m_MaxMassRatio = 1.f;
+    bool m_UniformMass = true;
+    u32 m_StepsSinceAdaptation = 0;
+    u32 m_Adaptations = 0;
+
+    u32 m_Capacity = 0;
+    u32 m_ScratchSlots = 0;
 };
 } // namespace Driz
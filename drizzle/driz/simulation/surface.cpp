@@ -0,0 +1,394 @@
+#include "driz/simulation/surface.hpp"
+#include "tkit/utils/hash.hpp"
+#include "tkit/profiling/clock.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace Driz
+{
+static constexpr u32 s_KeyBits = 21;
+static constexpr u64 s_KeyMask = (u64{1} << s_KeyBits) - 1;
+static constexpr i32 s_KeyOffset = 1 << (s_KeyBits - 1);
+
+template <Dimension D> static u64 packCell(const i32v<D> &p_Cell)
+{
+    u64 key = 0;
+    for (u32 i = 0; i < D; ++i)
+        key |= (static_cast<u64>(p_Cell[i] + s_KeyOffset) & s_KeyMask) << (s_KeyBits * i);
+    return key;
+}
+template <Dimension D> static i32v<D> unpackCell(const u64 p_Key)
+{
+    i32v<D> cell;
+    for (u32 i = 0; i < D; ++i)
+        cell[i] = static_cast<i32>((p_Key >> (s_KeyBits * i)) & s_KeyMask) - s_KeyOffset;
+    return cell;
+}
+
+// Kuhn's triangulation: every simplex walks from the lowest corner to the highest one along a different axis order.
+// Corners are indexed by their offset bits, and neighboring voxels split their shared faces identically
+template <Dimension D> static auto getSimplices()
+{
+    if constexpr (D == D2)
+        return TKit::Array<TKit::Array<u32, 3>, 2>{TKit::Array<u32, 3>{0, 1, 3}, TKit::Array<u32, 3>{0, 2, 3}};
+    else
+        return TKit::Array<TKit::Array<u32, 4>, 6>{TKit::Array<u32, 4>{0, 1, 3, 7}, TKit::Array<u32, 4>{0, 1, 5, 7},
+                                                   TKit::Array<u32, 4>{0, 2, 3, 7}, TKit::Array<u32, 4>{0, 2, 6, 7},
+                                                   TKit::Array<u32, 4>{0, 4, 5, 7}, TKit::Array<u32, 4>{0, 4, 6, 7}};
+}
+
+template <Dimension D>
+void SurfaceExtractor<D>::Update(const SimulationSettings &p_Settings, const SimArray<f32v<D>> &p_Positions)
+{
+    TKIT_PROFILE_NSCOPE("Driz::SurfaceExtractor::Update");
+    TKit::Clock clock{};
+
+    const Parameters parameters{.Radius = p_Settings.SmoothingRadius,
+                                .Mass = p_Settings.ParticleMass,
+                                .IsoLevel = p_Settings.SurfaceIsoLevel * p_Settings.TargetDensity,
+                                .Subdivisions = Math::Max(p_Settings.SurfaceSubdivisions, 1u),
+                                .Kernel = p_Settings.KType};
+    if (!(parameters == m_Parameters))
+    {
+        m_Blocks.Clear();
+        m_Parameters = parameters;
+    }
+
+    const u32 partitions = p_Settings.Partitions;
+    m_Positions = &p_Positions;
+    if (p_Positions.IsEmpty())
+    {
+        if (!m_Blocks.IsEmpty())
+            ++m_Version;
+        m_Blocks.Clear();
+        m_Vertices.Clear();
+        m_Normals.Clear();
+        Statistics = SurfaceStatistics{};
+        return;
+    }
+
+    m_Lookup.CollectStatistics = false;
+    m_Lookup.SetPositions(&p_Positions);
+    m_Lookup.UpdateGridLookup(parameters.Radius, partitions);
+    collectBlockKeys(partitions);
+
+    const u32 blocks = m_Keys.GetSize();
+    m_NextBlocks.Clear();
+    m_NextBlocks.Resize(blocks);
+
+    // Particles moving less than a fraction of a voxel do not trigger a rebuild
+    const f32 quantum = parameters.Radius / static_cast<f32>(8 * parameters.Subdivisions);
+    TKit::Array<u32, DRIZ_MAX_THREADS> rebuilt{};
+    Core::ForEachChunk(0, blocks, partitions,
+                       [this, &rebuilt, quantum](const u32 p_Chunk, const u32 p_Start, const u32 p_End) {
+                           TKIT_PROFILE_NSCOPE("Driz::SurfaceExtractor::Blocks");
+                           SimArray<u32> indices;
+                           SimArray<f32> samples;
+                           u32 count = 0;
+                           for (u32 i = p_Start; i < p_End; ++i)
+                           {
+                               Block &block = m_NextBlocks[i];
+                               block.Key = m_Keys[i];
+                               m_Lookup.CollectNeighborhood(unpackCell<D>(block.Key), indices);
+                               block.Signature = computeSignature(indices, quantum);
+
+                               const auto it = std::lower_bound(
+                                   m_Blocks.begin(), m_Blocks.end(), block.Key,
+                                   [](const Block &p_Block, const u64 p_Key) { return p_Block.Key < p_Key; });
+                               if (it != m_Blocks.end() && it->Key == block.Key)
+                               {
+                                   const bool unchanged = it->Signature == block.Signature;
+                                   block.Vertices = std::move(it->Vertices);
+                                   block.Normals = std::move(it->Normals);
+                                   if (unchanged)
+                                       continue;
+                               }
+                               buildBlock(block, indices, samples);
+                               ++count;
+                           }
+                           rebuilt[p_Chunk] = count;
+                       });
+
+    const bool resized = blocks != m_Blocks.GetSize();
+    std::swap(m_Blocks, m_NextBlocks);
+
+    Statistics.Blocks = blocks;
+    Statistics.RebuiltBlocks = 0;
+    for (u32 i = 0; i < partitions; ++i)
+        Statistics.RebuiltBlocks += rebuilt[i];
+
+    if (resized || Statistics.RebuiltBlocks != 0)
+    {
+        gatherGeometry(partitions);
+        ++m_Version;
+    }
+    Statistics.Primitives = m_Vertices.GetSize() / D;
+    Statistics.ExtractTime = static_cast<f32>(clock.GetElapsed().AsMilliseconds());
+}
+
+// Occupied cells and all of their neighbors, as the kernel support of a particle may reach into any of them
+template <Dimension D> void SurfaceExtractor<D>::collectBlockKeys(const u32 p_Partitions)
+{
+    m_Lookup.CollectOccupiedCells(p_Partitions, m_Cells);
+
+    constexpr u32 neighbors = D == D2 ? 9 : 27;
+    m_Keys.Resize(m_Cells.GetSize() * neighbors);
+    Core::ForEach(0, m_Cells.GetSize(), p_Partitions, [this](const u32 p_Start, const u32 p_End) {
+        for (u32 i = p_Start; i < p_End; ++i)
+            for (u32 j = 0; j < neighbors; ++j)
+            {
+                i32v<D> cell = m_Cells[i];
+                u32 offset = j;
+                for (u32 k = 0; k < D; ++k)
+                {
+                    cell[k] += static_cast<i32>(offset % 3) - 1;
+                    offset /= 3;
+                }
+                m_Keys[i * neighbors + j] = packCell<D>(cell);
+            }
+    });
+
+    std::sort(m_Keys.begin(), m_Keys.end());
+    m_Keys.Resize(static_cast<u32>(std::unique(m_Keys.begin(), m_Keys.end()) - m_Keys.begin()));
+}
+
+// Order independent, so that particles being reordered by the solver do not invalidate blocks
+template <Dimension D>
+u64 SurfaceExtractor<D>::computeSignature(const SimArray<u32> &p_Indices, const f32 p_Quantum) const
+{
+    const auto &positions = *m_Positions;
+    u64 signature = p_Indices.GetSize();
+    for (const u32 index : p_Indices)
+    {
+        i32v<D> quantized;
+        for (u32 i = 0; i < D; ++i)
+            quantized[i] = static_cast<i32>(std::floor(positions[index][i] / p_Quantum));
+        signature += static_cast<u64>(TKit::Hash(quantized)) * 0x9E3779B97F4A7C15ull;
+    }
+    return signature;
+}
+
+template <Dimension D>
+void SurfaceExtractor<D>::buildBlock(Block &p_Block, const SimArray<u32> &p_Indices, SimArray<f32> &p_Samples) const
+{
+    const auto &positions = *m_Positions;
+    const Parameters &params = m_Parameters;
+    const u32 voxels = params.Subdivisions;
+    const u32 side = voxels + 1;
+    const f32 size = params.Radius / static_cast<f32>(voxels);
+    const f32 r2 = params.Radius * params.Radius;
+    const f32v<D> origin = f32v<D>{unpackCell<D>(p_Block.Key)} * params.Radius;
+
+    u32 sampleCount = 1;
+    for (u32 i = 0; i < D; ++i)
+        sampleCount *= side;
+    p_Samples.Resize(sampleCount);
+    for (f32 &sample : p_Samples)
+        sample = 0.f;
+
+    // Every particle only touches the samples inside of its support box
+    for (const u32 index : p_Indices)
+    {
+        const f32v<D> &position = positions[index];
+        u32v<D> first;
+        u32v<D> last;
+        bool outside = false;
+        for (u32 i = 0; i < D; ++i)
+        {
+            const f32 low = std::ceil((position[i] - params.Radius - origin[i]) / size);
+            const f32 high = std::floor((position[i] + params.Radius - origin[i]) / size);
+            outside |= high < 0.f || low > static_cast<f32>(voxels);
+            first[i] = static_cast<u32>(Math::Clamp(low, 0.f, static_cast<f32>(voxels)));
+            last[i] = static_cast<u32>(Math::Clamp(high, 0.f, static_cast<f32>(voxels)));
+        }
+        if (outside)
+            continue;
+
+        const auto splat = [&](const u32 p_Sample, const f32v<D> &p_Point) {
+            const f32 distance = Math::DistanceSquared(p_Point, position);
+            if (distance < r2)
+                p_Samples[p_Sample] +=
+                    params.Mass * Kernel<D>::Evaluate(params.Kernel, params.Radius, Math::SquareRoot(distance));
+        };
+        if constexpr (D == D2)
+        {
+            for (u32 y = first[1]; y <= last[1]; ++y)
+                for (u32 x = first[0]; x <= last[0]; ++x)
+                    splat(y * side + x, origin + size * f32v2{static_cast<f32>(x), static_cast<f32>(y)});
+        }
+        else
+        {
+            for (u32 z = first[2]; z <= last[2]; ++z)
+                for (u32 y = first[1]; y <= last[1]; ++y)
+                    for (u32 x = first[0]; x <= last[0]; ++x)
+                        splat((z * side + y) * side + x,
+                              origin + size * f32v3{static_cast<f32>(x), static_cast<f32>(y), static_cast<f32>(z)});
+        }
+    }
+
+    p_Block.Vertices.Clear();
+    p_Block.Normals.Clear();
+
+    constexpr u32 corners = 1 << D;
+    const auto simplices = getSimplices<D>();
+    TKit::Array<f32v<D>, corners> points;
+    TKit::Array<f32, corners> values;
+
+    const f32 iso = params.IsoLevel;
+    const auto crossing = [&points, &values, iso](const u32 p_Inside, const u32 p_Outside) {
+        const f32 t = (iso - values[p_Inside]) / (values[p_Outside] - values[p_Inside]);
+        return points[p_Inside] + t * (points[p_Outside] - points[p_Inside]);
+    };
+
+    u32 voxelCount = 1;
+    for (u32 i = 0; i < D; ++i)
+        voxelCount *= voxels;
+    for (u32 v = 0; v < voxelCount; ++v)
+    {
+        u32v<D> voxel;
+        u32 rest = v;
+        for (u32 i = 0; i < D; ++i)
+        {
+            voxel[i] = rest % voxels;
+            rest /= voxels;
+        }
+
+        u32 inside = 0;
+        for (u32 c = 0; c < corners; ++c)
+        {
+            u32 sample = 0;
+            u32 stride = 1;
+            for (u32 i = 0; i < D; ++i)
+            {
+                const u32 coordinate = voxel[i] + ((c >> i) & 1);
+                sample += coordinate * stride;
+                points[c][i] = origin[i] + size * static_cast<f32>(coordinate);
+                stride *= side;
+            }
+            values[c] = p_Samples[sample];
+            inside += values[c] > iso;
+        }
+        // Fully inside or fully outside voxels hold no surface
+        if (inside == 0 || inside == corners)
+            continue;
+
+        for (const auto &simplex : simplices)
+        {
+            TKit::Array<u32, D + 1> in;
+            TKit::Array<u32, D + 1> out;
+            u32 inCount = 0;
+            u32 outCount = 0;
+            for (const u32 c : simplex)
+            {
+                if (values[c] > iso)
+                    in[inCount++] = c;
+                else
+                    out[outCount++] = c;
+            }
+            if (inCount == 0 || outCount == 0)
+                continue;
+
+            if constexpr (D == D2)
+            {
+                // One lone corner on either side, whose two edges are crossed
+                if (inCount == 1)
+                {
+                    p_Block.Vertices.Append(crossing(in[0], out[0]));
+                    p_Block.Vertices.Append(crossing(in[0], out[1]));
+                }
+                else
+                {
+                    p_Block.Vertices.Append(crossing(in[0], out[0]));
+                    p_Block.Vertices.Append(crossing(in[1], out[0]));
+                }
+            }
+            else
+            {
+                f32v3 inCenter{0.f};
+                f32v3 outCenter{0.f};
+                for (u32 i = 0; i < inCount; ++i)
+                    inCenter += points[in[i]];
+                for (u32 i = 0; i < outCount; ++i)
+                    outCenter += points[out[i]];
+                const f32v3 outward = outCenter / static_cast<f32>(outCount) - inCenter / static_cast<f32>(inCount);
+
+                const auto triangle = [&p_Block, &outward](const f32v3 &p_A, f32v3 p_B, f32v3 p_C) {
+                    f32v3 normal = Cross(p_B - p_A, p_C - p_A);
+                    if (Math::Dot(normal, outward) < 0.f)
+                    {
+                        std::swap(p_B, p_C);
+                        normal = -normal;
+                    }
+                    const f32 length = Math::Norm(normal);
+                    if (length > 0.f)
+                        normal /= length;
+                    p_Block.Vertices.Append(p_A);
+                    p_Block.Vertices.Append(p_B);
+                    p_Block.Vertices.Append(p_C);
+                    for (u32 i = 0; i < 3; ++i)
+                        p_Block.Normals.Append(normal);
+                };
+
+                if (inCount == 1)
+                    triangle(crossing(in[0], out[0]), crossing(in[0], out[1]), crossing(in[0], out[2]));
+                else if (inCount == 3)
+                    triangle(crossing(in[0], out[0]), crossing(in[1], out[0]), crossing(in[2], out[0]));
+                else
+                {
+                    // The four crossed edges go around a quad in this order
+                    const f32v3 q0 = crossing(in[0], out[0]);
+                    const f32v3 q1 = crossing(in[0], out[1]);
+                    const f32v3 q2 = crossing(in[1], out[1]);
+                    const f32v3 q3 = crossing(in[1], out[0]);
+                    triangle(q0, q1, q2);
+                    triangle(q0, q2, q3);
+                }
+            }
+        }
+    }
+}
+
+template <Dimension D> void SurfaceExtractor<D>::gatherGeometry(const u32 p_Partitions)
+{
+    TKIT_PROFILE_NSCOPE("Driz::SurfaceExtractor::Gather");
+    SimArray<u32> offsets;
+    offsets.Resize(m_Blocks.GetSize() + 1);
+    offsets[0] = 0;
+    for (u32 i = 0; i < m_Blocks.GetSize(); ++i)
+        offsets[i + 1] = offsets[i] + m_Blocks[i].Vertices.GetSize();
+
+    const u32 vertices = offsets[m_Blocks.GetSize()];
+    m_Vertices.Resize(vertices);
+    if constexpr (D == D3)
+        m_Normals.Resize(vertices);
+
+    Core::ForEach(0, m_Blocks.GetSize(), p_Partitions, [this, &offsets](const u32 p_Start, const u32 p_End) {
+        for (u32 i = p_Start; i < p_End; ++i)
+        {
+            const Block &block = m_Blocks[i];
+            for (u32 j = 0; j < block.Vertices.GetSize(); ++j)
+            {
+                m_Vertices[offsets[i] + j] = block.Vertices[j];
+                if constexpr (D == D3)
+                    m_Normals[offsets[i] + j] = block.Normals[j];
+            }
+        }
+    });
+}
+
+template <Dimension D> const SimArray<f32v<D>> &SurfaceExtractor<D>::GetVertices() const
+{
+    return m_Vertices;
+}
+template <Dimension D> const SimArray<f32v<D>> &SurfaceExtractor<D>::GetNormals() const
+{
+    return m_Normals;
+}
+template <Dimension D> u64 SurfaceExtractor<D>::GetVersion() const
+{
+    return m_Version;
+}
+
+template class SurfaceExtractor<D2>;
+template class SurfaceExtractor<D3>;
+} // namespace Driz
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "driz/simulation/lookup.hpp"
+
+namespace Driz
+{
+struct SurfaceStatistics
+{
+    u32 Blocks = 0;
+    u32 RebuiltBlocks = 0;
+    u32 Primitives = 0;    // Segments in 2D and triangles in 3D
+    f32 ExtractTime = 0.f; // In milliseconds
+};
+
+// Extracts the isosurface of the SPH density field. Density is splat onto a sparse set of voxel blocks, one per lookup
+// cell holding or neighboring particles, and every block is polygonized in parallel by splitting its voxels into
+// simplices: two triangles per square in 2D and six tetrahedra per cube in 3D. Blocks whose particles did not move
+// since the last update keep their geometry
+template <Dimension D> class SurfaceExtractor
+{
+  public:
+    void Update(const SimulationSettings &p_Settings, const SimArray<f32v<D>> &p_Positions);
+
+    // Every two vertices form a segment in 2D, and every three a triangle in 3D, wound counter clockwise when seen
+    // from outside of the fluid
+    const SimArray<f32v<D>> &GetVertices() const;
+    // 3D only. One outward facing normal per vertex, shared by the whole triangle
+    const SimArray<f32v<D>> &GetNormals() const;
+    // Grows every time the geometry changes, so that uploads can be skipped otherwise
+    u64 GetVersion() const;
+
+    SurfaceStatistics Statistics;
+
+  private:
+    struct Block
+    {
+        u64 Key;
+        u64 Signature;
+        SimArray<f32v<D>> Vertices;
+        SimArray<f32v<D>> Normals;
+    };
+
+    struct Parameters
+    {
+        f32 Radius;
+        f32 Mass;
+        f32 IsoLevel;
+        u32 Subdivisions;
+        KernelType Kernel;
+        bool operator==(const Parameters &) const = default;
+    };
+
+    void collectBlockKeys(u32 p_Partitions);
+    u64 computeSignature(const SimArray<u32> &p_Indices, f32 p_Quantum) const;
+    void buildBlock(Block &p_Block, const SimArray<u32> &p_Indices, SimArray<f32> &p_Samples) const;
+    void gatherGeometry(u32 p_Partitions);
+
+    LookupMethod<D> m_Lookup;
+    const SimArray<f32v<D>> *m_Positions = nullptr;
+    Parameters m_Parameters{};
+
+    SimArray<Block> m_Blocks; // Sorted by key
+    SimArray<Block> m_NextBlocks;
+    SimArray<i32v<D>> m_Cells;
+    SimArray<u64> m_Keys;
+
+    SimArray<f32v<D>> m_Vertices;
+    SimArray<f32v<D>> m_Normals;
+    u64 m_Version = 0;
+};
+} // namespace Driz
@@ -0,0 +1,265 @@
+#include "driz/simulation/telemetry.hpp"
+#include <fstream>
+
+namespace Driz
+{
+const char *GetPhaseName(const StepPhase p_Phase)
+{
+    switch (p_Phase)
+    {
+    case StepPhase::Predict:
+        return "Predict";
+    case StepPhase::LookupBuild:
+        return "LookupBuild";
+    case StepPhase::Sort:
+        return "Sort";
+    case StepPhase::Density:
+        return "Density";
+    case StepPhase::Forces:
+        return "Forces";
+    case StepPhase::Merge:
+        return "Merge";
+    case StepPhase::Integrate:
+        return "Integrate";
+    case StepPhase::Count:
+        break;
+    }
+    return "Unknown";
+}
+
+f32 LookupStatistics::GetPairEfficiency() const
+{
+    return CandidatePairs > 0 ? static_cast<f32>(AcceptedPairs) / static_cast<f32>(CandidatePairs) : 0.f;
+}
+f32 LookupStatistics::GetWorkImbalance() const
+{
+    if (Partitions == 0 || CandidatePairs == 0)
+        return 0.f;
+    u64 busiest = 0;
+    for (u32 i = 0; i < Partitions; ++i)
+        if (Work[i].Candidates > busiest)
+            busiest = Work[i].Candidates;
+    return static_cast<f32>(busiest) * Partitions / static_cast<f32>(CandidatePairs);
+}
+
+// std::atomic_ref only takes const objects from C++26 on, and loading never writes through the reference
+static u64 loadAcquire(const u64 &p_Value)
+{
+    return std::atomic_ref<u64>{const_cast<u64 &>(p_Value)}.load(std::memory_order_acquire);
+}
+
+f32 StepSample::GetParticleStepsPerSecond() const
+{
+    return StepTime > 0.f ? 1000.f * static_cast<f32>(Particles) / StepTime : 0.f;
+}
+
+void StepTelemetry::BeginStep()
+{
+    m_Current = StepSample{};
+    m_StepClock.Restart();
+}
+void StepTelemetry::EndStep(const u32 p_Particles, const LookupStatistics &p_Lookup)
+{
+    const u64 step = m_Written;
+    m_Current.StepTime = static_cast<f32>(m_StepClock.GetElapsed().AsMilliseconds());
+    m_Current.Particles = p_Particles;
+    m_Current.Pairs = p_Lookup.AcceptedPairs;
+    m_Current.CandidatePairs = p_Lookup.CandidatePairs;
+    m_Current.ClashPairs = p_Lookup.ClashPairs;
+    m_Current.Cells = p_Lookup.Cells;
+    m_Current.MinNeighbors = p_Lookup.MinNeighbors;
+    m_Current.MaxNeighbors = p_Lookup.MaxNeighbors;
+    m_Current.MeanNeighbors = p_Lookup.MeanNeighbors;
+    m_Current.WorkImbalance = p_Lookup.GetWorkImbalance();
+    m_Current.Step = step;
+    m_Lookup = p_Lookup;
+
+    std::atomic_ref<u64> sequence{m_Sequences[step % Capacity]};
+    sequence.store(2 * step + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_Samples[step % Capacity] = m_Current;
+    sequence.store(2 * step + 2, std::memory_order_release);
+    std::atomic_ref<u64>{m_Written}.store(step + 1, std::memory_order_release);
+}
+
+void StepTelemetry::AddPhaseTime(const StepPhase p_Phase, const TKit::Timespan p_Time)
+{
+    AddPhaseTime(p_Phase, static_cast<f32>(p_Time.AsMilliseconds()));
+}
+void StepTelemetry::AddPhaseTime(const StepPhase p_Phase, const f32 p_Milliseconds)
+{
+    m_Current.PhaseTimes[static_cast<u32>(p_Phase)] += p_Milliseconds;
+}
+
+u32 StepTelemetry::GetSampleCount() const
+{
+    const u64 written = GetStepCount();
+    return written < Capacity ? static_cast<u32>(written) : Capacity;
+}
+u64 StepTelemetry::GetStepCount() const
+{
+    return loadAcquire(m_Written);
+}
+
+const StepSample &StepTelemetry::GetSample(const u32 p_Index) const
+{
+    const u64 written = GetStepCount();
+    const u64 first = written < Capacity ? 0 : written - Capacity;
+    return m_Samples[(first + p_Index) % Capacity];
+}
+const StepSample &StepTelemetry::GetLatest() const
+{
+    return m_Samples[(GetStepCount() + Capacity - 1) % Capacity];
+}
+
+bool StepTelemetry::ReadSample(const u32 p_Index, StepSample &p_Sample) const
+{
+    const u64 written = GetStepCount();
+    const u64 step = (written < Capacity ? 0 : written - Capacity) + p_Index;
+    const u64 expected = 2 * step + 2;
+    if (loadAcquire(m_Sequences[step % Capacity]) != expected)
+        return false;
+    p_Sample = m_Samples[step % Capacity];
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return loadAcquire(m_Sequences[step % Capacity]) == expected;
+}
+
+StepSample StepTelemetry::GetAverage(const u32 p_Window) const
+{
+    const u32 count = GetSampleCount();
+    const u32 requested = p_Window < count ? p_Window : count;
+
+    StepSample average{};
+    u64 particles = 0;
+    u64 cells = 0;
+    u64 minNeighbors = 0;
+    u64 maxNeighbors = 0;
+    u32 window = 0;
+    for (u32 i = count - requested; i < count; ++i)
+    {
+        StepSample sample;
+        if (!ReadSample(i, sample))
+            continue;
+        ++window;
+        for (u32 j = 0; j < StepPhaseCount; ++j)
+            average.PhaseTimes[j] += sample.PhaseTimes[j];
+        average.StepTime += sample.StepTime;
+        average.Pairs += sample.Pairs;
+        average.CandidatePairs += sample.CandidatePairs;
+        average.ClashPairs += sample.ClashPairs;
+        average.MeanNeighbors += sample.MeanNeighbors;
+        average.WorkImbalance += sample.WorkImbalance;
+        particles += sample.Particles;
+        cells += sample.Cells;
+        minNeighbors += sample.MinNeighbors;
+        maxNeighbors += sample.MaxNeighbors;
+        average.Step = sample.Step;
+    }
+    if (window == 0)
+        return average;
+
+    const f32 factor = 1.f / static_cast<f32>(window);
+    for (u32 j = 0; j < StepPhaseCount; ++j)
+        average.PhaseTimes[j] *= factor;
+    average.StepTime *= factor;
+    average.MeanNeighbors *= factor;
+    average.WorkImbalance *= factor;
+    average.Pairs /= window;
+    average.CandidatePairs /= window;
+    average.ClashPairs /= window;
+    average.Particles = static_cast<u32>(particles / window);
+    average.Cells = static_cast<u32>(cells / window);
+    average.MinNeighbors = static_cast<u32>(minNeighbors / window);
+    average.MaxNeighbors = static_cast<u32>(maxNeighbors / window);
+    return average;
+}
+
+const LookupStatistics &StepTelemetry::GetLookupStatistics() const
+{
+    return m_Lookup;
+}
+
+bool StepTelemetry::Export(const fs::path &p_Path) const
+{
+    if (p_Path.extension() == ".json")
+        return ExportJson(p_Path);
+    return ExportCsv(p_Path);
+}
+
+bool StepTelemetry::ExportCsv(const fs::path &p_Path) const
+{
+    std::ofstream file{p_Path};
+    if (!file)
+        return false;
+
+    file << "step,particles,pairs,candidate_pairs,clash_pairs,cells,min_neighbors,mean_neighbors,max_neighbors,"
+            "work_imbalance,step_ms,particle_steps_per_second";
+    for (u32 j = 0; j < StepPhaseCount; ++j)
+        file << ',' << GetPhaseName(static_cast<StepPhase>(j)) << "_ms";
+    file << '\n';
+
+    const u32 count = GetSampleCount();
+    for (u32 i = 0; i < count; ++i)
+    {
+        StepSample sample;
+        if (!ReadSample(i, sample))
+            continue;
+        file << sample.Step << ',' << sample.Particles << ',' << sample.Pairs << ',' << sample.CandidatePairs << ','
+             << sample.ClashPairs << ',' << sample.Cells << ',' << sample.MinNeighbors << ',' << sample.MeanNeighbors
+             << ',' << sample.MaxNeighbors << ',' << sample.WorkImbalance << ',' << sample.StepTime << ','
+             << sample.GetParticleStepsPerSecond();
+        for (u32 j = 0; j < StepPhaseCount; ++j)
+            file << ',' << sample.PhaseTimes[j];
+        file << '\n';
+    }
+    return static_cast<bool>(file);
+}
+
+bool StepTelemetry::ExportJson(const fs::path &p_Path) const
+{
+    std::ofstream file{p_Path};
+    if (!file)
+        return false;
+
+    const auto writeSample = [&file](const StepSample &p_Sample) {
+        file << "{\"step\": " << p_Sample.Step << ", \"particles\": " << p_Sample.Particles
+             << ", \"pairs\": " << p_Sample.Pairs << ", \"candidate_pairs\": " << p_Sample.CandidatePairs
+             << ", \"clash_pairs\": " << p_Sample.ClashPairs << ", \"cells\": " << p_Sample.Cells
+             << ", \"neighbors\": {\"min\": " << p_Sample.MinNeighbors << ", \"mean\": " << p_Sample.MeanNeighbors
+             << ", \"max\": " << p_Sample.MaxNeighbors << "}, \"work_imbalance\": " << p_Sample.WorkImbalance
+             << ", \"step_ms\": " << p_Sample.StepTime
+             << ", \"particle_steps_per_second\": " << p_Sample.GetParticleStepsPerSecond() << ", \"phases_ms\": {";
+        for (u32 j = 0; j < StepPhaseCount; ++j)
+            file << (j == 0 ? "" : ", ") << '"' << GetPhaseName(static_cast<StepPhase>(j))
+                 << "\": " << p_Sample.PhaseTimes[j];
+        file << "}}";
+    };
+
+    const u32 count = GetSampleCount();
+    file << "{\n  \"steps\": " << GetStepCount() << ",\n  \"summary\": ";
+    writeSample(GetAverage(count));
+    file << ",\n  \"lookup\": {\"occupancy\": [";
+    for (u32 j = 0; j < LookupStatistics::HistogramSize; ++j)
+        file << (j == 0 ? "" : ", ") << m_Lookup.Occupancy[j];
+    file << "], \"max_occupancy\": " << m_Lookup.MaxOccupancy << ", \"clashes\": " << m_Lookup.Clashes
+         << ", \"pair_efficiency\": " << m_Lookup.GetPairEfficiency() << ", \"partitions\": [";
+    for (u32 j = 0; j < m_Lookup.Partitions; ++j)
+        file << (j == 0 ? "" : ", ") << "{\"cells\": " << m_Lookup.Work[j].Cells
+             << ", \"candidates\": " << m_Lookup.Work[j].Candidates << ", \"accepted\": " << m_Lookup.Work[j].Accepted
+             << '}';
+    file << "]},\n  \"samples\": [";
+    bool first = true;
+    for (u32 i = 0; i < count; ++i)
+    {
+        StepSample sample;
+        if (!ReadSample(i, sample))
+            continue;
+        file << (first ? "\n    " : ",\n    ");
+        writeSample(sample);
+        first = false;
+    }
+    file << "\n  ]\n}\n";
+    return static_cast<bool>(file);
+}
+
+} // namespace Driz
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "driz/core/core.hpp"
+#include "tkit/container/array.hpp"
+#include "tkit/profiling/clock.hpp"
+#include <atomic>
+
+namespace Driz
+{
+enum class StepPhase : u32
+{
+    Predict = 0,
+    LookupBuild,
+    Sort,
+    Density,
+    Forces,
+    Merge,
+    Integrate,
+    Count
+};
+
+constexpr u32 StepPhaseCount = static_cast<u32>(StepPhase::Count);
+
+const char *GetPhaseName(StepPhase p_Phase);
+
+struct PartitionWork
+{
+    u64 Candidates = 0;
+    u64 Accepted = 0;
+    u64 ClashPairs = 0;
+    u32 Cells = 0;
+};
+
+// Filled by the lookup while it builds the grid and traverses pairs, and by the solver for the neighbor counts. Pair
+// counts and per partition work are only collected when the lookup collects statistics
+struct LookupStatistics
+{
+    static constexpr u32 HistogramSize = 16;
+
+    TKit::Array<u32, HistogramSize> Occupancy{}; // Cells holding i particles. The last bin also holds fuller cells
+    TKit::Array<PartitionWork, DRIZ_MAX_THREADS> Work{};
+
+    u64 CandidatePairs = 0;
+    u64 AcceptedPairs = 0;
+    u64 ClashPairs = 0; // Candidates only tested because their cell, or one in the stencil, shares a key with another
+
+    u32 Cells = 0;
+    u32 Clashes = 0;
+    u32 MaxOccupancy = 0;
+    u32 Partitions = 0;
+
+    u32 MinNeighbors = 0;
+    u32 MaxNeighbors = 0;
+    f32 MeanNeighbors = 0.f;
+
+    f32 GetPairEfficiency() const;
+    // Ratio between the busiest partition and the average one, in candidate pairs
+    f32 GetWorkImbalance() const;
+};
+
+struct StepSample
+{
+    TKit::Array<f32, StepPhaseCount> PhaseTimes{}; // Milliseconds
+    f32 StepTime = 0.f;                            // Milliseconds
+    u64 Pairs = 0;
+    u64 CandidatePairs = 0;
+    u64 ClashPairs = 0;
+    u64 Step = 0;
+    u32 Particles = 0;
+    u32 Cells = 0;
+
+    u32 MinNeighbors = 0;
+    u32 MaxNeighbors = 0;
+    f32 MeanNeighbors = 0.f;
+    f32 WorkImbalance = 0.f;
+
+    f32 GetParticleStepsPerSecond() const;
+};
+
+// Always-on step instrumentation. The solver is the only writer: it fills the current sample while the step runs and
+// publishes it into a fixed ring buffer when the step ends. Every slot carries a sequence number, odd while the slot is
+// written, so readers on other threads can tell a consistent copy from one the writer wrapped around and overwrote.
+// Neither side ever blocks. Counters are plain integers accessed through std::atomic_ref, which keeps the telemetry
+// (and the solver owning it) movable
+class StepTelemetry
+{
+  public:
+    static constexpr u32 Capacity = 1024;
+
+    class Scope
+    {
+      public:
+        Scope(StepTelemetry &p_Telemetry, const StepPhase p_Phase) : m_Telemetry(p_Telemetry), m_Phase(p_Phase)
+        {
+        }
+        ~Scope()
+        {
+            m_Telemetry.AddPhaseTime(m_Phase, m_Clock.GetElapsed());
+        }
+
+      private:
+        StepTelemetry &m_Telemetry;
+        StepPhase m_Phase;
+        TKit::Clock m_Clock{};
+    };
+
+    void BeginStep();
+    void EndStep(u32 p_Particles, const LookupStatistics &p_Lookup);
+
+    void AddPhaseTime(StepPhase p_Phase, TKit::Timespan p_Time);
+    void AddPhaseTime(StepPhase p_Phase, f32 p_Milliseconds);
+
+    u32 GetSampleCount() const;
+    u64 GetStepCount() const;
+
+    // Samples are indexed from the oldest one still stored. References are only stable on the stepping thread
+    const StepSample &GetSample(u32 p_Index) const;
+    const StepSample &GetLatest() const;
+    // Safe from any thread. Fails if the sample was overwritten while it was being copied
+    bool ReadSample(u32 p_Index, StepSample &p_Sample) const;
+    // Samples overwritten while averaging are left out
+    StepSample GetAverage(u32 p_Window) const;
+
+    // Only the latest lookup statistics are kept in full, samples store a summary of them
+    const LookupStatistics &GetLookupStatistics() const;
+
+    bool Export(const fs::path &p_Path) const;
+    bool ExportCsv(const fs::path &p_Path) const;
+    bool ExportJson(const fs::path &p_Path) const;
+
+    static inline fs::path ExportPath{};
+
+  private:
+    TKit::Array<StepSample, Capacity> m_Samples{};
+    TKit::Array<u64, Capacity> m_Sequences{}; // 2 * step + 2 once the sample of that step is complete
+    u64 m_Written = 0;
+
+    LookupStatistics m_Lookup{};
+    StepSample m_Current{};
+    TKit::Clock m_StepClock{};
+};
+} // namespace Driz